@@ -687,6 +687,20 @@ class TheThingsNetwork
         ttn_prepare_for_power_off();
     }
 
+    /**
+     * @brief Saves the communication state without stopping.
+     * 
+     * The session keys, frame counters and channel state are saved in NVS (non-volatile storage)
+     * so that @ref resumeAfterPowerOff(int) can continue the session after an unexpected reset.
+     * Nothing is saved while a join or transmission is in progress.
+     *
+     * @return `true` if the state was saved, `false` otherwise.
+     */
+    bool saveSession()
+    {
+        return ttn_save_session();
+    }
+
     /**
      * @brief Waits until the TTN device is idle.
      * 
@@ -416,6 +416,158 @@ extern "C"
         uint32_t frequency;
     } ttn_rf_settings_t;
 
+    /**
+     * @brief Radio statistics of the last completed uplink
+     */
+    typedef struct
+    {
+        /**
+         * @brief Airtime of the uplink frame, in ms
+         */
+        uint32_t airtime_ms;
+        /**
+         * @brief Data rate the uplink was sent with (region specific, see @ref ttn_data_rate_t)
+         */
+        int data_rate;
+        /**
+         * @brief Transmit power, in dBm
+         */
+        int tx_power;
+        /**
+         * @brief `true` if a downlink was received in RX1 or RX2
+         */
+        bool downlink;
+        /**
+         * @brief RSSI of that downlink, in dBm
+         */
+        int rssi;
+        /**
+         * @brief SNR of that downlink, in dB
+         */
+        int snr;
+        /**
+         * @brief Number of gateways that received the uplink, from a LinkCheckAns (0 if none was received)
+         */
+        int link_check_gateways;
+        /**
+         * @brief Demodulation margin of the uplink at the best gateway, in dB, from a LinkCheckAns
+         */
+        int link_check_margin;
+    } ttn_uplink_stats_t;
+
+    /**
+     * @brief Radio SPI statistics since startup
+     */
+    typedef struct
+    {
+        /**
+         * @brief SPI transactions with the radio chip
+         */
+        uint32_t transactions;
+        /**
+         * @brief Register writes skipped because the register already had the value
+         */
+        uint32_t writes_skipped;
+        /**
+         * @brief Register writes combined into a burst with the preceding register
+         */
+        uint32_t writes_coalesced;
+        /**
+         * @brief Register reads answered from the register shadow
+         */
+        uint32_t reads_skipped;
+        /**
+         * @brief Number of transmissions set up
+         */
+        uint32_t tx_setups;
+        /**
+         * @brief Time to set up the last transmission, from the first radio access to the payload written, in µs
+         */
+        uint32_t tx_setup_us;
+        /**
+         * @brief SPI transactions needed to set up the last transmission
+         */
+        uint32_t tx_setup_transactions;
+    } ttn_spi_stats_t;
+
+/**
+ * @brief Number of buckets of a timing histogram
+ */
+#define TTN_HISTOGRAM_BUCKETS 8
+
+    /**
+     * @brief Histogram of timing errors, in µs
+     *
+     * The buckets hold the values < 0, < 50, < 100, < 200, < 500, < 1000, < 2000 and >= 2000 µs.
+     */
+    typedef struct
+    {
+        /**
+         * @brief Number of values per bucket
+         */
+        uint32_t counts[TTN_HISTOGRAM_BUCKETS];
+        /**
+         * @brief Total number of values
+         */
+        uint32_t count;
+        /**
+         * @brief Smallest value, in µs
+         */
+        int32_t min_us;
+        /**
+         * @brief Largest value, in µs
+         */
+        int32_t max_us;
+    } ttn_histogram_t;
+
+    /**
+     * @brief Timing statistics of the LoRaWAN stack since startup
+     */
+    typedef struct
+    {
+        /**
+         * @brief Delay from the scheduled time of an LMIC job to its start (negative if started early)
+         */
+        ttn_histogram_t job_latency;
+        /**
+         * @brief Delay from the radio's DIO interrupt to the start of its processing
+         */
+        ttn_histogram_t dio_latency;
+        /**
+         * @brief Time the receiver was switched on relative to the scheduled start of the RX window
+         * (negative if early)
+         */
+        ttn_histogram_t rx_open_error;
+    } ttn_timing_stats_t;
+
+    /**
+     * @brief Statistics of the saved session state since startup
+     */
+    typedef struct
+    {
+        /**
+         * @brief Number of times the frame counters were saved in RTC memory
+         */
+        uint32_t rtc_saves;
+        /**
+         * @brief Number of times the complete session was written to NVS
+         */
+        uint32_t nvs_writes;
+        /**
+         * @brief Duration of the last NVS write, in µs
+         */
+        uint32_t last_nvs_save_us;
+        /**
+         * @brief Duration of the slowest NVS write, in µs
+         */
+        uint32_t max_nvs_save_us;
+        /**
+         * @brief `true` if the frame counters of the resumed session came from RTC memory,
+         * `false` if they were advanced by the safety gap
+         */
+        bool counters_from_rtc;
+    } ttn_session_stats_t;
+
     /**
      * @brief Callback for recieved messages
      *
@@ -425,6 +577,49 @@ extern "C"
      */
     typedef void (*ttn_message_cb)(const uint8_t *payload, size_t length, ttn_port_t port);
 
+    /**
+     * @brief Received message, held in a buffer of the downlink pool
+     *
+     * The buffer stays valid until it is released, see @ref ttn_on_downlink().
+     */
+    typedef struct
+    {
+        /**
+         * @brief Received bytes
+         */
+        const uint8_t *payload;
+        /**
+         * @brief Number of received bytes
+         */
+        uint8_t length;
+        /**
+         * @brief Port the message was received on
+         */
+        ttn_port_t port;
+        /**
+         * @brief Downlink frame counter (FCntDown) of the message
+         */
+        uint32_t frame_counter;
+    } ttn_downlink_t;
+
+    /**
+     * @brief Callback for received messages, with buffer ownership
+     *
+     * @param downlink  received message, valid until the callback returns unless retained
+     */
+    typedef void (*ttn_downlink_cb)(ttn_downlink_t *downlink);
+
+    /**
+     * @brief Callback for completed transmissions of queued messages
+     *
+     * Called from the TTN background task. It must return quickly and must not call
+     * @ref ttn_transmit_message().
+     *
+     * @param result     @ref TTN_SUCCESSFUL_TRANSMISSION or @ref TTN_ERROR_TRANSMISSION_FAILED
+     * @param user_data  value passed to @ref ttn_queue_message()
+     */
+    typedef void (*ttn_transmit_cb)(ttn_response_code_t result, void *user_data);
+
     /**
      * @brief Initializes The Things Network device instance.
      *
@@ -574,6 +769,20 @@ extern "C"
      */
     bool ttn_join_with_keys(const char *dev_eui, const char *app_eui, const char *app_key);
 
+    /**
+     * @brief Drops the current session and activates the device again via OTAA.
+     *
+     * Use it when the network no longer answers the session (e.g. it has been deleted or has expired).
+     * @ref ttn_join() and @ref ttn_join_with_keys() cannot replace a session that has already been
+     * established or resumed. Queued messages and the message in flight fail with
+     * `TTN_ERROR_TRANSMISSION_FAILED`. The keys from the last join or provisioning call are used.
+     *
+     * The function blocks until the activation has completed or failed.
+     *
+     * @return `true` if the activation was succesful, `false` if the activation failed
+     */
+    bool ttn_rejoin(void);
+
     /**
      * @brief Resumes TTN communication after deep sleep.
      * 
@@ -646,6 +855,25 @@ extern "C"
      */
     void ttn_prepare_for_power_off(void);
 
+    /**
+     * @brief Saves the communication state without stopping.
+     * 
+     * The frame counters are saved in RTC memory on every call. The session keys, frame counters
+     * and channel state are saved in NVS (non-volatile storage) after a join and then every
+     * `CONFIG_TTN_NVS_CHECKPOINT_INTERVAL` uplinks, so that @ref ttn_resume_after_power_off(int)
+     * can continue the session after an unexpected reset. If the RTC memory was lost, the uplink
+     * frame counter is advanced past any value possibly used since the last checkpoint.
+     * Communication continues normally.
+     * 
+     * Nothing is saved while a join or transmission is in progress; call this function after
+     * every uplink, once @ref ttn_transmit_message() has returned.
+     * 
+     * Before this function is called, `nvs_flash_init()` must have been called once.
+     *
+     * @return `true` if the state was saved, `false` if the device is busy, not joined or NVS failed.
+     */
+    bool ttn_save_session(void);
+
     /**
      * @brief Waits until the TTN device is idle.
      * 
@@ -699,6 +927,37 @@ extern "C"
      */
     ttn_response_code_t ttn_transmit_message(const uint8_t *payload, size_t length, ttn_port_t port, bool confirm);
 
+    /**
+     * @brief Queues a message for transmission without waiting
+     *
+     * The payload is copied into a queue of `CONFIG_TTN_TX_QUEUE_LEN` entries. Whenever the
+     * TTN device becomes idle, the queued message with the highest priority (the oldest one
+     * for equal priorities) is handed to LMIC, which still enforces the duty cycle.
+     * The callback reports the outcome of each message.
+     *
+     * If the queue is full, the newest message with the lowest priority is dropped (and its callback
+     * reports a failure) to make room, provided its priority is lower than the new message's.
+     *
+     * Messages received in the receive windows of queued messages are passed to the callbacks
+     * registered with @ref ttn_on_message() and @ref ttn_on_downlink().
+     *
+     * @param payload    bytes to be transmitted
+     * @param length     number of bytes to be transmitted
+     * @param port       port (use 1 as default)
+     * @param confirm    flag indicating if a confirmation should be requested
+     * @param priority   higher values are transmitted first
+     * @param callback   function called when the transmission has completed or failed (or `NULL`)
+     * @param user_data  value passed to the callback
+     * @return `true` if the message was queued, `false` if the queue is full or the message is too long
+     */
+    bool ttn_queue_message(const uint8_t *payload, size_t length, ttn_port_t port, bool confirm, uint8_t priority,
+                           ttn_transmit_cb callback, void *user_data);
+
+    /**
+     * @brief Returns the number of queued messages, including the one being transmitted
+     */
+    int ttn_queued_message_count(void);
+
     /**
      * @brief Sets the function to be called when a message is received
      *
@@ -707,14 +966,47 @@ extern "C"
      * parameters. The values are only valid during the duration of the
      * callback. So they must be immediately processed or copied.
      *
-     * Messages are received as a result of @ref ttn_transmit_message(). The callback is called
-     * in the task that called this function and it occurs before this function
-     * returns control to the caller.
+     * Messages are received in the receive windows of any transmission. The callback is called
+     * from the TTN receive task, usually before @ref ttn_transmit_message() returns.
      *
      * @param callback  the callback function
      */
     void ttn_on_message(ttn_message_cb callback);
 
+    /**
+     * @brief Sets the function to be called with the buffer of a received message
+     *
+     * Received messages are copied once from LMIC into one of `CONFIG_TTN_RX_BUFFER_COUNT` pool
+     * buffers and passed to the callback from the TTN receive task (after the callback of
+     * @ref ttn_on_message(), if any), whether or not a task waits in @ref ttn_transmit_message().
+     *
+     * To keep the message after returning, e.g. to process it in another task without copying it,
+     * the callback calls @ref ttn_downlink_retain() and later @ref ttn_downlink_release().
+     * While all buffers are held, further messages are dropped.
+     *
+     * @param callback  the callback function
+     */
+    void ttn_on_downlink(ttn_downlink_cb callback);
+
+    /**
+     * @brief Keeps a received message's buffer beyond the return of the downlink callback
+     *
+     * @param downlink  message passed to the downlink callback
+     */
+    void ttn_downlink_retain(ttn_downlink_t *downlink);
+
+    /**
+     * @brief Returns a retained message's buffer to the pool
+     *
+     * @param downlink  message previously passed to @ref ttn_downlink_retain()
+     */
+    void ttn_downlink_release(ttn_downlink_t *downlink);
+
+    /**
+     * @brief Returns the number of received messages dropped because no downlink buffer was free
+     */
+    uint32_t ttn_downlinks_dropped(void);
+
     /**
      * @brief Checks if DevEUI, AppEUI/JoinEUI and AppKey have been stored in non-volatile storage
      * or have been provided by a call to @ref ttn_join_with_keys() or to @ref ttn_provision_transiently().
@@ -802,6 +1094,137 @@ extern "C"
      */
     ttn_rf_settings_t ttn_rx2_settings(void);
 
+    /**
+     * @brief Requests a link check with the next uplink.
+     * 
+     * A LinkCheckReq MAC command is added to the next uplink. If the network answers in one of the
+     * receive windows, the gateway count and margin are reported by @ref ttn_last_uplink_stats().
+     * Every answer is a downlink, so use sparingly.
+     */
+    void ttn_request_link_check(void);
+
+    /**
+     * @brief Calculates the airtime of an uplink at the current data rate.
+     *
+     * Includes the LoRaWAN frame overhead and any MAC commands waiting to go out with the next uplink.
+     *
+     * @param length length of the application payload, in bytes
+     * @return airtime, in milliseconds
+     */
+    uint32_t ttn_uplink_airtime_ms(size_t length);
+
+    /**
+     * @brief Gets the time until the duty cycle limits allow the next uplink at the current data rate.
+     *
+     * Considers the sub-band availability of all enabled channels and the global duty cycle.
+     * A message sent earlier is held back by the stack until then.
+     *
+     * @return delay, in milliseconds (0 if an uplink can start now)
+     */
+    uint32_t ttn_next_tx_delay_ms(void);
+
+    /**
+     * @brief Gets the radio statistics of the last completed uplink.
+     *
+     * @return airtime, data rate, power and downlink/link check reception of the last uplink
+     */
+    ttn_uplink_stats_t ttn_last_uplink_stats(void);
+
+    /**
+     * @brief Gets the SPI statistics of the radio chip.
+     *
+     * Shows the effect of the register shadow (see the "Shadow radio registers" option).
+     *
+     * @return transaction and register access counters, and the cost of the last transmission setup
+     */
+    ttn_spi_stats_t ttn_spi_stats(void);
+
+    /**
+     * @brief Gets the timing statistics of job scheduling, radio interrupts and RX windows.
+     *
+     * A receive window opened late misses downlinks. Use these statistics to tune the clock error
+     * allowance of the receive windows and the task priorities.
+     *
+     * @return histograms since startup
+     */
+    ttn_timing_stats_t ttn_timing_stats(void);
+
+    /**
+     * @brief Gets the statistics of the saved session state.
+     *
+     * @return number and duration of the RTC and NVS saves
+     */
+    ttn_session_stats_t ttn_session_stats(void);
+
+    /**
+     * @brief Gets the size of the LMIC event trace.
+     *
+     * The trace is only recorded if the "LMIC event log" option is set to "Binary trace".
+     *
+     * @return number of bytes needed to export the complete trace (with the flash ring, an upper bound),
+     *   0 if the trace is disabled
+     */
+    size_t ttn_trace_size(void);
+
+    /**
+     * @brief Exports the LMIC event trace.
+     *
+     * The trace is copied oldest event first. If the buffer is too small, the newest events are
+     * left out. The trace is not cleared; pass the export to ttn_trace_discard() once it has been
+     * stored elsewhere. All values are little-endian.
+     *
+     * Records are numbered consecutively. With the "Keep the trace in flash" option, the numbering
+     * continues across resets. An export holds consecutive records only; if records have been lost
+     * in between (the trace overflowed while it could not be written to flash), it stops before the
+     * gap and the next export after ttn_trace_discard() starts after it.
+     *
+     * Header (12 bytes):
+     * - 0: magic "LMTR"
+     * - 4: format version (2)
+     * - 5: microseconds per LMIC tick
+     * - 6: number of records (uint16)
+     * - 8: sequence number of the first record (uint32)
+     *
+     * Record (36 bytes plus message text):
+     * - 0: record length in bytes, including this byte
+     * - 1: LMIC event (`ev_t`), or 0xff for a message, 0xfe for a message with datum, 0xfd for a fatal error
+     * - 2: LMIC time in ticks (uint32)
+     * - 6: end of last transmission in ticks (uint32)
+     * - 10: global duty cycle availability in ticks (uint32)
+     * - 14: frequency in Hz (uint32)
+     * - 18: datum of message, or line number for fatal errors (uint32)
+     * - 22: radio op mode (uint16)
+     * - 24: uplink frame counter (uint16)
+     * - 26: downlink frame counter (uint16)
+     * - 28: RX symbol timeout (uint16)
+     * - 30: radio parameters `rps_t` (uint16)
+     * - 32: TX channel
+     * - 33: data rate
+     * - 34: TX/RX flags
+     * - 35: saved IRQ flags
+     * - 36: message text, up to 24 characters, not null terminated (messages and fatal errors only)
+     *
+     * @param buffer buffer receiving the trace
+     * @param length length of the buffer (in bytes)
+     * @return number of bytes written, 0 if the trace is disabled or the buffer is too small
+     */
+    size_t ttn_trace_export(uint8_t *buffer, size_t length);
+
+    /**
+     * @brief Removes the records of an earlier export from the LMIC event trace, e.g. after it has been uploaded.
+     *
+     * Records recorded since the export are kept. With the flash ring, the discarded records of the
+     * flash sector being written may come back after a reset; their sequence numbers tell them apart.
+     *
+     * @param trace trace returned by ttn_trace_export() (at least the header)
+     */
+    void ttn_trace_discard(const uint8_t *trace);
+
+    /**
+     * @brief Clears the LMIC event trace.
+     */
+    void ttn_trace_clear(void);
+
     /**
      * @brief Gets the received signal strength indicator (RSSI).
      *
@@ -10,18 +10,53 @@
  * AES encryption using ESP32's hardware AES unit.
  *******************************************************************************/
 
+#include <stdbool.h>
 #include "mbedtls/aes.h"
 #include "../lmic/oslmic.h"
 
 #if defined(USE_MBEDTLS_AES)
 
-void lmic_aes_encrypt(u1_t *data, u1_t *key)
+// LMIC alternates between the network and the application session key
+// (and the app key while joining), so a couple of contexts covers it
+#define AES_CONTEXT_CACHE_SIZE 2
+
+typedef struct
 {
+    u1_t key[16];
+    bool has_key;
+    bool initialized;
     mbedtls_aes_context ctx;
-    mbedtls_aes_init(&ctx);
-    mbedtls_aes_setkey_enc(&ctx, key, 128);
-    mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT, data, data);
-    mbedtls_aes_free(&ctx);
+} aes_cached_context_t;
+
+static aes_cached_context_t contexts[AES_CONTEXT_CACHE_SIZE];
+static u1_t next_slot;
+
+static mbedtls_aes_context *context_for_key(const u1_t *key)
+{
+    for (int i = 0; i < AES_CONTEXT_CACHE_SIZE; i++)
+    {
+        if (contexts[i].has_key && memcmp(contexts[i].key, key, 16) == 0)
+            return &contexts[i].ctx;
+    }
+
+    // Key schedule not cached: replace the oldest entry
+    aes_cached_context_t *entry = &contexts[next_slot];
+    next_slot = (next_slot + 1) % AES_CONTEXT_CACHE_SIZE;
+
+    if (!entry->initialized)
+    {
+        mbedtls_aes_init(&entry->ctx);
+        entry->initialized = true;
+    }
+    mbedtls_aes_setkey_enc(&entry->ctx, key, 128);
+    memcpy(entry->key, key, 16);
+    entry->has_key = true;
+    return &entry->ctx;
+}
+
+void lmic_aes_encrypt(u1_t *data, u1_t *key)
+{
+    mbedtls_aes_crypt_ecb(context_for_key(key), MBEDTLS_AES_ENCRYPT, data, data);
 }
 
 
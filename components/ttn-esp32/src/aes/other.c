@@ -50,6 +50,49 @@ static void shift_left(xref2u1_t buf, u1_t len) {
     }
 }
 
+// CMAC subkeys only depend on the key, and LMIC uses the same network
+// session key for every MIC, so keep them for the last few keys instead of
+// spending an extra block encryption per frame.
+#define CMAC_SUBKEY_CACHE_SIZE 2
+
+struct cmac_subkeys {
+    u1_t key[16];
+    u1_t k1[16];
+    u1_t k2[16];
+    u1_t valid;
+};
+
+static struct cmac_subkeys cmacSubkeys[CMAC_SUBKEY_CACHE_SIZE];
+static u1_t cmacNextSlot;
+
+// Derive the next RFC4493 subkey from the previous one (or from the
+// encrypted all-zeroes block for K1)
+static void cmac_next_subkey(xref2u1_t k) {
+    u1_t msb = k[0] & 0x80;
+    shift_left(k, 16);
+    if (msb)
+        k[15] ^= 0x87;
+}
+
+static const struct cmac_subkeys *cmac_get_subkeys(void) {
+    for (u1_t i = 0; i < CMAC_SUBKEY_CACHE_SIZE; ++i) {
+        if (cmacSubkeys[i].valid && memcmp(cmacSubkeys[i].key, AESkey, 16) == 0)
+            return &cmacSubkeys[i];
+    }
+
+    struct cmac_subkeys *entry = &cmacSubkeys[cmacNextSlot];
+    cmacNextSlot = (cmacNextSlot + 1) % CMAC_SUBKEY_CACHE_SIZE;
+
+    memcpy(entry->key, AESkey, 16);
+    memset(entry->k1, 0, sizeof(entry->k1));
+    lmic_aes_encrypt(entry->k1, AESkey);
+    cmac_next_subkey(entry->k1);
+    memcpy(entry->k2, entry->k1, sizeof(entry->k2));
+    cmac_next_subkey(entry->k2);
+    entry->valid = 1;
+    return entry;
+}
+
 // Apply RFC4493 CMAC, using AESKEY as the key. If prepend_aux is true,
 // AESAUX is prepended to the message. AESAUX is used as working memory
 // in any case. The CMAC result is returned in AESAUX as well.
@@ -74,29 +117,10 @@ static void os_aes_cmac(xref2u1_t buf, u2_t len, u1_t prepend_aux) {
         }
 
         if (len == 0) {
-            // Final block, xor with K1 or K2. K1 and K2 are calculated
-            // by encrypting the all-zeroes block and then applying some
-            // shifts and xor on that.
-            u1_t final_key[16];
-            memset(final_key, 0, sizeof(final_key));
-            lmic_aes_encrypt(final_key, AESkey);
-
-            // Calculate K1
-            u1_t msb = final_key[0] & 0x80;
-            shift_left(final_key, sizeof(final_key));
-            if (msb)
-                final_key[sizeof(final_key)-1] ^= 0x87;
-
-            // If the final block was not complete, calculate K2 from K1
-            if (need_padding) {
-                msb = final_key[0] & 0x80;
-                shift_left(final_key, sizeof(final_key));
-                if (msb)
-                    final_key[sizeof(final_key)-1] ^= 0x87;
-            }
-
-            // Xor with K1 or K2
-            for (u1_t i = 0; i < sizeof(final_key); ++i)
+            // Final block, xor with K1, or K2 if the block was padded
+            const struct cmac_subkeys *subkeys = cmac_get_subkeys();
+            const u1_t *final_key = need_padding ? subkeys->k2 : subkeys->k1;
+            for (u1_t i = 0; i < 16; ++i)
                 AESaux[i] ^= final_key[i];
         }
 
@@ -56,8 +56,11 @@
 #define US_PER_OSTICK 16
 #define OSTICKS_PER_SEC (1000000 / US_PER_OSTICK)
 
-//#define USE_ORIGINAL_AES
+#if defined(CONFIG_TTN_AES_ORIGINAL)
+#define USE_ORIGINAL_AES
+#else
 #define USE_MBEDTLS_AES
+#endif
 
 #if LMIC_DEBUG_LEVEL > 0 || LMIC_X_DEBUG_LEVEL > 0
 #include <stdio.h>
@@ -65,6 +68,15 @@
 
 #define LMIC_ENABLE_onEvent 0
 
+#if defined(CONFIG_TTN_LMIC_PROFILE_CLASS_A)
+#define LMIC_ENABLE_DeviceTimeReq 0
+#define LMIC_MAX_FRAME_LENGTH CONFIG_TTN_MAX_FRAME_LENGTH
+#endif
+
+#if defined(CONFIG_TTN_EVENT_LOG_CONSOLE) || defined(CONFIG_TTN_EVENT_LOG_TRACE)
+#define LMIC_ENABLE_event_logging 1
+#endif
+
 #define DISABLE_PING
 
 #define DISABLE_BEACONS
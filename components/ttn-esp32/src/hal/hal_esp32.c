@@ -34,6 +34,16 @@
 
 #define TAG "ttn_hal"
 
+// SX127x register addresses used by the register shadow
+#define REG_FIFO 0x00
+#define REG_OP_MODE 0x01
+#define OP_MODE_BANK_MASK 0xc0 // LongRangeMode and AccessSharedReg select the register bank
+#define OP_MODE_BANK_LORA 0x80
+#define OP_MODE_BANK_UNKNOWN 0xff
+#define MAX_BURST_LEN 16
+#define OP_MODE_MASK 0x07
+#define OP_MODE_RX_SINGLE 0x06
+
 
 typedef enum {
     WAIT_KIND_NONE = 0,
@@ -53,6 +63,12 @@ static void init_spi(void);
 static void assert_nss(spi_transaction_t* trans);
 static void deassert_nss(spi_transaction_t* trans);
 static void init_timer(void);
+static void spi_transact(u1_t cmd, const u1_t *tx_buf, u1_t *rx_buf, size_t len);
+static bool shadow_cacheable(u1_t addr);
+static void shadow_invalidate(void);
+static void shadow_set_bank(u1_t op_mode);
+static void flush_burst(void);
+static void histogram_add(hal_esp32_histogram_t *histogram, int32_t value_us);
 
 static void set_next_alarm(int64_t time);
 static void arm_timer(int64_t esp_now);
@@ -69,10 +85,22 @@ static int8_t rssi_cal = 10;
 
 static TaskHandle_t lmic_task;
 static uint32_t dio_interrupt_time;
+static int64_t dio_interrupt_esp_time;
+static int64_t rx_open_target;
+static hal_esp32_timing_stats_t timing_stats;
 static uint8_t dio_num;
 
 static spi_device_handle_t spi_handle;
 static spi_transaction_t spi_transaction;
+static hal_esp32_spi_stats_t spi_stats;
+static int64_t tx_setup_start;
+static uint32_t tx_setup_start_transactions;
+static u1_t reg_shadow[128];
+static uint32_t reg_shadow_valid[128 / 32];
+static u1_t reg_bank = OP_MODE_BANK_UNKNOWN;
+static u1_t burst_addr;
+static u1_t burst_len;
+static u1_t burst_buf[MAX_BURST_LEN];
 static SemaphoreHandle_t mutex;
 static esp_timer_handle_t timer;
 static int64_t time_offset;
@@ -103,6 +131,7 @@ void hal_esp32_configure_pins(spi_host_device_t host, uint8_t nss, uint8_t rxtx,
 void IRAM_ATTR qio_irq_handler(void *arg)
 {
     dio_interrupt_time = hal_ticks();
+    dio_interrupt_esp_time = get_current_time();
     dio_num = (u1_t)(long)arg;
     BaseType_t higher_prio_task_woken = pdFALSE;
     xTaskNotifyFromISR(lmic_task, NOTIFY_BIT_DIO, eSetBits, &higher_prio_task_woken);
@@ -167,6 +196,10 @@ void hal_pin_rst(u1_t val)
     if (pin_rst == LMIC_UNUSED_PIN)
         return;
 
+    // a reset restores the register defaults
+    burst_len = 0;
+    shadow_invalidate();
+
     if (val == 0 || val == 1)
     {
         // drive pin
@@ -231,27 +264,181 @@ void init_spi(void)
     ESP_LOGI(TAG, "SPI initialized");
 }
 
-void hal_spi_write(u1_t cmd, const u1_t *buf, size_t len)
+void spi_transact(u1_t cmd, const u1_t *tx_buf, u1_t *rx_buf, size_t len)
 {
+    if (tx_setup_start == 0)
+    {
+        tx_setup_start = esp_timer_get_time();
+        tx_setup_start_transactions = spi_stats.transactions;
+    }
+
     memset(&spi_transaction, 0, sizeof(spi_transaction));
     spi_transaction.addr = cmd;
     spi_transaction.length = 8 * len;
-    spi_transaction.tx_buffer = buf;
+    spi_transaction.tx_buffer = tx_buf;
+    if (rx_buf != NULL)
+    {
+        spi_transaction.rxlength = 8 * len;
+        spi_transaction.rx_buffer = rx_buf;
+    }
     esp_err_t err = spi_device_transmit(spi_handle, &spi_transaction);
     ESP_ERROR_CHECK(err);
+    spi_stats.transactions++;
+}
+
+void hal_spi_write(u1_t cmd, const u1_t *buf, size_t len)
+{
+    u1_t addr = cmd & 0x7f;
+
+#if defined(CONFIG_TTN_SPI_REGISTER_CACHE)
+    if (len == 1 && shadow_cacheable(addr))
+    {
+        uint32_t bit = 1UL << (addr % 32);
+        if ((reg_shadow_valid[addr / 32] & bit) != 0 && reg_shadow[addr] == buf[0])
+        {
+            spi_stats.writes_skipped++;
+            return;
+        }
+        reg_shadow[addr] = buf[0];
+        reg_shadow_valid[addr / 32] |= bit;
+
+        // defer the write so that writes to consecutive registers go out as one burst
+        if (burst_len > 0 && burst_addr + burst_len == addr && burst_len < MAX_BURST_LEN)
+        {
+            burst_buf[burst_len++] = buf[0];
+            spi_stats.writes_coalesced++;
+            return;
+        }
+        flush_burst();
+        burst_addr = addr;
+        burst_buf[0] = buf[0];
+        burst_len = 1;
+        return;
+    }
+#endif
+
+    flush_burst();
+    spi_transact(cmd, buf, NULL, len);
+
+    if (addr == REG_OP_MODE && len == 1)
+    {
+        // LMIC waits for the RX window with hal_waitUntil(), then switches to single RX
+        if ((buf[0] & OP_MODE_MASK) == OP_MODE_RX_SINGLE && rx_open_target != 0)
+            histogram_add(&timing_stats.rx_open_error, get_current_time() - rx_open_target);
+        rx_open_target = 0;
+        shadow_set_bank(buf[0]);
+    }
+    else if (addr == REG_FIFO && len > 1)
+    {
+        // the payload is the last step before the transmission is started
+        spi_stats.tx_setups++;
+        spi_stats.tx_setup_us = esp_timer_get_time() - tx_setup_start;
+        spi_stats.tx_setup_transactions = spi_stats.transactions - tx_setup_start_transactions;
+    }
 }
 
 void hal_spi_read(u1_t cmd, u1_t *buf, size_t len)
 {
+    u1_t addr = cmd & 0x7f;
+
+#if defined(CONFIG_TTN_SPI_REGISTER_CACHE)
+    if (len == 1 && shadow_cacheable(addr) && (reg_shadow_valid[addr / 32] & (1UL << (addr % 32))) != 0)
+    {
+        buf[0] = reg_shadow[addr];
+        spi_stats.reads_skipped++;
+        return;
+    }
+#endif
+
+    flush_burst();
+
     memset(buf, 0, len);
-    memset(&spi_transaction, 0, sizeof(spi_transaction));
-    spi_transaction.addr = cmd;
-    spi_transaction.length = 8 * len;
-    spi_transaction.rxlength = 8 * len;
-    spi_transaction.tx_buffer = buf;
-    spi_transaction.rx_buffer = buf;
-    esp_err_t err = spi_device_transmit(spi_handle, &spi_transaction);
-    ESP_ERROR_CHECK(err);
+    spi_transact(cmd, buf, buf, len);
+
+    if (len == 1 && addr == REG_OP_MODE)
+    {
+        shadow_set_bank(buf[0]);
+    }
+    else if (len == 1 && shadow_cacheable(addr))
+    {
+        reg_shadow[addr] = buf[0];
+        reg_shadow_valid[addr / 32] |= 1UL << (addr % 32);
+    }
+}
+
+// Write the deferred burst of register writes (if any)
+void flush_burst(void)
+{
+    if (burst_len == 0)
+        return;
+
+    u1_t len = burst_len;
+    burst_len = 0;
+    spi_transact(burst_addr | 0x80, burst_buf, NULL, len);
+}
+
+// Registers that only change when written. Status, IRQ, FIFO and
+// mode registers are always accessed. Only the LoRa register bank is shadowed.
+bool shadow_cacheable(u1_t addr)
+{
+    if (reg_bank != OP_MODE_BANK_LORA)
+        return false;
+
+    switch (addr)
+    {
+    case 0x06: // RegFrfMsb
+    case 0x07: // RegFrfMid
+    case 0x08: // RegFrfLsb
+    case 0x09: // RegPaConfig
+    case 0x0a: // RegPaRamp
+    case 0x0b: // RegOcp
+    case 0x0e: // RegFifoTxBaseAddr
+    case 0x0f: // RegFifoRxBaseAddr
+    case 0x11: // RegIrqFlagsMask
+    case 0x1d: // RegModemConfig1
+    case 0x1e: // RegModemConfig2
+    case 0x1f: // RegSymbTimeoutLsb
+    case 0x20: // RegPreambleMsb
+    case 0x21: // RegPreambleLsb
+    case 0x22: // RegPayloadLength
+    case 0x23: // RegPayloadMaxLength
+    case 0x26: // RegModemConfig3
+    case 0x31: // RegDetectOptimize
+    case 0x33: // RegInvertIQ
+    case 0x36: // RegHighBwOptimize1
+    case 0x37: // RegDetectionThreshold
+    case 0x39: // RegSyncWord
+    case 0x3a: // RegHighBwOptimize2
+    case 0x3b: // RegInvertIQ2
+    case 0x40: // RegDioMapping1
+    case 0x41: // RegDioMapping2
+    case 0x4d: // RegPaDac
+        return true;
+    default:
+        return false;
+    }
+}
+
+void shadow_invalidate(void)
+{
+    memset(reg_shadow_valid, 0, sizeof(reg_shadow_valid));
+    reg_bank = OP_MODE_BANK_UNKNOWN;
+}
+
+// The same addresses map to different registers in the FSK and LoRa banks
+void shadow_set_bank(u1_t op_mode)
+{
+    u1_t bank = op_mode & OP_MODE_BANK_MASK;
+    if (bank != reg_bank)
+    {
+        memset(reg_shadow_valid, 0, sizeof(reg_shadow_valid));
+        reg_bank = bank;
+    }
+}
+
+hal_esp32_spi_stats_t hal_esp32_get_spi_stats(void)
+{
+    return spi_stats;
 }
 
 
@@ -377,6 +564,10 @@ void timer_callback(void *arg)
 bool wait(wait_kind_e wait_kind)
 {
     TickType_t ticks_to_wait = wait_kind == WAIT_KIND_CHECK_IO ? 0 : portMAX_DELAY;
+
+    // nothing may be left in the register burst buffer while LMIC isn't running
+    flush_burst();
+
     while (true)
     {
         current_wait_kind = wait_kind;
@@ -407,6 +598,7 @@ bool wait(wait_kind_e wait_kind)
         {
             if (wait_kind != WAIT_KIND_WAIT_FOR_TIMER)
                 disarm_timer();
+            histogram_add(&timing_stats.dio_latency, get_current_time() - dio_interrupt_esp_time);
             hal_esp32_enter_critical_section();
             radio_irq_handler_v2(dio_num, dio_interrupt_time);
             hal_esp32_leave_critical_section();
@@ -452,6 +644,7 @@ u4_t hal_waitUntil(u4_t time)
 {
     int64_t esp_now = get_current_time();
     int64_t esp_time = os_time_to_esp_time(esp_now, time);
+    rx_open_target = esp_time;
     set_next_alarm(esp_time);
     arm_timer(esp_now);
     wait(WAIT_KIND_WAIT_FOR_TIMER);
@@ -478,7 +671,10 @@ u1_t hal_checkTimer(uint32_t time)
     int64_t esp_time = os_time_to_esp_time(esp_now, time);
     int64_t diff = esp_time - esp_now;
     if (diff < 100)
+    {
+        histogram_add(&timing_stats.job_latency, -diff);
         return 1; // timer has expired or will expire very soon
+    }
 
     set_next_alarm(esp_time);
     return 0;
@@ -496,6 +692,33 @@ void hal_sleep(void)
 }
 
 
+
+// -----------------------------------------------------------------------------
+// TIMING STATISTICS
+
+// upper bounds of the histogram buckets (in µs); the last bucket is open-ended
+static const int32_t histogram_limits_us[HAL_ESP32_HISTOGRAM_BUCKETS - 1] = { 0, 50, 100, 200, 500, 1000, 2000 };
+
+void histogram_add(hal_esp32_histogram_t *histogram, int32_t value_us)
+{
+    int bucket = 0;
+    while (bucket < HAL_ESP32_HISTOGRAM_BUCKETS - 1 && value_us >= histogram_limits_us[bucket])
+        bucket++;
+    histogram->counts[bucket]++;
+
+    if (histogram->count == 0 || value_us < histogram->min_us)
+        histogram->min_us = value_us;
+    if (histogram->count == 0 || value_us > histogram->max_us)
+        histogram->max_us = value_us;
+    histogram->count++;
+}
+
+hal_esp32_timing_stats_t hal_esp32_get_timing_stats(void)
+{
+    return timing_stats;
+}
+
+
 // -----------------------------------------------------------------------------
 // IRQ
 
@@ -541,7 +764,11 @@ void hal_esp32_leave_critical_section(void)
 void lmic_background_task(void* pvParameter)
 {
     while (run_background_task)
+    {
+        // each job's first radio access starts a new TX setup measurement
+        tx_setup_start = 0;
         os_runloop_once();
+    }
     vTaskDelete(NULL);
 }
 
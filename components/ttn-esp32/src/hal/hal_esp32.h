@@ -35,6 +35,49 @@ void hal_esp32_set_rssi_cal(int8_t rssi_cal);
 
 TickType_t hal_esp32_get_timer_duration(void);
 
+typedef struct
+{
+    uint32_t transactions;          // SPI transactions with the radio
+    uint32_t writes_skipped;        // register writes dropped as the register already had the value
+    uint32_t writes_coalesced;      // register writes merged into a burst with the preceding register
+    uint32_t reads_skipped;         // register reads answered from the shadow
+    uint32_t tx_setups;             // transmissions set up
+    uint32_t tx_setup_us;           // last transmission: first radio access to payload written (in µs)
+    uint32_t tx_setup_transactions; // last transmission: SPI transactions for the setup
+} hal_esp32_spi_stats_t;
+
+/**
+ * Gets the radio SPI statistics.
+ * 
+ * @return counters since startup
+ */
+hal_esp32_spi_stats_t hal_esp32_get_spi_stats(void);
+
+#define HAL_ESP32_HISTOGRAM_BUCKETS 8
+
+typedef struct
+{
+    // buckets: < 0, < 50, < 100, < 200, < 500, < 1000, < 2000, >= 2000 µs
+    uint32_t counts[HAL_ESP32_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    int32_t min_us;
+    int32_t max_us;
+} hal_esp32_histogram_t;
+
+typedef struct
+{
+    hal_esp32_histogram_t job_latency;   // scheduled LMIC job time to job start
+    hal_esp32_histogram_t dio_latency;   // DIO interrupt to radio IRQ handler
+    hal_esp32_histogram_t rx_open_error; // scheduled RX window time to receiver switched on
+} hal_esp32_timing_stats_t;
+
+/**
+ * Gets the timing statistics of job scheduling, interrupt handling and RX windows.
+ * 
+ * @return histograms since startup
+ */
+hal_esp32_timing_stats_t hal_esp32_get_timing_stats(void);
+
 /**
  * Gets the time.
  * 
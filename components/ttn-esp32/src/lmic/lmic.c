@@ -918,9 +918,8 @@ scan_mac_cmds(
 
         switch( cmd ) {
         case MCMD_LinkCheckAns: {
-            // TODO(tmm@mcci.com) capture these, reliably..
-            //int gwmargin = opts[oidx+1];
-            //int ngws = opts[oidx+2];
+            LMIC.linkCheckMargin = opts[oidx+1];
+            LMIC.linkCheckGwCnt = opts[oidx+2];
             break;
         }
         // from 1.0.3 spec section 5.2:
@@ -1902,6 +1901,11 @@ static bit_t buildDataFrame (void) {
     }
 #endif // !DISABLE_MCMD_RXTimingSetupReq)
 
+    if ( LMIC.txLinkCheckReq ) {
+        LMIC.frame[end+0] = MCMD_LinkCheckReq;
+        end += 1;
+        LMIC.txLinkCheckReq = 0;
+    }
 #if LMIC_ENABLE_DeviceTimeReq
     if ( LMIC.txDeviceTimeReqState == lmic_RequestTimeState_tx ) {
         LMIC.frame[end+0] = MCMD_DeviceTimeReq;
@@ -3038,6 +3042,44 @@ void LMIC_setLinkCheckMode (bit_t enabled) {
     LMIC.adrAckReq = enabled ? LINK_CHECK_INIT : LINK_CHECK_OFF;
 }
 
+// Ask the network for a LinkCheckAns with the next uplink. The answer is
+// reported in LMIC.linkCheckMargin / LMIC.linkCheckGwCnt (0 until it arrives).
+void LMIC_requestLinkCheck (void) {
+    LMIC.txLinkCheckReq = 1;
+    LMIC.linkCheckGwCnt = 0;
+}
+
+// Airtime of an uplink with plen bytes of FRMPayload at the current data rate,
+// counting the frame header, port, MIC and any MAC commands already pending.
+ostime_t LMIC_calcUplinkAirTime (u1_t plen) {
+    u1_t flen = OFF_DAT_OPTS + LMIC.pendMacLen + LMIC.txLinkCheckReq + 1 + plen + 4;
+    return calcAirTime(updr2rps(LMIC.datarate), flen);
+}
+
+// Earliest time the duty cycle limits allow the next uplink at the current
+// data rate. Unlike LMICbandplan_nextTx() this doesn't select a channel, so
+// it can be polled without disturbing the channel shuffle.
+ostime_t LMIC_nextTxTime (void) {
+    ostime_t txbeg = os_getTime();
+#if CFG_LMIC_EU_like
+    ostime_t mintime = txbeg + sec2osticks(28800);
+    for (u1_t chnl = 0; chnl < MAX_CHANNELS; ++chnl) {
+        if ((LMIC.channelMap & (1 << chnl)) == 0)
+            continue;
+        if ((LMIC.channelDrMap[chnl] & (1 << (LMIC.datarate & 0xF))) == 0)
+            continue;
+        ostime_t avail = LMIC.bands[LMIC.channelFreq[chnl] & 0x3].avail;
+        if ((s4_t)(mintime - avail) > 0)
+            mintime = avail;
+    }
+    if ((s4_t)(mintime - txbeg) > 0)
+        txbeg = mintime;
+#endif
+    if (LMIC.globalDutyRate != 0 && (s4_t)(txbeg - LMIC.globalDutyAvail) < 0)
+        txbeg = LMIC.globalDutyAvail;
+    return txbeg;
+}
+
 // Sets the max clock error to compensate for (defaults to 0, which
 // allows for +/- 640 at SF7BW250). MAX_CLOCK_ERROR represents +/-100%,
 // so e.g. for a +/-1% error you would pass MAX_CLOCK_ERROR * 1 / 100.
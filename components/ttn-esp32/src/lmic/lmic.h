@@ -627,6 +627,9 @@ struct lmic_t {
 
     u1_t        margin;
     s1_t        devAnsMargin; // SNR value between -32 and 31 (inclusive) for the last successfully received DevStatusReq command
+    u1_t        txLinkCheckReq;   // send LinkCheckReq with the next uplink
+    u1_t        linkCheckMargin;  // demodulation margin [dB] from the last LinkCheckAns
+    u1_t        linkCheckGwCnt;   // gateways from the last LinkCheckAns, 0 = no answer since the request
     u1_t        adrEnabled;
     u1_t        moreData;     // NWK has more data pending
 #if LMIC_ENABLE_TxParamSetupReq
@@ -726,6 +729,9 @@ void  LMIC_setPingable   (u1_t intvExp);
 
 void LMIC_setSession (u4_t netid, devaddr_t devaddr, xref2u1_t nwkKey, xref2u1_t artKey);
 void LMIC_setLinkCheckMode (bit_t enabled);
+void LMIC_requestLinkCheck (void);
+ostime_t LMIC_calcUplinkAirTime (u1_t plen);
+ostime_t LMIC_nextTxTime (void);
 void LMIC_setClockError(u2_t error);
 
 u4_t LMIC_getSeqnoUp    (void);
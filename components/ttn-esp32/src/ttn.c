@@ -13,6 +13,7 @@
 #include "ttn.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "hal/hal_esp32.h"
 #include "lmic/lmic.h"
@@ -24,6 +25,7 @@
 #define TAG "ttn"
 
 #define DEFAULT_MAX_TX_POWER -1000
+#define FCNT_RESTORE_GAP (2 * CONFIG_TTN_NVS_CHECKPOINT_INTERVAL)
 
 /**
  * @brief Reason the user code is waiting
@@ -32,7 +34,8 @@ typedef enum
 {
     TTN_WAITING_NONE,
     TTN_WAITING_FOR_JOIN,
-    TTN_WAITING_FOR_TRANSMISSION
+    TTN_WAITING_FOR_TRANSMISSION,
+    TTN_WAITING_FOR_QUEUED_TRANSMISSION
 } ttn_waiting_reason_t;
 
 /**
@@ -43,7 +46,6 @@ typedef enum
     TTN_EVENT_NONE,
     TTN_EVNT_JOIN_COMPLETED,
     TTN_EVENT_JOIN_FAILED,
-    TTN_EVENT_MESSAGE_RECEIVED,
     TTN_EVENT_TRANSMISSION_COMPLETED,
     TTN_EVENT_TRANSMISSION_FAILED
 } ttn_event_t;
@@ -54,31 +56,75 @@ typedef enum
 typedef struct
 {
     ttn_event_t event;
-    uint8_t port;
-    const uint8_t *message;
-    size_t message_size;
 } ttn_lmic_event_t;
 
+/**
+ * @brief Buffer of the downlink pool
+ */
+typedef struct
+{
+    ttn_downlink_t downlink; // must be first, the application only sees this part
+    uint8_t refs;
+    uint8_t payload[MAX_LEN_PAYLOAD];
+} ttn_rx_buffer_t;
+
+/**
+ * @brief Message waiting in the transmit queue
+ */
+typedef struct
+{
+    uint8_t payload[MAX_LEN_PAYLOAD];
+    uint8_t length;
+    ttn_port_t port;
+    bool confirm;
+    uint8_t priority;
+    uint32_t seq;
+    ttn_transmit_cb callback;
+    void *user_data;
+} ttn_queued_message_t;
+
 static bool is_started;
 static bool has_joined;
 static QueueHandle_t lmic_event_queue;
 static ttn_message_cb message_callback;
+static ttn_downlink_cb downlink_callback;
+static ttn_rx_buffer_t rx_pool[CONFIG_TTN_RX_BUFFER_COUNT];
+static QueueHandle_t rx_dispatch_queue;
+static uint32_t rx_dropped;
 static ttn_waiting_reason_t waiting_reason;
 static ttn_rf_settings_t last_rf_settings[4];
 static ttn_rx_tx_window_t current_rx_tx_window;
+static ttn_uplink_stats_t current_uplink_stats;
+static ttn_uplink_stats_t last_uplink_stats;
 static int subband = 2;
 static ttn_data_rate_t join_data_rate = TTN_DR_JOIN_DEFAULT;
 static int max_tx_power = DEFAULT_MAX_TX_POWER;
 
+static ttn_queued_message_t tx_queue[CONFIG_TTN_TX_QUEUE_LEN];
+static int tx_queue_len;
+static uint32_t tx_queue_seq;
+static osjob_t tx_queue_job;
+static ttn_transmit_cb tx_callback;
+static void *tx_user_data;
+static ttn_response_code_t tx_result;
+static bool checkpoint_due;
+static u4_t checkpoint_seqno_up;
+static ttn_session_stats_t session_stats;
+
 static void start(void);
 static void stop(void);
 static bool join_core(void);
 static void config_rf_params(void);
 static void event_callback(void *user_data, ev_t event);
 static void message_received_callback(void *user_data, uint8_t port, const uint8_t *message, size_t message_size);
+static void rx_dispatch_task(void *param);
 static void message_transmitted_callback(void *user_data, int success);
+static void start_next_queued(void);
+static void flush_queue(void);
+static void queue_job_callback(osjob_t *job);
 static void save_rf_settings(ttn_rf_settings_t *rf_settings);
 static void clear_rf_settings(ttn_rf_settings_t *rf_settings);
+static bool checkpoint_session(void);
 
 void ttn_init(void)
 {
@@ -88,7 +134,12 @@ void ttn_init(void)
 #endif
 
     message_callback = NULL;
+    downlink_callback = NULL;
     hal_esp32_init_critical_section();
+
+    rx_dispatch_queue = xQueueCreate(CONFIG_TTN_RX_BUFFER_COUNT, sizeof(ttn_rx_buffer_t *));
+    ASSERT(rx_dispatch_queue != NULL);
+    xTaskCreate(rx_dispatch_task, "ttn_rx", 1024 * 4, NULL, CONFIG_TTN_BG_TASK_PRIO - 1, NULL);
 }
 
 void ttn_configure_pins(spi_host_device_t spi_host, uint8_t nss, uint8_t rxtx, uint8_t rst, uint8_t dio0, uint8_t dio1)
@@ -113,6 +164,12 @@ void start(void)
     LMIC_registerEventCb(event_callback, NULL);
     LMIC_registerRxMessageCb(message_received_callback, NULL);
 
+#if defined(CONFIG_TTN_LMIC_PROFILE_CLASS_A)
+    ESP_LOGI(TAG, "LMIC Class A profile: state %d bytes, max. payload %d bytes", (int)sizeof(struct lmic_t), MAX_LEN_PAYLOAD);
+#else
+    ESP_LOGI(TAG, "LMIC full profile: state %d bytes, max. payload %d bytes", (int)sizeof(struct lmic_t), MAX_LEN_PAYLOAD);
+#endif
+
     os_init_ex(NULL);
     hal_esp32_enter_critical_section();
     LMIC_reset();
@@ -136,6 +193,8 @@ void stop(void)
     hal_esp32_stop_lmic_task();
     waiting_reason = TTN_WAITING_NONE;
     hal_esp32_leave_critical_section();
+
+    flush_queue();
 }
 
 void ttn_shutdown(void)
@@ -203,6 +262,23 @@ bool ttn_join_with_keys(const char *dev_eui, const char *app_eui, const char *ap
     return join_core();
 }
 
+bool ttn_rejoin(void)
+{
+    if (!is_started)
+        return join_core();
+
+    // LMIC_startJoining() does nothing while LMIC has a device address: drop the session first, and fail
+    // whatever was queued or in flight for it
+    hal_esp32_enter_critical_section();
+    has_joined = false;
+    LMIC_unjoin();
+    waiting_reason = TTN_WAITING_NONE;
+    hal_esp32_leave_critical_section();
+    flush_queue();
+
+    return join_core();
+}
+
 bool ttn_join(void)
 {
     if (!ttn_provisioning_have_keys())
@@ -256,6 +332,15 @@ bool ttn_resume_after_power_off(int off_duration)
     if (!ttn_nvs_restore(off_duration))
         return false;
 
+    // The frame counters may have advanced after the last checkpoint
+    session_stats.counters_from_rtc = ttn_rtc_restore_counters();
+    if (!session_stats.counters_from_rtc)
+    {
+        LMIC.seqnoUp += FCNT_RESTORE_GAP;
+        ESP_LOGW(TAG, "Frame counters not in RTC memory, skipping %d uplink frame counters", FCNT_RESTORE_GAP);
+    }
+    checkpoint_due = true;
+
     has_joined = true;
     return true;
 }
@@ -287,6 +372,7 @@ bool join_core(void)
     start();
 
     has_joined = true;
+    checkpoint_due = true;
     hal_esp32_enter_critical_section();
     xQueueReset(lmic_event_queue);
     waiting_reason = TTN_WAITING_FOR_JOIN;
@@ -300,6 +386,13 @@ bool join_core(void)
     ttn_lmic_event_t event;
     xQueueReceive(lmic_event_queue, &event, portMAX_DELAY);
     has_joined = event.event == TTN_EVNT_JOIN_COMPLETED;
+
+    if (has_joined)
+    {
+        hal_esp32_enter_critical_section();
+        start_next_queued();
+        hal_esp32_leave_critical_section();
+    }
     return has_joined;
 }
 
@@ -326,16 +419,13 @@ ttn_response_code_t ttn_transmit_message(const uint8_t *payload, size_t length,
 
         switch (result.event)
         {
-        case TTN_EVENT_MESSAGE_RECEIVED:
-            if (message_callback != NULL)
-                message_callback(result.message, result.message_size, result.port);
-            break;
-
         case TTN_EVENT_TRANSMISSION_COMPLETED:
-            return TTN_SUCCESSFUL_TRANSMISSION;
-
         case TTN_EVENT_TRANSMISSION_FAILED:
-            return TTN_ERROR_TRANSMISSION_FAILED;
+            hal_esp32_enter_critical_section();
+            start_next_queued();
+            hal_esp32_leave_critical_section();
+            return result.event == TTN_EVENT_TRANSMISSION_COMPLETED ? TTN_SUCCESSFUL_TRANSMISSION
+                                                                     : TTN_ERROR_TRANSMISSION_FAILED;
 
         default:
             ASSERT(0);
@@ -343,11 +433,93 @@ ttn_response_code_t ttn_transmit_message(const uint8_t *payload, size_t length,
     }
 }
 
+bool ttn_queue_message(const uint8_t *payload, size_t length, ttn_port_t port, bool confirm, uint8_t priority,
+                       ttn_transmit_cb callback, void *user_data)
+{
+    if (length > MAX_LEN_PAYLOAD)
+        return false;
+
+    ttn_queued_message_t evicted = {.callback = NULL};
+
+    hal_esp32_enter_critical_section();
+    int slot = tx_queue_len;
+    if (tx_queue_len == CONFIG_TTN_TX_QUEUE_LEN)
+    {
+        // full: make room by dropping the newest message of the lowest priority, if it is below ours
+        slot = 0;
+        for (int i = 1; i < tx_queue_len; i++)
+        {
+            if (tx_queue[i].priority < tx_queue[slot].priority ||
+                (tx_queue[i].priority == tx_queue[slot].priority && tx_queue[i].seq > tx_queue[slot].seq))
+                slot = i;
+        }
+        if (tx_queue[slot].priority >= priority)
+        {
+            hal_esp32_leave_critical_section();
+            return false;
+        }
+        evicted = tx_queue[slot];
+    }
+    else
+    {
+        tx_queue_len++;
+    }
+
+    ttn_queued_message_t *msg = &tx_queue[slot];
+    memcpy(msg->payload, payload, length);
+    msg->length = length;
+    msg->port = port;
+    msg->confirm = confirm;
+    msg->priority = priority;
+    msg->seq = tx_queue_seq++;
+    msg->callback = callback;
+    msg->user_data = user_data;
+
+    if (is_started && has_joined)
+        start_next_queued();
+    hal_esp32_leave_critical_section();
+
+    if (evicted.callback != NULL)
+        evicted.callback(TTN_ERROR_TRANSMISSION_FAILED, evicted.user_data);
+    return true;
+}
+
+int ttn_queued_message_count(void)
+{
+    hal_esp32_enter_critical_section();
+    int count = tx_queue_len;
+    if (waiting_reason == TTN_WAITING_FOR_QUEUED_TRANSMISSION)
+        count++;
+    hal_esp32_leave_critical_section();
+    return count;
+}
+
 void ttn_on_message(ttn_message_cb callback)
 {
     message_callback = callback;
 }
 
+void ttn_on_downlink(ttn_downlink_cb callback)
+{
+    downlink_callback = callback;
+}
+
+void ttn_downlink_retain(ttn_downlink_t *downlink)
+{
+    __atomic_add_fetch(&((ttn_rx_buffer_t *)downlink)->refs, 1, __ATOMIC_RELAXED);
+}
+
+void ttn_downlink_release(ttn_downlink_t *downlink)
+{
+    // the buffer returns to the pool when the count drops to zero
+    __atomic_sub_fetch(&((ttn_rx_buffer_t *)downlink)->refs, 1, __ATOMIC_RELEASE);
+}
+
+uint32_t ttn_downlinks_dropped(void)
+{
+    return rx_dropped;
+}
+
 bool ttn_is_provisioned(void)
 {
     if (ttn_provisioning_have_keys())
@@ -366,10 +538,50 @@ void ttn_prepare_for_deep_sleep(void)
 
 void ttn_prepare_for_power_off(void)
 {
-    ttn_nvs_save();
+    ttn_rtc_save_counters();
+    checkpoint_session();
     stop();
 }
 
+bool ttn_save_session(void)
+{
+    if (!has_joined)
+        return false;
+
+    hal_esp32_enter_critical_section();
+    bool saved = false;
+    if ((LMIC.opmode & (OP_JOINING | OP_TXDATA | OP_POLL | OP_TXRXPEND)) == 0)
+    {
+        ttn_rtc_save_counters();
+        session_stats.rtc_saves++;
+        saved = true;
+        if (checkpoint_due || LMIC.seqnoUp - checkpoint_seqno_up >= CONFIG_TTN_NVS_CHECKPOINT_INTERVAL)
+            saved = checkpoint_session();
+    }
+    hal_esp32_leave_critical_section();
+    return saved;
+}
+
+// Writes the complete state to NVS
+bool checkpoint_session(void)
+{
+    int64_t start_time = esp_timer_get_time();
+    bool saved = ttn_nvs_save();
+    uint32_t duration = esp_timer_get_time() - start_time;
+
+    session_stats.last_nvs_save_us = duration;
+    if (duration > session_stats.max_nvs_save_us)
+        session_stats.max_nvs_save_us = duration;
+
+    if (saved)
+    {
+        session_stats.nvs_writes++;
+        checkpoint_seqno_up = LMIC.seqnoUp;
+        checkpoint_due = false;
+    }
+    return saved;
+}
+
 void ttn_wait_for_idle(void)
 {
     while (true)
@@ -466,6 +678,121 @@ int ttn_rssi(void)
     return LMIC.rssi;
 }
 
+void ttn_request_link_check(void)
+{
+    hal_esp32_enter_critical_section();
+    LMIC_requestLinkCheck();
+    hal_esp32_leave_critical_section();
+}
+
+uint32_t ttn_uplink_airtime_ms(size_t length)
+{
+    if (length > MAX_LEN_PAYLOAD)
+        length = MAX_LEN_PAYLOAD;
+
+    hal_esp32_enter_critical_section();
+    ostime_t airtime = LMIC_calcUplinkAirTime(length);
+    hal_esp32_leave_critical_section();
+    return osticks2ms(airtime);
+}
+
+uint32_t ttn_next_tx_delay_ms(void)
+{
+    hal_esp32_enter_critical_section();
+    ostime_t delay = LMIC_nextTxTime() - os_getTime();
+    hal_esp32_leave_critical_section();
+    return delay > 0 ? osticks2ms(delay) : 0;
+}
+
+ttn_uplink_stats_t ttn_last_uplink_stats(void)
+{
+    hal_esp32_enter_critical_section();
+    ttn_uplink_stats_t stats = last_uplink_stats;
+    hal_esp32_leave_critical_section();
+    return stats;
+}
+
+ttn_spi_stats_t ttn_spi_stats(void)
+{
+    hal_esp32_enter_critical_section();
+    hal_esp32_spi_stats_t hal_stats = hal_esp32_get_spi_stats();
+    hal_esp32_leave_critical_section();
+
+    return (ttn_spi_stats_t){
+        .transactions = hal_stats.transactions,
+        .writes_skipped = hal_stats.writes_skipped,
+        .writes_coalesced = hal_stats.writes_coalesced,
+        .reads_skipped = hal_stats.reads_skipped,
+        .tx_setups = hal_stats.tx_setups,
+        .tx_setup_us = hal_stats.tx_setup_us,
+        .tx_setup_transactions = hal_stats.tx_setup_transactions,
+    };
+}
+
+static ttn_histogram_t convert_histogram(const hal_esp32_histogram_t *histogram)
+{
+    ttn_histogram_t result = {
+        .count = histogram->count,
+        .min_us = histogram->min_us,
+        .max_us = histogram->max_us,
+    };
+    memcpy(result.counts, histogram->counts, sizeof(result.counts));
+    return result;
+}
+
+ttn_timing_stats_t ttn_timing_stats(void)
+{
+    hal_esp32_enter_critical_section();
+    hal_esp32_timing_stats_t hal_stats = hal_esp32_get_timing_stats();
+    hal_esp32_leave_critical_section();
+
+    return (ttn_timing_stats_t){
+        .job_latency = convert_histogram(&hal_stats.job_latency),
+        .dio_latency = convert_histogram(&hal_stats.dio_latency),
+        .rx_open_error = convert_histogram(&hal_stats.rx_open_error),
+    };
+}
+
+size_t ttn_trace_size(void)
+{
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+    return ttn_log_trace_size();
+#else
+    return 0;
+#endif
+}
+
+size_t ttn_trace_export(uint8_t *buffer, size_t length)
+{
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+    return ttn_log_trace_export(buffer, length);
+#else
+    return 0;
+#endif
+}
+
+void ttn_trace_discard(const uint8_t *trace)
+{
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+    ttn_log_trace_discard(trace);
+#endif
+}
+
+void ttn_trace_clear(void)
+{
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+    ttn_log_trace_clear();
+#endif
+}
+
+ttn_session_stats_t ttn_session_stats(void)
+{
+    hal_esp32_enter_critical_section();
+    ttn_session_stats_t stats = session_stats;
+    hal_esp32_leave_critical_section();
+    return stats;
+}
+
 // --- Callbacks ---
 
 #if CONFIG_LOG_DEFAULT_LEVEL >= 3 || LMIC_ENABLE_event_logging
@@ -483,6 +810,25 @@ void event_callback(void *user_data, ev_t event)
         save_rf_settings(&last_rf_settings[TTN_WINDOW_TX]);
         clear_rf_settings(&last_rf_settings[TTN_WINDOW_RX1]);
         clear_rf_settings(&last_rf_settings[TTN_WINDOW_RX2]);
+        current_uplink_stats = (ttn_uplink_stats_t){
+            .airtime_ms = osticks2ms(calcAirTime(LMIC.rps, LMIC.dataLen)),
+            .data_rate = LMIC.datarate,
+            .tx_power = LMIC.radio_txpow,
+        };
+        break;
+
+    case EV_TXCOMPLETE:
+        current_rx_tx_window = TTN_WINDOW_IDLE;
+        current_uplink_stats.downlink = (LMIC.txrxFlags & (TXRX_DNW1 | TXRX_DNW2)) != 0;
+        if (current_uplink_stats.downlink)
+        {
+            current_uplink_stats.rssi = LMIC.rssi - RSSI_OFF;
+            current_uplink_stats.snr = (LMIC.snr + SNR_SCALEUP / 2) / SNR_SCALEUP;
+        }
+        current_uplink_stats.link_check_gateways = LMIC.linkCheckGwCnt;
+        current_uplink_stats.link_check_margin = LMIC.linkCheckMargin;
+        LMIC.linkCheckGwCnt = 0;
+        last_uplink_stats = current_uplink_stats;
         break;
 
     case EV_RXSTART:
@@ -534,21 +880,162 @@ void event_callback(void *user_data, ev_t event)
 // Called by LMIC when a message has been received
 void message_received_callback(void *user_data, uint8_t port, const uint8_t *message, size_t message_size)
 {
-    ttn_lmic_event_t result = {
-        .event = TTN_EVENT_MESSAGE_RECEIVED, .port = port, .message = message, .message_size = message_size};
-    xQueueSend(lmic_event_queue, &result, pdMS_TO_TICKS(100));
+    // LMIC reuses its frame buffer for the next frame: copy the payload once into a pool buffer
+    // owned by the dispatch task, so the LMIC task never waits for the application
+    ttn_rx_buffer_t *buffer = NULL;
+    for (int i = 0; i < CONFIG_TTN_RX_BUFFER_COUNT && buffer == NULL; i++)
+    {
+        uint8_t free_refs = 0;
+        if (__atomic_compare_exchange_n(&rx_pool[i].refs, &free_refs, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            buffer = &rx_pool[i];
+    }
+    if (buffer == NULL)
+    {
+        rx_dropped++;
+        ESP_LOGW(TAG, "No downlink buffer free, message on port %d dropped", port);
+        return;
+    }
+
+    memcpy(buffer->payload, message, message_size);
+    buffer->downlink = (ttn_downlink_t){
+        .payload = buffer->payload,
+        .length = message_size,
+        .port = port,
+        .frame_counter = LMIC.seqnoDn - 1,
+    };
+
+    if (xQueueSend(rx_dispatch_queue, &buffer, 0) != pdTRUE)
+    {
+        rx_dropped++;
+        ttn_downlink_release(&buffer->downlink);
+    }
+}
+
+// Delivers received messages to the application, independent of any transmission
+void rx_dispatch_task(void *param)
+{
+    ttn_rx_buffer_t *buffer;
+
+    while (true)
+    {
+        xQueueReceive(rx_dispatch_queue, &buffer, portMAX_DELAY);
+
+        ttn_downlink_t *downlink = &buffer->downlink;
+        if (message_callback != NULL)
+            message_callback(downlink->payload, downlink->length, downlink->port);
+        if (downlink_callback != NULL)
+            downlink_callback(downlink);
+
+        ttn_downlink_release(downlink);
+    }
 }
 
 // Called by LMIC when a message has been transmitted (or the transmission failed)
 void message_transmitted_callback(void *user_data, int success)
 {
+    if (waiting_reason == TTN_WAITING_FOR_QUEUED_TRANSMISSION)
+    {
+        // report and start the next message from a job, once LMIC has finished with this event;
+        // until then the transmit path stays reserved
+        tx_result = success ? TTN_SUCCESSFUL_TRANSMISSION : TTN_ERROR_TRANSMISSION_FAILED;
+        os_setCallback(&tx_queue_job, queue_job_callback);
+        return;
+    }
+
     waiting_reason = TTN_WAITING_NONE;
     ttn_lmic_event_t result = {.event = success ? TTN_EVENT_TRANSMISSION_COMPLETED : TTN_EVENT_TRANSMISSION_FAILED};
     xQueueSend(lmic_event_queue, &result, pdMS_TO_TICKS(100));
 }
 
+// Called by LMIC (as a job) after a queued message has been transmitted
+void queue_job_callback(osjob_t *job)
+{
+    hal_esp32_enter_critical_section();
+    ttn_transmit_cb callback = tx_callback;
+    tx_callback = NULL;
+    if (waiting_reason == TTN_WAITING_FOR_QUEUED_TRANSMISSION)
+        waiting_reason = TTN_WAITING_NONE;
+    hal_esp32_leave_critical_section();
+
+    if (callback != NULL)
+        callback(tx_result, tx_user_data);
+
+    hal_esp32_enter_critical_section();
+    start_next_queued();
+    hal_esp32_leave_critical_section();
+}
+
 // --- Helpers
 
+// Hands the highest priority queued message (oldest first) to LMIC if it is idle.
+// Must be called in the critical section or from the LMIC task.
+void start_next_queued(void)
+{
+    while (tx_queue_len > 0)
+    {
+        if (waiting_reason != TTN_WAITING_NONE ||
+            (LMIC.opmode & (OP_JOINING | OP_TXDATA | OP_POLL | OP_TXRXPEND | OP_SHUTDOWN)) != 0)
+            return;
+
+        int next = 0;
+        for (int i = 1; i < tx_queue_len; i++)
+        {
+            if (tx_queue[i].priority > tx_queue[next].priority ||
+                (tx_queue[i].priority == tx_queue[next].priority && tx_queue[i].seq < tx_queue[next].seq))
+                next = i;
+        }
+        ttn_queued_message_t *msg = &tx_queue[next];
+
+        lmic_tx_error_t err = LMIC_sendWithCallback(msg->port, msg->payload, msg->length, msg->confirm,
+                                                    message_transmitted_callback, NULL);
+        ttn_transmit_cb callback = msg->callback;
+        void *cb_user_data = msg->user_data;
+        tx_queue[next] = tx_queue[--tx_queue_len];
+
+        if (err == LMIC_ERROR_SUCCESS)
+        {
+            waiting_reason = TTN_WAITING_FOR_QUEUED_TRANSMISSION;
+            tx_callback = callback;
+            tx_user_data = cb_user_data;
+            hal_esp32_wake_up();
+            return;
+        }
+
+        ESP_LOGW(TAG, "Queued message rejected by LMIC (%d)", err);
+        if (callback != NULL)
+            callback(TTN_ERROR_TRANSMISSION_FAILED, cb_user_data);
+    }
+}
+
+// Fails all queued messages and the one in flight
+void flush_queue(void)
+{
+    struct
+    {
+        ttn_transmit_cb callback;
+        void *user_data;
+    } flushed[CONFIG_TTN_TX_QUEUE_LEN + 1];
+    int count = 0;
+
+    hal_esp32_enter_critical_section();
+    for (int i = 0; i < tx_queue_len; i++)
+    {
+        flushed[count].callback = tx_queue[i].callback;
+        flushed[count++].user_data = tx_queue[i].user_data;
+    }
+    tx_queue_len = 0;
+    flushed[count].callback = tx_callback;
+    flushed[count++].user_data = tx_user_data;
+    tx_callback = NULL;
+    hal_esp32_leave_critical_section();
+
+    for (int i = 0; i < count; i++)
+    {
+        if (flushed[i].callback != NULL)
+            flushed[i].callback(TTN_ERROR_TRANSMISSION_FAILED, flushed[i].user_data);
+    }
+}
+
 void save_rf_settings(ttn_rf_settings_t *rf_settings)
 {
     rf_settings->spreading_factor = (ttn_spreading_factor_t)(getSf(LMIC.rps) + 1);
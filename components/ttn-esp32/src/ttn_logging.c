@@ -10,18 +10,32 @@
  * Circular buffer for detailed logging without affecting LMIC timing.
  *******************************************************************************/
 
+#include "lmic/lmic.h"
+
 #if LMIC_ENABLE_event_logging
 
 #include "ttn_logging.h"
+#include "ttn_trace_flash.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "lmic/lmic.h"
+#include "freertos/semphr.h"
 #include <string.h>
 
 #define NUM_RINGBUF_MSG 50
 #define TAG "lmic"
 
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+#define TRACE_MAGIC "LMTR"
+#define TRACE_VERSION 2
+#define TRACE_HEADER_LEN 12
+#define TRACE_FIXED_LEN 36
+#define TRACE_MAX_TEXT_LEN 24
+#define TRACE_TYPE_FATAL 0xfd
+#define TRACE_TYPE_DATUM 0xfe
+#define TRACE_TYPE_MESSAGE 0xff
+#endif
+
 /**
  * @brief Message structure used in ring buffer
  *
@@ -60,6 +74,9 @@ static void printEvtTxStart(TTNLogMessage *log);
 static void printEvtRxStart(TTNLogMessage *log);
 static void printEvtJoinTxComplete(TTNLogMessage *log);
 static void bin2hex(const uint8_t *bin, unsigned len, char *buf, char sep);
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+static void traceMessage(TTNLogMessage *log);
+#endif
 
 // Constants for formatting LORA values
 static const char *const SF_NAMES[] = {"FSK", "SF7", "SF8", "SF9", "SF10", "SF11", "SF12", "SFrfu"};
@@ -69,6 +86,19 @@ static const char *const CRC_NAMES[] = {"NoCrc", "Crc"};
 
 static RingbufHandle_t ringBuffer;
 
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+// Binary trace: whole records in a circular byte buffer, oldest records are dropped first.
+// With the flash ring, the buffer only holds the records not written to flash yet.
+static uint8_t traceBuf[CONFIG_TTN_TRACE_BUFFER_SIZE];
+static size_t traceHead;      // offset of the oldest record
+static size_t traceUsed;
+static uint32_t traceHeadSeq; // sequence number of the oldest record
+static SemaphoreHandle_t traceMutex;
+#if defined(CONFIG_TTN_TRACE_FLASH)
+static bool traceFlash;
+#endif
+#endif
+
 // Initialize logging
 void ttn_log_init(void)
 {
@@ -79,6 +109,15 @@ void ttn_log_init(void)
         ASSERT(0);
     }
 
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+    traceMutex = xSemaphoreCreateMutex();
+#if defined(CONFIG_TTN_TRACE_FLASH)
+    traceFlash = ttn_trace_flash_init();
+    if (traceFlash)
+        traceHeadSeq = ttn_trace_flash_next_seq();
+#endif
+#endif
+
     xTaskCreate(loggingTask, "ttn_log", 1024 * 4, ringBuffer, 4, NULL);
     hal_set_failure_handler(logFatal);
 }
@@ -147,7 +186,13 @@ void loggingTask(void *param)
         if (log == NULL)
             continue;
 
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+        traceMessage(log);
+        if ((int)log->event == -3)
+            printMessage(log); // fatal errors are shown on the console, too
+#else
         printMessage(log);
+#endif
 
         vRingbufferReturnItem(ringBuffer, log);
     }
@@ -287,6 +332,222 @@ void printEvtJoinTxComplete(TTNLogMessage *log)
     ESP_LOGI(TAG, "- saveIrqFlags=0x%02x", log->saveIrqFlags);
 }
 
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+
+// ---------------------------------------------------------------------------
+// Binary trace
+//
+// See ttn_trace_export() for the format.
+
+static void putU2(uint8_t *p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void putU4(uint8_t *p, uint32_t value)
+{
+    putU2(p, value);
+    putU2(p + 2, value >> 16);
+}
+
+static void traceCopyOut(size_t offset, uint8_t *dst, size_t len)
+{
+    size_t pos = (traceHead + offset) % sizeof(traceBuf);
+    size_t first = sizeof(traceBuf) - pos;
+    if (first > len)
+        first = len;
+    memcpy(dst, traceBuf + pos, first);
+    memcpy(dst + first, traceBuf, len - first);
+}
+
+// Remove the oldest record from the buffer
+static void traceDropOldest(void)
+{
+    uint8_t oldestLen = traceBuf[traceHead];
+    traceHead = (traceHead + oldestLen) % sizeof(traceBuf);
+    traceUsed -= oldestLen;
+    traceHeadSeq++;
+}
+
+#if defined(CONFIG_TTN_TRACE_FLASH)
+// Move the buffered records to the flash ring
+static void traceFlush(void)
+{
+    uint8_t rec[TRACE_FIXED_LEN + TRACE_MAX_TEXT_LEN];
+    while (traceUsed > 0)
+    {
+        traceCopyOut(0, rec, traceBuf[traceHead]);
+        if (!ttn_trace_flash_append(rec, traceHeadSeq))
+        {
+            ESP_LOGE(TAG, "Trace flash write failed, trace kept in RAM only");
+            traceFlash = false;
+            return;
+        }
+        traceDropOldest();
+    }
+}
+#endif
+
+// Serialize a log message and append it to the trace, dropping the oldest records if needed
+void traceMessage(TTNLogMessage *log)
+{
+    uint8_t rec[TRACE_FIXED_LEN + TRACE_MAX_TEXT_LEN];
+    size_t len = TRACE_FIXED_LEN;
+    int event = (int)log->event;
+
+    // LMIC events are identified by their code; only free-text messages carry their text
+    if (event < 0 && log->message != NULL)
+    {
+        const char *text = log->message;
+        size_t textLen = strlen(text);
+        if (textLen > TRACE_MAX_TEXT_LEN)
+        {
+            // keep the end of file names (fatal errors), the start of messages
+            if (event == -3)
+                text += textLen - TRACE_MAX_TEXT_LEN;
+            textLen = TRACE_MAX_TEXT_LEN;
+        }
+        memcpy(rec + TRACE_FIXED_LEN, text, textLen);
+        len += textLen;
+    }
+
+    rec[0] = len;
+    rec[1] = event == -1 ? TRACE_TYPE_MESSAGE : event == -2 ? TRACE_TYPE_DATUM : event == -3 ? TRACE_TYPE_FATAL : event;
+    putU4(rec + 2, log->time);
+    putU4(rec + 6, log->txend);
+    putU4(rec + 10, log->globalDutyAvail);
+    putU4(rec + 14, log->freq);
+    putU4(rec + 18, log->datum);
+    putU2(rec + 22, log->opmode);
+    putU2(rec + 24, log->fcntUp);
+    putU2(rec + 26, log->fcntDn);
+    putU2(rec + 28, log->rxsyms);
+    putU2(rec + 30, log->rps);
+    rec[32] = log->txChnl;
+    rec[33] = log->datarate;
+    rec[34] = log->txrxFlags;
+    rec[35] = log->saveIrqFlags;
+
+    xSemaphoreTake(traceMutex, portMAX_DELAY);
+
+    while (traceUsed + len > sizeof(traceBuf))
+        traceDropOldest();
+
+    size_t pos = (traceHead + traceUsed) % sizeof(traceBuf);
+    size_t first = sizeof(traceBuf) - pos;
+    if (first > len)
+        first = len;
+    memcpy(traceBuf + pos, rec, first);
+    memcpy(traceBuf, rec + first, len - first);
+    traceUsed += len;
+
+#if defined(CONFIG_TTN_TRACE_FLASH)
+    // Writing and erasing flash stalls the caches; stay clear of transmissions and receive
+    // windows unless the buffer is filling up
+    if (traceFlash && (!(log->opmode & OP_TXRXPEND) || traceUsed > sizeof(traceBuf) / 2))
+        traceFlush();
+#endif
+
+    xSemaphoreGive(traceMutex);
+}
+
+size_t ttn_log_trace_size(void)
+{
+    if (traceMutex == NULL)
+        return 0;
+    size_t size = TRACE_HEADER_LEN + traceUsed;
+#if defined(CONFIG_TTN_TRACE_FLASH)
+    if (traceFlash)
+    {
+        xSemaphoreTake(traceMutex, portMAX_DELAY);
+        size += ttn_trace_flash_size();
+        xSemaphoreGive(traceMutex);
+    }
+#endif
+    return size;
+}
+
+size_t ttn_log_trace_export(uint8_t *buffer, size_t length)
+{
+    if (traceMutex == NULL || length < TRACE_HEADER_LEN)
+        return 0;
+
+    xSemaphoreTake(traceMutex, portMAX_DELAY);
+
+    uint32_t first = traceHeadSeq;
+    uint16_t count = 0;
+    size_t flashLen = 0;
+#if defined(CONFIG_TTN_TRACE_FLASH)
+    if (traceFlash)
+        flashLen = ttn_trace_flash_export(buffer + TRACE_HEADER_LEN, length - TRACE_HEADER_LEN, &first, &count);
+#endif
+
+    // then the buffered records, if they follow on; whole records only, oldest first
+    size_t offset = 0;
+    if (count == 0 || first + count == traceHeadSeq)
+    {
+        if (count == 0)
+            first = traceHeadSeq;
+        while (offset < traceUsed && count < UINT16_MAX)
+        {
+            uint8_t recLen = traceBuf[(traceHead + offset) % sizeof(traceBuf)];
+            if (TRACE_HEADER_LEN + flashLen + offset + recLen > length)
+                break;
+            offset += recLen;
+            count++;
+        }
+        traceCopyOut(0, buffer + TRACE_HEADER_LEN + flashLen, offset);
+    }
+
+    xSemaphoreGive(traceMutex);
+
+    memcpy(buffer, TRACE_MAGIC, 4);
+    buffer[4] = TRACE_VERSION;
+    buffer[5] = US_PER_OSTICK;
+    putU2(buffer + 6, count);
+    putU4(buffer + 8, first);
+    return TRACE_HEADER_LEN + flashLen + offset;
+}
+
+// Discard the records numbered before end
+static void traceDiscard(uint32_t end)
+{
+    while (traceUsed > 0 && traceHeadSeq < end)
+        traceDropOldest();
+#if defined(CONFIG_TTN_TRACE_FLASH)
+    if (traceFlash)
+        ttn_trace_flash_discard(end);
+#endif
+}
+
+void ttn_log_trace_discard(const uint8_t *trace)
+{
+    if (traceMutex == NULL || memcmp(trace, TRACE_MAGIC, 4) != 0 || trace[4] != TRACE_VERSION)
+        return;
+
+    uint32_t first = trace[8] | (trace[9] << 8) | (trace[10] << 16) | ((uint32_t)trace[11] << 24);
+    uint16_t count = trace[6] | (trace[7] << 8);
+
+    xSemaphoreTake(traceMutex, portMAX_DELAY);
+    traceDiscard(first + count);
+    xSemaphoreGive(traceMutex);
+}
+
+void ttn_log_trace_clear(void)
+{
+    if (traceMutex == NULL)
+        return;
+
+    xSemaphoreTake(traceMutex, portMAX_DELAY);
+    while (traceUsed > 0)
+        traceDropOldest();
+    traceDiscard(traceHeadSeq);
+    xSemaphoreGive(traceMutex);
+}
+
+#endif
+
 static const char *HEX_DIGITS = "0123456789ABCDEF";
 
 /**
@@ -35,12 +35,23 @@ extern "C"
      * them and outputs them via the regular ESP-IDF logging mechanism.
      *
      * In order to activate the detailed logging, set the macro
-     * `LMIC_ENABLE_event_logging` to 1.
+     * `LMIC_ENABLE_event_logging` to 1 (done by the "LMIC event log" setting).
+     *
+     * With the "Binary trace" setting, the logging task doesn't format the
+     * messages but serializes them into a compact binary trace kept in RAM.
+     * It can be retrieved with ttn_trace_export().
      */
 
     void ttn_log_init(void);
     void ttn_log_event(int event, const char *message, uint32_t datum);
 
+#if defined(CONFIG_TTN_EVENT_LOG_TRACE)
+    size_t ttn_log_trace_size(void);
+    size_t ttn_log_trace_export(uint8_t *buffer, size_t length);
+    void ttn_log_trace_discard(const uint8_t *trace);
+    void ttn_log_trace_clear(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
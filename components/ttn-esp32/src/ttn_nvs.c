@@ -30,7 +30,7 @@
 
 static struct lmic_t tmp_LMIC;
 
-void ttn_nvs_save()
+bool ttn_nvs_save()
 {
     nvs_handle handle = 0;
     esp_err_t res = nvs_open(NVS_FLASH_PARTITION, NVS_READWRITE, &handle);
@@ -66,7 +66,9 @@ void ttn_nvs_save()
 done:
     nvs_close(handle);
 
-    ESP_ERROR_CHECK(res);
+    if (res != ESP_OK)
+        ESP_LOGW(TAG, "Saving LMIC state failed: %s", esp_err_to_name(res));
+    return res == ESP_OK;
 }
 
 bool ttn_nvs_restore(int off_duration)
@@ -88,6 +90,14 @@ bool ttn_nvs_restore(int off_duration)
     if (res != ESP_OK)
         goto done;
 
+    // state saved before the join completed has no session to resume
+    if (len1 != LMIC_DIST(radio, pendTxData) || tmp_LMIC.devaddr == 0 || (tmp_LMIC.opmode & OP_JOINING) != 0)
+    {
+        ESP_LOGW(TAG, "Saved LMIC state has no valid session");
+        res = ESP_ERR_INVALID_STATE;
+        goto done;
+    }
+
     memset(LMIC.pendTxData, 0, MAX_LEN_PAYLOAD);
 
     size_t len2 = LMIC_DIST(pendTxData, frame) - MAX_LEN_PAYLOAD;
@@ -95,6 +105,14 @@ bool ttn_nvs_restore(int off_duration)
     if (res != ESP_OK)
         goto done;
 
+    // a shorter blob is read without error, leaving the rest of the chunk stale
+    if (len2 != LMIC_DIST(pendTxData, frame) - MAX_LEN_PAYLOAD)
+    {
+        ESP_LOGW(TAG, "Saved LMIC state has the wrong layout");
+        res = ESP_ERR_INVALID_SIZE;
+        goto done;
+    }
+
     memset(LMIC.frame, 0, MAX_LEN_FRAME);
 
     size_t len3 = sizeof(struct lmic_t) - LMIC_OFFSET(frame) - MAX_LEN_FRAME;
@@ -102,6 +120,13 @@ bool ttn_nvs_restore(int off_duration)
     if (res != ESP_OK)
         goto done;
 
+    if (len3 != sizeof(struct lmic_t) - LMIC_OFFSET(frame) - MAX_LEN_FRAME)
+    {
+        ESP_LOGW(TAG, "Saved LMIC state has the wrong layout");
+        res = ESP_ERR_INVALID_SIZE;
+        goto done;
+    }
+
     // invalidate data
     res = nvs_erase_key(handle, NVS_FLASH_KEY_TIME);
     if (res != ESP_OK)
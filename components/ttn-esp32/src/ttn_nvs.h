@@ -20,7 +20,7 @@ extern "C"
 {
 #endif
 
-    void ttn_nvs_save();
+    bool ttn_nvs_save();
     bool ttn_nvs_restore(int off_duration);
 
 #ifdef __cplusplus
@@ -20,10 +20,37 @@
 #define TTN_RTC_MEM_SIZE (sizeof(struct lmic_t) - LMIC_OFFSET(radio) - MAX_LEN_PAYLOAD - MAX_LEN_FRAME)
 
 #define TTN_RTC_FLAG_VALUE 0xf30b84ce
+#define TTN_RTC_COUNTERS_MAGIC 0x5e9c0a71
+
+// Frame counters of the current session, saved after every uplink
+typedef struct
+{
+    uint32_t magic;
+    uint32_t devaddr;
+    uint32_t key_id; // first bytes of the network session key, tells sessions with the same address apart
+    uint32_t seqno_up;
+    uint32_t seqno_dn;
+    uint32_t check;
+} ttn_rtc_counters_t;
 
 RTC_DATA_ATTR uint8_t ttn_rtc_mem_buf[TTN_RTC_MEM_SIZE];
 RTC_DATA_ATTR uint32_t ttn_rtc_flag;
 
+// Unlike RTC_DATA_ATTR, not reinitialized on boot: survives software, panic and watchdog resets
+RTC_NOINIT_ATTR static ttn_rtc_counters_t ttn_rtc_counters;
+
+static uint32_t session_key_id(void)
+{
+    uint32_t key_id;
+    memcpy(&key_id, LMIC.nwkKey, sizeof(key_id));
+    return key_id;
+}
+
+static uint32_t counters_check(const ttn_rtc_counters_t *counters)
+{
+    return ~(counters->magic ^ counters->devaddr ^ counters->key_id ^ counters->seqno_up ^ counters->seqno_dn);
+}
+
 void ttn_rtc_save()
 {
     // Copy LMIC struct except client, osjob, pendTxData and frame
@@ -56,3 +83,33 @@ bool ttn_rtc_restore()
 
     return true;
 }
+
+void ttn_rtc_save_counters()
+{
+    ttn_rtc_counters_t counters = {
+        .magic = TTN_RTC_COUNTERS_MAGIC,
+        .devaddr = LMIC.devaddr,
+        .key_id = session_key_id(),
+        .seqno_up = LMIC.seqnoUp,
+        .seqno_dn = LMIC.seqnoDn,
+    };
+    counters.check = counters_check(&counters);
+    ttn_rtc_counters = counters;
+}
+
+bool ttn_rtc_restore_counters()
+{
+    ttn_rtc_counters_t counters = ttn_rtc_counters;
+    if (counters.magic != TTN_RTC_COUNTERS_MAGIC || counters.check != counters_check(&counters))
+        return false;
+
+    // only the session restored from NVS may be continued
+    if (counters.devaddr != LMIC.devaddr || counters.key_id != session_key_id())
+        return false;
+
+    if (counters.seqno_up > LMIC.seqnoUp)
+        LMIC.seqnoUp = counters.seqno_up;
+    if (counters.seqno_dn > LMIC.seqnoDn)
+        LMIC.seqnoDn = counters.seqno_dn;
+    return true;
+}
@@ -22,6 +22,8 @@ extern "C"
 
     void ttn_rtc_save();
     bool ttn_rtc_restore();
+    void ttn_rtc_save_counters();
+    bool ttn_rtc_restore_counters();
 
 #ifdef __cplusplus
 }
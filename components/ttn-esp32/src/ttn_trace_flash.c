@@ -0,0 +1,237 @@
+/*******************************************************************************
+ *
+ * ttn-esp32 - The Things Network device library for ESP-IDF / SX127x
+ *
+ * Copyright (c) 2018-2021 Manuel Bleichenbacher
+ *
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Flash ring for the binary LMIC event trace.
+ *******************************************************************************/
+
+#include "esp_partition.h"
+
+#if defined(CONFIG_TTN_TRACE_FLASH)
+
+#include "ttn_trace_flash.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "ttn_trace"
+#define SECTOR_SIZE 4096
+#define SECTOR_MAGIC "LMTS"
+#define SECTOR_HEADER_LEN 8
+#define NO_SEQ 0xffffffff
+
+typedef struct
+{
+    uint32_t first; // sequence number of the first record, NO_SEQ if erased or invalid
+    uint16_t count;
+    uint16_t bytes;
+} TraceSector;
+
+static const esp_partition_t *partition;
+static TraceSector *sectors;
+static size_t numSectors;
+static size_t current;       // sector being written
+static uint32_t nextSeq;     // sequence number of the next record appended
+static uint32_t releasedSeq; // records before this one have been discarded
+
+static uint32_t getU4(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Reads the header and walks the records of a sector
+static void scanSector(size_t index, uint8_t *buf)
+{
+    TraceSector *sector = &sectors[index];
+    sector->first = NO_SEQ;
+    sector->count = 0;
+    sector->bytes = 0;
+
+    if (esp_partition_read(partition, index * SECTOR_SIZE, buf, SECTOR_SIZE) != ESP_OK ||
+        memcmp(buf, SECTOR_MAGIC, 4) != 0)
+        return;
+
+    sector->first = getU4(buf + 4);
+    size_t offset = SECTOR_HEADER_LEN;
+    while (offset < SECTOR_SIZE)
+    {
+        // erased flash reads 0xff; a record is at least its length and type
+        uint8_t len = buf[offset];
+        if (len < 2 || len == 0xff || offset + len > SECTOR_SIZE)
+            break;
+        offset += len;
+        sector->count++;
+    }
+    sector->bytes = offset - SECTOR_HEADER_LEN;
+}
+
+bool ttn_trace_flash_init(void)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         CONFIG_TTN_TRACE_FLASH_PARTITION);
+    if (partition == NULL)
+    {
+        ESP_LOGW(TAG, "No \"%s\" partition, trace kept in RAM only", CONFIG_TTN_TRACE_FLASH_PARTITION);
+        return false;
+    }
+
+    numSectors = partition->size / SECTOR_SIZE;
+    uint8_t *buf = malloc(SECTOR_SIZE);
+    free(sectors);
+    sectors = calloc(numSectors, sizeof(TraceSector));
+    if (numSectors < 2 || buf == NULL || sectors == NULL)
+    {
+        ESP_LOGE(TAG, "Trace partition too small or out of memory");
+        free(buf);
+        partition = NULL;
+        numSectors = 0;
+        return false;
+    }
+
+    // the sector being written is the one with the newest records; if there is none, start at sector 0
+    current = numSectors - 1;
+    bool found = false;
+    for (size_t i = 0; i < numSectors; i++)
+    {
+        scanSector(i, buf);
+        if (sectors[i].first != NO_SEQ && (!found || sectors[i].first > sectors[current].first))
+        {
+            current = i;
+            found = true;
+        }
+    }
+    free(buf);
+
+    nextSeq = found ? sectors[current].first + sectors[current].count : 0;
+    releasedSeq = 0;
+    ESP_LOGI(TAG, "Trace partition: %u sectors, next record %u", (unsigned)numSectors, (unsigned)nextSeq);
+    return true;
+}
+
+uint32_t ttn_trace_flash_next_seq(void)
+{
+    return nextSeq;
+}
+
+// Erases the sector after the current one (dropping its records) and starts it at seq
+static bool startSector(uint32_t seq)
+{
+    size_t next = (current + 1) % numSectors;
+    sectors[next].first = NO_SEQ;
+    if (esp_partition_erase_range(partition, next * SECTOR_SIZE, SECTOR_SIZE) != ESP_OK)
+        return false;
+
+    uint8_t header[SECTOR_HEADER_LEN];
+    memcpy(header, SECTOR_MAGIC, 4);
+    header[4] = seq;
+    header[5] = seq >> 8;
+    header[6] = seq >> 16;
+    header[7] = seq >> 24;
+    if (esp_partition_write(partition, next * SECTOR_SIZE, header, sizeof(header)) != ESP_OK)
+        return false;
+
+    sectors[next].first = seq;
+    sectors[next].count = 0;
+    sectors[next].bytes = 0;
+    current = next;
+    return true;
+}
+
+bool ttn_trace_flash_append(const uint8_t *record, uint32_t seq)
+{
+    if (partition == NULL)
+        return false;
+
+    uint8_t len = record[0];
+    TraceSector *sector = &sectors[current];
+    if (sector->first == NO_SEQ || seq != nextSeq || SECTOR_HEADER_LEN + sector->bytes + len > SECTOR_SIZE)
+    {
+        if (!startSector(seq))
+            return false;
+        sector = &sectors[current];
+    }
+
+    if (esp_partition_write(partition, current * SECTOR_SIZE + SECTOR_HEADER_LEN + sector->bytes, record, len) != ESP_OK)
+        return false;
+
+    sector->count++;
+    sector->bytes += len;
+    nextSeq = seq + 1;
+    return true;
+}
+
+size_t ttn_trace_flash_size(void)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < numSectors; i++)
+    {
+        if (sectors[i].first != NO_SEQ && sectors[i].first + sectors[i].count > releasedSeq)
+            size += sectors[i].bytes;
+    }
+    return size;
+}
+
+size_t ttn_trace_flash_export(uint8_t *buffer, size_t length, uint32_t *first, uint16_t *count)
+{
+    size_t used = 0;
+    uint16_t copied = 0;
+    uint32_t expected = NO_SEQ;
+
+    // oldest sector first: the one after the current sector
+    for (size_t k = 1; k <= numSectors; k++)
+    {
+        const TraceSector *sector = &sectors[(current + k) % numSectors];
+        if (sector->first == NO_SEQ || sector->first + sector->count <= releasedSeq)
+            continue;
+
+        size_t offset = ((current + k) % numSectors) * SECTOR_SIZE + SECTOR_HEADER_LEN;
+        size_t end = offset + sector->bytes;
+        for (uint32_t seq = sector->first; offset < end; seq++)
+        {
+            uint8_t len;
+            if (esp_partition_read(partition, offset, &len, 1) != ESP_OK)
+                goto done;
+            if (seq >= releasedSeq)
+            {
+                if ((expected != NO_SEQ && seq != expected) || used + len > length || copied == UINT16_MAX)
+                    goto done;
+                if (esp_partition_read(partition, offset, buffer + used, len) != ESP_OK)
+                    goto done;
+                if (copied == 0)
+                    *first = seq;
+                used += len;
+                copied++;
+                expected = seq + 1;
+            }
+            offset += len;
+        }
+    }
+
+done:
+    *count = copied;
+    return used;
+}
+
+void ttn_trace_flash_discard(uint32_t end)
+{
+    if (partition == NULL)
+        return;
+
+    for (size_t i = 0; i < numSectors; i++)
+    {
+        TraceSector *sector = &sectors[i];
+        if (i == current || sector->first == NO_SEQ || sector->first + sector->count > end)
+            continue;
+        if (esp_partition_erase_range(partition, i * SECTOR_SIZE, SECTOR_SIZE) == ESP_OK)
+            sector->first = NO_SEQ;
+    }
+    if (end > releasedSeq)
+        releasedSeq = end;
+}
+
+#endif
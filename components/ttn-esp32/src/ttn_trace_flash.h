@@ -0,0 +1,89 @@
+/*******************************************************************************
+ *
+ * ttn-esp32 - The Things Network device library for ESP-IDF / SX127x
+ *
+ * Copyright (c) 2018-2021 Manuel Bleichenbacher
+ *
+ * Licensed under MIT License
+ * https://opensource.org/licenses/MIT
+ *
+ * Flash ring for the binary LMIC event trace.
+ *******************************************************************************/
+
+#ifndef TTN_TRACE_FLASH_H
+#define TTN_TRACE_FLASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Flash ring for the binary trace.
+     *
+     * Keeps trace records in a data partition so they survive resets and
+     * power loss. The partition is used as a ring of 4 KB sectors; each
+     * sector starts with a header holding the sequence number of its first
+     * record, followed by the records back to back (the first byte of a
+     * record is its length). When the ring is full, the oldest sector is
+     * erased.
+     *
+     * Records are numbered; the numbering continues across resets. Records
+     * are appended in order; a gap in the numbering starts a new sector.
+     *
+     * The functions are not thread-safe, the logging code serializes them.
+     */
+
+    /**
+     * @brief Finds the partition and the newest record in it.
+     * @return true if the partition is usable
+     */
+    bool ttn_trace_flash_init(void);
+
+    /**
+     * @brief Sequence number the next record will get.
+     */
+    uint32_t ttn_trace_flash_next_seq(void);
+
+    /**
+     * @brief Appends a record, erasing the oldest sector if needed.
+     * @param record record, its first byte is its length
+     * @param seq sequence number of the record
+     * @return true if written
+     */
+    bool ttn_trace_flash_append(const uint8_t *record, uint32_t seq);
+
+    /**
+     * @brief Number of bytes of the records not discarded yet.
+     *
+     * An upper bound: the discarded records of a partly discarded sector are counted.
+     */
+    size_t ttn_trace_flash_size(void);
+
+    /**
+     * @brief Copies consecutive records, oldest first, up to the first gap or the end of the buffer.
+     * @param buffer buffer receiving the records
+     * @param length length of the buffer (in bytes)
+     * @param first receives the sequence number of the first record copied
+     * @param count receives the number of records copied
+     * @return number of bytes written
+     */
+    size_t ttn_trace_flash_export(uint8_t *buffer, size_t length, uint32_t *first, uint16_t *count);
+
+    /**
+     * @brief Discards the records numbered before end.
+     *
+     * Sectors holding only discarded records are erased. The discarded records of
+     * the sector being written are skipped until the next reset.
+     */
+    void ttn_trace_flash_discard(uint32_t end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+/* Throughput benchmark for the LMIC AES backends (os_aes)
+ *
+ *   aes_bench_<backend> [rounds]
+ * Runs the AES work LMIC does per frame, with the key copied into AESkey before every call as LMIC does:
+ * payload CTR under the AppSKey, then the MIC over B0 and the frame under the NwkSKey, so the backend
+ * alternates between two keys. Sizes are the MaxBox compact and full telemetry uplinks, the largest EU868
+ * SF12 payload and the largest payload overall; plus the join accept decryption (AES_ENC, 16 and 32 bytes).
+ * Host numbers: compare the backends with each other, not with the ESP32-S3.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oslmic.h"
+
+#define FRAME_OVERHEAD  13  // MHDR, FHDR without options, FPort; the MIC itself is not covered
+
+static const u1_t s_app_skey[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+};
+static const u1_t s_nwk_skey[16] = {
+    0xa5, 0x5a, 0x01, 0x10, 0x77, 0x3c, 0xc3, 0x99, 0x42, 0x24, 0x18, 0x81, 0x6e, 0xe6, 0x0f, 0xf0,
+};
+
+static volatile u4_t s_sink;
+
+u4_t os_rmsbf4(xref2cu1_t buf)
+{
+    return ((u4_t)buf[0] << 24) | ((u4_t)buf[1] << 16) | ((u4_t)buf[2] << 8) | buf[3];
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void block(u1_t *b, u1_t type, u1_t last)
+{
+    memset(b, 0, 16);
+    b[0] = type;
+    b[6] = 0x78;
+    b[10] = 0x2a;
+    b[15] = last;
+}
+
+// CTR over the payload, then the MIC over the frame; returns ns per frame
+static double bench_frame(u2_t payload_len, long rounds)
+{
+    u1_t frame[FRAME_OVERHEAD + 256] = {0};
+    u2_t frame_len = FRAME_OVERHEAD + payload_len;
+
+    double t0 = now_s();
+    for (long r = 0; r < rounds; r++) {
+        frame[FRAME_OVERHEAD - 1] = (u1_t)r;
+
+        memcpy(AESkey, s_app_skey, 16);
+        block(AESaux, 0x01, 1);
+        os_aes(AES_CTR, frame + FRAME_OVERHEAD, payload_len);
+
+        memcpy(AESkey, s_nwk_skey, 16);
+        block(AESaux, 0x49, (u1_t)frame_len);
+        s_sink += os_aes(AES_MIC, frame, frame_len);
+    }
+    return (now_s() - t0) * 1e9 / rounds;
+}
+
+static double bench_mic(u2_t len, long rounds)
+{
+    u1_t frame[256] = {0};
+
+    double t0 = now_s();
+    for (long r = 0; r < rounds; r++) {
+        frame[0] = (u1_t)r;
+        memcpy(AESkey, s_nwk_skey, 16);
+        block(AESaux, 0x49, (u1_t)len);
+        s_sink += os_aes(AES_MIC, frame, len);
+    }
+    return (now_s() - t0) * 1e9 / rounds;
+}
+
+static double bench_ctr(u2_t len, long rounds)
+{
+    u1_t payload[256] = {0};
+
+    double t0 = now_s();
+    for (long r = 0; r < rounds; r++) {
+        memcpy(AESkey, s_app_skey, 16);
+        block(AESaux, 0x01, 1);
+        os_aes(AES_CTR, payload, len);
+    }
+    s_sink += payload[0];
+    return (now_s() - t0) * 1e9 / rounds;
+}
+
+static double bench_enc(u2_t len, long rounds)
+{
+    u1_t accept[32] = {0};
+
+    double t0 = now_s();
+    for (long r = 0; r < rounds; r++) {
+        memcpy(AESkey, s_app_skey, 16);
+        os_aes(AES_ENC, accept, len);
+    }
+    s_sink += accept[0];
+    return (now_s() - t0) * 1e9 / rounds;
+}
+
+int main(int argc, char **argv)
+{
+    long rounds = argc > 1 ? atol(argv[1]) : 200000;
+    static const u2_t payloads[] = {9, 18, 51, 222};
+
+    printf("aes_bench (%s): %ld rounds\n", AES_BACKEND_NAME, rounds);
+    printf("  payload   frame ns    MIC ns    CTR ns\n");
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+        u2_t len = payloads[i];
+        printf("  %7u %10.0f %9.0f %9.0f\n", len, bench_frame(len, rounds),
+               bench_mic(FRAME_OVERHEAD + len, rounds), bench_ctr(len, rounds));
+    }
+    printf("  join accept: %.0f ns (16 bytes), %.0f ns (32 bytes)\n", bench_enc(16, rounds), bench_enc(32, rounds));
+    return 0;
+}
@@ -0,0 +1,183 @@
+/* Known-answer tests for the LMIC AES backends (os_aes)
+ *
+ * Built once per backend, see CMakeLists.txt. CMAC against the RFC 4493 vectors, including after the key
+ * schedule and subkey caches have been evicted by other keys; ECB against FIPS-197; CTR and the MIC with a
+ * prepended B0 block against the backend's own ECB.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "oslmic.h"
+#include "shim_check.h"
+
+// RFC 4493 section 4; not the empty message, which neither backend handles and LoRaWAN never has
+static const u1_t s_rfc_key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+};
+static const u1_t s_rfc_message[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+};
+static const struct {
+    u2_t len;
+    u4_t mic;                       // first four bytes of the tag; LoRaWAN only sends those
+} s_rfc_vectors[] = {
+    {16, 0x070a16b4},
+    {40, 0xdfa66747},
+    {64, 0x51f0bebf},
+};
+
+// FIPS-197 appendix C.1
+static const u1_t s_fips_key[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+static const u1_t s_fips_plain[16] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+};
+static const u1_t s_fips_cipher[16] = {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a,
+};
+
+static const u1_t s_other_key[16] = {
+    0xa5, 0x5a, 0x01, 0x10, 0x77, 0x3c, 0xc3, 0x99, 0x42, 0x24, 0x18, 0x81, 0x6e, 0xe6, 0x0f, 0xf0,
+};
+
+u4_t os_rmsbf4(xref2cu1_t buf)
+{
+    return ((u4_t)buf[0] << 24) | ((u4_t)buf[1] << 16) | ((u4_t)buf[2] << 8) | buf[3];
+}
+
+// LMIC copies the key into AESkey before every call, and the original backend expands it there in place
+static void load_key(const u1_t *key)
+{
+    memcpy(AESkey, key, 16);
+}
+
+static u4_t mic(const u1_t *key, const u1_t *message, u2_t len)
+{
+    u1_t buf[256];
+    memcpy(buf, message, len);
+    load_key(key);
+    return os_aes(AES_MIC | AES_MICNOAUX, buf, len);
+}
+
+static void ecb(const u1_t *key, u1_t *block)
+{
+    load_key(key);
+    os_aes(AES_ENC, block, 16);
+}
+
+// LoRaWAN A/B0 block: direction, device address, frame counter, last byte is the block index or length
+static void lorawan_block(u1_t *block, u1_t type, u1_t last)
+{
+    static const u1_t header[16] = {0, 0, 0, 0, 0, 0, 0x78, 0x56, 0x34, 0x12, 0x2a, 0x00, 0x00, 0x00, 0, 0};
+    memcpy(block, header, 16);
+    block[0] = type;
+    block[15] = last;
+}
+
+static void test_cmac_rfc4493(void)
+{
+    // Twice: the second round runs from the cached key schedule and subkeys
+    for (int round = 0; round < 2; round++) {
+        for (size_t i = 0; i < sizeof(s_rfc_vectors) / sizeof(s_rfc_vectors[0]); i++) {
+            CHECK(mic(s_rfc_key, s_rfc_message, s_rfc_vectors[i].len) == s_rfc_vectors[i].mic);
+        }
+    }
+}
+
+static void test_cmac_key_switch(void)
+{
+    // Two other keys push the RFC key out of both two-entry caches
+    for (int round = 0; round < 3; round++) {
+        mic(s_fips_key, s_rfc_message, 40);
+        mic(s_other_key, s_rfc_message, 40);
+        CHECK(mic(s_rfc_key, s_rfc_message, 40) == 0xdfa66747);
+        CHECK(mic(s_rfc_key, s_rfc_message, 16) == 0x070a16b4);
+    }
+}
+
+static void test_ecb_fips197(void)
+{
+    u1_t blocks[32];
+    memcpy(blocks, s_fips_plain, 16);
+    memcpy(blocks + 16, s_fips_plain, 16);
+
+    load_key(s_fips_key);
+    os_aes(AES_ENC, blocks, sizeof(blocks));
+    CHECK(!memcmp(blocks, s_fips_cipher, 16));
+    CHECK(!memcmp(blocks + 16, s_fips_cipher, 16));
+
+    // And again after another key has been used
+    mic(s_other_key, s_rfc_message, 16);
+    memcpy(blocks, s_fips_plain, 16);
+    ecb(s_fips_key, blocks);
+    CHECK(!memcmp(blocks, s_fips_cipher, 16));
+}
+
+static void test_ctr(void)
+{
+    static const u2_t lengths[] = {1, 9, 16, 18, 51, 128, 222};
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        u2_t len = lengths[l];
+        u1_t plain[256], buf[256], expected[256];
+        for (int i = 0; i < len; i++) {
+            plain[i] = (u1_t)(i * 7 + len);
+        }
+
+        // Payload XOR E(A_i), i counting from 1
+        for (int i = 0; i < len; i += 16) {
+            u1_t a[16];
+            lorawan_block(a, 0x01, (u1_t)(i / 16 + 1));
+            ecb(s_other_key, a);
+            for (int j = 0; j < 16 && i + j < len; j++) {
+                expected[i + j] = plain[i + j] ^ a[j];
+            }
+        }
+
+        memcpy(buf, plain, len);
+        load_key(s_other_key);
+        lorawan_block(AESaux, 0x01, 1);
+        os_aes(AES_CTR, buf, len);
+        CHECK(!memcmp(buf, expected, len));
+
+        load_key(s_other_key);
+        lorawan_block(AESaux, 0x01, 1);
+        os_aes(AES_CTR, buf, len);
+        CHECK(!memcmp(buf, plain, len));
+    }
+}
+
+static void test_mic_with_b0(void)
+{
+    // AES_MIC without AES_MICNOAUX prepends AESaux: the same as a MIC over B0 || message
+    u1_t message[16 + 40];
+    lorawan_block(message, 0x49, 40);
+    memcpy(message + 16, s_rfc_message, 40);
+    u4_t expected = mic(s_rfc_key, message, sizeof(message));
+
+    u1_t buf[40];
+    memcpy(buf, s_rfc_message, 40);
+    load_key(s_rfc_key);
+    lorawan_block(AESaux, 0x49, 40);
+    CHECK(os_aes(AES_MIC, buf, 40) == expected);
+}
+
+int main(void)
+{
+    test_cmac_rfc4493();
+    test_cmac_key_switch();
+    test_ecb_fips197();
+    test_ctr();
+    test_mic_with_b0();
+
+    if (s_failures) {
+        printf("%d check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("aes_test (%s): all tests passed\n", AES_BACKEND_NAME);
+    return 0;
+}
@@ -0,0 +1,29 @@
+/* Host stand-in for mbedTLS AES, on OpenSSL's block cipher
+ *
+ * Only what components/ttn-esp32/src/aes/mbedtls_aes.c uses. On the host OpenSSL uses AES-NI, as close as the host
+ * gets to the ESP32-S3's AES peripheral; the numbers say how much the backend's caching saves, not the hardware.
+*/
+#pragma once
+
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/aes.h>
+
+#define MBEDTLS_AES_ENCRYPT 1
+
+typedef AES_KEY mbedtls_aes_context;
+
+static inline void mbedtls_aes_init(mbedtls_aes_context *ctx)
+{
+}
+
+static inline int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+    return AES_set_encrypt_key(key, keybits, ctx);
+}
+
+static inline int mbedtls_aes_crypt_ecb(mbedtls_aes_context *ctx, int mode, const unsigned char input[16],
+                                        unsigned char output[16])
+{
+    AES_encrypt(input, output, ctx);
+    return 0;
+}
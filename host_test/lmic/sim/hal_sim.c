@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lmic.h"
+#include "hal_sim.h"
+#include "sx127x_sim.h"
+
+#define JOB_LATENCY_TICKS       1       // a due job runs this long after its deadline
+#define SPI_TRANSACTION_US      8       // a register access at 10 MHz, with chip select and driver overhead
+
+// os_init() refers to the pin table; the simulator calls os_init_ex(NULL) as ttn.c does
+struct lmic_pinmap {
+    uint8_t unused;
+};
+const struct lmic_pinmap lmic_pins;
+
+static int64_t s_now_us;
+static int64_t s_alarm_us = -1;
+static int64_t s_deadline_us = INT64_MAX;
+static int32_t s_drift_ppm;
+static int32_t s_irq_latency_us = 20;
+static uint32_t s_spi_transactions;
+static hal_failure_handler_t *s_failure_handler;
+
+int64_t hal_sim_now_us(void)
+{
+    return s_now_us;
+}
+
+void hal_sim_set_deadline_us(int64_t deadline_us)
+{
+    s_deadline_us = deadline_us;
+}
+
+void hal_sim_set_drift_ppm(int32_t ppm)
+{
+    s_drift_ppm = ppm;
+}
+
+void hal_sim_set_irq_latency_us(int32_t latency_us)
+{
+    s_irq_latency_us = latency_us;
+}
+
+uint32_t hal_sim_spi_transactions(void)
+{
+    return s_spi_transactions;
+}
+
+// The device's clock in microseconds, and back. Drift is applied to the whole run, so a change mid-run jumps.
+static int64_t device_us(int64_t true_us)
+{
+    return true_us + true_us * s_drift_ppm / 1000000;
+}
+
+// Rounded up, so the device clock has reached dev_us by then
+static int64_t true_us(int64_t dev_us)
+{
+    int64_t scale = 1000000 + s_drift_ppm;
+    return (dev_us * 1000000 + scale - 1) / scale;
+}
+
+// A 32-bit LMIC time to true time, assuming it is within 2^31 ticks of now
+static int64_t os_time_to_true_us(u4_t os_time)
+{
+    int64_t now_ticks = device_us(s_now_us) >> 4;
+    int32_t diff = (int32_t)(os_time - (u4_t)now_ticks);
+    return true_us((now_ticks + diff) << 4);
+}
+
+static void advance_to(int64_t t_us)
+{
+    if (t_us > s_now_us) {
+        s_now_us = t_us;
+    }
+}
+
+// Hand a DIO edge that has happened by now to LMIC, as the ESP32 HAL's ISR and background task would
+static bool deliver_irq(void)
+{
+    int64_t at_us;
+    int dio = sx127x_sim_take_irq(s_now_us, &at_us);
+    if (dio < 0) {
+        return false;
+    }
+    advance_to(at_us + s_irq_latency_us);
+    radio_irq_handler_v2((u1_t)dio, (ostime_t)(device_us(at_us) >> 4));
+    return true;
+}
+
+void hal_init(void)
+{
+    hal_init_ex(NULL);
+}
+
+void hal_init_ex(const void *pContext)
+{
+    (void)pContext;
+    sx127x_sim_reset();
+}
+
+void hal_pin_rxtx(u1_t val)
+{
+    (void)val;
+}
+
+void hal_pin_rst(u1_t val)
+{
+    // SX1276: low is reset
+    if (val == 0) {
+        sx127x_sim_reset();
+    }
+}
+
+void hal_spi_write(u1_t cmd, const u1_t *buf, size_t len)
+{
+    s_spi_transactions++;
+    sx127x_sim_write(cmd & 0x7F, buf, len, s_now_us);
+    s_now_us += SPI_TRANSACTION_US;
+}
+
+void hal_spi_read(u1_t cmd, u1_t *buf, size_t len)
+{
+    s_spi_transactions++;
+    sx127x_sim_read(cmd & 0x7F, buf, len, s_now_us);
+    s_now_us += SPI_TRANSACTION_US;
+}
+
+void hal_disableIRQs(void)
+{
+}
+
+void hal_enableIRQs(void)
+{
+}
+
+uint8_t hal_getIrqLevel(void)
+{
+    return 0;
+}
+
+u4_t hal_ticks(void)
+{
+    return (u4_t)(device_us(s_now_us) >> 4);
+}
+
+u4_t hal_waitUntil(u4_t time)
+{
+    advance_to(os_time_to_true_us(time));
+    u4_t diff = hal_ticks() - time;
+    return diff < 0x80000000U ? diff : 0;
+}
+
+u1_t hal_checkTimer(u4_t time)
+{
+    int64_t t_us = os_time_to_true_us(time);
+    if (t_us - s_now_us < 100) {
+        // Due within the ESP32 HAL's margin: run it now, but after its time, or a job that compares the clock
+        // with its deadline and reschedules itself would spin on a clock that only moves when LMIC sleeps
+        advance_to(os_time_to_true_us(time + JOB_LATENCY_TICKS));
+        s_alarm_us = -1;
+        return 1;
+    }
+    s_alarm_us = t_us;
+    return 0;
+}
+
+void hal_sleep(void)
+{
+    if (deliver_irq()) {
+        return;
+    }
+
+    int64_t wake_us = s_deadline_us;
+    if (s_alarm_us >= 0 && s_alarm_us < wake_us) {
+        wake_us = s_alarm_us;
+    }
+    int64_t irq_us = sx127x_sim_next_irq_us();
+    if (irq_us >= 0 && irq_us < wake_us) {
+        wake_us = irq_us;
+    }
+    advance_to(wake_us);
+    if (s_alarm_us >= 0 && s_alarm_us <= s_now_us) {
+        s_alarm_us = -1;
+    }
+    deliver_irq();
+}
+
+void hal_pollPendingIRQs_helper(void)
+{
+    deliver_irq();
+}
+
+void hal_processPendingIRQs(void)
+{
+    deliver_irq();
+}
+
+void hal_set_failure_handler(hal_failure_handler_t *const handler)
+{
+    s_failure_handler = handler;
+}
+
+void hal_failed(const char *file, u2_t line)
+{
+    if (s_failure_handler) {
+        s_failure_handler(file, line);
+    }
+    fprintf(stderr, "LMIC failed at %s:%u (t=%lld us)\n", file, line, (long long)s_now_us);
+    exit(2);
+}
+
+s1_t hal_getRssiCal(void)
+{
+    return 10;
+}
+
+ostime_t hal_setModuleActive(bit_t val)
+{
+    (void)val;
+    return 0;
+}
+
+bit_t hal_queryUsingTcxo(void)
+{
+    return 0;
+}
+
+uint8_t hal_getTxPowerPolicy(u1_t inputPolicy, s1_t requestedPower, u4_t frequency)
+{
+    (void)inputPolicy;
+    (void)requestedPower;
+    (void)frequency;
+    return LMICHAL_radio_tx_power_policy_paboost;
+}
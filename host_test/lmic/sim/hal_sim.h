@@ -0,0 +1,35 @@
+/* Linux HAL for LMIC on simulated time
+ *
+ * Implements hal.h against the virtual SX1276 instead of SPI and GPIO. Nothing waits: hal_waitUntil() moves
+ * the clock forward, hal_sleep() jumps to the earliest of the LMIC timer, the next DIO edge and the deadline set
+ * by the scenario runner, and DIO edges are handed to radio_irq_handler_v2() with the tick they happened at, as
+ * the ESP32 HAL's ISR captures it. The device clock can run fast or slow against true (network) time.
+*/
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief True time in microseconds
+ */
+int64_t hal_sim_now_us(void);
+
+/**
+ * @brief hal_sleep() returns no later than this, so the runner gets control back
+ */
+void hal_sim_set_deadline_us(int64_t deadline_us);
+
+/**
+ * @brief Device clock error against true time, in ppm; positive runs fast
+ */
+void hal_sim_set_drift_ppm(int32_t ppm);
+
+/**
+ * @brief Delay from a DIO edge to the handler running; the timestamp passed is still the edge's
+ */
+void hal_sim_set_irq_latency_us(int32_t latency_us);
+
+/**
+ * @brief SPI transactions since start
+ */
+uint32_t hal_sim_spi_transactions(void);
@@ -0,0 +1,470 @@
+/* LMIC simulator: the ttn-esp32 LMIC on a Linux HAL, a virtual SX1276 and a scripted network server
+ *
+ *   lmic_sim <scenario.sim>
+ * Runs a scenario on simulated time, so an hour of joins and uplinks takes milliseconds and every run is the
+ * same. One command per line, '#' starts a comment:
+ *   join [timeout_s]                       start OTAA and run until EV_JOINED
+ *   rejoin [timeout_s]                     as ttn_rejoin(): LMIC_unjoin(), then join
+ *   rejoin_after <n>                       rejoin after n uplinks in a row without a downlink or link check
+ *                                          answer, as lorawan_adr.c does; 0 (the default) never
+ *   uplink <port> <len> [confirmed]        once LMIC is ready, queue an uplink and run until EV_TXCOMPLETE
+ *   linkcheck                              piggyback a LinkCheckReq on the next uplink
+ *   idle <s>                               let LMIC run for a while
+ *   dr <dr> | adr on|off                   data rate, ADR
+ *   clock_error <percent>                  LMIC_setClockError(), widens the RX windows
+ *   drift <ppm> | irq_latency <us>         device crystal error, DIO edge to handler delay
+ *   net downlink <port> <hex> [confirmed]  queue a downlink for the next uplink
+ *   net mac linkadr <dr> <txpow> [chmask] | devstatus | rxtiming <s> | dutycycle <n>
+ *   net drop <n> | rx2 on|off | snr <dB>   lose uplinks, answer in RX2, link quality
+ *   expect joined | ack | no_ack | downlink <port> <hex> | no_downlink | link_check <gateways> <margin>
+ *   expect mac_answer <cid> [status] | dr <dr> | txpow <dBm> | rx_delay <s> | uplinks <n> | fcnt_up <n>
+ *   expect joins <n> | rejoins <n>
+ *   expect rx_hits <n> | rx_missed <n> | hit_rate <percent>
+ *   repeat <n> <command ...>               run a command n times
+ *   report
+ * At the end (and on report) prints RX window hits and misses, how far from the downlink's preamble the windows
+ * opened, and the CPU time and SPI transactions LMIC spent per frame (join or uplink, radio model included,
+ * network server not). Exit status 1 if an expectation failed, 2 if LMIC asserted.
+*/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lmic.h"
+#include "hal_sim.h"
+#include "netserver_sim.h"
+#include "sx127x_sim.h"
+
+#define MAX_ARGS                8
+#define DEFAULT_TIMEOUT_S       3600
+#define DEFAULT_TX_POWER        14
+
+static const u1_t s_app_eui[8] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x70};
+static const u1_t s_dev_eui[8] = {0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01};
+static const u1_t s_app_key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+};
+
+static const char *s_file;
+static int s_line;
+static int s_failures;
+
+static bool s_joined;
+static bool s_tx_complete;
+static uint8_t s_txrx_flags;
+static uint8_t s_rx_port;
+static uint8_t s_rx_data[256];
+static size_t s_rx_len;
+static uint32_t s_rx_frames;            // downlinks that reached the application
+static int s_rejoin_after;
+static int s_silent_uplinks;            // since the last downlink or link check answer
+static uint32_t s_rejoins;
+
+static struct {
+    uint32_t count;
+    int64_t cpu_ns_sum;
+    int64_t cpu_ns_max;
+    uint32_t spi_sum;
+} s_frames;
+static double s_wall_start_s;
+
+void os_getArtEui(u1_t *buf)
+{
+    memcpy(buf, s_app_eui, 8);
+}
+
+void os_getDevEui(u1_t *buf)
+{
+    memcpy(buf, s_dev_eui, 8);
+}
+
+void os_getDevKey(u1_t *buf)
+{
+    memcpy(buf, s_app_key, 16);
+}
+
+static void event_callback(void *user_data, ev_t event)
+{
+    (void)user_data;
+    switch (event) {
+    case EV_JOINED:
+        s_joined = true;
+        break;
+    case EV_TXCOMPLETE:
+        s_tx_complete = true;
+        s_txrx_flags = LMIC.txrxFlags;
+        s_rx_len = LMIC.dataLen;
+        s_rx_port = (LMIC.txrxFlags & TXRX_PORT) ? LMIC.frame[LMIC.dataBeg - 1] : 0;
+        memcpy(s_rx_data, LMIC.frame + LMIC.dataBeg, LMIC.dataLen);
+        s_rx_frames += (LMIC.txrxFlags & (TXRX_DNW1 | TXRX_DNW2)) != 0;
+        break;
+    default:
+        break;
+    }
+}
+
+static double wall_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool joined(void)
+{
+    return s_joined;
+}
+
+static bool tx_complete(void)
+{
+    return s_tx_complete;
+}
+
+static bool tx_ready(void)
+{
+    return LMIC_queryTxReady();
+}
+
+// Run LMIC until done() (if given) or for duration_s, passing what the device sends to the network server.
+// Returns the CPU time spent in LMIC.
+static int64_t run(bool (*done)(void), int64_t duration_s)
+{
+    int64_t limit_us = hal_sim_now_us() + duration_s * 1000000;
+    int64_t spent_ns = 0;
+
+    hal_sim_set_deadline_us(limit_us);
+    while (!(done && done()) && hal_sim_now_us() < limit_us) {
+        int64_t t0 = cpu_ns();
+        os_runloop_once();
+        spent_ns += cpu_ns() - t0;
+
+        sim_packet_t packet;
+        while (sx127x_sim_take_uplink(&packet)) {
+            netserver_uplink(&packet);
+        }
+    }
+    return spent_ns;
+}
+
+static bool run_frame(bool (*done)(void), int64_t timeout_s)
+{
+    uint32_t spi = hal_sim_spi_transactions();
+    int64_t spent_ns = run(done, timeout_s);
+
+    s_frames.count++;
+    s_frames.cpu_ns_sum += spent_ns;
+    if (spent_ns > s_frames.cpu_ns_max) {
+        s_frames.cpu_ns_max = spent_ns;
+    }
+    s_frames.spi_sum += hal_sim_spi_transactions() - spi;
+    return done();
+}
+
+static void fail(const char *what)
+{
+    printf("%s:%d: %s\n", s_file, s_line, what);
+    s_failures++;
+}
+
+static void expect(bool cond, const char *what)
+{
+    if (!cond) {
+        char text[160];
+        snprintf(text, sizeof(text), "expect failed: %s", what);
+        fail(text);
+    }
+}
+
+static size_t parse_hex(const char *hex, uint8_t *out, size_t max)
+{
+    size_t n = 0;
+    while (hex[0] && hex[1] && n < max) {
+        unsigned byte;
+        if (sscanf(hex, "%2x", &byte) != 1) {
+            break;
+        }
+        out[n++] = (uint8_t)byte;
+        hex += 2;
+    }
+    return n;
+}
+
+static long arg_long(int argc, char **argv, int i, long fallback)
+{
+    return i < argc ? strtol(argv[i], NULL, 0) : fallback;
+}
+
+static void report(void)
+{
+    sx127x_sim_stats_t radio = sx127x_sim_stats();
+    netserver_stats_t net = netserver_stats();
+    double virtual_s = hal_sim_now_us() / 1e6;
+    double wall = wall_s() - s_wall_start_s;
+    uint32_t attempts = radio.rx_hits + radio.rx_early + radio.rx_late;
+
+    printf("  virtual time %.1f s in %.3f s wall (%.0fx real time)\n", virtual_s, wall,
+           wall > 0 ? virtual_s / wall : 0);
+    printf("  frames: %u sent, %u joins, %u uplinks (%u confirmed, %u retransmitted), %u downlinks received\n",
+           radio.tx, net.joins, net.uplinks, net.confirmed_uplinks, net.retransmissions, s_rx_frames);
+    printf("  RX windows: %u opened, %u hit, %u early, %u late, %u empty; hit rate %.1f%%\n", radio.rx_windows,
+           radio.rx_hits, radio.rx_early, radio.rx_late, radio.rx_empty,
+           attempts ? 100.0 * radio.rx_hits / attempts : 100.0);
+    if (radio.open_error_count) {
+        printf("  RX open vs preamble start: min %lld us, avg %lld us, max %lld us\n",
+               (long long)radio.open_error_min_us,
+               (long long)(radio.open_error_sum_us / radio.open_error_count), (long long)radio.open_error_max_us);
+    }
+    if (s_frames.count) {
+        printf("  per frame: CPU avg %.1f us, max %.1f us; SPI transactions avg %.1f\n",
+               s_frames.cpu_ns_sum / 1e3 / s_frames.count, s_frames.cpu_ns_max / 1e3,
+               (double)s_frames.spi_sum / s_frames.count);
+    }
+    if (net.bad_mic || radio.unrouted_irqs) {
+        printf("  %u bad MICs, %u IRQs not routed to a DIO line\n", net.bad_mic, radio.unrouted_irqs);
+    }
+}
+
+static void net_command(int argc, char **argv)
+{
+    uint8_t buf[NETSERVER_MAX_MAC + 222];
+
+    if (argc >= 4 && !strcmp(argv[1], "downlink")) {
+        size_t len = parse_hex(argv[3], buf, 222);
+        netserver_queue_downlink((uint8_t)atoi(argv[2]), buf, len, argc > 4 && !strcmp(argv[4], "confirmed"));
+    } else if (argc >= 3 && !strcmp(argv[1], "mac")) {
+        if (!strcmp(argv[2], "linkadr") && argc >= 5) {
+            uint16_t chmask = (uint16_t)arg_long(argc, argv, 5, 0x0007);
+            uint8_t cmd[] = {0x03, (uint8_t)((atoi(argv[3]) << 4) | (atoi(argv[4]) & 0x0F)), (uint8_t)chmask,
+                             (uint8_t)(chmask >> 8), 0x01};
+            netserver_queue_mac(cmd, sizeof(cmd));
+        } else if (!strcmp(argv[2], "devstatus")) {
+            uint8_t cmd[] = {0x06};
+            netserver_queue_mac(cmd, sizeof(cmd));
+        } else if (!strcmp(argv[2], "rxtiming") && argc >= 4) {
+            uint8_t cmd[] = {0x08, (uint8_t)atoi(argv[3])};
+            netserver_queue_mac(cmd, sizeof(cmd));
+        } else if (!strcmp(argv[2], "dutycycle") && argc >= 4) {
+            uint8_t cmd[] = {0x04, (uint8_t)atoi(argv[3])};
+            netserver_queue_mac(cmd, sizeof(cmd));
+        } else {
+            fail("unknown MAC command");
+        }
+    } else if (argc >= 3 && !strcmp(argv[1], "drop")) {
+        netserver_drop_uplinks(atoi(argv[2]));
+    } else if (argc >= 3 && !strcmp(argv[1], "rx2")) {
+        netserver_use_rx2(!strcmp(argv[2], "on"));
+    } else if (argc >= 3 && !strcmp(argv[1], "snr")) {
+        netserver_set_snr((int8_t)atoi(argv[2]));
+    } else {
+        fail("unknown net command");
+    }
+}
+
+static void expect_command(int argc, char **argv)
+{
+    sx127x_sim_stats_t radio = sx127x_sim_stats();
+    netserver_stats_t net = netserver_stats();
+    const char *what = argc > 1 ? argv[1] : "";
+    long n = arg_long(argc, argv, 2, 0);
+    char text[120];
+    snprintf(text, sizeof(text), "%s %s%s%s", what, argc > 2 ? argv[2] : "", argc > 3 ? " " : "",
+             argc > 3 ? argv[3] : "");
+
+    if (!strcmp(what, "joined")) {
+        expect(s_joined, text);
+    } else if (!strcmp(what, "ack")) {
+        expect(s_txrx_flags & TXRX_ACK, text);
+    } else if (!strcmp(what, "no_ack")) {
+        expect(!(s_txrx_flags & TXRX_ACK), text);
+    } else if (!strcmp(what, "downlink") && argc >= 4) {
+        uint8_t data[222];
+        size_t len = parse_hex(argv[3], data, sizeof(data));
+        expect(s_rx_port == n && s_rx_len == len && !memcmp(s_rx_data, data, len), text);
+    } else if (!strcmp(what, "no_downlink")) {
+        expect(!s_rx_len && !s_rx_port, text);
+    } else if (!strcmp(what, "link_check") && argc >= 4) {
+        expect(LMIC.linkCheckGwCnt == n && LMIC.linkCheckMargin == atoi(argv[3]), text);
+    } else if (!strcmp(what, "mac_answer") && argc >= 3) {
+        expect(net.mac_answers[n & 0xFF] && (argc < 4 || net.mac_status[n & 0xFF] == strtol(argv[3], NULL, 0)),
+               text);
+    } else if (!strcmp(what, "dr")) {
+        expect(LMIC.datarate == n, text);
+    } else if (!strcmp(what, "txpow")) {
+        expect(LMIC.adrTxPow == n, text);
+    } else if (!strcmp(what, "rx_delay")) {
+        expect(LMIC.rxDelay == n, text);
+    } else if (!strcmp(what, "uplinks")) {
+        expect(net.uplinks == n, text);
+    } else if (!strcmp(what, "fcnt_up")) {
+        expect(net.fcnt_up == n, text);
+    } else if (!strcmp(what, "joins")) {
+        expect(net.joins == n, text);
+    } else if (!strcmp(what, "rejoins")) {
+        expect(s_rejoins == n, text);
+    } else if (!strcmp(what, "rx_hits")) {
+        expect(radio.rx_hits == n, text);
+    } else if (!strcmp(what, "rx_missed")) {
+        expect(radio.rx_early + radio.rx_late == n, text);
+    } else if (!strcmp(what, "hit_rate")) {
+        uint32_t attempts = radio.rx_hits + radio.rx_early + radio.rx_late;
+        expect(attempts && 100 * radio.rx_hits >= n * attempts, text);
+    } else {
+        fail("unknown expectation");
+    }
+}
+
+static void join(int64_t timeout_s)
+{
+    s_joined = false;
+    s_silent_uplinks = 0;
+    if (!LMIC_startJoining()) {
+        fail("join ignored: LMIC still has a session");
+    } else if (!run_frame(joined, timeout_s)) {
+        fail("join timed out");
+    }
+}
+
+static void rejoin(int64_t timeout_s)
+{
+    s_rejoins++;
+    LMIC_unjoin();
+    join(timeout_s);
+}
+
+static void uplink_done(void)
+{
+    if (s_txrx_flags & (TXRX_DNW1 | TXRX_DNW2)) {
+        s_silent_uplinks = 0;
+    } else if (s_rejoin_after && ++s_silent_uplinks >= s_rejoin_after) {
+        rejoin(DEFAULT_TIMEOUT_S);
+    }
+}
+
+static void command(int argc, char **argv)
+{
+    const char *cmd = argv[0];
+
+    if (!strcmp(cmd, "join")) {
+        join(arg_long(argc, argv, 1, DEFAULT_TIMEOUT_S));
+    } else if (!strcmp(cmd, "rejoin")) {
+        rejoin(arg_long(argc, argv, 1, DEFAULT_TIMEOUT_S));
+    } else if (!strcmp(cmd, "rejoin_after") && argc >= 2) {
+        s_rejoin_after = atoi(argv[1]);
+    } else if (!strcmp(cmd, "repeat") && argc >= 3) {
+        for (int i = atoi(argv[1]); i > 0; i--) {
+            command(argc - 2, argv + 2);
+        }
+    } else if (!strcmp(cmd, "uplink") && argc >= 3) {
+        // LMIC may still be sending a frame of its own, with MAC answers the last downlink asked for
+        run(tx_ready, DEFAULT_TIMEOUT_S);
+
+        uint8_t payload[222];
+        int len = atoi(argv[2]);
+        for (int i = 0; i < len; i++) {
+            payload[i] = (uint8_t)(i + LMIC.seqnoUp);
+        }
+        s_tx_complete = false;
+        s_txrx_flags = 0;
+        s_rx_len = 0;
+        s_rx_port = 0;
+        bool confirmed = argc > 3 && !strcmp(argv[3], "confirmed");
+        lmic_tx_error_t err = LMIC_setTxData2((u1_t)atoi(argv[1]), payload, (u1_t)len, confirmed);
+        if (err != LMIC_ERROR_SUCCESS) {
+            char text[40];
+            snprintf(text, sizeof(text), "uplink rejected: %d", err);
+            fail(text);
+        } else if (!run_frame(tx_complete, DEFAULT_TIMEOUT_S)) {
+            fail("uplink timed out");
+        } else {
+            uplink_done();
+        }
+    } else if (!strcmp(cmd, "linkcheck")) {
+        LMIC_requestLinkCheck();
+    } else if (!strcmp(cmd, "idle") && argc >= 2) {
+        run(NULL, atol(argv[1]));
+    } else if (!strcmp(cmd, "dr") && argc >= 2) {
+        LMIC_setDrTxpow((dr_t)atoi(argv[1]), DEFAULT_TX_POWER);
+    } else if (!strcmp(cmd, "adr") && argc >= 2) {
+        LMIC_setAdrMode(!strcmp(argv[1], "on"));
+    } else if (!strcmp(cmd, "clock_error") && argc >= 2) {
+        LMIC_setClockError((u2_t)(MAX_CLOCK_ERROR * atoi(argv[1]) / 100));
+    } else if (!strcmp(cmd, "drift") && argc >= 2) {
+        hal_sim_set_drift_ppm(atoi(argv[1]));
+    } else if (!strcmp(cmd, "irq_latency") && argc >= 2) {
+        hal_sim_set_irq_latency_us(atoi(argv[1]));
+    } else if (!strcmp(cmd, "net")) {
+        net_command(argc, argv);
+    } else if (!strcmp(cmd, "expect")) {
+        expect_command(argc, argv);
+    } else if (!strcmp(cmd, "report")) {
+        report();
+    } else {
+        fail("unknown command");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <scenario.sim>\n", argv[0]);
+        return 2;
+    }
+    s_file = argv[1];
+    FILE *f = fopen(s_file, "r");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", s_file, strerror(errno));
+        return 2;
+    }
+
+    netserver_config_t config = {
+        .net_id = 0x000013,
+        .dev_addr = 0x260B1234,
+        .rx_delay_s = 1,
+        .rx2_dr = 3,
+    };
+    memcpy(config.app_key, s_app_key, 16);
+    netserver_init(&config);
+
+    // As ttn.c sets LMIC up
+    s_wall_start_s = wall_s();
+    os_init_ex(NULL);
+    LMIC_reset();
+    LMIC_registerEventCb(event_callback, NULL);
+    LMIC_setClockError(MAX_CLOCK_ERROR * 4 / 100);
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        s_line++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = 0;
+        }
+        char *args[MAX_ARGS];
+        int n = 0;
+        for (char *tok = strtok(line, " \t\r\n"); tok && n < MAX_ARGS; tok = strtok(NULL, " \t\r\n")) {
+            args[n++] = tok;
+        }
+        if (n) {
+            command(n, args);
+        }
+    }
+    fclose(f);
+
+    printf("lmic_sim: %s\n", s_file);
+    report();
+    if (s_failures) {
+        printf("%d expectation(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("lmic_sim: all expectations met\n");
+    return 0;
+}
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/evp.h>
+
+#include "netserver_sim.h"
+
+#define MHDR_JOIN_REQUEST       0x00
+#define MHDR_JOIN_ACCEPT        0x20
+#define MHDR_UNCONFIRMED_UP     0x40
+#define MHDR_UNCONFIRMED_DOWN   0x60
+#define MHDR_CONFIRMED_UP       0x80
+#define MHDR_CONFIRMED_DOWN     0xA0
+
+#define FCTRL_ADR               0x80
+#define FCTRL_ACK               0x20
+#define FCTRL_FOPTS_LEN         0x0F
+
+#define JOIN_ACCEPT_DELAY_S     5
+#define DOWNLINK_RSSI_DBM       (-80)
+
+static netserver_config_t s_config;
+static netserver_stats_t s_stats;
+
+static bool s_joined;
+static uint8_t s_nwk_skey[16];
+static uint8_t s_app_skey[16];
+static uint32_t s_app_nonce;
+static uint32_t s_fcnt_up;
+static bool s_fcnt_up_valid;
+static uint32_t s_fcnt_down;
+
+static uint8_t s_mac[NETSERVER_MAX_MAC];
+static size_t s_mac_len;
+static bool s_app_pending;
+static uint8_t s_app_port;
+static uint8_t s_app_data[222];
+static size_t s_app_len;
+static bool s_app_confirmed;
+
+static uint8_t s_pending_rx_delay_s;         // from a RXTimingSetupReq, used once the device answers
+
+static int s_drop;
+static bool s_rx2;
+static int8_t s_snr_db = 10;
+
+// ---------------------------------------------------------------------------------------------------------------
+// Crypto: AES-128 blocks and CMAC (RFC 4493)
+
+static void aes_block(const uint8_t *key, const uint8_t *in, uint8_t *out, bool decrypt)
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int len;
+    EVP_CipherInit_ex(ctx, EVP_aes_128_ecb(), NULL, key, NULL, decrypt ? 0 : 1);
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    EVP_CipherUpdate(ctx, out, &len, in, 16);
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+static void cmac_subkey(uint8_t *k)
+{
+    uint8_t carry = k[0] & 0x80;
+    for (int i = 0; i < 15; i++) {
+        k[i] = (uint8_t)((k[i] << 1) | (k[i + 1] >> 7));
+    }
+    k[15] = (uint8_t)((k[15] << 1) ^ (carry ? 0x87 : 0));
+}
+
+// First four bytes of CMAC(key, prefix || message), LSB first as LoRaWAN sends them
+static uint32_t cmac(const uint8_t *key, const uint8_t *prefix, const uint8_t *message, size_t message_len)
+{
+    uint8_t buf[16 + 256];
+    size_t len = 0;
+    if (prefix) {
+        memcpy(buf, prefix, 16);
+        len = 16;
+    }
+    memcpy(buf + len, message, message_len);
+    len += message_len;
+
+    uint8_t k[16] = {0};
+    aes_block(key, k, k, false);
+    cmac_subkey(k);
+    bool complete = len && len % 16 == 0;
+    if (!complete) {
+        cmac_subkey(k);
+    }
+
+    size_t blocks = complete ? len / 16 : len / 16 + 1;
+    uint8_t x[16] = {0};
+    for (size_t b = 0; b < blocks; b++) {
+        uint8_t block[16] = {0};
+        size_t n = len - b * 16 < 16 ? len - b * 16 : 16;
+        memcpy(block, buf + b * 16, n);
+        if (b == blocks - 1) {
+            if (!complete) {
+                block[n] = 0x80;
+            }
+            for (int i = 0; i < 16; i++) {
+                block[i] ^= k[i];
+            }
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] ^= block[i];
+        }
+        aes_block(key, x, x, false);
+    }
+    return x[0] | (x[1] << 8) | (x[2] << 16) | ((uint32_t)x[3] << 24);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// A_i and B0 blocks: block type, direction (0 up, 1 down), device address, frame counter, last byte
+static void frame_block(uint8_t *block, uint8_t type, int dir, uint32_t fcnt, uint8_t last)
+{
+    memset(block, 0, 16);
+    block[0] = type;
+    block[5] = (uint8_t)dir;
+    put_le32(block + 6, s_config.dev_addr);
+    put_le32(block + 10, fcnt);
+    block[15] = last;
+}
+
+static void frame_crypt(const uint8_t *key, int dir, uint32_t fcnt, uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i += 16) {
+        uint8_t a[16];
+        frame_block(a, 0x01, dir, fcnt, (uint8_t)(i / 16 + 1));
+        aes_block(key, a, a, false);
+        for (size_t j = 0; j < 16 && i + j < len; j++) {
+            data[i + j] ^= a[j];
+        }
+    }
+}
+
+static uint32_t frame_mic(int dir, uint32_t fcnt, const uint8_t *frame, size_t len)
+{
+    uint8_t b0[16];
+    frame_block(b0, 0x49, dir, fcnt, (uint8_t)len);
+    return cmac(s_nwk_skey, b0, frame, len);
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// Radio parameters
+
+static int data_rate(uint8_t sf, uint32_t bw_hz)
+{
+    return bw_hz == 250000 ? 6 : 12 - sf;
+}
+
+static void set_data_rate(sim_packet_t *packet, int dr)
+{
+    packet->sf = dr == 6 ? 7 : (uint8_t)(12 - dr);
+    packet->bw_hz = dr == 6 ? 250000 : 125000;
+}
+
+// Schedule the answer to an uplink in RX1 or RX2
+static void send(const sim_packet_t *uplink, const uint8_t *frame, size_t len, int delay_s, int rx2_dr)
+{
+    sim_packet_t packet = {0};
+    memcpy(packet.data, frame, len);
+    packet.len = (uint8_t)len;
+    packet.iq_inverted = true;
+    packet.snr_db = s_snr_db;
+    packet.rssi_dbm = DOWNLINK_RSSI_DBM;
+    if (s_rx2) {
+        packet.freq_hz = NETSERVER_RX2_FREQ_HZ;
+        set_data_rate(&packet, rx2_dr);
+        delay_s++;
+    } else {
+        packet.freq_hz = uplink->freq_hz;
+        packet.sf = uplink->sf;
+        packet.bw_hz = uplink->bw_hz;
+    }
+    packet.start_us = uplink->end_us + delay_s * 1000000LL;
+    packet.end_us = packet.start_us + sx127x_sim_airtime_us(packet.sf, packet.bw_hz, 1, 8, packet.len, false, false);
+    sx127x_sim_schedule_downlink(&packet);
+    s_stats.downlinks++;
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// Frames
+
+static void join_request(const sim_packet_t *packet)
+{
+    const uint8_t *frame = packet->data;
+    s_stats.join_requests++;
+    if (packet->len != 23 || cmac(s_config.app_key, NULL, frame, 19) != get_le32(frame + 19)) {
+        s_stats.bad_mic++;
+        return;
+    }
+    uint16_t dev_nonce = frame[17] | (frame[18] << 8);
+
+    uint8_t accept[17];
+    s_app_nonce++;
+    accept[0] = MHDR_JOIN_ACCEPT;
+    accept[1] = (uint8_t)s_app_nonce;
+    accept[2] = (uint8_t)(s_app_nonce >> 8);
+    accept[3] = (uint8_t)(s_app_nonce >> 16);
+    accept[4] = (uint8_t)s_config.net_id;
+    accept[5] = (uint8_t)(s_config.net_id >> 8);
+    accept[6] = (uint8_t)(s_config.net_id >> 16);
+    put_le32(accept + 7, s_config.dev_addr);
+    accept[11] = s_config.rx2_dr & 0x0F;
+    accept[12] = s_config.rx_delay_s;
+    put_le32(accept + 13, cmac(s_config.app_key, NULL, accept, 13));
+
+    // Session keys from the nonces, under the AppKey
+    uint8_t block[16] = {0};
+    memcpy(block + 1, accept + 1, 6);
+    block[7] = (uint8_t)dev_nonce;
+    block[8] = (uint8_t)(dev_nonce >> 8);
+    block[0] = 0x01;
+    aes_block(s_config.app_key, block, s_nwk_skey, false);
+    block[0] = 0x02;
+    aes_block(s_config.app_key, block, s_app_skey, false);
+
+    // The server encrypts with AES decrypt, so the device only needs encrypt
+    aes_block(s_config.app_key, accept + 1, accept + 1, true);
+
+    s_joined = true;
+    s_fcnt_up_valid = false;
+    s_fcnt_down = 0;
+    s_mac_len = 0;
+    s_stats.joins++;
+    send(packet, accept, sizeof(accept), JOIN_ACCEPT_DELAY_S, 0);
+}
+
+static int mac_answer_len(uint8_t cid)
+{
+    switch (cid) {
+    case 0x02:                                          // LinkCheckReq
+    case 0x04:                                          // DutyCycleAns
+    case 0x08:                                          // RXTimingSetupAns
+    case 0x09:                                          // TxParamSetupAns
+    case 0x0D:                                          // DeviceTimeReq
+        return 0;
+    case 0x03:                                          // LinkADRAns
+    case 0x05:                                          // RXParamSetupAns
+    case 0x07:                                          // NewChannelAns
+    case 0x0A:                                          // DlChannelAns
+        return 1;
+    case 0x06:                                          // DevStatusAns
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+// Demodulation floor per spreading factor, SF7 to SF12, in half dB
+static const int8_t s_demod_floor_half_db[] = {-15, -20, -25, -30, -35, -40};
+
+static void data_uplink(const sim_packet_t *packet)
+{
+    const uint8_t *frame = packet->data;
+    size_t len = packet->len;
+
+    if (!s_joined || len < 12 || get_le32(frame + 1) != s_config.dev_addr) {
+        return;
+    }
+    uint32_t fcnt = frame[6] | (frame[7] << 8);
+    if (s_fcnt_up_valid) {
+        fcnt |= s_fcnt_up & 0xFFFF0000;
+        if (fcnt < s_fcnt_up) {
+            fcnt += 0x10000;
+        }
+    }
+    if (frame_mic(0, fcnt, frame, len - 4) != get_le32(frame + len - 4)) {
+        s_stats.bad_mic++;
+        return;
+    }
+
+    // The same counter again is a retransmission (NbTrans, or a confirmed uplink that missed its ACK): answer it
+    bool confirmed = frame[0] == MHDR_CONFIRMED_UP;
+    if (s_fcnt_up_valid && fcnt == s_fcnt_up) {
+        s_stats.retransmissions++;
+    } else {
+        s_stats.uplinks++;
+        s_stats.confirmed_uplinks += confirmed;
+    }
+    s_fcnt_up = fcnt;
+    s_fcnt_up_valid = true;
+    s_stats.fcnt_up = fcnt;
+    s_stats.last_dr = (uint8_t)data_rate(packet->sf, packet->bw_hz);
+    s_stats.last_adr = frame[5] & FCTRL_ADR;
+
+    // MAC answers and requests in FOpts
+    size_t fopts_len = frame[5] & FCTRL_FOPTS_LEN;
+    bool link_check = false;
+    for (size_t i = 8; i < 8 + fopts_len;) {
+        uint8_t cid = frame[i];
+        int n = mac_answer_len(cid);
+        if (n < 0) {
+            break;
+        }
+        s_stats.mac_answers[cid]++;
+        s_stats.mac_status[cid] = n ? frame[i + 1] : 0;
+        link_check |= cid == 0x02;
+        if (cid == 0x08 && s_pending_rx_delay_s) {
+            s_config.rx_delay_s = s_pending_rx_delay_s;
+            s_pending_rx_delay_s = 0;
+        }
+        i += 1 + n;
+    }
+    size_t port_at = 8 + fopts_len;
+    s_stats.last_port = port_at < len - 4 ? frame[port_at] : 0;
+    s_stats.last_len = port_at < len - 4 ? (uint8_t)(len - 4 - port_at - 1) : 0;
+
+    if (link_check && s_mac_len + 3 <= NETSERVER_MAX_MAC) {
+        int floor = s_demod_floor_half_db[packet->sf - 7];
+        int margin = (2 * s_snr_db - floor) / 2;
+        s_mac[s_mac_len++] = 0x02;
+        s_mac[s_mac_len++] = (uint8_t)(margin < 0 ? 0 : margin > 254 ? 254 : margin);
+        s_mac[s_mac_len++] = 1;
+    }
+
+    if (!confirmed && !s_mac_len && !s_app_pending) {
+        return;
+    }
+
+    uint8_t down[256];
+    size_t n = 0;
+    down[n++] = s_app_pending && s_app_confirmed ? MHDR_CONFIRMED_DOWN : MHDR_UNCONFIRMED_DOWN;
+    put_le32(down + n, s_config.dev_addr);
+    n += 4;
+    down[n++] = (uint8_t)((confirmed ? FCTRL_ACK : 0) | s_mac_len);
+    down[n++] = (uint8_t)s_fcnt_down;
+    down[n++] = (uint8_t)(s_fcnt_down >> 8);
+    memcpy(down + n, s_mac, s_mac_len);
+    n += s_mac_len;
+    if (s_app_pending) {
+        down[n++] = s_app_port;
+        memcpy(down + n, s_app_data, s_app_len);
+        frame_crypt(s_app_skey, 1, s_fcnt_down, down + n, s_app_len);
+        n += s_app_len;
+    }
+    put_le32(down + n, frame_mic(1, s_fcnt_down, down, n));
+    n += 4;
+
+    s_fcnt_down++;
+    s_mac_len = 0;
+    s_app_pending = false;
+    send(packet, down, n, s_config.rx_delay_s, s_config.rx2_dr);
+}
+
+void netserver_init(const netserver_config_t *config)
+{
+    s_config = *config;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_joined = false;
+    s_mac_len = 0;
+    s_app_pending = false;
+    s_drop = 0;
+    s_rx2 = false;
+}
+
+void netserver_uplink(const sim_packet_t *packet)
+{
+    if (s_drop > 0) {
+        s_drop--;
+        s_stats.dropped++;
+        return;
+    }
+    if (packet->iq_inverted || !packet->len) {
+        return;
+    }
+    switch (packet->data[0]) {
+    case MHDR_JOIN_REQUEST:
+        join_request(packet);
+        break;
+    case MHDR_UNCONFIRMED_UP:
+    case MHDR_CONFIRMED_UP:
+        data_uplink(packet);
+        break;
+    default:
+        break;
+    }
+}
+
+void netserver_queue_downlink(uint8_t port, const uint8_t *data, size_t len, bool confirmed)
+{
+    if (len > sizeof(s_app_data)) {
+        len = sizeof(s_app_data);
+    }
+    memcpy(s_app_data, data, len);
+    s_app_len = len;
+    s_app_port = port;
+    s_app_confirmed = confirmed;
+    s_app_pending = true;
+}
+
+void netserver_queue_mac(const uint8_t *command, size_t len)
+{
+    if (s_mac_len + len <= NETSERVER_MAX_MAC) {
+        if (command[0] == 0x08) {
+            s_pending_rx_delay_s = (command[1] & 0x0F) ? command[1] & 0x0F : 1;
+        }
+        memcpy(s_mac + s_mac_len, command, len);
+        s_mac_len += len;
+    }
+}
+
+void netserver_drop_uplinks(int n)
+{
+    s_drop = n;
+}
+
+void netserver_use_rx2(bool rx2)
+{
+    s_rx2 = rx2;
+}
+
+void netserver_set_snr(int8_t snr_db)
+{
+    s_snr_db = snr_db;
+}
+
+netserver_stats_t netserver_stats(void)
+{
+    return s_stats;
+}
@@ -0,0 +1,78 @@
+/* Scripted LoRaWAN 1.0.x network server for the LMIC simulator
+ *
+ * One gateway, one device, EU868. Handles OTAA joins (join accept in RX1 after 5 s, or RX2), checks the MIC and
+ * frame counter of every uplink, answers LinkCheckReq and acknowledges confirmed uplinks, and sends whatever the
+ * script has queued: application downlinks and MAC commands (in FOpts). Answers go in RX1 on the uplink's
+ * channel and data rate, or in RX2 (869.525 MHz) when the script asks for it. The device's MAC answers are kept
+ * for the script to check.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sx127x_sim.h"
+
+#define NETSERVER_RX2_FREQ_HZ       869525000
+#define NETSERVER_MAX_MAC           15          // FOpts
+
+typedef struct {
+    uint8_t app_key[16];
+    uint32_t net_id;
+    uint32_t dev_addr;
+    uint8_t rx_delay_s;                         /*<! RX1 delay for data frames, sent in the join accept */
+    uint8_t rx2_dr;                             /*<! sent in the join accept */
+} netserver_config_t;
+
+typedef struct {
+    uint32_t join_requests;
+    uint32_t joins;                             /*<! join accepts sent */
+    uint32_t uplinks;                           /*<! new data frames with a good MIC */
+    uint32_t confirmed_uplinks;
+    uint32_t bad_mic;
+    uint32_t retransmissions;                   /*<! same frame counter as the last uplink */
+    uint32_t dropped;                           /*<! lost on purpose by the script */
+    uint32_t downlinks;
+    uint32_t fcnt_up;                           /*<! of the last uplink */
+    uint8_t last_port;
+    uint8_t last_len;
+    uint8_t last_dr;                            /*<! data rate of the last uplink */
+    bool last_adr;                              /*<! ADR bit of the last uplink */
+    uint32_t mac_answers[256];                  /*<! count per CID seen in uplink FOpts */
+    uint8_t mac_status[256];                    /*<! first payload byte of the last answer per CID */
+} netserver_stats_t;
+
+void netserver_init(const netserver_config_t *config);
+
+/**
+ * @brief Handle a frame the device has sent, and put the answer (if any) on the air
+ */
+void netserver_uplink(const sim_packet_t *packet);
+
+/**
+ * @brief Queue an application downlink for the next uplink
+ */
+void netserver_queue_downlink(uint8_t port, const uint8_t *data, size_t len, bool confirmed);
+
+/**
+ * @brief Queue a MAC command (CID and payload) for the next uplink
+ */
+void netserver_queue_mac(const uint8_t *command, size_t len);
+
+/**
+ * @brief Lose the next n uplinks, as if the gateway had not heard them
+ */
+void netserver_drop_uplinks(int n);
+
+/**
+ * @brief Answer in RX2 instead of RX1
+ */
+void netserver_use_rx2(bool rx2);
+
+/**
+ * @brief SNR the gateway measures on uplinks (link check margin) and the device on downlinks
+ */
+void netserver_set_snr(int8_t snr_db);
+
+netserver_stats_t netserver_stats(void);
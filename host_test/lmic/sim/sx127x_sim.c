@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sx127x_sim.h"
+
+#define REG_FIFO                0x00
+#define REG_OP_MODE             0x01
+#define REG_FRF_MSB             0x06
+#define REG_FRF_MID             0x07
+#define REG_FRF_LSB             0x08
+#define REG_FIFO_ADDR_PTR       0x0D
+#define REG_FIFO_TX_BASE        0x0E
+#define REG_FIFO_RX_BASE        0x0F
+#define REG_FIFO_RX_CURRENT     0x10
+#define REG_IRQ_FLAGS_MASK      0x11
+#define REG_IRQ_FLAGS           0x12
+#define REG_RX_NB_BYTES         0x13
+#define REG_PKT_SNR             0x19
+#define REG_PKT_RSSI            0x1A
+#define REG_MODEM_CONFIG1       0x1D
+#define REG_MODEM_CONFIG2       0x1E
+#define REG_SYMB_TIMEOUT_LSB    0x1F
+#define REG_PREAMBLE_MSB        0x20
+#define REG_PREAMBLE_LSB        0x21
+#define REG_PAYLOAD_LENGTH      0x22
+#define REG_MODEM_CONFIG3       0x26
+#define REG_RSSI_WIDEBAND       0x2C
+#define REG_INVERT_IQ           0x33
+#define REG_DIO_MAPPING1        0x40
+#define REG_VERSION             0x42
+
+#define OPMODE_LORA             0x80
+#define OPMODE_MASK             0x07
+#define OPMODE_STANDBY          0x01
+#define OPMODE_TX               0x03
+#define OPMODE_RX_SINGLE        0x06
+
+#define IRQ_RX_TIMEOUT          0x80
+#define IRQ_RX_DONE             0x40
+#define IRQ_TX_DONE             0x08
+
+#define RSSI_OFFSET_HF          157
+#define DOWNLINK_PREAMBLE       8                       // symbols, LoRaWAN
+#define FRF_STEP_HZ             61.03515625
+
+typedef enum {
+    EVENT_NONE,
+    EVENT_TX_DONE,
+    EVENT_RX_DONE,
+    EVENT_RX_TIMEOUT,
+} event_t;
+
+static uint8_t s_regs[128];
+static uint8_t s_fifo[256];
+
+static event_t s_event;
+static int64_t s_event_us;
+static sim_packet_t s_tx;                               // on the air while s_event is EVENT_TX_DONE
+static sim_packet_t s_rx;                               // being received while s_event is EVENT_RX_DONE
+
+static sim_packet_t s_on_air[SX127X_SIM_MAX_ON_AIR];
+static int s_on_air_count;
+
+#define MAX_COMPLETED 4
+static sim_packet_t s_completed[MAX_COMPLETED];
+static int s_completed_count;
+
+static uint32_t s_noise = 0x2545f491;
+static sx127x_sim_stats_t s_stats = {
+    .open_error_min_us = INT64_MAX,
+    .open_error_max_us = INT64_MIN,
+};
+
+void sx127x_sim_reset(void)
+{
+    memset(s_regs, 0, sizeof(s_regs));
+    memset(s_fifo, 0, sizeof(s_fifo));
+    s_regs[REG_OP_MODE] = 0x09;
+    s_regs[REG_FIFO_TX_BASE] = 0x80;
+    s_regs[REG_MODEM_CONFIG1] = 0x72;
+    s_regs[REG_MODEM_CONFIG2] = 0x70;
+    s_regs[REG_SYMB_TIMEOUT_LSB] = 0x64;
+    s_regs[REG_PREAMBLE_LSB] = 0x08;
+    s_regs[REG_INVERT_IQ] = 0x27;
+    s_regs[REG_VERSION] = 0x12;
+    s_event = EVENT_NONE;
+}
+
+static uint32_t bw_hz(void)
+{
+    switch (s_regs[REG_MODEM_CONFIG1] >> 4) {
+    case 8:
+        return 250000;
+    case 9:
+        return 500000;
+    default:
+        return 125000;
+    }
+}
+
+static uint8_t sf(void)
+{
+    return s_regs[REG_MODEM_CONFIG2] >> 4;
+}
+
+static uint32_t freq_hz(void)
+{
+    uint32_t frf = (s_regs[REG_FRF_MSB] << 16) | (s_regs[REG_FRF_MID] << 8) | s_regs[REG_FRF_LSB];
+    return (uint32_t)(frf * FRF_STEP_HZ + 0.5);
+}
+
+static int64_t symbol_us(uint8_t spreading_factor, uint32_t bandwidth_hz)
+{
+    return ((int64_t)1000000 << spreading_factor) / bandwidth_hz;
+}
+
+int64_t sx127x_sim_airtime_us(uint8_t spreading_factor, uint32_t bandwidth_hz, uint8_t cr, uint16_t preamble,
+                              uint8_t len, bool crc, bool implicit_header)
+{
+    int64_t tsym = symbol_us(spreading_factor, bandwidth_hz);
+    int de = tsym >= 16000;                             // low data rate optimisation, as LMIC sets it
+    int num = 8 * len - 4 * spreading_factor + 28 + 16 * crc - 20 * implicit_header;
+    int den = 4 * (spreading_factor - 2 * de);
+    int payload_symbols = 8 + (num > 0 ? (num + den - 1) / den * (cr + 4) : 0);
+
+    // Preamble plus 4.25 symbols of sync word, in quarter symbols
+    return ((preamble * 4 + 17) + payload_symbols * 4) * tsym / 4;
+}
+
+static void start_tx(int64_t now_us)
+{
+    uint8_t len = s_regs[REG_PAYLOAD_LENGTH];
+    uint8_t base = s_regs[REG_FIFO_TX_BASE];
+
+    memset(&s_tx, 0, sizeof(s_tx));
+    for (int i = 0; i < len; i++) {
+        s_tx.data[i] = s_fifo[(uint8_t)(base + i)];
+    }
+    s_tx.len = len;
+    s_tx.freq_hz = freq_hz();
+    s_tx.sf = sf();
+    s_tx.bw_hz = bw_hz();
+    s_tx.iq_inverted = !(s_regs[REG_INVERT_IQ] & 0x01);  // bit 0 set is TX IQ not inverted
+    s_tx.start_us = now_us;
+    s_tx.end_us = now_us + sx127x_sim_airtime_us(s_tx.sf, s_tx.bw_hz, (s_regs[REG_MODEM_CONFIG1] >> 1) & 0x07,
+                                                 (s_regs[REG_PREAMBLE_MSB] << 8) | s_regs[REG_PREAMBLE_LSB], len,
+                                                 s_regs[REG_MODEM_CONFIG2] & 0x04, s_regs[REG_MODEM_CONFIG1] & 0x01);
+    s_event = EVENT_TX_DONE;
+    s_event_us = s_tx.end_us;
+}
+
+static void drop_expired(int64_t now_us)
+{
+    int kept = 0;
+    for (int i = 0; i < s_on_air_count; i++) {
+        if (s_on_air[i].end_us > now_us) {
+            s_on_air[kept++] = s_on_air[i];
+        }
+    }
+    s_on_air_count = kept;
+}
+
+static void start_rx_single(int64_t now_us)
+{
+    uint8_t spreading_factor = sf();
+    uint32_t bandwidth_hz = bw_hz();
+    uint32_t freq = freq_hz();
+    bool inverted = s_regs[REG_INVERT_IQ] & 0x40;
+    int64_t tsym = symbol_us(spreading_factor, bandwidth_hz);
+    int symbols = ((s_regs[REG_MODEM_CONFIG2] & 0x03) << 8) | s_regs[REG_SYMB_TIMEOUT_LSB];
+    int64_t timeout_us = now_us + symbols * tsym;
+
+    s_stats.rx_windows++;
+    drop_expired(now_us);
+
+    s_event = EVENT_RX_TIMEOUT;
+    s_event_us = timeout_us;
+
+    for (int i = 0; i < s_on_air_count; i++) {
+        const sim_packet_t *p = &s_on_air[i];
+        // Another channel (the frequency registers have a 61 Hz step) or data rate, or meant for a later window
+        if (llabs((int64_t)p->freq_hz - freq) > FRF_STEP_HZ || p->sf != spreading_factor || p->bw_hz != bandwidth_hz ||
+            p->iq_inverted != inverted || p->start_us > timeout_us + 500000) {
+            continue;
+        }
+
+        int64_t error_us = now_us - p->start_us;
+        if (error_us < s_stats.open_error_min_us) {
+            s_stats.open_error_min_us = error_us;
+        }
+        if (error_us > s_stats.open_error_max_us) {
+            s_stats.open_error_max_us = error_us;
+        }
+        s_stats.open_error_sum_us += error_us;
+        s_stats.open_error_count++;
+
+        int64_t last_open_us = p->start_us + (DOWNLINK_PREAMBLE - SX127X_SIM_DETECT_SYMBOLS) * tsym;
+        int64_t detect_us = (now_us > p->start_us ? now_us : p->start_us) + SX127X_SIM_DETECT_SYMBOLS * tsym;
+        if (now_us > last_open_us) {
+            s_stats.rx_late++;
+        } else if (detect_us > timeout_us) {
+            s_stats.rx_early++;
+        } else {
+            s_stats.rx_hits++;
+            s_rx = *p;
+            s_on_air[i] = s_on_air[--s_on_air_count];
+            s_event = EVENT_RX_DONE;
+            s_event_us = s_rx.end_us;
+        }
+        return;
+    }
+    s_stats.rx_empty++;
+}
+
+static void write_reg(uint8_t addr, uint8_t value, int64_t now_us)
+{
+    switch (addr) {
+    case REG_FIFO:
+        s_fifo[s_regs[REG_FIFO_ADDR_PTR]++] = value;
+        return;
+    case REG_IRQ_FLAGS:
+        s_regs[REG_IRQ_FLAGS] &= ~value;
+        return;
+    case REG_VERSION:
+        return;
+    case REG_OP_MODE: {
+        s_regs[REG_OP_MODE] = value;
+        int mode = value & OPMODE_MASK;
+        if (!(value & OPMODE_LORA)) {
+            s_event = EVENT_NONE;
+        } else if (mode == OPMODE_TX) {
+            start_tx(now_us);
+        } else if (mode == OPMODE_RX_SINGLE) {
+            start_rx_single(now_us);
+        } else {
+            // Sleep, standby or continuous receive (LMIC only uses that for RSSI): anything in progress stops
+            s_event = EVENT_NONE;
+        }
+        return;
+    }
+    default:
+        s_regs[addr & 0x7F] = value;
+        return;
+    }
+}
+
+static uint8_t read_reg(uint8_t addr)
+{
+    switch (addr) {
+    case REG_FIFO:
+        return s_fifo[s_regs[REG_FIFO_ADDR_PTR]++];
+    case REG_RSSI_WIDEBAND:
+        // radio_init seeds its random pool from the noise LSB; a fixed LCG keeps runs deterministic
+        s_noise = s_noise * 1103515245 + 12345;
+        return (s_noise >> 16) & 0xFF;
+    default:
+        return s_regs[addr & 0x7F];
+    }
+}
+
+void sx127x_sim_write(uint8_t addr, const uint8_t *buf, size_t len, int64_t now_us)
+{
+    // Burst access to the FIFO stays on the FIFO, everything else auto-increments the address
+    for (size_t i = 0; i < len; i++) {
+        write_reg(addr == REG_FIFO ? addr : (uint8_t)(addr + i), buf[i], now_us);
+    }
+}
+
+void sx127x_sim_read(uint8_t addr, uint8_t *buf, size_t len, int64_t now_us)
+{
+    (void)now_us;
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = read_reg(addr == REG_FIFO ? addr : (uint8_t)(addr + i));
+    }
+}
+
+int64_t sx127x_sim_next_irq_us(void)
+{
+    return s_event == EVENT_NONE ? -1 : s_event_us;
+}
+
+int sx127x_sim_take_irq(int64_t now_us, int64_t *at_us)
+{
+    if (s_event == EVENT_NONE || s_event_us > now_us) {
+        return -1;
+    }
+
+    event_t event = s_event;
+    s_event = EVENT_NONE;
+    *at_us = s_event_us;
+    s_regs[REG_OP_MODE] = (s_regs[REG_OP_MODE] & ~OPMODE_MASK) | OPMODE_STANDBY;
+
+    uint8_t flag;
+    int dio;
+    switch (event) {
+    case EVENT_TX_DONE:
+        s_stats.tx++;
+        if (s_completed_count < MAX_COMPLETED) {
+            s_completed[s_completed_count++] = s_tx;
+        }
+        flag = IRQ_TX_DONE;
+        dio = (s_regs[REG_DIO_MAPPING1] >> 6) == 1 ? 0 : -1;
+        break;
+    case EVENT_RX_DONE: {
+        uint8_t base = s_regs[REG_FIFO_RX_BASE];
+        for (int i = 0; i < s_rx.len; i++) {
+            s_fifo[(uint8_t)(base + i)] = s_rx.data[i];
+        }
+        s_regs[REG_FIFO_RX_CURRENT] = base;
+        s_regs[REG_RX_NB_BYTES] = s_rx.len;
+        s_regs[REG_PKT_SNR] = (uint8_t)(s_rx.snr_db * 4);
+        s_regs[REG_PKT_RSSI] = (uint8_t)(s_rx.rssi_dbm + RSSI_OFFSET_HF);
+        flag = IRQ_RX_DONE;
+        dio = (s_regs[REG_DIO_MAPPING1] >> 6) == 0 ? 0 : -1;
+        break;
+    }
+    default:
+        flag = IRQ_RX_TIMEOUT;
+        dio = ((s_regs[REG_DIO_MAPPING1] >> 4) & 0x03) == 0 ? 1 : -1;
+        break;
+    }
+
+    // A masked IRQ neither sets its flag nor raises a DIO line
+    if (s_regs[REG_IRQ_FLAGS_MASK] & flag) {
+        return -1;
+    }
+    s_regs[REG_IRQ_FLAGS] |= flag;
+    if (dio < 0) {
+        s_stats.unrouted_irqs++;
+    }
+    return dio;
+}
+
+bool sx127x_sim_take_uplink(sim_packet_t *packet)
+{
+    if (!s_completed_count) {
+        return false;
+    }
+    *packet = s_completed[0];
+    memmove(s_completed, s_completed + 1, --s_completed_count * sizeof(s_completed[0]));
+    return true;
+}
+
+void sx127x_sim_schedule_downlink(const sim_packet_t *packet)
+{
+    drop_expired(packet->start_us);
+    if (s_on_air_count < SX127X_SIM_MAX_ON_AIR) {
+        s_on_air[s_on_air_count++] = *packet;
+    }
+}
+
+sx127x_sim_stats_t sx127x_sim_stats(void)
+{
+    return s_stats;
+}
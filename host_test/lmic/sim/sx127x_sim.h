@@ -0,0 +1,83 @@
+/* Virtual SX1276: the register file, FIFO, DIO lines and airtime of a LoRa radio, on simulated time
+ *
+ * Enough of the chip for LMIC's radio.c: LoRa and FSK register banks, sleep/standby/TX/RX single/RX continuous,
+ * RegIrqFlags with RegIrqFlagsMask and the DIO0/DIO1 mapping. A transmission ends TxDone after its airtime
+ * from the modem registers; a single receive either locks onto a downlink on the air (same frequency, spreading
+ * factor and bandwidth, inverted IQ) or ends RxTimeout after RegSymbTimeout symbols. The receiver locks if it
+ * is listening for SX127X_SIM_DETECT_SYMBOLS preamble symbols before the timeout.
+ *
+ * Times are true (network) time in microseconds; the HAL converts to the device's clock.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SX127X_SIM_DETECT_SYMBOLS   5
+#define SX127X_SIM_MAX_ON_AIR       4       // downlinks scheduled for the receiver at once
+
+typedef struct {
+    int64_t start_us;                   /*<! first preamble symbol */
+    int64_t end_us;
+    uint32_t freq_hz;
+    uint8_t sf;                         /*<! 7-12 */
+    uint32_t bw_hz;
+    bool iq_inverted;                   /*<! downlinks are sent with inverted IQ */
+    int8_t snr_db;
+    int16_t rssi_dbm;
+    uint8_t len;
+    uint8_t data[256];
+} sim_packet_t;
+
+typedef struct {
+    uint32_t tx;                        /*<! transmissions completed */
+    uint32_t rx_windows;                /*<! single receives started */
+    uint32_t rx_hits;                   /*<! downlink received */
+    uint32_t rx_early;                  /*<! a downlink was on the air, the window timed out before its preamble */
+    uint32_t rx_late;                   /*<! a downlink was on the air, the window opened after its preamble */
+    uint32_t rx_empty;                  /*<! nothing was sent for this window */
+    int64_t open_error_min_us;          /*<! window open relative to the downlink's first preamble symbol */
+    int64_t open_error_max_us;
+    int64_t open_error_sum_us;
+    uint32_t open_error_count;
+    uint32_t unrouted_irqs;             /*<! IRQs that no DIO line was mapped to; LMIC would hang */
+} sx127x_sim_stats_t;
+
+/**
+ * @brief Power-on register values; what is on the air and the statistics are kept
+ */
+void sx127x_sim_reset(void);
+
+void sx127x_sim_write(uint8_t addr, const uint8_t *buf, size_t len, int64_t now_us);
+
+void sx127x_sim_read(uint8_t addr, uint8_t *buf, size_t len, int64_t now_us);
+
+/**
+ * @brief Time of the next DIO rising edge, -1 if none is pending
+ */
+int64_t sx127x_sim_next_irq_us(void);
+
+/**
+ * @brief If a DIO line has risen by now: latch the IRQ flag and return the DIO number (0 or 1), else -1
+ * @param at_us time of the rising edge
+ */
+int sx127x_sim_take_irq(int64_t now_us, int64_t *at_us);
+
+/**
+ * @brief Completed transmissions, oldest first; false when there are none left
+ */
+bool sx127x_sim_take_uplink(sim_packet_t *packet);
+
+/**
+ * @brief Put a packet on the air for the receiver
+ */
+void sx127x_sim_schedule_downlink(const sim_packet_t *packet);
+
+/**
+ * @brief LoRa time on air, per the SX1276 datasheet
+ */
+int64_t sx127x_sim_airtime_us(uint8_t sf, uint32_t bw_hz, uint8_t cr, uint16_t preamble, uint8_t len, bool crc,
+                              bool implicit_header);
+
+sx127x_sim_stats_t sx127x_sim_stats(void);
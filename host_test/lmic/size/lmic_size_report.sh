@@ -0,0 +1,62 @@
+#!/bin/sh
+# Size of the LMIC stack per feature profile (CONFIG_TTN_LMIC_PROFILE_*): flash (text + rodata + data), .bss and
+# sizeof(struct lmic_t), EU868 with the SX1276 as MaxBox builds it. The sources are only compiled, not linked, so a
+# cross compiler works too:
+#
+#   host_test/lmic/size/lmic_size_report.sh
+#   CC=xtensa-esp32s3-elf-gcc NM=xtensa-esp32s3-elf-nm SIZE=xtensa-esp32s3-elf-size CFLAGS=-Os \
+#       host_test/lmic/size/lmic_size_report.sh
+#
+# With the host compiler it builds 32-bit (-m32) when it can, so pointers and alignment match the ESP32-S3; the code
+# size is the host's, good for comparing profiles rather than as firmware numbers. sizeof(struct lmic_t) is the size
+# of the LMIC symbol. Exits 1 if the Class A profile doesn't come out smaller than the full one.
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+TTN_SRC="$HERE/../../../components/ttn-esp32/src"
+SHIM="$HERE/../../shim/include"
+CC=${CC:-cc}
+NM=${NM:-nm}
+SIZE=${SIZE:-size}
+
+if [ -z "$CFLAGS" ]; then
+    if printf '#include <stdint.h>\n#include <string.h>\n' | "$CC" -m32 -x c -c -o /dev/null - 2>/dev/null; then
+        CFLAGS="-m32 -Os"
+    else
+        CFLAGS="-Os"
+        echo "note: $CC can't build 32-bit objects, pointers are 64-bit" >&2
+    fi
+fi
+
+SOURCES="lmic.c lmic_eu868.c lmic_eu_like.c lmic_util.c lmic_channelshuffle.c oslmic.c radio.c"
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# profile name, extra sources, defines
+measure() {
+    name=$1
+    sources="$SOURCES $2"
+    mkdir -p "$WORK/$name"
+    for src in $sources; do
+        # shellcheck disable=SC2086
+        "$CC" $CFLAGS $3 -Wno-expansion-to-defined -I"$TTN_SRC/lmic" -I"$SHIM" -c "$TTN_SRC/lmic/$src" \
+            -o "$WORK/$name/${src%.c}.o"
+    done
+    # Berkeley format: text (code and rodata), data, bss per object
+    set -- $("$SIZE" -B "$WORK/$name"/*.o | awk 'NR > 1 { t += $1; d += $2; b += $3 } END { print t, d, b }')
+    text=$1 data=$2 bss=$3
+    lmic=$(printf "%d" "0x$("$NM" -S "$WORK/$name/lmic.o" | awk '$4 == "LMIC" { print $2 }')")
+    printf "%-10s %8d %8d %8d %8d\n" "$name" $((text + data)) "$data" "$bss" "$lmic"
+    eval "lmic_$name=$lmic"
+}
+
+printf "%-10s %8s %8s %8s %8s\n" profile flash data bss lmic_t
+measure full "lmic_compliance.c" "-DCONFIG_TTN_LMIC_PROFILE_FULL=1"
+measure class_a "" "-DCONFIG_TTN_LMIC_PROFILE_CLASS_A=1 -DCONFIG_TTN_MAX_FRAME_LENGTH=64"
+
+# shellcheck disable=SC2154
+if [ "$lmic_class_a" -ge "$lmic_full" ]; then
+    echo "Class A profile is not smaller than the full one" >&2
+    exit 1
+fi
@@ -0,0 +1,89 @@
+/* Prints uploaded LMIC event traces as text
+ *
+ *   lmic_trace upload1.bin [upload2.bin ...]
+ *
+ * Give the uploads of one box in the order they arrived. Records already printed from an earlier upload (the
+ * flash ring sends them again after a reset) are skipped, and lost records are reported.
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace_decode.h"
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(size > 0 ? size : 1);
+    if (buf && fread(buf, 1, size, f) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *len = size;
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace.bin [trace.bin ...]\n", argv[0]);
+        return 2;
+    }
+
+    int status = 0;
+    bool have_next = false;
+    uint32_t next = 0;                          // sequence number expected next
+
+    for (int i = 1; i < argc; i++) {
+        size_t len;
+        uint8_t *buf = read_file(argv[i], &len);
+        if (!buf) {
+            return 2;
+        }
+
+        trace_header_t header;
+        int pos = trace_decode_header(buf, len, &header);
+        if (pos < 0) {
+            fprintf(stderr, "%s: not an LMIC trace\n", argv[i]);
+            free(buf);
+            status = 1;
+            continue;
+        }
+        printf("== %s: %u records from #%u, format %u, %u us/tick\n", argv[i], header.count,
+               (unsigned)header.first, header.version, header.us_per_tick);
+        if (have_next && header.first > next) {
+            printf("== records #%u to #%u lost\n", (unsigned)next, (unsigned)header.first - 1);
+        }
+
+        for (uint32_t n = 0; n < header.count; n++) {
+            trace_record_t record;
+            int rec_len = trace_decode_record(buf + pos, len - pos, header.first + n, &record);
+            if (rec_len < 0) {
+                fprintf(stderr, "%s: record #%u at offset %d is malformed\n", argv[i],
+                        (unsigned)(header.first + n), pos);
+                status = 1;
+                break;
+            }
+            pos += rec_len;
+            if (have_next && record.seq < next) {
+                continue;
+            }
+
+            char line[256];
+            trace_format_record(&record, header.us_per_tick, line, sizeof(line));
+            puts(line);
+            next = record.seq + 1;
+            have_next = true;
+        }
+        free(buf);
+    }
+    return status;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "lmic.h"
+#include "trace_decode.h"
+
+#define TRACE_V1_HEADER_LEN     8
+#define TRACE_V2_HEADER_LEN     12
+#define TRACE_FIXED_LEN         36
+
+static const char *const s_event_names[] = {LMIC_EVENT_NAME_TABLE__INIT};
+static const char *const s_sf_names[] = {"FSK", "SF7", "SF8", "SF9", "SF10", "SF11", "SF12", "SFrfu"};
+static const char *const s_bw_names[] = {"BW125", "BW250", "BW500", "BWrfu"};
+
+static uint16_t get_u2(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u4(const uint8_t *p)
+{
+    return get_u2(p) | ((uint32_t)get_u2(p + 2) << 16);
+}
+
+int trace_decode_header(const uint8_t *buf, size_t len, trace_header_t *header)
+{
+    if (len < TRACE_V1_HEADER_LEN || memcmp(buf, "LMTR", 4) != 0) {
+        return -1;
+    }
+    header->version = buf[4];
+    header->us_per_tick = buf[5];
+    header->count = get_u2(buf + 6);
+
+    switch (header->version) {
+    case 1:
+        header->first = 0;
+        return TRACE_V1_HEADER_LEN;
+    case 2:
+        if (len < TRACE_V2_HEADER_LEN) {
+            return -1;
+        }
+        header->first = get_u4(buf + 8);
+        return TRACE_V2_HEADER_LEN;
+    default:
+        return -1;
+    }
+}
+
+int trace_decode_record(const uint8_t *buf, size_t len, uint32_t seq, trace_record_t *record)
+{
+    if (len < TRACE_FIXED_LEN) {
+        return -1;
+    }
+    size_t rec_len = buf[0];
+    if (rec_len < TRACE_FIXED_LEN || rec_len > TRACE_FIXED_LEN + TRACE_MAX_TEXT_LEN || rec_len > len) {
+        return -1;
+    }
+
+    memset(record, 0, sizeof(*record));
+    record->seq = seq;
+    record->type = buf[1];
+    record->time = get_u4(buf + 2);
+    record->txend = get_u4(buf + 6);
+    record->global_duty_avail = get_u4(buf + 10);
+    record->freq = get_u4(buf + 14);
+    record->datum = get_u4(buf + 18);
+    record->opmode = get_u2(buf + 22);
+    record->fcnt_up = get_u2(buf + 24);
+    record->fcnt_dn = get_u2(buf + 26);
+    record->rxsyms = get_u2(buf + 28);
+    record->rps = get_u2(buf + 30);
+    record->tx_channel = buf[32];
+    record->datarate = buf[33];
+    record->txrx_flags = buf[34];
+    record->save_irq_flags = buf[35];
+    memcpy(record->text, buf + TRACE_FIXED_LEN, rec_len - TRACE_FIXED_LEN);
+    return (int)rec_len;
+}
+
+void trace_format_record(const trace_record_t *record, unsigned us_per_tick, char *out, size_t out_len)
+{
+    char event[48];
+    switch (record->type) {
+    case TRACE_TYPE_MESSAGE:
+        snprintf(event, sizeof(event), "\"%s\"", record->text);
+        break;
+    case TRACE_TYPE_DATUM:
+        snprintf(event, sizeof(event), "\"%s\" 0x%x", record->text, (unsigned)record->datum);
+        break;
+    case TRACE_TYPE_FATAL:
+        snprintf(event, sizeof(event), "FATAL %s:%u", record->text, (unsigned)record->datum);
+        break;
+    default:
+        if (record->type < sizeof(s_event_names) / sizeof(s_event_names[0])) {
+            snprintf(event, sizeof(event), "%s", s_event_names[record->type]);
+        } else {
+            snprintf(event, sizeof(event), "EV_%u", record->type);
+        }
+        break;
+    }
+
+    snprintf(out, out_len,
+             "#%u %.3f ms %s: freq=%u.%03u %s %s ch=%u dr=%u up=%u dn=%u opmode=0x%04x rxsyms=%u txrx=0x%02x irq=0x%02x",
+             (unsigned)record->seq, (double)record->time * us_per_tick / 1000, event,
+             (unsigned)(record->freq / 1000000), (unsigned)(record->freq / 1000 % 1000),
+             s_sf_names[record->rps & 0x7], s_bw_names[(record->rps >> 3) & 0x3], record->tx_channel,
+             record->datarate, record->fcnt_up, record->fcnt_dn, record->opmode, record->rxsyms,
+             record->txrx_flags, record->save_irq_flags);
+}
@@ -0,0 +1,60 @@
+/* Decoder for the binary LMIC event trace (ttn_trace_export(), uploaded to API_ENDPOINT_LORA_TRACE)
+ *
+ * Reads format versions 1 (no sequence numbers, records numbered from 0) and 2. See ttn_trace_export() in
+ * components/ttn-esp32/include/ttn.h for the layout.
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_TYPE_FATAL        0xfd
+#define TRACE_TYPE_DATUM        0xfe
+#define TRACE_TYPE_MESSAGE      0xff
+#define TRACE_MAX_TEXT_LEN      24
+
+typedef struct {
+    uint8_t version;
+    uint8_t us_per_tick;
+    uint16_t count;                             /*<! records in this export */
+    uint32_t first;                             /*<! sequence number of the first record */
+} trace_header_t;
+
+typedef struct {
+    uint32_t seq;
+    uint8_t type;                               /*<! LMIC ev_t, or TRACE_TYPE_* */
+    uint32_t time;                              /*<! LMIC ticks */
+    uint32_t txend;
+    uint32_t global_duty_avail;
+    uint32_t freq;
+    uint32_t datum;                             /*<! or the line number of a fatal error */
+    uint16_t opmode;
+    uint16_t fcnt_up;
+    uint16_t fcnt_dn;
+    uint16_t rxsyms;
+    uint16_t rps;
+    uint8_t tx_channel;
+    uint8_t datarate;
+    uint8_t txrx_flags;
+    uint8_t save_irq_flags;
+    char text[TRACE_MAX_TEXT_LEN + 1];          /*<! messages and fatal errors (file name) */
+} trace_record_t;
+
+/**
+ * @brief Parse the header of an export
+ *
+ * @return header length, or -1 if buf is not a trace
+ */
+int trace_decode_header(const uint8_t *buf, size_t len, trace_header_t *header);
+
+/**
+ * @brief Parse the record at buf
+ *
+ * @return record length, or -1 if it is truncated or malformed
+ */
+int trace_decode_record(const uint8_t *buf, size_t len, uint32_t seq, trace_record_t *record);
+
+/**
+ * @brief One line of text for a record: sequence number, time in ms, event, radio and MAC state
+ */
+void trace_format_record(const trace_record_t *record, unsigned us_per_tick, char *out, size_t out_len);
@@ -0,0 +1,289 @@
+/* Tests for the LMIC trace flash ring (ttn_trace_flash.c) and the trace decoder
+ *
+ * The ring runs on a RAM image with NOR flash semantics: erase sets a sector to 0xff, writes can only clear bits.
+ * "Resets" re-run ttn_trace_flash_init() on the same image.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_partition.h"
+#include "ttn_trace_flash.h"
+#include "trace_decode.h"
+#include "shim_check.h"
+
+#define SECTORS             4
+#define SECTOR_SIZE         4096
+#define RECORD_LEN          36
+#define RECORDS_PER_SECTOR  ((SECTOR_SIZE - 8) / RECORD_LEN)
+#define EV_TXSTART          17
+
+static uint8_t s_flash[SECTORS * SECTOR_SIZE];
+static const esp_partition_t s_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .size = sizeof(s_flash),
+    .label = CONFIG_TTN_TRACE_FLASH_PARTITION,
+};
+static int s_erases;
+static int s_bad_writes;                        // bits that would have to go from 0 to 1
+static int s_write_budget = -1;                 // bytes written before "power is lost", -1 for no limit
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    return type == ESP_PARTITION_TYPE_DATA && strcmp(label, s_partition.label) == 0 ? &s_partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (src_offset + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, s_flash + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    if (dst_offset + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        if (s_write_budget == 0) {
+            return ESP_FAIL;
+        }
+        if (s_write_budget > 0) {
+            s_write_budget--;
+        }
+        if ((s_flash[dst_offset + i] & bytes[i]) != bytes[i]) {
+            s_bad_writes++;
+        }
+        s_flash[dst_offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if (offset % SECTOR_SIZE || size % SECTOR_SIZE || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(s_flash + offset, 0xff, size);
+    s_erases += size / SECTOR_SIZE;
+    return ESP_OK;
+}
+
+// A TX start record as ttn_logging.c writes it, with the sequence number in the datum to check the order
+static void make_record(uint8_t *rec, uint32_t seq)
+{
+    memset(rec, 0, RECORD_LEN);
+    rec[0] = RECORD_LEN;
+    rec[1] = EV_TXSTART;
+    rec[2] = seq * 100;
+    rec[3] = (seq * 100) >> 8;
+    memcpy(rec + 14, (const uint8_t[]){0xa0, 0x27, 0xbe, 0x33}, 4);     // 868100000 Hz
+    memcpy(rec + 18, &seq, 4);
+    rec[30] = 0x05;                             // rps: SF11, BW125
+    rec[33] = 5;
+}
+
+static void append_range(uint32_t from, uint32_t to)
+{
+    uint8_t rec[RECORD_LEN];
+    for (uint32_t seq = from; seq < to; seq++) {
+        make_record(rec, seq);
+        CHECK(ttn_trace_flash_append(rec, seq));
+    }
+}
+
+// Export everything and check the records are first, first + 1, ... and decode
+static uint16_t export_check(uint32_t *first)
+{
+    static uint8_t buf[SECTORS * SECTOR_SIZE];
+    uint16_t count = 0;
+    size_t len = ttn_trace_flash_export(buf, sizeof(buf), first, &count);
+    CHECK(len == (size_t)count * RECORD_LEN);
+
+    size_t pos = 0;
+    for (uint16_t n = 0; n < count; n++) {
+        trace_record_t record;
+        int rec_len = trace_decode_record(buf + pos, len - pos, *first + n, &record);
+        CHECK(rec_len == RECORD_LEN);
+        if (rec_len < 0) {
+            break;
+        }
+        CHECK(record.datum == *first + n);
+        CHECK(record.type == EV_TXSTART);
+        pos += rec_len;
+    }
+    return count;
+}
+
+static void test_fill_and_reset(void)
+{
+    memset(s_flash, 0x5a, sizeof(s_flash));     // never used: no valid sector headers
+    CHECK(ttn_trace_flash_init());
+    CHECK(ttn_trace_flash_next_seq() == 0);
+    CHECK(ttn_trace_flash_size() == 0);
+
+    append_range(0, 300);
+    uint32_t first = 0;
+    CHECK(export_check(&first) == 300);
+    CHECK(first == 0);
+    CHECK(ttn_trace_flash_size() == 300 * RECORD_LEN);
+
+    // a reset finds the newest record and keeps appending after it, in the same sector
+    int erases = s_erases;
+    CHECK(ttn_trace_flash_init());
+    CHECK(ttn_trace_flash_next_seq() == 300);
+    append_range(300, 310);
+    CHECK(s_erases == erases);
+    CHECK(export_check(&first) == 310);
+    CHECK(first == 0);
+    CHECK(s_bad_writes == 0);
+}
+
+static void test_wrap(void)
+{
+    // keep going until the ring has wrapped: the oldest sector goes, the rest stays consecutive
+    append_range(310, 4 * RECORDS_PER_SECTOR + 10);
+    uint32_t first = 0;
+    uint16_t count = export_check(&first);
+    CHECK(first == RECORDS_PER_SECTOR);
+    CHECK(first + count == 4 * RECORDS_PER_SECTOR + 10);
+    CHECK(s_bad_writes == 0);
+}
+
+static void test_discard(void)
+{
+    uint32_t first = 0;
+    uint16_t count = export_check(&first);
+    uint32_t end = first + count;
+
+    // discard part of it: the next export starts right after, whole sectors before it are erased
+    uint32_t half = first + count / 2;
+    ttn_trace_flash_discard(half);
+    uint32_t next_first = 0;
+    CHECK(export_check(&next_first) == end - half);
+    CHECK(next_first == half);
+
+    // records added after an export survive its discard
+    append_range(end, end + 5);
+    ttn_trace_flash_discard(end);
+    CHECK(export_check(&next_first) == 5);
+    CHECK(next_first == end);
+
+    // after a reset, the discarded records of the sector being written come back, the erased sectors don't
+    CHECK(ttn_trace_flash_init());
+    CHECK(export_check(&next_first) == end + 5 - 4 * RECORDS_PER_SECTOR);
+    CHECK(next_first == 4 * RECORDS_PER_SECTOR);
+    CHECK(s_bad_writes == 0);
+}
+
+static void test_gap(void)
+{
+    // a gap in the numbering (records lost in RAM) starts a new sector; an export stops before it
+    uint32_t next = ttn_trace_flash_next_seq();
+    ttn_trace_flash_discard(next);
+    append_range(next, next + 3);
+    append_range(next + 10, next + 12);
+    uint32_t first = 0;
+    CHECK(export_check(&first) == 3);
+    CHECK(first == next);
+
+    ttn_trace_flash_discard(next + 3);
+    CHECK(export_check(&first) == 2);
+    CHECK(first == next + 10);
+
+    CHECK(ttn_trace_flash_init());
+    CHECK(ttn_trace_flash_next_seq() == next + 12);
+    CHECK(s_bad_writes == 0);
+}
+
+static void test_torn_record(void)
+{
+    // power lost while a record was being written: its length made it, most of it didn't
+    uint32_t next = ttn_trace_flash_next_seq();
+    uint8_t rec[RECORD_LEN];
+    make_record(rec, next);
+    s_write_budget = 1;
+    CHECK(!ttn_trace_flash_append(rec, next));
+    s_write_budget = -1;
+
+    // it is counted (and decodes to junk), the ones after it are fine
+    CHECK(ttn_trace_flash_init());
+    CHECK(ttn_trace_flash_next_seq() == next + 1);
+    append_range(next + 1, next + 3);
+    ttn_trace_flash_discard(next + 1);
+    uint32_t first = 0;
+    CHECK(export_check(&first) == 2);
+    CHECK(first == next + 1);
+    CHECK(s_bad_writes == 0);
+}
+
+static void test_decode(void)
+{
+    uint8_t buf[12 + RECORD_LEN + 40];
+    memcpy(buf, "LMTR", 4);
+    buf[4] = 2;
+    buf[5] = 16;
+    buf[6] = 2;
+    buf[7] = 0;
+    memcpy(buf + 8, (const uint8_t[]){0x39, 0x30, 0, 0}, 4);            // 12345
+
+    trace_header_t header;
+    CHECK(trace_decode_header(buf, sizeof(buf), &header) == 12);
+    CHECK(header.version == 2 && header.us_per_tick == 16 && header.count == 2 && header.first == 12345);
+
+    make_record(buf + 12, 7);
+    uint8_t *msg = buf + 12 + RECORD_LEN;
+    memset(msg, 0, 40);
+    msg[0] = RECORD_LEN + 4;
+    msg[1] = TRACE_TYPE_DATUM;
+    memcpy(msg + 18, (const uint8_t[]){0xef, 0xbe, 0, 0}, 4);
+    memcpy(msg + RECORD_LEN, "Join", 4);
+
+    trace_record_t record;
+    char line[256];
+    int pos = 12;
+    int len = trace_decode_record(buf + pos, sizeof(buf) - pos, header.first, &record);
+    CHECK(len == RECORD_LEN);
+    CHECK(record.seq == 12345 && record.freq == 868100000 && record.datarate == 5 && record.time == 700);
+    trace_format_record(&record, header.us_per_tick, line, sizeof(line));
+    CHECK(strstr(line, "#12345 11.200 ms EV_TXSTART") == line);
+    CHECK(strstr(line, "freq=868.100 SF11 BW125") != NULL);
+
+    pos += len;
+    len = trace_decode_record(buf + pos, sizeof(buf) - pos, header.first + 1, &record);
+    CHECK(len == RECORD_LEN + 4);
+    trace_format_record(&record, header.us_per_tick, line, sizeof(line));
+    CHECK(strstr(line, "\"Join\" 0xbeef") != NULL);
+
+    // truncated and foreign data
+    CHECK(trace_decode_record(buf + 12, RECORD_LEN - 1, 0, &record) < 0);
+    buf[12] = 200;
+    CHECK(trace_decode_record(buf + 12, sizeof(buf) - 12, 0, &record) < 0);
+    CHECK(trace_decode_header((const uint8_t *)"LMTX\2\20\0\0\0\0\0\0", 12, &header) < 0);
+
+    // format 1: no sequence number, 8 byte header
+    buf[4] = 1;
+    CHECK(trace_decode_header(buf, sizeof(buf), &header) == 8);
+    CHECK(header.first == 0);
+}
+
+int main(void)
+{
+    test_fill_and_reset();
+    test_wrap();
+    test_discard();
+    test_gap();
+    test_torn_record();
+    test_decode();
+
+    if (s_failures) {
+        printf("trace_test: %d failures\n", s_failures);
+        return 1;
+    }
+    printf("trace_test: all tests passed\n");
+    return 0;
+}
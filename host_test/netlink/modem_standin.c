@@ -0,0 +1,330 @@
+/* Modem stand-in, see modem_standin.h
+*/
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "ppp_lite.h"
+#include "modem_standin.h"
+
+#define NMEA_INTERVAL_MS        200
+#define NO_CARRIER_DELAY_MS     20
+
+// Good fix: 10 satellites, HDOP 1.0
+static const char s_nmea[] = "$GNGNS,223254.00,5156.126739,N,00629.13328,W,AAA,10,1.0,18.9,46.0,,,V*48\r\n";
+
+static modem_standin_config_t s_config;
+static pthread_t s_thread;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;         // guards s_stats and the mode
+static pthread_mutex_t s_write_lock = PTHREAD_MUTEX_INITIALIZER;
+static modem_standin_stats_t s_stats;
+
+static ppp_lite_t s_peer;
+static int s_pppd_fd = -1;
+static pid_t s_pppd_pid;
+static int64_t s_no_carrier_at_ms;                                  // session ended, NO CARRIER due; 0 if not
+
+static char s_line[128];
+static size_t s_line_len;
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void write_all(int fd, const void *data, size_t len)
+{
+    pthread_mutex_lock(&s_write_lock);
+    while (len) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        data = (const uint8_t *)data + n;
+        len -= n;
+    }
+    pthread_mutex_unlock(&s_write_lock);
+}
+
+static void reply(const char *text)
+{
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "\r\n%s\r\n", text);
+    write_all(s_config.fd, buf, n);
+}
+
+static void peer_output(ppp_lite_t *ppp, const uint8_t *data, size_t len)
+{
+    write_all(s_config.fd, data, len);
+}
+
+static void peer_up(ppp_lite_t *ppp, uint32_t local_ip, uint32_t peer_ip)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.sessions_up++;
+    pthread_mutex_unlock(&s_lock);
+}
+
+static void peer_down(ppp_lite_t *ppp, bool by_peer)
+{
+    // Modem hangs up once LCP is closed, whichever side closed it
+    pthread_mutex_lock(&s_lock);
+    if (s_stats.data_mode && !s_no_carrier_at_ms) {
+        s_no_carrier_at_ms = now_ms() + NO_CARRIER_DELAY_MS;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+static void pppd_start(void)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("socketpair");
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], 0);
+        dup2(fds[1], 1);
+        close(fds[0]);
+        close(fds[1]);
+        // Network side: waits for our LCP like the modem does, assigns the address, nothing fancy
+        execl(s_config.pppd_path, "pppd", "notty", "nodetach", "silent", "local", "noauth", "nodefaultroute",
+              "noccp", "novj", "nodeflate", "nobsdcomp", "lcp-echo-interval", "0", "10.64.64.1:10.64.64.2",
+              (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    s_pppd_fd = fds[0];
+    s_pppd_pid = pid;
+}
+
+static void pppd_stop(void)
+{
+    if (s_pppd_fd < 0) {
+        return;
+    }
+    kill(s_pppd_pid, SIGTERM);
+    close(s_pppd_fd);
+    waitpid(s_pppd_pid, NULL, 0);
+    s_pppd_fd = -1;
+}
+
+static void enter_data_mode(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.dials++;
+    s_stats.data_mode = true;
+    s_no_carrier_at_ms = 0;
+    pthread_mutex_unlock(&s_lock);
+
+    reply("CONNECT 115200");
+    if (s_config.pppd_path) {
+        pppd_start();
+    } else {
+        ppp_lite_open(&s_peer);
+    }
+}
+
+static void leave_data_mode(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.data_mode = false;
+    s_stats.sessions_down++;
+    s_no_carrier_at_ms = 0;
+    pthread_mutex_unlock(&s_lock);
+
+    if (s_config.pppd_path) {
+        pppd_stop();
+    } else {
+        ppp_lite_reset(&s_peer);
+    }
+}
+
+static bool starts_with(const char *s, const char *prefix)
+{
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+static void handle_command(const char *line)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stats.commands++;
+    pthread_mutex_unlock(&s_lock);
+
+    if (!strcmp(line, "AT") || !strcmp(line, "ATE0") || !strcmp(line, "ATH") || starts_with(line, "AT+CGDCONT=")) {
+        reply("OK");
+    } else if (starts_with(line, "AT+CGPSINFOCFG=")) {
+        pthread_mutex_lock(&s_lock);
+        s_stats.configured = true;
+        pthread_mutex_unlock(&s_lock);
+        reply("OK");
+    } else if (!strcmp(line, "AT+CGPS=1,1") || !strcmp(line, "AT+CGPSHOT") || !strcmp(line, "AT+CGPSWARM")) {
+        pthread_mutex_lock(&s_lock);
+        s_stats.gnss_on = true;
+        s_stats.gnss_starts++;
+        pthread_mutex_unlock(&s_lock);
+        reply("OK");
+    } else if (!strcmp(line, "AT+CGPS=0")) {
+        pthread_mutex_lock(&s_lock);
+        s_stats.gnss_on = false;
+        pthread_mutex_unlock(&s_lock);
+        reply("OK");
+    } else if (!strcmp(line, "ATD*99#")) {
+        enter_data_mode();
+    } else {
+        reply("ERROR");
+    }
+}
+
+static void command_input(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == '\r' || data[i] == '\n') {
+            if (s_line_len) {
+                s_line[s_line_len] = '\0';
+                s_line_len = 0;
+                handle_command(s_line);
+                if (s_stats.data_mode) {
+                    return; // anything after ATD in this read would be PPP, and the firmware never sends that
+                }
+            }
+        } else if (s_line_len < sizeof(s_line) - 1) {
+            s_line[s_line_len++] = data[i];
+        }
+    }
+}
+
+static void data_input(const uint8_t *data, size_t len)
+{
+    if (len == 3 && !memcmp(data, "+++", 3)) {
+        pthread_mutex_lock(&s_lock);
+        s_stats.escapes++;
+        pthread_mutex_unlock(&s_lock);
+        leave_data_mode();
+        reply("OK");
+        return;
+    }
+
+    // PPP escapes every control character, so a raw CR can only be AT command text that leaked into the link
+    if (memchr(data, '\r', len)) {
+        pthread_mutex_lock(&s_lock);
+        s_stats.stray_commands++;
+        pthread_mutex_unlock(&s_lock);
+    }
+
+    if (s_config.pppd_path) {
+        if (s_pppd_fd >= 0) {
+            write_all(s_pppd_fd, data, len);
+        }
+    } else {
+        ppp_lite_input(&s_peer, data, len);
+    }
+}
+
+static void *standin_thread(void *arg)
+{
+    uint8_t buf[2048];
+    int64_t next_nmea_ms = 0;
+
+    while (1) {
+        struct pollfd pfds[2] = {
+            {.fd = s_config.fd, .events = POLLIN},
+            {.fd = s_pppd_fd, .events = POLLIN},
+        };
+        poll(pfds, s_pppd_fd >= 0 ? 2 : 1, 10);
+
+        if (pfds[0].revents & (POLLHUP | POLLERR)) {
+            break;
+        }
+        if (pfds[0].revents & POLLIN) {
+            ssize_t n = recv(s_config.fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                break;
+            }
+            if (s_stats.data_mode) {
+                data_input(buf, n);
+            } else {
+                command_input(buf, n);
+            }
+        }
+        if (s_pppd_fd >= 0 && (pfds[1].revents & (POLLIN | POLLHUP))) {
+            ssize_t n = read(s_pppd_fd, buf, sizeof(buf));
+            if (n > 0) {
+                write_all(s_config.fd, buf, n);
+            } else {
+                peer_down(NULL, true); // pppd exited
+                close(s_pppd_fd);
+                waitpid(s_pppd_pid, NULL, 0);
+                s_pppd_fd = -1;
+            }
+        }
+
+        int64_t now = now_ms();
+        if (!s_config.pppd_path) {
+            ppp_lite_tick(&s_peer, now);
+        }
+
+        pthread_mutex_lock(&s_lock);
+        bool no_carrier = s_no_carrier_at_ms && now >= s_no_carrier_at_ms;
+        bool nmea = s_stats.gnss_on && !s_stats.data_mode && now >= next_nmea_ms;
+        pthread_mutex_unlock(&s_lock);
+
+        if (no_carrier) {
+            leave_data_mode();
+            reply("NO CARRIER");
+        }
+        if (nmea) {
+            write_all(s_config.fd, s_nmea, sizeof(s_nmea) - 1);
+            next_nmea_ms = now + NMEA_INTERVAL_MS;
+        }
+    }
+    return NULL;
+}
+
+void modem_standin_start(const modem_standin_config_t *config)
+{
+    s_config = *config;
+    ppp_lite_config_t peer_config = {
+        .local_ip = inet_addr("10.64.64.1"),
+        .peer_ip = inet_addr("10.64.64.2"),
+        .passive = true,
+        .output = peer_output,
+        .up = peer_up,
+        .down = peer_down,
+    };
+    ppp_lite_init(&s_peer, &peer_config);
+    pthread_create(&s_thread, NULL, standin_thread, NULL);
+}
+
+modem_standin_stats_t modem_standin_stats(void)
+{
+    pthread_mutex_lock(&s_lock);
+    modem_standin_stats_t stats = s_stats;
+    pthread_mutex_unlock(&s_lock);
+    return stats;
+}
+
+void modem_standin_drop(void)
+{
+    if (s_config.pppd_path) {
+        if (s_pppd_fd >= 0) {
+            kill(s_pppd_pid, SIGTERM); // pppd sends Terminate-Request and exits
+        }
+    } else {
+        ppp_lite_close(&s_peer);
+    }
+}
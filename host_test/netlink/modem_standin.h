@@ -0,0 +1,40 @@
+/* Modem stand-in: plays the SIM7600 on the far end of the shim UART
+ *
+ * Answers the AT commands sim7600.c sends, streams NMEA while the GNSS receiver is on, and on ATD*99# switches
+ * to data mode with a PPP peer: either ppp_lite in the modem's passive role, or a relay to a real pppd.
+ * Counts what the firmware does wrong, e.g. command text written to the UART while in data mode.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    int fd;                             /*<! our end of the UART socket */
+    const char *pppd_path;              /*<! run pppd as the network side instead of ppp_lite, NULL for ppp_lite */
+} modem_standin_config_t;
+
+typedef struct {
+    uint32_t commands;                  /*<! AT command lines answered */
+    uint32_t dials;
+    uint32_t sessions_up;               /*<! PPP sessions that reached IPCP Opened */
+    uint32_t sessions_down;
+    uint32_t escapes;                   /*<! "+++" seen in data mode */
+    uint32_t stray_commands;            /*<! AT text received in data mode */
+    uint32_t gnss_starts;
+    bool data_mode;
+    bool gnss_on;
+    bool configured;                    /*<! NMEA output selected (AT+CGPSINFOCFG) */
+} modem_standin_stats_t;
+
+void modem_standin_start(const modem_standin_config_t *config);
+
+/**
+ * @brief Snapshot of the counters
+ */
+modem_standin_stats_t modem_standin_stats(void);
+
+/**
+ * @brief Network side ends the PPP session (LCP Terminate-Request), then NO CARRIER
+ */
+void modem_standin_drop(void);
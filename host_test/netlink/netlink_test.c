@@ -0,0 +1,218 @@
+/* Link manager and SIM7600 PPP tests against a modem stand-in
+ *
+ * Runs the real at.c, sim7600.c and netlink.c on the host shim; WiFi and the position filter are stubbed.
+ *
+ *   netlink_test                 PPP network side played by ppp_lite
+ *   netlink_test /usr/sbin/pppd  PPP network side played by pppd (needs root; exits 77 = skipped otherwise)
+*/
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+
+#include "maxbox_defines.h"
+#include "at.h"
+#include "netlink.h"
+#include "position.h"
+#include "sim7600.h"
+#include "wifi.h"
+
+#include "modem_standin.h"
+#include "shim_check.h"
+
+#define SKIPPED 77
+
+// Polls cond every 10ms for up to timeout_ms
+#define WAIT_FOR(cond, timeout_ms) do { \
+        int64_t _deadline = now_ms() + (timeout_ms); \
+        while (!(cond) && now_ms() < _deadline) { \
+            usleep(10000); \
+        } \
+    } while (0)
+
+#define now_ms() (esp_timer_get_time() / 1000)
+
+static telemetry_t s_tel = {.aux_battery_voltage = 13.0f};
+static struct maxbox s_mb = {.tel = &s_tel};
+maxbox_t mb = &s_mb;
+
+/* WiFi stub: fails (or succeeds) after a delay, like an association attempt */
+
+static volatile esp_err_t s_wifi_result = ESP_FAIL;
+static volatile int s_wifi_delay_ms = 100;
+static volatile int s_wifi_attempts;
+
+esp_err_t wifi_connect()
+{
+    s_wifi_attempts++;
+    vTaskDelay(pdMS_TO_TICKS(s_wifi_delay_ms));
+    return s_wifi_result;
+}
+
+void wifi_disconnect()
+{
+}
+
+/* Position stub: always parked, so the GNSS scheduler takes one fix and stops */
+
+void position_init()
+{
+}
+
+void position_update(const nmea_fix_t *fix)
+{
+}
+
+void position_tick()
+{
+}
+
+bool position_moving()
+{
+    return false;
+}
+
+static void test_failover_to_cellular(void)
+{
+    int64_t start = now_ms();
+    CHECK(netlink_connect(false) == NET_LINK_CELLULAR);
+    CHECK(now_ms() - start < 5000);
+    CHECK(s_wifi_attempts == 1);
+
+    modem_standin_stats_t stats = modem_standin_stats();
+    CHECK(stats.dials == 1 && stats.data_mode);
+    CHECK(mb->tel->net_link == NET_LINK_CELLULAR);
+}
+
+static void test_commands_rejected_in_data_mode(void)
+{
+    uint32_t commands = modem_standin_stats().commands;
+
+    CHECK(at_command("AT+CSQ\r", AT_DEFAULT_TIMEOUT_MS, NULL, 0) == ESP_ERR_INVALID_STATE);
+    CHECK(at_command_async("AT+CGPS=0\r", AT_DEFAULT_TIMEOUT_MS, NULL, NULL) == ESP_ERR_INVALID_STATE);
+    usleep(200000);
+
+    modem_standin_stats_t stats = modem_standin_stats();
+    CHECK(stats.stray_commands == 0);
+    CHECK(stats.commands == commands);
+}
+
+static void test_connect_when_up(void)
+{
+    int64_t start = now_ms();
+    CHECK(netlink_connect(false) == NET_LINK_CELLULAR);
+    CHECK(now_ms() - start < 100);
+    CHECK(s_wifi_attempts == 1);
+    CHECK(modem_standin_stats().dials == 1);
+}
+
+static void test_redial_after_network_drop(void)
+{
+    modem_standin_drop();
+    WAIT_FOR(!modem_standin_stats().data_mode, 3000);
+    CHECK(!modem_standin_stats().data_mode);
+    usleep(200000); // let the PPP events reach netlink
+
+    // Urgent: WiFi failed a moment ago, so this goes straight to cellular and must redial
+    int attempts = s_wifi_attempts;
+    CHECK(netlink_connect(true) == NET_LINK_CELLULAR);
+    CHECK(s_wifi_attempts == attempts);
+
+    modem_standin_stats_t stats = modem_standin_stats();
+    CHECK(stats.dials == 2 && stats.data_mode);
+    CHECK(stats.stray_commands == 0);
+}
+
+static void test_disconnect(void)
+{
+    netlink_disconnect();
+
+    modem_standin_stats_t stats = modem_standin_stats();
+    CHECK(!stats.data_mode);
+    CHECK(stats.escapes == 0); // LCP terminate brought the modem back, no +++ needed
+    CHECK(stats.stray_commands == 0);
+    CHECK(at_command("AT\r", AT_DEFAULT_TIMEOUT_MS, NULL, 0) == ESP_OK);
+}
+
+static void *connect_thread(void *arg)
+{
+    *(net_link_t *)arg = netlink_connect(false);
+    return NULL;
+}
+
+static void test_concurrent_connect_disconnect(void)
+{
+    // Disconnect lands while connect is still in the WiFi attempt; it must wait, not deadlock or interleave
+    pthread_t thread;
+    net_link_t link = NET_LINK_NONE;
+    s_wifi_delay_ms = 300;
+
+    int64_t start = now_ms();
+    pthread_create(&thread, NULL, connect_thread, &link);
+    usleep(50000);
+    netlink_disconnect();
+    pthread_join(thread, NULL);
+
+    CHECK(link == NET_LINK_CELLULAR);
+    CHECK(now_ms() - start < 10000);
+    CHECK(!modem_standin_stats().data_mode);
+    CHECK(at_command("AT\r", AT_DEFAULT_TIMEOUT_MS, NULL, 0) == ESP_OK);
+
+    // And the link manager still works afterwards
+    CHECK(netlink_connect(true) == NET_LINK_CELLULAR);
+    netlink_disconnect();
+    CHECK(!modem_standin_stats().data_mode);
+    CHECK(modem_standin_stats().stray_commands == 0);
+}
+
+int main(int argc, char **argv)
+{
+    modem_standin_config_t standin = {0};
+    if (argc > 1) {
+        if (access(argv[1], X_OK) != 0 || geteuid() != 0) {
+            printf("netlink: %s needs root, skipped\n", argv[1]);
+            return SKIPPED;
+        }
+        standin.pppd_path = argv[1];
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+    shim_uart_attach(SIM_UART_PORT, fds[0]);
+    standin.fd = fds[1];
+    modem_standin_start(&standin);
+
+    shim_gpio_set_input(SIM_STATUS_PIN, 1); // modem powered: boot goes through the reset path
+    esp_event_loop_create_default();
+    sim7600_init();
+    netlink_init();
+
+    // Boot: modem answers and NMEA output is configured
+    WAIT_FOR(modem_standin_stats().configured, 10000);
+    CHECK(modem_standin_stats().configured);
+
+    test_failover_to_cellular();
+    test_commands_rejected_in_data_mode();
+    test_connect_when_up();
+    test_redial_after_network_drop();
+    test_disconnect();
+    test_concurrent_connect_disconnect();
+
+    if (s_failures) {
+        printf("%d check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("netlink: all tests passed\n");
+    return 0;
+}
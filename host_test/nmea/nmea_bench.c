@@ -0,0 +1,75 @@
+/* Throughput benchmark for the streaming NMEA parser
+ *
+ *   nmea_bench [rounds]
+ * Feeds a one-second SIM7600 output burst (supported and unsupported sentences) through the parser and
+ * reports bytes/s and ns per sentence. Host numbers; scale by the ESP32-S3's clock for a rough on-target figure.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nmea.h"
+
+static const char *s_burst[] = {
+    "GNGNS,223254.00,5156.126739,N,00629.13328,W,AAN,10,1.0,18.9,46.0,,,V",
+    "GNGGA,223254.00,5156.126739,N,00629.13328,W,1,10,1.0,18.9,M,46.0,M,,",
+    "GNRMC,223254.00,A,5156.126739,N,00629.13328,W,0.0,279.3,150323,,,A,V",
+    "GNGSA,A,3,04,05,09,12,24,25,29,,,,,,1.8,1.0,1.5,1",
+    "GNGSA,A,3,65,66,72,,,,,,,,,,1.8,1.0,1.5,2",
+    "GPGSV,3,1,11,04,15,270,30,05,44,206,41,09,22,155,35,12,61,081,44,1",
+    "GPGSV,3,2,11,24,33,298,38,25,51,101,42,29,09,045,28,31,03,330,,1",
+    "GPGSV,3,3,11,18,02,189,,20,01,003,,26,00,150,,1",
+    "GLGSV,2,1,06,65,32,064,36,66,71,332,40,72,14,028,30,73,05,242,,1",
+    "GLGSV,2,2,06,81,18,116,,88,26,296,,1",
+    "GNVTG,279.3,T,,M,0.0,N,0.0,K,A",
+};
+
+static unsigned s_callbacks;
+
+static void on_sentence(nmea_sentence_t type, const nmea_fix_t *fix, void *ctx)
+{
+    s_callbacks++;
+}
+
+int main(int argc, char **argv)
+{
+    long rounds = argc > 1 ? atol(argv[1]) : 200000;
+    char burst[2048];
+    size_t len = 0;
+    size_t sentences = sizeof(s_burst) / sizeof(s_burst[0]);
+
+    for (size_t i = 0; i < sentences; i++) {
+        uint8_t checksum = 0;
+        for (const char *c = s_burst[i]; *c; c++) {
+            checksum ^= *c;
+        }
+        len += snprintf(burst + len, sizeof(burst) - len, "$%s*%02X\r\n", s_burst[i], checksum);
+    }
+
+    nmea_parser_t p;
+    nmea_parser_init(&p, on_sentence, NULL);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long r = 0; r < rounds; r++) {
+        nmea_parse(&p, (const uint8_t *)burst, len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double bytes = (double)len * rounds;
+
+    if (p.stats.checksum_errors || p.stats.framing_errors || s_callbacks != 5 * rounds) {
+        printf("nmea_bench: unexpected parse result (%u checksum, %u framing errors, %u callbacks)\n",
+               p.stats.checksum_errors, p.stats.framing_errors, s_callbacks);
+        return 1;
+    }
+
+    printf("nmea_bench: %zu-byte burst of %zu sentences x %ld rounds\n", len, sentences, rounds);
+    printf("  %.1f MB/s, %.0f ns/sentence, %.2f ns/byte\n", bytes / seconds / 1e6,
+           seconds * 1e9 / ((double)sentences * rounds), seconds * 1e9 / bytes);
+    // The UART delivers 11520 bytes/s at 115200 baud
+    printf("  %.4f%% of one host core at 115200 baud\n", 11520.0 * seconds / bytes * 100);
+    return 0;
+}
@@ -0,0 +1,169 @@
+/* Fuzz harness for the streaming NMEA parser
+ *
+ * Built standalone, main() mutates a corpus of real SIM7600 sentences and feeds them in random-sized chunks:
+ *   nmea_fuzz [iterations] [seed]
+ * The same LLVMFuzzerTestOneInput() entry point can be linked against libFuzzer instead (-DNMEA_LIBFUZZER).
+ * Every input must leave the parser sane, and a clean sentence afterwards must always parse.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nmea.h"
+
+static const char *s_corpus[] = {
+    "$GNGNS,223254.00,5156.126739,N,00629.13328,W,AAA,10,1.0,18.9,46.0,,,V*7A\r\n",
+    "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n",
+    "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n",
+    "$GNGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1*27\r\n",
+    "$GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00*74\r\n",
+    "$GNGNS,,,,,,NNN,0,,,,,,V*57\r\n",
+};
+
+static const char s_probe[] = "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n";
+
+static unsigned s_calls;
+
+static void fail(const char *what)
+{
+    printf("nmea_fuzz: %s\n", what);
+    abort();
+}
+
+static void on_sentence(nmea_sentence_t type, const nmea_fix_t *fix, void *ctx)
+{
+    s_calls++;
+    if (type < NMEA_SENTENCE_GNS || type > NMEA_SENTENCE_GSA) {
+        fail("callback for an unsupported sentence type");
+    }
+    // parse_coordinate() accepts at most 180 degrees and 59.9999999 minutes
+    if (fix->lat_e7 > 1810000000 || fix->lat_e7 < -1810000000 ||
+            fix->lon_e7 > 1810000000 || fix->lon_e7 < -1810000000) {
+        fail("coordinate out of range");
+    }
+    if (fix->time_ms >= 86401000) {
+        fail("time of day out of range");
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    nmea_parser_t p;
+    nmea_parser_init(&p, on_sentence, NULL);
+    s_calls = 0;
+
+    // First byte picks the chunk size so split points get exercised too
+    size_t chunk = size ? (data[0] % 32) + 1 : 1;
+    for (size_t i = 0; i < size; i += chunk) {
+        nmea_parse(&p, data + i, (size - i < chunk) ? size - i : chunk);
+    }
+
+    if (s_calls > p.stats.sentences) {
+        fail("more callbacks than checksum-valid sentences");
+    }
+
+    // Whatever came before, the parser must resynchronise on the next '$'
+    unsigned before = s_calls;
+    nmea_parse(&p, (const uint8_t *)s_probe, sizeof(s_probe) - 1);
+    if (s_calls != before + 1 || p.fix.lat_e7 != 481173000 || p.fix.lon_e7 != 115166667 || !p.fix.position_valid) {
+        fail("parser did not recover");
+    }
+    return 0;
+}
+
+#ifndef NMEA_LIBFUZZER
+
+static const char s_alphabet[] = "$,*\r\n.-0123456789ABCDEFNSWGPRMCV";
+
+static size_t mutate(uint8_t *buf, size_t len, size_t max)
+{
+    switch (rand() % 6) {
+    case 0: // flip a bit
+        if (len) {
+            buf[rand() % len] ^= 1 << (rand() % 8);
+        }
+        break;
+    case 1: // replace with an NMEA-ish byte
+        if (len) {
+            buf[rand() % len] = s_alphabet[rand() % (sizeof(s_alphabet) - 1)];
+        }
+        break;
+    case 2: // truncate
+        if (len) {
+            len = rand() % len;
+        }
+        break;
+    case 3: // insert a byte
+        if (len < max) {
+            size_t at = rand() % (len + 1);
+            memmove(buf + at + 1, buf + at, len - at);
+            buf[at] = (rand() % 2) ? s_alphabet[rand() % (sizeof(s_alphabet) - 1)] : rand();
+            len++;
+        }
+        break;
+    case 4: // duplicate a run, stretching fields past their limits
+        if (len) {
+            size_t at = rand() % len;
+            size_t run = 1 + rand() % 24;
+            if (at + run > len) {
+                run = len - at;
+            }
+            if (len + run <= max) {
+                memmove(buf + at + run, buf + at, len - at);
+                len += run;
+            }
+        }
+        break;
+    case 5: // splice in another corpus sentence
+        {
+            const char *s = s_corpus[rand() % (sizeof(s_corpus) / sizeof(s_corpus[0]))];
+            size_t n = strlen(s);
+            size_t at = len ? rand() % len : 0;
+            if (at + n > max) {
+                n = max - at;
+            }
+            memcpy(buf + at, s, n);
+            if (at + n > len) {
+                len = at + n;
+            }
+        }
+        break;
+    }
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    unsigned seed = argc > 2 ? (unsigned)atol(argv[2]) : 1;
+    uint8_t buf[1024];
+
+    srand(seed);
+    for (long it = 0; it < iterations; it++) {
+        size_t len = 0;
+        int sentences = 1 + rand() % 4;
+        for (int i = 0; i < sentences; i++) {
+            const char *s = s_corpus[rand() % (sizeof(s_corpus) / sizeof(s_corpus[0]))];
+            size_t n = strlen(s);
+            memcpy(buf + len, s, n);
+            len += n;
+        }
+        int mutations = rand() % 8;
+        for (int i = 0; i < mutations; i++) {
+            len = mutate(buf, len, sizeof(buf));
+        }
+        if (rand() % 16 == 0) {
+            // Pure noise now and then
+            len = rand() % sizeof(buf);
+            for (size_t i = 0; i < len; i++) {
+                buf[i] = rand();
+            }
+        }
+        LLVMFuzzerTestOneInput(buf, len);
+    }
+
+    printf("nmea_fuzz: %ld inputs, seed %u, no failures\n", iterations, seed);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,140 @@
+/* Known-answer tests for the streaming NMEA parser
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "nmea.h"
+#include "shim_check.h"
+
+static int s_calls;
+static nmea_sentence_t s_last_type;
+static nmea_fix_t s_last_fix;
+
+static void on_sentence(nmea_sentence_t type, const nmea_fix_t *fix, void *ctx)
+{
+    s_calls++;
+    s_last_type = type;
+    s_last_fix = *fix;
+}
+
+static void feed(nmea_parser_t *p, const char *s)
+{
+    nmea_parse(p, (const uint8_t *)s, strlen(s));
+}
+
+// Frames a sentence body as $<body>*hh\r\n
+static void feed_body(nmea_parser_t *p, const char *body)
+{
+    char line[128];
+    uint8_t checksum = 0;
+    for (const char *c = body; *c; c++) {
+        checksum ^= *c;
+    }
+    snprintf(line, sizeof(line), "$%s*%02X\r\n", body, checksum);
+    feed(p, line);
+}
+
+static void test_sentences(void)
+{
+    nmea_parser_t p;
+    nmea_parser_init(&p, on_sentence, NULL);
+    s_calls = 0;
+
+    feed_body(&p, "GNGNS,223254.00,5156.126739,N,00629.13328,W,AAA,10,1.0,18.9,46.0,,,V");
+    CHECK(s_calls == 1 && s_last_type == NMEA_SENTENCE_GNS);
+    CHECK(s_last_fix.lat_e7 == 519354457 && s_last_fix.lon_e7 == -64855547);
+    CHECK(s_last_fix.sats_used == 10 && s_last_fix.hdop_x100 == 100 && s_last_fix.alt_dm == 189);
+    CHECK(s_last_fix.time_ms == ((22 * 60 + 32) * 60 + 54) * 1000);
+    CHECK(s_last_fix.position_valid);
+
+    feed_body(&p, "GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W");
+    CHECK(s_calls == 2 && s_last_type == NMEA_SENTENCE_RMC);
+    CHECK(s_last_fix.date == 230394 && s_last_fix.speed_knots_x100 == 2240 && s_last_fix.course_x100 == 8440);
+    CHECK(s_last_fix.lat_e7 == 481173000 && s_last_fix.lon_e7 == 115166667);
+
+    feed_body(&p, "GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,");
+    CHECK(s_calls == 3 && s_last_type == NMEA_SENTENCE_GGA);
+    CHECK(s_last_fix.alt_dm == 5454 && s_last_fix.hdop_x100 == 90 && s_last_fix.sats_used == 8);
+    CHECK(s_last_fix.fix_quality == 1 && s_last_fix.position_valid);
+
+    feed_body(&p, "GNGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1");
+    CHECK(s_calls == 4 && s_last_type == NMEA_SENTENCE_GSA);
+    CHECK(s_last_fix.fix_type == 3 && s_last_fix.pdop_x100 == 250);
+    CHECK(s_last_fix.hdop_x100 == 130 && s_last_fix.vdop_x100 == 210);
+    // GSA carries no position and must not clear the last one
+    CHECK(s_last_fix.position_valid && s_last_fix.lat_e7 == 481173000);
+
+    // No fix: position fields empty, last coordinates kept but marked invalid
+    feed_body(&p, "GNGNS,,,,,,NNN,0,,,,,,V");
+    CHECK(s_calls == 5 && !s_last_fix.position_valid && s_last_fix.lat_e7 == 481173000);
+
+    feed_body(&p, "GPGGA,000001,3351.000,S,15112.000,E,0,00,,,M,,M,,");
+    CHECK(s_calls == 6 && !s_last_fix.position_valid);
+    CHECK(s_last_fix.lat_e7 == -338500000 && s_last_fix.lon_e7 == 1512000000);
+
+    CHECK(p.stats.sentences == 6 && p.stats.checksum_errors == 0 && p.stats.framing_errors == 0);
+}
+
+static void test_errors(void)
+{
+    nmea_parser_t p;
+    nmea_parser_init(&p, on_sentence, NULL);
+    s_calls = 0;
+
+    // Wrong checksum
+    feed(&p, "$GNGNS,223254.00,5156.126739,N,00629.13328,W,AAA,10,1.0,18.9,46.0,,,V*48\r\n");
+    CHECK(s_calls == 0 && p.stats.checksum_errors == 1);
+
+    // Missing checksum
+    feed(&p, "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,\r\n");
+    CHECK(s_calls == 0 && p.stats.framing_errors == 1);
+
+    // Sentence cut off by the next '$': the second one still parses
+    feed(&p, "$GPGGA,1235");
+    feed_body(&p, "GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W");
+    CHECK(s_calls == 1 && p.stats.framing_errors == 2);
+
+    // Overlong sentence
+    char line[160];
+    memset(line, 'A', sizeof(line));
+    line[0] = '$';
+    line[sizeof(line) - 1] = '\0';
+    feed(&p, line);
+    feed(&p, "\r\n");
+    CHECK(s_calls == 1 && p.stats.framing_errors == 3);
+
+    // Known but unsupported type
+    feed_body(&p, "GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00");
+    CHECK(s_calls == 1 && p.stats.unknown == 1);
+
+    // Garbage in a numeric field is ignored without clearing the rest of the fix
+    feed_body(&p, "GPGGA,123520,4807.038,N,01131.000,E,1,x8,0.9,545.4,M,46.9,M,,");
+    CHECK(s_calls == 2 && s_last_fix.sats_used == 0 && s_last_fix.alt_dm == 5454);
+}
+
+static void test_split_feed(void)
+{
+    // Byte at a time, as the UART ring buffer may hand them over
+    const char *s = "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n";
+    nmea_parser_t p;
+    nmea_parser_init(&p, on_sentence, NULL);
+    s_calls = 0;
+    for (const char *c = s; *c; c++) {
+        nmea_parse_byte(&p, *c);
+    }
+    CHECK(s_calls == 1 && s_last_fix.lat_e7 == 481173000);
+}
+
+int main(void)
+{
+    test_sentences();
+    test_errors();
+    test_split_feed();
+
+    if (s_failures) {
+        printf("%d check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("nmea: all tests passed\n");
+    return 0;
+}
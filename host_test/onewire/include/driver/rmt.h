@@ -0,0 +1,8 @@
+/* Host stand-in for the RMT driver types in owb_rmt.h; onewire_sim.c provides owb_rmt_initialize()
+*/
+#pragma once
+
+typedef int rmt_channel_t;
+
+#define RMT_CHANNEL_0   0
+#define RMT_CHANNEL_4   4
@@ -0,0 +1,5 @@
+/* Host stand-in for the FreeRTOS ring buffer type, which owb_rmt.h declares its driver info with
+*/
+#pragma once
+
+typedef void *RingbufHandle_t;
@@ -0,0 +1,130 @@
+/* Bus cost of the 1-Wire operations MaxBox runs, on the simulated bus
+ *
+ *   onewire_bench [rounds]
+ *
+ * Counts bus transactions (each an RMT round trip the task sleeps through on the ESP32) and bus time, for the
+ * batched touch_bits driver and the slot by slot fallback. Before the searches were batched, enumerating took
+ * 194 transactions per device, about what the fallback still costs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "onewire.h"
+#include "onewire_sim.h"
+
+#define IBUTTON_POLL_MS     250
+
+typedef struct {
+    const char *name;
+    uint64_t transactions;
+    uint64_t bus_us;
+    uint64_t operations;
+} bench_total_t;
+
+static void add(bench_total_t *total, uint64_t operations)
+{
+    onewire_sim_stats_t stats = onewire_sim_stats();
+    total->transactions += stats.transactions;
+    total->bus_us += stats.bus_us;
+    total->operations += operations;
+}
+
+static void print(const bench_total_t *total, const char *per)
+{
+    printf("  %-34s %7.1f transactions/%s %7.2f ms bus/%s\n", total->name,
+           (double)total->transactions / total->operations, per,
+           (double)total->bus_us / 1000 / total->operations, per);
+}
+
+static void random_bus(int probes, bool ibutton, OneWireBus_ROMCode *ibutton_rom)
+{
+    static const uint8_t probe_families[] = {ONEWIRE_FAMILY_DS18B20, ONEWIRE_FAMILY_DS18S20, ONEWIRE_FAMILY_DS1822};
+    onewire_sim_device_t devices[ONEWIRE_SIM_MAX_DEVICES];
+    memset(devices, 0, sizeof(devices));
+
+    int n = 0;
+    for (; n < probes; n++) {
+        uint64_t serial = ((uint64_t)rand() << 32) ^ rand();
+        devices[n].rom = onewire_sim_rom(probe_families[rand() % sizeof(probe_families)], serial);
+    }
+    if (ibutton) {
+        devices[n].rom = onewire_sim_rom(ONEWIRE_FAMILY_DS1990A, ((uint64_t)rand() << 32) ^ rand());
+        if (ibutton_rom) {
+            *ibutton_rom = devices[n].rom;
+        }
+        n++;
+    }
+    onewire_sim_set_devices(devices, n);
+}
+
+static void bench_enumerate(int rounds, bool touch_bits)
+{
+    OneWireBus *bus = onewire_sim_bus(touch_bits);
+    bench_total_t total = {touch_bits ? "enumerate, touch_bits" : "enumerate, slot by slot"};
+
+    for (int round = 0; round < rounds; round++) {
+        int probes = 1 + rand() % 4;
+        random_bus(probes, rand() % 2, NULL);
+
+        OneWireBus_SearchState search;
+        bool found = false;
+        int n = 0;
+        onewire_sim_reset_stats();
+        owb_search_first(bus, &search, &found);
+        while (found) {
+            n++;
+            owb_search_next(bus, &search, &found);
+        }
+        add(&total, n);
+    }
+    print(&total, "device");
+}
+
+static void bench_poll(int rounds, bool ibutton)
+{
+    OneWireBus *bus = onewire_sim_bus(true);
+    bench_total_t search = {"family search"};
+    bench_total_t check = {ibutton ? "verify attached ROM" : "family check first"};
+
+    for (int round = 0; round < rounds; round++) {
+        OneWireBus_ROMCode attached;
+        random_bus(1 + rand() % 3, ibutton, &attached);
+
+        OneWireBus_ROMCode rom_code;
+        onewire_sim_reset_stats();
+        onewire_find_family(bus, ONEWIRE_FAMILY_DS1990A, &rom_code);
+        add(&search, 1);
+
+        // as ibutton.c polls
+        bool present = false;
+        onewire_sim_reset_stats();
+        if (ibutton) {
+            owb_verify_rom(bus, attached, &present);
+        } else if (owb_family_present(bus, ONEWIRE_FAMILY_DS1990A, &present) == OWB_STATUS_OK && present) {
+            onewire_find_family(bus, ONEWIRE_FAMILY_DS1990A, &rom_code);
+        }
+        add(&check, 1);
+    }
+    print(&search, "poll");
+    print(&check, "poll");
+    printf("  at one poll per %d ms: %.1f%% -> %.1f%% of the bus\n", IBUTTON_POLL_MS,
+           100.0 * search.bus_us / 1000 / search.operations / IBUTTON_POLL_MS,
+           100.0 * check.bus_us / 1000 / check.operations / IBUTTON_POLL_MS);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    srand(1);
+
+    printf("onewire_bench: %d rounds\n", rounds);
+    printf("enumerating 1-4 probes, with or without an iButton:\n");
+    bench_enumerate(rounds, true);
+    bench_enumerate(rounds, false);
+    printf("iButton poll, probes only on the bus:\n");
+    bench_poll(rounds, false);
+    printf("iButton poll, iButton attached:\n");
+    bench_poll(rounds, true);
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include <string.h>
+
+#include "onewire_sim.h"
+
+#define DS18X20_CONVERT_T           0x44
+#define DS18X20_READ_SCRATCHPAD     0xBE
+
+typedef enum {
+    SIM_IDLE,                               // nothing addressed, slots are ignored until the next reset
+    SIM_ROM_COMMAND,
+    SIM_SEARCH,
+    SIM_READ_ROM,
+    SIM_MATCH_ROM,
+    SIM_FUNCTION_COMMAND,
+    SIM_READ_SCRATCHPAD,
+} sim_state_t;
+
+static onewire_sim_device_t s_devices[ONEWIRE_SIM_MAX_DEVICES];
+static int s_count;
+static onewire_sim_stats_t s_stats;
+
+static sim_state_t s_state;
+static bool s_active[ONEWIRE_SIM_MAX_DEVICES];  // still addressed: not dropped out of a search or Match ROM
+static int s_bit;                               // bit position within the command, ROM code or scratchpad
+static int s_search_phase;                      // 0: ROM bit, 1: its complement, 2: direction from the master
+static uint8_t s_command;
+
+void onewire_sim_set_devices(const onewire_sim_device_t *devices, int count)
+{
+    s_count = count < ONEWIRE_SIM_MAX_DEVICES ? count : ONEWIRE_SIM_MAX_DEVICES;
+    if (s_count) {
+        memcpy(s_devices, devices, s_count * sizeof(s_devices[0]));
+    }
+    s_state = SIM_IDLE;
+}
+
+void onewire_sim_reset_stats(void)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+onewire_sim_stats_t onewire_sim_stats(void)
+{
+    onewire_sim_stats_t stats = s_stats;
+    stats.bus_us = stats.resets * ONEWIRE_SIM_RESET_US + stats.slots * ONEWIRE_SIM_SLOT_US;
+    return stats;
+}
+
+OneWireBus_ROMCode onewire_sim_rom(uint8_t family, uint64_t serial)
+{
+    OneWireBus_ROMCode rom;
+    rom.bytes[0] = family;
+    for (int i = 0; i < 6; i++) {
+        rom.bytes[1 + i] = serial >> (8 * i);
+    }
+    rom.bytes[7] = owb_crc8_bytes(0, rom.bytes, 7);
+    return rom;
+}
+
+static bool rom_bit(int device, int bit)
+{
+    return (s_devices[device].rom.bytes[bit / 8] >> (bit % 8)) & 1;
+}
+
+// Receive one bit of a command; true once all eight are in
+static bool command_bit(int level)
+{
+    s_command |= level << s_bit;
+    if (++s_bit < 8) {
+        return false;
+    }
+    s_bit = 0;
+    return true;
+}
+
+static void rom_command(void)
+{
+    switch (s_command) {
+    case OWB_ROM_SEARCH:
+        s_state = SIM_SEARCH;
+        s_search_phase = 0;
+        break;
+    case OWB_ROM_READ:
+        s_state = SIM_READ_ROM;
+        break;
+    case OWB_ROM_MATCH:
+        s_state = SIM_MATCH_ROM;
+        break;
+    case OWB_ROM_SKIP:
+        s_state = SIM_FUNCTION_COMMAND;
+        break;
+    default:
+        s_state = SIM_IDLE;
+        break;
+    }
+    s_command = 0;
+}
+
+static void function_command(void)
+{
+    switch (s_command) {
+    case DS18X20_CONVERT_T:
+        s_stats.converts++;
+        s_state = SIM_IDLE;
+        break;
+    case DS18X20_READ_SCRATCHPAD:
+        s_state = SIM_READ_SCRATCHPAD;
+        break;
+    default:
+        s_state = SIM_IDLE;
+        break;
+    }
+    s_command = 0;
+}
+
+// One time slot: the master writes level (1 is also a read slot), returns the level sampled on the bus
+static int slot(int level)
+{
+    int in = level;
+    s_stats.slots++;
+
+    switch (s_state) {
+    case SIM_IDLE:
+        break;
+    case SIM_ROM_COMMAND:
+        if (command_bit(level)) {
+            rom_command();
+        }
+        break;
+    case SIM_SEARCH:
+        if (s_search_phase < 2) {
+            // each device sends its bit, then the complement; sending a 0 pulls the bus low
+            for (int d = 0; d < s_count; d++) {
+                if (s_active[d] && rom_bit(d, s_bit) == s_search_phase) {
+                    in = 0;
+                }
+            }
+            s_search_phase++;
+        } else {
+            for (int d = 0; d < s_count; d++) {
+                if (rom_bit(d, s_bit) != level) {
+                    s_active[d] = false;
+                }
+            }
+            s_search_phase = 0;
+            if (++s_bit == 64) {
+                s_state = SIM_IDLE;
+            }
+        }
+        break;
+    case SIM_READ_ROM:
+        for (int d = 0; d < s_count; d++) {
+            if (!rom_bit(d, s_bit)) {
+                in = 0;
+            }
+        }
+        if (++s_bit == 64) {
+            s_bit = 0;
+            s_state = SIM_FUNCTION_COMMAND;
+        }
+        break;
+    case SIM_MATCH_ROM:
+        for (int d = 0; d < s_count; d++) {
+            if (rom_bit(d, s_bit) != level) {
+                s_active[d] = false;
+            }
+        }
+        if (++s_bit == 64) {
+            s_bit = 0;
+            s_state = SIM_FUNCTION_COMMAND;
+        }
+        break;
+    case SIM_FUNCTION_COMMAND:
+        if (command_bit(level)) {
+            function_command();
+        }
+        break;
+    case SIM_READ_SCRATCHPAD:
+        if (s_bit < 72) {
+            for (int d = 0; d < s_count; d++) {
+                if (s_active[d] && !((s_devices[d].scratchpad[s_bit / 8] >> (s_bit % 8)) & 1)) {
+                    in = 0;
+                }
+            }
+        }
+        s_bit++;
+        break;
+    }
+    return in;
+}
+
+static owb_status sim_reset(const OneWireBus *bus, bool *is_present)
+{
+    s_stats.transactions++;
+    s_stats.resets++;
+    *is_present = s_count > 0;
+    s_state = SIM_ROM_COMMAND;
+    s_bit = 0;
+    s_command = 0;
+    for (int d = 0; d < s_count; d++) {
+        s_active[d] = true;
+    }
+    return OWB_STATUS_OK;
+}
+
+static owb_status sim_write_bits(const OneWireBus *bus, uint8_t out, int number_of_bits_to_write)
+{
+    s_stats.transactions++;
+    for (int i = 0; i < number_of_bits_to_write; i++) {
+        slot((out >> i) & 1);
+    }
+    return OWB_STATUS_OK;
+}
+
+static owb_status sim_read_bits(const OneWireBus *bus, uint8_t *in, int number_of_bits_to_read)
+{
+    s_stats.transactions++;
+    *in = 0;
+    for (int i = 0; i < number_of_bits_to_read; i++) {
+        *in |= slot(1) << i;
+    }
+    return OWB_STATUS_OK;
+}
+
+static owb_status sim_touch_bits(const OneWireBus *bus, uint32_t out, uint32_t *in, int number_of_bits)
+{
+    s_stats.transactions++;
+    *in = 0;
+    for (int i = 0; i < number_of_bits; i++) {
+        *in |= (uint32_t)slot((out >> i) & 1) << i;
+    }
+    return OWB_STATUS_OK;
+}
+
+static owb_status sim_uninitialize(const OneWireBus *bus)
+{
+    return OWB_STATUS_OK;
+}
+
+static const struct owb_driver s_touch_driver = {
+    .name = "sim",
+    .uninitialize = sim_uninitialize,
+    .reset = sim_reset,
+    .write_bits = sim_write_bits,
+    .read_bits = sim_read_bits,
+    .touch_bits = sim_touch_bits,
+};
+
+static const struct owb_driver s_slot_driver = {
+    .name = "sim, slot by slot",
+    .uninitialize = sim_uninitialize,
+    .reset = sim_reset,
+    .write_bits = sim_write_bits,
+    .read_bits = sim_read_bits,
+};
+
+static OneWireBus s_touch_bus = {.driver = &s_touch_driver, .use_crc = true};
+static OneWireBus s_slot_bus = {.driver = &s_slot_driver, .use_crc = true};
+
+OneWireBus *onewire_sim_bus(bool touch_bits)
+{
+    return touch_bits ? &s_touch_bus : &s_slot_bus;
+}
+
+// onewire_init() gets the simulated bus instead of the RMT channels
+OneWireBus *owb_rmt_initialize(owb_rmt_driver_info *info, gpio_num_t gpio_num, rmt_channel_t tx_channel,
+                               rmt_channel_t rx_channel)
+{
+    info->bus = s_touch_bus;
+    info->rb = &s_touch_bus;
+    info->gpio = gpio_num;
+    return &info->bus;
+}
@@ -0,0 +1,49 @@
+/* Simulated 1-Wire bus for owb.c and onewire.c on the host
+ *
+ * Devices answer at the time slot level: reset and presence, Search ROM, Read ROM, Match ROM and Skip ROM, then
+ * Convert T and Read Scratchpad. Several devices answering at once are a wired AND, as on the real bus. Every driver
+ * call counts as one bus transaction: on the ESP32 each one is an RMT round trip the calling task waits for.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "owb.h"
+
+#define ONEWIRE_SIM_MAX_DEVICES     8
+#define ONEWIRE_SIM_RESET_US        960     // low phase, presence and recovery
+#define ONEWIRE_SIM_SLOT_US         75      // OW_DURATION_SLOT in owb_rmt.c
+
+typedef struct {
+    OneWireBus_ROMCode rom;
+    uint8_t scratchpad[9];                  /*<! returned by Read Scratchpad, CRC included */
+} onewire_sim_device_t;
+
+typedef struct {
+    uint32_t transactions;                  /*<! driver calls, including resets */
+    uint32_t resets;
+    uint32_t slots;
+    uint32_t converts;                      /*<! Convert T commands */
+    uint32_t bus_us;                        /*<! time the bus was busy */
+} onewire_sim_stats_t;
+
+/**
+ * @brief Put devices on the bus (copied), replacing the ones there
+ */
+void onewire_sim_set_devices(const onewire_sim_device_t *devices, int count);
+
+/**
+ * @brief The simulated bus, with a driver that batches slots (touch_bits, as owb_rmt.c) or one that sends one
+ *        read or write per call
+ */
+OneWireBus *onewire_sim_bus(bool touch_bits);
+
+void onewire_sim_reset_stats(void);
+
+onewire_sim_stats_t onewire_sim_stats(void);
+
+/**
+ * @brief A ROM code with a valid CRC
+ */
+OneWireBus_ROMCode onewire_sim_rom(uint8_t family, uint64_t serial);
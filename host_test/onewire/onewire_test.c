@@ -0,0 +1,232 @@
+/* Tests for the 1-Wire bus code (owb.c, onewire.c) on the simulated bus
+ *
+ * Searches run with both drivers, the batched touch_bits one the RMT driver has and the slot by slot fallback,
+ * and must give the same answers.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "onewire.h"
+#include "onewire_sim.h"
+#include "shim_check.h"
+
+#define DS18X20_CONVERT_T           0x44
+#define DS18X20_READ_SCRATCHPAD     0xBE
+
+static const uint8_t s_families[] = {
+    ONEWIRE_FAMILY_DS18B20, ONEWIRE_FAMILY_DS18B20, ONEWIRE_FAMILY_DS18S20, ONEWIRE_FAMILY_DS1822,
+    ONEWIRE_FAMILY_DS1990A, 0x81,            // 0x81: DS1420 serial ID, an unrelated family with the iButton's low bit
+};
+
+static int random_bus(onewire_sim_device_t *devices)
+{
+    int count = 1 + rand() % 6;
+    for (int i = 0; i < count; i++) {
+        memset(&devices[i], 0, sizeof(devices[i]));
+        uint64_t serial = ((uint64_t)rand() << 32) ^ rand();
+        devices[i].rom = onewire_sim_rom(s_families[rand() % sizeof(s_families)], serial);
+    }
+    onewire_sim_set_devices(devices, count);
+    return count;
+}
+
+static int compare_rom(const void *a, const void *b)
+{
+    return memcmp(a, b, sizeof(OneWireBus_ROMCode));
+}
+
+static void test_crc(void)
+{
+    // Maxim AN27 example ROM code
+    static const uint8_t rom[] = {0x02, 0x1c, 0xb8, 0x01, 0x00, 0x00, 0x00};
+    CHECK(owb_crc8_bytes(0, rom, sizeof(rom)) == 0xa2);
+}
+
+static void test_search(bool touch_bits)
+{
+    OneWireBus *bus = onewire_sim_bus(touch_bits);
+    onewire_sim_device_t devices[ONEWIRE_SIM_MAX_DEVICES];
+
+    for (int round = 0; round < 500; round++) {
+        int count = random_bus(devices);
+
+        OneWireBus_ROMCode found[ONEWIRE_SIM_MAX_DEVICES + 1];
+        OneWireBus_SearchState search;
+        bool more = false;
+        int n = 0;
+        CHECK(owb_search_first(bus, &search, &more) == OWB_STATUS_OK);
+        while (more && n <= ONEWIRE_SIM_MAX_DEVICES) {
+            found[n++] = search.rom_code;
+            CHECK(owb_search_next(bus, &search, &more) == OWB_STATUS_OK);
+        }
+
+        // the search runs in ascending ROM code order, LSB first
+        OneWireBus_ROMCode expected[ONEWIRE_SIM_MAX_DEVICES];
+        for (int i = 0; i < count; i++) {
+            expected[i] = devices[i].rom;
+        }
+        qsort(expected, count, sizeof(expected[0]), compare_rom);
+        qsort(found, n, sizeof(found[0]), compare_rom);
+        CHECK(n == count);
+        CHECK(n != count || !memcmp(found, expected, n * sizeof(found[0])));
+    }
+}
+
+static void test_find_family(bool touch_bits)
+{
+    OneWireBus *bus = onewire_sim_bus(touch_bits);
+    onewire_sim_device_t devices[ONEWIRE_SIM_MAX_DEVICES];
+
+    for (int round = 0; round < 500; round++) {
+        int count = random_bus(devices);
+        for (int f = 0; f < sizeof(s_families); f++) {
+            uint8_t family = s_families[f];
+            bool expected = false;
+            for (int i = 0; i < count; i++) {
+                expected |= devices[i].rom.fields.family[0] == family;
+            }
+
+            bool present = !expected;
+            CHECK(owb_family_present(bus, family, &present) == OWB_STATUS_OK);
+            CHECK(present == expected);
+
+            OneWireBus_ROMCode rom_code;
+            bool found = onewire_find_family(bus, family, &rom_code);
+            CHECK(found == expected);
+            CHECK(!found || rom_code.fields.family[0] == family);
+        }
+    }
+}
+
+static void test_family_present_cost(void)
+{
+    OneWireBus *bus = onewire_sim_bus(true);
+    onewire_sim_device_t probes[] = {
+        {.rom = onewire_sim_rom(ONEWIRE_FAMILY_DS18B20, 0x1234)},
+        {.rom = onewire_sim_rom(ONEWIRE_FAMILY_DS18B20, 0x5678)},
+    };
+    onewire_sim_set_devices(probes, 2);
+
+    // a probes-only bus is ruled out by a reset and one batch of slots, not a search
+    bool present = true;
+    onewire_sim_reset_stats();
+    CHECK(owb_family_present(bus, ONEWIRE_FAMILY_DS1990A, &present) == OWB_STATUS_OK);
+    CHECK(!present);
+    CHECK(onewire_sim_stats().transactions == 2);
+    CHECK(onewire_sim_stats().slots == 8 + 8 * 3);
+
+    // an empty bus stops after the reset
+    onewire_sim_set_devices(NULL, 0);
+    present = true;
+    onewire_sim_reset_stats();
+    CHECK(owb_family_present(bus, ONEWIRE_FAMILY_DS1990A, &present) == OWB_STATUS_OK);
+    CHECK(!present);
+    CHECK(onewire_sim_stats().transactions == 1);
+
+    CHECK(owb_family_present(NULL, ONEWIRE_FAMILY_DS1990A, &present) == OWB_STATUS_PARAMETER_NULL);
+    CHECK(owb_family_present(bus, ONEWIRE_FAMILY_DS1990A, NULL) == OWB_STATUS_PARAMETER_NULL);
+}
+
+static void test_verify_rom(void)
+{
+    OneWireBus *bus = onewire_sim_bus(true);
+    onewire_sim_device_t devices[] = {
+        {.rom = onewire_sim_rom(ONEWIRE_FAMILY_DS18B20, 0x1234)},
+        {.rom = onewire_sim_rom(ONEWIRE_FAMILY_DS1990A, 0xabcdef)},
+    };
+    onewire_sim_set_devices(devices, 2);
+
+    bool present = false;
+    CHECK(owb_verify_rom(bus, devices[1].rom, &present) == OWB_STATUS_OK);
+    CHECK(present);
+
+    OneWireBus_ROMCode gone = onewire_sim_rom(ONEWIRE_FAMILY_DS1990A, 0xabcdee);
+    CHECK(owb_verify_rom(bus, gone, &present) == OWB_STATUS_OK);
+    CHECK(!present);
+
+    // the ROM code goes out in batches, without starting again, whatever its last bit
+    for (uint64_t serial = 1; serial < 64; serial++) {
+        devices[1].rom = onewire_sim_rom(ONEWIRE_FAMILY_DS1990A, serial);
+        onewire_sim_set_devices(devices, 2);
+        onewire_sim_reset_stats();
+        CHECK(owb_verify_rom(bus, devices[1].rom, &present) == OWB_STATUS_OK);
+        CHECK(present);
+        CHECK(onewire_sim_stats().resets == 1);
+        CHECK(onewire_sim_stats().slots == 8 + 64 * 3);
+    }
+}
+
+static void test_read_rom_and_scratchpad(void)
+{
+    OneWireBus *bus = onewire_sim_bus(true);
+    onewire_sim_device_t devices[] = {
+        {.rom = onewire_sim_rom(ONEWIRE_FAMILY_DS18B20, 0x1234), .scratchpad = {0x91, 0x01, 0x4b, 0x46, 0x7f}},
+        {.rom = onewire_sim_rom(ONEWIRE_FAMILY_DS18B20, 0x5678), .scratchpad = {0x50, 0x05, 0x4b, 0x46, 0x7f}},
+    };
+    for (int i = 0; i < 2; i++) {
+        devices[i].scratchpad[8] = owb_crc8_bytes(0, devices[i].scratchpad, 8);
+    }
+
+    // Read ROM only makes sense with one device on the bus
+    onewire_sim_set_devices(devices, 1);
+    OneWireBus_ROMCode rom_code;
+    CHECK(owb_read_rom(bus, &rom_code) == OWB_STATUS_OK);
+    CHECK(!memcmp(&rom_code, &devices[0].rom, sizeof(rom_code)));
+
+    // what temperature.c does: Skip ROM, Convert T to all, then each scratchpad by Match ROM
+    onewire_sim_set_devices(devices, 2);
+    onewire_sim_reset_stats();
+    bool present = false;
+    CHECK(owb_reset(bus, &present) == OWB_STATUS_OK && present);
+    owb_write_byte(bus, OWB_ROM_SKIP);
+    owb_write_byte(bus, DS18X20_CONVERT_T);
+    CHECK(onewire_sim_stats().converts == 1);
+
+    for (int i = 0; i < 2; i++) {
+        uint8_t sp[9];
+        CHECK(owb_reset(bus, &present) == OWB_STATUS_OK && present);
+        owb_write_byte(bus, OWB_ROM_MATCH);
+        owb_write_rom_code(bus, devices[i].rom);
+        owb_write_byte(bus, DS18X20_READ_SCRATCHPAD);
+        owb_read_bytes(bus, sp, sizeof(sp));
+        CHECK(!memcmp(sp, devices[i].scratchpad, sizeof(sp)));
+        CHECK(owb_crc8_bytes(0, sp, sizeof(sp)) == 0);
+    }
+}
+
+static void test_take_give(void)
+{
+    onewire_init();
+    OneWireBus *bus = onewire_take();
+    CHECK(bus != NULL);
+    if (bus) {
+        CHECK(bus->use_crc);
+        onewire_sim_device_t devices[] = {{.rom = onewire_sim_rom(ONEWIRE_FAMILY_DS1990A, 0x42)}};
+        onewire_sim_set_devices(devices, 1);
+        OneWireBus_ROMCode rom_code;
+        CHECK(onewire_find_family(bus, ONEWIRE_FAMILY_DS1990A, &rom_code));
+        onewire_give();
+    }
+}
+
+int main(void)
+{
+    srand(1);
+    test_crc();
+    test_search(true);
+    test_search(false);
+    test_find_family(true);
+    test_find_family(false);
+    test_family_present_cost();
+    test_verify_rom();
+    test_read_rom_and_scratchpad();
+    test_take_give();
+
+    if (s_failures) {
+        printf("onewire_test: %d failures\n", s_failures);
+        return 1;
+    }
+    printf("onewire_test: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+/* Position filter and parked/moving classifier tests
+ *
+ * The odometer, geofences and telemetry are stubbed; the shim clock is stepped one second per fix.
+*/
+#include <stdio.h>
+
+#include "esp_timer.h"
+#include "shim_check.h"
+
+#include "maxbox_defines.h"
+#include "position.h"
+#include "vehicle.h"
+#include "geofence.h"
+#include "telemetry.h"
+
+#define LAT_E7      515000000
+#define LON_E7      -1000000
+#define E7_PER_M    (1 / 0.011131949f)  // latitude
+
+static telemetry_t s_tel;
+static struct maxbox s_mb = {.tel = &s_tel};
+maxbox_t mb = &s_mb;
+
+static int32_t s_odometer_changed_ts = -1;
+static int s_uploads_requested;
+
+int32_t vehicle_odometer_changed_ts()
+{
+    return s_odometer_changed_ts;
+}
+
+void telemetry_request_upload()
+{
+    s_uploads_requested++;
+}
+
+void geofence_check(int32_t lat_e7, int32_t lon_e7, uint32_t fix_time_ms)
+{
+}
+
+// One second later, a fix north_m metres north of the test origin
+static void fix_at(float north_m)
+{
+    static uint32_t time_ms;
+    nmea_fix_t fix = {
+        .lat_e7 = LAT_E7 + (int32_t)(north_m * E7_PER_M),
+        .lon_e7 = LON_E7,
+        .time_ms = time_ms += 1000,
+        .hdop_x100 = 90,
+        .sats_used = 9,
+        .position_valid = true,
+    };
+    shim_timer_advance_ms(1000);
+    position_update(&fix);
+}
+
+static void test_parked_at_boot(void)
+{
+    // No odometer change since boot is not a recent change
+    position_tick();
+    CHECK(!position_moving());
+    CHECK(s_uploads_requested == 0);
+}
+
+static void test_parked_jitter_not_reported(void)
+{
+    uint32_t seq = position_report_seq();
+    fix_at(0);
+    CHECK(position_report_seq() != seq);
+    CHECK(mb->tel->gnss_latitude != 0);
+
+    seq = position_report_seq();
+    float latitude = mb->tel->gnss_latitude;
+    const float jitter_m[] = {3, -2, 4, -3, 1, 2, -4, 0};
+    for (int i = 0; i < sizeof(jitter_m) / sizeof(jitter_m[0]); i++) {
+        fix_at(jitter_m[i]);
+    }
+    CHECK(!position_moving());
+    CHECK(position_report_seq() == seq);
+    CHECK(mb->tel->gnss_latitude == latitude);
+    CHECK(s_uploads_requested == 0);
+}
+
+static void test_far_outlier_rejected(void)
+{
+    // One wild fix well beyond the re-origin distance is gated like any other
+    uint32_t seq = position_report_seq();
+    float latitude = mb->tel->gnss_latitude;
+    uint32_t rejected = mb->tel->gnss_rejected;
+    fix_at(50000);
+    CHECK(mb->tel->gnss_rejected == rejected + 1);
+    CHECK(position_report_seq() == seq);
+    CHECK(mb->tel->gnss_latitude == latitude);
+    fix_at(0);
+    CHECK(!position_moving());
+    CHECK(mb->tel->gnss_latitude == latitude);
+}
+
+static void test_odometer_moving_then_parked(void)
+{
+    uint32_t seq = position_report_seq();
+    s_odometer_changed_ts = box_timestamp();
+    position_tick();
+    CHECK(position_moving());
+    CHECK(s_uploads_requested == 1);
+    CHECK(position_report_seq() != seq);
+
+    // Pulling away north at 2 m/s^2 up to 15 m/s: the reported position follows
+    float north = 0, speed = 0;
+    for (int i = 0; i < 25; i++) {
+        speed = speed < 15 ? speed + 2 : 15;
+        fix_at(north += speed);
+    }
+    CHECK(position_moving());
+    CHECK(mb->tel->gnss_latitude > (LAT_E7 + 200 * E7_PER_M) / 1e7f);
+
+    // Stopped: the odometer window and the dwell time both have to run out
+    shim_timer_advance_ms(GNSS_MOVING_WINDOW_S * 1000);
+    for (int i = 0; i < POSITION_PARK_DWELL_S + 30 && position_moving(); i++) {
+        fix_at(north);
+    }
+    CHECK(!position_moving());
+    CHECK(s_uploads_requested == 2);
+
+    seq = position_report_seq();
+    fix_at(north + 2);
+    CHECK(position_report_seq() == seq);
+}
+
+static void test_long_drive_reorigins(void)
+{
+    // From where it parked, about 14km north at up to 30 m/s: the origin moves along without rejecting fixes
+    uint32_t rejected = mb->tel->gnss_rejected;
+    float north = (mb->tel->gnss_latitude * 1e7f - LAT_E7) / E7_PER_M, speed = 0;
+    for (int i = 0; i < 500; i++) {
+        s_odometer_changed_ts = box_timestamp();
+        speed = speed < 30 ? speed + 2 : 30;
+        fix_at(north += speed);
+    }
+    CHECK(north > 14000);
+    CHECK(mb->tel->gnss_rejected == rejected);
+    CHECK(position_moving());
+    float error_m = (mb->tel->gnss_latitude * 1e7f - LAT_E7) / E7_PER_M - north;
+    CHECK(error_m > -POSITION_REPORT_DISTANCE_M - 30 && error_m < 10);
+}
+
+int main(void)
+{
+    position_init();
+
+    test_parked_at_boot();
+    test_parked_jitter_not_reported();
+    test_far_outlier_rejected();
+    test_odometer_moving_then_parked();
+    test_long_drive_reorigins();
+
+    if (s_failures) {
+        printf("%d check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("position: all tests passed\n");
+    return 0;
+}
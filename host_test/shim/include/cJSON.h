@@ -0,0 +1,5 @@
+/* Host shim: cJSON as an opaque type, for headers that take cJSON pointers in code the host tests stub out
+*/
+#pragma once
+
+typedef struct cJSON cJSON;
@@ -0,0 +1,34 @@
+/* Host shim: GPIO levels live in an array tests can poke with shim_gpio_set_input()
+*/
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_MODE_DISABLE,
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+    GPIO_MODE_INPUT_OUTPUT,
+    GPIO_MODE_OUTPUT_OD,
+    GPIO_MODE_INPUT_OUTPUT_OD,
+} gpio_mode_t;
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio);
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode);
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level);
+int gpio_get_level(gpio_num_t gpio);
+void esp_rom_gpio_pad_select_gpio(uint32_t gpio);
+
+void shim_gpio_set_input(gpio_num_t gpio, int level);
+int shim_gpio_get_output(gpio_num_t gpio);
+
+#ifdef __cplusplus
+}
+#endif
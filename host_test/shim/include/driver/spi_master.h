@@ -0,0 +1,17 @@
+/* Host shim: types only, like the IDF header it pulls in the FreeRTOS and libc basics ttn.h relies on
+*/
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {SPI1_HOST, SPI2_HOST, SPI3_HOST} spi_host_device_t;
+#define SPI_DMA_DISABLED 0
+
+#ifdef __cplusplus
+}
+#endif
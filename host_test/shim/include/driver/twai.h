@@ -0,0 +1,21 @@
+/* Host shim: TWAI (CAN) driver, only the message type headers refer to
+*/
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t flags;
+    uint32_t identifier;
+    uint8_t data_length_code;
+    uint8_t data[8];
+} twai_message_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,34 @@
+/* Host shim: ESP_LOGx print to stdout with a timestamp. MAXBOX_LOG_LEVEL (0-5, default 3 = info) filters them.
+*/
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+void shim_log(esp_log_level_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+void shim_log_buffer_hex(esp_log_level_t level, const char *tag, const void *buffer, uint16_t len);
+
+#define ESP_LOGE(tag, format, ...) shim_log(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) shim_log(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) shim_log(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) shim_log(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) shim_log(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+#define ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, len, level) shim_log_buffer_hex(level, tag, buffer, len)
+#define ESP_LOG_BUFFER_HEX(tag, buffer, len) shim_log_buffer_hex(ESP_LOG_INFO, tag, buffer, len)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,72 @@
+/* Host shim: an esp_netif is a PPP client (shim/src/ppp_lite.c) driven through the esp_netif driver API
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+    int type;
+} esp_netif_config_t;
+
+#define ESP_NETIF_DEFAULT_PPP() { .type = 1 }
+
+typedef struct esp_netif_driver_base_s {
+    esp_err_t (*post_attach)(esp_netif_t *netif, void *args);
+    esp_netif_t *netif;
+} esp_netif_driver_base_t;
+
+typedef struct {
+    void *handle;
+    esp_err_t (*transmit)(void *h, void *buffer, size_t len);
+} esp_netif_driver_ifconfig_t;
+
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+    esp_netif_t *esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+    IP_EVENT_PPP_GOT_IP = 6,
+    IP_EVENT_PPP_LOST_IP,
+} ip_event_t;
+
+#define IPSTR "%d.%d.%d.%d"
+#define IP2STR(ipaddr) (int)((ipaddr)->addr & 0xff), (int)(((ipaddr)->addr >> 8) & 0xff), \
+                       (int)(((ipaddr)->addr >> 16) & 0xff), (int)(((ipaddr)->addr >> 24) & 0xff)
+
+esp_netif_t *esp_netif_new(const esp_netif_config_t *config);
+esp_err_t esp_netif_attach(esp_netif_t *netif, void *driver_handle);
+esp_err_t esp_netif_set_driver_config(esp_netif_t *netif, const esp_netif_driver_ifconfig_t *config);
+esp_err_t esp_netif_receive(esp_netif_t *netif, void *buffer, size_t len, void *eb);
+void esp_netif_action_start(void *netif, esp_event_base_t base, int32_t id, void *data);
+void esp_netif_action_stop(void *netif, esp_event_base_t base, int32_t id, void *data);
+void esp_netif_action_connected(void *netif, esp_event_base_t base, int32_t id, void *data);
+void esp_netif_action_disconnected(void *netif, esp_event_base_t base, int32_t id, void *data);
+
+#ifdef __cplusplus
+}
+#endif
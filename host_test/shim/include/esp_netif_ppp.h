@@ -0,0 +1,30 @@
+#pragma once
+
+#include "esp_netif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ESP_EVENT_DECLARE_BASE(NETIF_PPP_STATUS);
+
+typedef enum {
+    NETIF_PPP_ERRORNONE         = 0,
+    NETIF_PPP_ERRORPARAM        = 1,
+    NETIF_PPP_ERROROPEN         = 2,
+    NETIF_PPP_ERRORDEVICE       = 3,
+    NETIF_PPP_ERRORALLOC        = 4,
+    NETIF_PPP_ERRORUSER         = 5,
+    NETIF_PPP_ERRORCONNECT      = 6,
+    NETIF_PPP_ERRORAUTHFAIL     = 7,
+    NETIF_PPP_ERRORPROTOCOL     = 8,
+    NETIF_PPP_ERRORPEERDEAD     = 9,
+    NETIF_PPP_ERRORIDLETIMEOUT  = 10,
+    NETIF_PPP_ERRORCONNECTTIME  = 11,
+    NETIF_PPP_ERRORLOOPBACK     = 12,
+    NETIF_PP_PHASE_OFFSET       = 0x100,
+} esp_netif_ppp_status_event_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t esp_get_free_heap_size(void);
+void esp_restart(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,20 @@
+/* Host shim: microseconds since the process started, plus whatever a test skipped ahead
+*/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int64_t esp_timer_get_time(void);
+
+/**
+ * @brief Move the clock forward, e.g. past a dwell time, without waiting for it
+ */
+void shim_timer_advance_ms(int64_t ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,97 @@
+/* Minimal PPP endpoint for host tests: HDLC-like framing (RFC 1662), LCP (RFC 1661) and IPCP (RFC 1332).
+ *
+ * Enough to bring a link up against pppd or another ppp_lite and to tear it down from either side.
+ * No authentication, compression or IP forwarding; IP datagrams are only counted.
+*/
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PPP_LITE_MTU            1500
+#define PPP_LITE_RESTART_MS     1000    // Restart timer, RFC 1661 section 4.6
+#define PPP_LITE_MAX_CONFIGURE  10
+#define PPP_LITE_MAX_TERMINATE  2
+
+typedef struct ppp_lite ppp_lite_t;
+
+typedef struct {
+    uint32_t local_ip;          /*<! our address, network byte order; 0 asks the peer to assign one */
+    uint32_t peer_ip;           /*<! address offered to a peer that asks for 0.0.0.0, 0 = don't assign */
+    bool passive;               /*<! wait for the peer's Configure-Request before sending ours, like a modem */
+    void (*output)(ppp_lite_t *ppp, const uint8_t *data, size_t len);
+    void (*up)(ppp_lite_t *ppp, uint32_t local_ip, uint32_t peer_ip);
+    void (*down)(ppp_lite_t *ppp, bool by_peer);    /*<! also called if negotiation gives up */
+    void *ctx;
+} ppp_lite_config_t;
+
+struct ppp_lite {
+    ppp_lite_config_t config;
+    pthread_mutex_t lock;
+
+    // Receive framing
+    uint8_t rx[PPP_LITE_MTU + 8];
+    size_t rx_len;
+    bool rx_escape;
+    bool rx_overflow;
+
+    // Negotiation, one configure exchange per protocol
+    bool open;                  /*<! ppp_lite_open() called and not yet down */
+    bool terminating;
+    bool lcp_ours_acked, lcp_theirs_acked;
+    bool ipcp_ours_acked, ipcp_theirs_acked;
+    bool up;
+    bool send_magic;
+    uint8_t next_id;
+    uint8_t lcp_req_id, ipcp_req_id, term_id;
+    uint32_t magic;
+    uint32_t local_ip;
+    uint32_t peer_ip;
+    int retries;
+    int64_t restart_at_ms;
+
+    // Counters
+    uint32_t frames_in, frames_out, bad_fcs, ip_in, protocol_rejects;
+};
+
+void ppp_lite_init(ppp_lite_t *ppp, const ppp_lite_config_t *config);
+
+/**
+ * @brief Start negotiating (sends LCP Configure-Request, or waits for the peer's if passive)
+ */
+void ppp_lite_open(ppp_lite_t *ppp);
+
+/**
+ * @brief Send LCP Terminate-Request; down(false) follows on Terminate-Ack or after the retries run out
+ */
+void ppp_lite_close(ppp_lite_t *ppp);
+
+/**
+ * @brief Forget all state without telling the peer, e.g. after carrier loss
+ */
+void ppp_lite_reset(ppp_lite_t *ppp);
+
+/**
+ * @brief Feed received bytes
+ */
+void ppp_lite_input(ppp_lite_t *ppp, const uint8_t *data, size_t len);
+
+/**
+ * @brief Drive retransmissions; call every few tens of ms with a monotonic time
+ */
+void ppp_lite_tick(ppp_lite_t *ppp, int64_t now_ms);
+
+/**
+ * @brief Send an IPv4 datagram over the link (e.g. to check the peer counts it)
+ */
+void ppp_lite_send_ip(ppp_lite_t *ppp, const uint8_t *datagram, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
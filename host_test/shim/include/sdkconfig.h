@@ -0,0 +1,14 @@
+/* Host shim: the project Kconfig values host-built code refers to
+*/
+#pragma once
+
+#define CONFIG_MAXBOX_CELLULAR_APN      "hosttest"
+#define CONFIG_MAXBOX_API_ROOT          "http://localhost/api/"
+#define CONFIG_MAXBOX_API_SECRET        "secret"
+#define CONFIG_MAXBOX_FW_VERSION        "host"
+#define CONFIG_ESP_WIFI_SSID            "depot"
+#define CONFIG_ESP_WIFI_PASSWORD        "password"
+
+#define CONFIG_TTN_LORA_FREQ_EU_868     1
+#define CONFIG_TTN_RADIO_SX1276_77_78_79 1
+#define CONFIG_TTN_PROVISION_UART_NONE  1
@@ -0,0 +1,14 @@
+/* Host tests: CHECK(cond) reports a failed condition and carries on; main() returns non-zero if s_failures is set
+*/
+#pragma once
+
+#include <stdio.h>
+
+static int s_failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            s_failures++; \
+        } \
+    } while (0)
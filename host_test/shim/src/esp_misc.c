@@ -0,0 +1,152 @@
+/* Host shim: logging, timer, error names and GPIO
+*/
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "driver/gpio.h"
+
+#define SHIM_GPIO_COUNT 64
+
+static pthread_mutex_t s_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static int s_gpio_in[SHIM_GPIO_COUNT];
+static int s_gpio_out[SHIM_GPIO_COUNT];
+
+static int64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t s_start_us;
+static int64_t s_skipped_us;
+
+__attribute__((constructor)) static void shim_start(void)
+{
+    s_start_us = monotonic_us();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return monotonic_us() - s_start_us + __atomic_load_n(&s_skipped_us, __ATOMIC_RELAXED);
+}
+
+void shim_timer_advance_ms(int64_t ms)
+{
+    __atomic_add_fetch(&s_skipped_us, ms * 1000, __ATOMIC_RELAXED);
+}
+
+static esp_log_level_t log_level(void)
+{
+    static int level = -1;
+    if (level < 0) {
+        const char *env = getenv("MAXBOX_LOG_LEVEL");
+        level = env ? atoi(env) : ESP_LOG_INFO;
+    }
+    return level;
+}
+
+void shim_log(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    if (level > log_level()) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&s_log_lock);
+    printf("%c (%lld) %s: ", letters[level], (long long)(esp_timer_get_time() / 1000), tag);
+    vprintf(format, args);
+    printf("\n");
+    fflush(stdout);
+    pthread_mutex_unlock(&s_log_lock);
+    va_end(args);
+}
+
+void shim_log_buffer_hex(esp_log_level_t level, const char *tag, const void *buffer, uint16_t len)
+{
+    if (level > log_level()) {
+        return;
+    }
+    pthread_mutex_lock(&s_log_lock);
+    printf("%s:", tag);
+    for (uint16_t i = 0; i < len; i++) {
+        printf(" %02x", ((const uint8_t *)buffer)[i]);
+    }
+    printf("\n");
+    pthread_mutex_unlock(&s_log_lock);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 200 * 1024;
+}
+
+void esp_restart(void)
+{
+    printf("esp_restart() called\n");
+    exit(1);
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio)
+{
+    return gpio_set_level(gpio, 0);
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode)
+{
+    return (gpio >= 0 && gpio < SHIM_GPIO_COUNT) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    if (gpio < 0 || gpio >= SHIM_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    __atomic_store_n(&s_gpio_out[gpio], (int)level, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio)
+{
+    return (gpio >= 0 && gpio < SHIM_GPIO_COUNT) ? __atomic_load_n(&s_gpio_in[gpio], __ATOMIC_RELAXED) : 0;
+}
+
+void esp_rom_gpio_pad_select_gpio(uint32_t gpio)
+{
+}
+
+void shim_gpio_set_input(gpio_num_t gpio, int level)
+{
+    __atomic_store_n(&s_gpio_in[gpio], level, __ATOMIC_RELAXED);
+}
+
+int shim_gpio_get_output(gpio_num_t gpio)
+{
+    return __atomic_load_n(&s_gpio_out[gpio], __ATOMIC_RELAXED);
+}
@@ -0,0 +1,128 @@
+/* Host shim: esp_netif PPP interface backed by a ppp_lite client
+ *
+ * Mirrors the lwIP PPPoS netif closely enough for sim7600.c: action_start begins LCP, GOT_IP and LOST_IP go to
+ * IP_EVENT and every end of session is reported on NETIF_PPP_STATUS, ERRORUSER when we closed it ourselves.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "esp_netif.h"
+#include "esp_netif_ppp.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "ppp_lite.h"
+
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+ESP_EVENT_DEFINE_BASE(NETIF_PPP_STATUS);
+
+struct esp_netif_obj {
+    ppp_lite_t ppp;
+    esp_netif_driver_ifconfig_t driver;
+    volatile bool started;
+    volatile bool got_ip;
+};
+
+static void netif_output(ppp_lite_t *ppp, const uint8_t *data, size_t len)
+{
+    esp_netif_t *netif = ppp->config.ctx;
+    if (netif->driver.transmit) {
+        netif->driver.transmit(netif->driver.handle, (void *)data, len);
+    }
+}
+
+static void netif_up(ppp_lite_t *ppp, uint32_t local_ip, uint32_t peer_ip)
+{
+    esp_netif_t *netif = ppp->config.ctx;
+    ip_event_got_ip_t event = {
+        .esp_netif = netif,
+        .ip_info = {.ip.addr = local_ip, .netmask.addr = 0xffffffff, .gw.addr = peer_ip},
+        .ip_changed = true,
+    };
+    netif->got_ip = true;
+    esp_event_post(IP_EVENT, IP_EVENT_PPP_GOT_IP, &event, sizeof(event), portMAX_DELAY);
+}
+
+static void netif_down(ppp_lite_t *ppp, bool by_peer)
+{
+    esp_netif_t *netif = ppp->config.ctx;
+    int32_t status = by_peer ? NETIF_PPP_ERRORCONNECT : NETIF_PPP_ERRORUSER;
+
+    netif->started = false;
+    if (netif->got_ip) {
+        netif->got_ip = false;
+        esp_event_post(IP_EVENT, IP_EVENT_PPP_LOST_IP, NULL, 0, portMAX_DELAY);
+    }
+    esp_event_post(NETIF_PPP_STATUS, status, NULL, 0, portMAX_DELAY);
+}
+
+static void netif_tick_task(void *arg)
+{
+    esp_netif_t *netif = arg;
+    while (1) {
+        ppp_lite_tick(&netif->ppp, esp_timer_get_time() / 1000);
+        vTaskDelay(20);
+    }
+}
+
+esp_netif_t *esp_netif_new(const esp_netif_config_t *config)
+{
+    esp_netif_t *netif = calloc(1, sizeof(esp_netif_t));
+    ppp_lite_config_t ppp_config = {
+        .output = netif_output,
+        .up = netif_up,
+        .down = netif_down,
+        .ctx = netif,
+    };
+    ppp_lite_init(&netif->ppp, &ppp_config);
+    xTaskCreate(netif_tick_task, "ppp_tick", 2048, netif, 10, NULL);
+    return netif;
+}
+
+esp_err_t esp_netif_attach(esp_netif_t *netif, void *driver_handle)
+{
+    esp_netif_driver_base_t *base = driver_handle;
+    return base->post_attach ? base->post_attach(netif, driver_handle) : ESP_OK;
+}
+
+esp_err_t esp_netif_set_driver_config(esp_netif_t *netif, const esp_netif_driver_ifconfig_t *config)
+{
+    netif->driver = *config;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_receive(esp_netif_t *netif, void *buffer, size_t len, void *eb)
+{
+    if (netif->started) {
+        ppp_lite_input(&netif->ppp, buffer, len);
+    }
+    return ESP_OK;
+}
+
+void esp_netif_action_start(void *esp_netif, esp_event_base_t base, int32_t id, void *data)
+{
+    esp_netif_t *netif = esp_netif;
+    netif->got_ip = false;
+    netif->started = true;
+    ppp_lite_open(&netif->ppp);
+}
+
+void esp_netif_action_stop(void *esp_netif, esp_event_base_t base, int32_t id, void *data)
+{
+    esp_netif_t *netif = esp_netif;
+    if (!netif->ppp.open) {
+        // Already down (peer hung up or negotiation gave up): lwIP still reports the user stop
+        netif->started = false;
+        esp_event_post(NETIF_PPP_STATUS, NETIF_PPP_ERRORUSER, NULL, 0, portMAX_DELAY);
+        return;
+    }
+    ppp_lite_close(&netif->ppp);
+}
+
+void esp_netif_action_connected(void *esp_netif, esp_event_base_t base, int32_t id, void *data)
+{
+}
+
+void esp_netif_action_disconnected(void *esp_netif, esp_event_base_t base, int32_t id, void *data)
+{
+}
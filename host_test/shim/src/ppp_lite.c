@@ -0,0 +1,537 @@
+/* Minimal PPP endpoint for host tests, see ppp_lite.h
+ *
+ * Not a full RFC 1661 automaton: each side sends one Configure-Request per protocol and retransmits it until
+ * acknowledged, acknowledges whatever options it understands and rejects the rest. That is all pppd and the
+ * SIM7600 need to reach the Opened state with no authentication.
+*/
+#include <string.h>
+
+#include "ppp_lite.h"
+
+#define PPP_FLAG        0x7e
+#define PPP_ESCAPE      0x7d
+#define PPP_TRANS       0x20
+#define PPP_FCS_INIT    0xffff
+#define PPP_FCS_GOOD    0xf0b8
+
+#define PROTO_IP        0x0021
+#define PROTO_IPCP      0x8021
+#define PROTO_LCP       0xc021
+
+enum {
+    CONF_REQ = 1, CONF_ACK, CONF_NAK, CONF_REJ, TERM_REQ, TERM_ACK, CODE_REJ, PROTO_REJ, ECHO_REQ, ECHO_REP, DISCARD_REQ,
+};
+
+enum {
+    LCP_OPT_MRU = 1, LCP_OPT_ACCM = 2, LCP_OPT_MAGIC = 5, LCP_OPT_PFC = 7, LCP_OPT_ACFC = 8,
+};
+
+#define IPCP_OPT_ADDRESS 3
+
+typedef struct {
+    bool up;
+    bool down;
+    bool down_by_peer;
+    uint32_t local_ip, peer_ip;
+} pending_t;
+
+static uint16_t fcs16(uint16_t fcs, const uint8_t *data, size_t len)
+{
+    // RFC 1662 appendix C, bitwise; frames here are tiny
+    while (len--) {
+        fcs ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            fcs = (fcs & 1) ? (fcs >> 1) ^ 0x8408 : fcs >> 1;
+        }
+    }
+    return fcs;
+}
+
+static void send_frame(ppp_lite_t *ppp, uint16_t protocol, const uint8_t *info, size_t len)
+{
+    uint8_t raw[PPP_LITE_MTU + 8];
+    uint8_t out[2 * sizeof(raw) + 2];
+    size_t n = 0, o = 0;
+
+    if (len > PPP_LITE_MTU) {
+        return;
+    }
+    raw[n++] = 0xff;
+    raw[n++] = 0x03;
+    raw[n++] = protocol >> 8;
+    raw[n++] = protocol & 0xff;
+    if (len) {
+        memcpy(raw + n, info, len);
+    }
+    n += len;
+    uint16_t fcs = fcs16(PPP_FCS_INIT, raw, n) ^ 0xffff;
+    raw[n++] = fcs & 0xff;
+    raw[n++] = fcs >> 8;
+
+    // Default ACCM: every control character is escaped
+    out[o++] = PPP_FLAG;
+    for (size_t i = 0; i < n; i++) {
+        if (raw[i] < 0x20 || raw[i] == PPP_FLAG || raw[i] == PPP_ESCAPE) {
+            out[o++] = PPP_ESCAPE;
+            out[o++] = raw[i] ^ PPP_TRANS;
+        } else {
+            out[o++] = raw[i];
+        }
+    }
+    out[o++] = PPP_FLAG;
+
+    ppp->frames_out++;
+    ppp->config.output(ppp, out, o);
+}
+
+static void send_packet(ppp_lite_t *ppp, uint16_t protocol, uint8_t code, uint8_t id, const uint8_t *data, size_t len)
+{
+    uint8_t packet[PPP_LITE_MTU];
+    if (len + 4 > sizeof(packet)) {
+        return;
+    }
+    packet[0] = code;
+    packet[1] = id;
+    packet[2] = (len + 4) >> 8;
+    packet[3] = (len + 4) & 0xff;
+    if (len) {
+        memcpy(packet + 4, data, len);
+    }
+    send_frame(ppp, protocol, packet, len + 4);
+}
+
+static void send_lcp_request(ppp_lite_t *ppp)
+{
+    uint8_t options[6];
+    size_t n = 0;
+    if (ppp->send_magic) {
+        options[n++] = LCP_OPT_MAGIC;
+        options[n++] = 6;
+        memcpy(options + n, &ppp->magic, 4);
+        n += 4;
+    }
+    ppp->lcp_req_id = ppp->next_id++;
+    send_packet(ppp, PROTO_LCP, CONF_REQ, ppp->lcp_req_id, options, n);
+}
+
+static void send_ipcp_request(ppp_lite_t *ppp)
+{
+    uint8_t options[6] = {IPCP_OPT_ADDRESS, 6};
+    memcpy(options + 2, &ppp->local_ip, 4);
+    ppp->ipcp_req_id = ppp->next_id++;
+    send_packet(ppp, PROTO_IPCP, CONF_REQ, ppp->ipcp_req_id, options, sizeof(options));
+}
+
+static bool lcp_opened(const ppp_lite_t *ppp)
+{
+    return ppp->lcp_ours_acked && ppp->lcp_theirs_acked;
+}
+
+static void clear_state(ppp_lite_t *ppp)
+{
+    ppp->open = false;
+    ppp->terminating = false;
+    ppp->lcp_ours_acked = ppp->lcp_theirs_acked = false;
+    ppp->ipcp_ours_acked = ppp->ipcp_theirs_acked = false;
+    ppp->up = false;
+    ppp->send_magic = true;
+    ppp->local_ip = ppp->config.local_ip;
+    ppp->peer_ip = 0;
+    ppp->retries = 0;
+    ppp->restart_at_ms = 0;
+    ppp->rx_len = 0;
+    ppp->rx_escape = false;
+    ppp->rx_overflow = false;
+}
+
+static void go_down(ppp_lite_t *ppp, bool by_peer, pending_t *pending)
+{
+    bool was_open = ppp->open;
+    clear_state(ppp);
+    if (was_open) {
+        pending->down = true;
+        pending->down_by_peer = by_peer;
+    }
+}
+
+static void check_progress(ppp_lite_t *ppp, bool lcp_was_opened, pending_t *pending)
+{
+    if (!lcp_was_opened && lcp_opened(ppp)) {
+        ppp->retries = 0;
+        send_ipcp_request(ppp);
+    }
+    if (!ppp->up && lcp_opened(ppp) && ppp->ipcp_ours_acked && ppp->ipcp_theirs_acked) {
+        ppp->up = true;
+        pending->up = true;
+        pending->local_ip = ppp->local_ip;
+        pending->peer_ip = ppp->peer_ip;
+    }
+}
+
+static void handle_lcp_request(ppp_lite_t *ppp, uint8_t id, const uint8_t *opts, size_t len)
+{
+    uint8_t rejected[PPP_LITE_MTU];
+    size_t n_rejected = 0;
+
+    for (size_t i = 0; i + 2 <= len && opts[i + 1] >= 2 && i + opts[i + 1] <= len; i += opts[i + 1]) {
+        switch (opts[i]) {
+        case LCP_OPT_MRU:
+        case LCP_OPT_ACCM:
+        case LCP_OPT_MAGIC:
+        case LCP_OPT_PFC:
+        case LCP_OPT_ACFC:
+            break; // we always send uncompressed, fully escaped frames and accept compressed ones
+        default:
+            memcpy(rejected + n_rejected, opts + i, opts[i + 1]);
+            n_rejected += opts[i + 1];
+            break;
+        }
+    }
+
+    if (n_rejected) {
+        send_packet(ppp, PROTO_LCP, CONF_REJ, id, rejected, n_rejected);
+        return;
+    }
+    send_packet(ppp, PROTO_LCP, CONF_ACK, id, opts, len);
+    ppp->lcp_theirs_acked = true;
+}
+
+static void handle_lcp(ppp_lite_t *ppp, const uint8_t *packet, size_t len, pending_t *pending)
+{
+    uint8_t code = packet[0], id = packet[1];
+    const uint8_t *data = packet + 4;
+    size_t data_len = len - 4;
+    bool was_opened = lcp_opened(ppp);
+
+    if (!ppp->open) {
+        // Closed: answer Terminate-Requests so the peer doesn't wait, drop everything else
+        if (code == TERM_REQ) {
+            send_packet(ppp, PROTO_LCP, TERM_ACK, id, NULL, 0);
+        }
+        return;
+    }
+
+    switch (code) {
+    case CONF_REQ:
+        if (ppp->terminating) {
+            break;
+        }
+        if (was_opened) {
+            // Peer restarted negotiation: start over (RFC 1661 Opened + RCR)
+            ppp->lcp_ours_acked = false;
+            ppp->ipcp_ours_acked = ppp->ipcp_theirs_acked = false;
+            ppp->up = false;
+            was_opened = false;
+        }
+        if (!ppp->lcp_ours_acked && ppp->restart_at_ms == 0) {
+            send_lcp_request(ppp); // passive open: our first request goes out once the peer speaks
+            ppp->restart_at_ms = 1;
+        }
+        handle_lcp_request(ppp, id, data, data_len);
+        break;
+    case CONF_ACK:
+        if (id == ppp->lcp_req_id) {
+            ppp->lcp_ours_acked = true;
+        }
+        break;
+    case CONF_NAK:
+        if (id == ppp->lcp_req_id) {
+            ppp->magic = ppp->magic * 1103515245u + 12345u; // only magic is ever requested; pick another
+            send_lcp_request(ppp);
+        }
+        break;
+    case CONF_REJ:
+        if (id == ppp->lcp_req_id) {
+            ppp->send_magic = false;
+            send_lcp_request(ppp);
+        }
+        break;
+    case TERM_REQ:
+        send_packet(ppp, PROTO_LCP, TERM_ACK, id, NULL, 0);
+        go_down(ppp, true, pending);
+        return;
+    case TERM_ACK:
+        if (ppp->terminating) {
+            go_down(ppp, false, pending);
+        }
+        return;
+    case CODE_REJ:
+    case PROTO_REJ:
+    case ECHO_REP:
+    case DISCARD_REQ:
+        break;
+    case ECHO_REQ:
+        if (was_opened && data_len >= 4) {
+            uint8_t reply[PPP_LITE_MTU];
+            memcpy(reply, data, data_len);
+            memcpy(reply, ppp->send_magic ? &ppp->magic : &(uint32_t) {0}, 4);
+            send_packet(ppp, PROTO_LCP, ECHO_REP, id, reply, data_len);
+        }
+        break;
+    default:
+        send_packet(ppp, PROTO_LCP, CODE_REJ, ppp->next_id++, packet, len);
+        break;
+    }
+    check_progress(ppp, was_opened, pending);
+}
+
+static void handle_ipcp(ppp_lite_t *ppp, const uint8_t *packet, size_t len, pending_t *pending)
+{
+    uint8_t code = packet[0], id = packet[1];
+    const uint8_t *opts = packet + 4;
+    size_t opts_len = len - 4;
+
+    if (!ppp->open || ppp->terminating || !lcp_opened(ppp)) {
+        return; // RFC 1661: NCP packets before LCP is Opened are silently discarded
+    }
+
+    switch (code) {
+    case CONF_REQ: {
+        uint8_t rejected[PPP_LITE_MTU], naked[6];
+        size_t n_rejected = 0, n_naked = 0;
+        uint32_t requested = 0;
+
+        for (size_t i = 0; i + 2 <= opts_len && opts[i + 1] >= 2 && i + opts[i + 1] <= opts_len; i += opts[i + 1]) {
+            if (opts[i] == IPCP_OPT_ADDRESS && opts[i + 1] == 6) {
+                memcpy(&requested, opts + i + 2, 4);
+                if (ppp->config.peer_ip && requested != ppp->config.peer_ip) {
+                    naked[0] = IPCP_OPT_ADDRESS;
+                    naked[1] = 6;
+                    memcpy(naked + 2, &ppp->config.peer_ip, 4);
+                    n_naked = 6;
+                }
+            } else {
+                // VJ compression, DNS and anything else
+                memcpy(rejected + n_rejected, opts + i, opts[i + 1]);
+                n_rejected += opts[i + 1];
+            }
+        }
+
+        if (n_rejected) {
+            send_packet(ppp, PROTO_IPCP, CONF_REJ, id, rejected, n_rejected);
+        } else if (n_naked) {
+            send_packet(ppp, PROTO_IPCP, CONF_NAK, id, naked, n_naked);
+        } else {
+            send_packet(ppp, PROTO_IPCP, CONF_ACK, id, opts, opts_len);
+            ppp->peer_ip = requested;
+            ppp->ipcp_theirs_acked = true;
+        }
+        break;
+    }
+    case CONF_ACK:
+        if (id == ppp->ipcp_req_id) {
+            ppp->ipcp_ours_acked = true;
+        }
+        break;
+    case CONF_NAK:
+        if (id == ppp->ipcp_req_id) {
+            for (size_t i = 0; i + 2 <= opts_len && opts[i + 1] >= 2 && i + opts[i + 1] <= opts_len; i += opts[i + 1]) {
+                if (opts[i] == IPCP_OPT_ADDRESS && opts[i + 1] == 6) {
+                    memcpy(&ppp->local_ip, opts + i + 2, 4);
+                }
+            }
+            send_ipcp_request(ppp);
+        }
+        break;
+    case TERM_REQ:
+        send_packet(ppp, PROTO_IPCP, TERM_ACK, id, NULL, 0);
+        ppp->ipcp_ours_acked = ppp->ipcp_theirs_acked = false;
+        if (ppp->up) {
+            go_down(ppp, true, pending);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+    check_progress(ppp, true, pending);
+}
+
+static void handle_frame(ppp_lite_t *ppp, const uint8_t *frame, size_t len, pending_t *pending)
+{
+    // Address/control and protocol may be compressed if the peer asked for ACFC/PFC
+    if (len >= 2 && frame[0] == 0xff && frame[1] == 0x03) {
+        frame += 2;
+        len -= 2;
+    }
+    if (len < 1) {
+        return;
+    }
+    uint16_t protocol;
+    if (frame[0] & 1) {
+        protocol = frame[0];
+        frame += 1;
+        len -= 1;
+    } else {
+        if (len < 2) {
+            return;
+        }
+        protocol = (frame[0] << 8) | frame[1];
+        frame += 2;
+        len -= 2;
+    }
+
+    ppp->frames_in++;
+    if (protocol == PROTO_LCP || protocol == PROTO_IPCP) {
+        if (len < 4) {
+            return;
+        }
+        size_t packet_len = (frame[2] << 8) | frame[3];
+        if (packet_len < 4 || packet_len > len) {
+            return;
+        }
+        if (protocol == PROTO_LCP) {
+            handle_lcp(ppp, frame, packet_len, pending);
+        } else {
+            handle_ipcp(ppp, frame, packet_len, pending);
+        }
+    } else if (protocol == PROTO_IP) {
+        if (ppp->up) {
+            ppp->ip_in++;
+        }
+    } else if (ppp->open && lcp_opened(ppp)) {
+        // CCP, IPv6CP... : Protocol-Reject with the protocol and as much of the packet as fits
+        uint8_t reject[PPP_LITE_MTU];
+        size_t n = len > sizeof(reject) - 2 ? sizeof(reject) - 2 : len;
+        reject[0] = protocol >> 8;
+        reject[1] = protocol & 0xff;
+        memcpy(reject + 2, frame, n);
+        ppp->protocol_rejects++;
+        send_packet(ppp, PROTO_LCP, PROTO_REJ, ppp->next_id++, reject, n + 2);
+    }
+}
+
+static void run_pending(ppp_lite_t *ppp, const pending_t *pending)
+{
+    if (pending->down && ppp->config.down) {
+        ppp->config.down(ppp, pending->down_by_peer);
+    }
+    if (pending->up && ppp->config.up) {
+        ppp->config.up(ppp, pending->local_ip, pending->peer_ip);
+    }
+}
+
+void ppp_lite_init(ppp_lite_t *ppp, const ppp_lite_config_t *config)
+{
+    memset(ppp, 0, sizeof(ppp_lite_t));
+    ppp->config = *config;
+    pthread_mutex_init(&ppp->lock, NULL);
+    ppp->magic = 0x4d617842 ^ (uint32_t)(uintptr_t)ppp;
+    ppp->next_id = 1;
+    clear_state(ppp);
+}
+
+void ppp_lite_open(ppp_lite_t *ppp)
+{
+    pthread_mutex_lock(&ppp->lock);
+    clear_state(ppp);
+    ppp->open = true;
+    if (!ppp->config.passive) {
+        send_lcp_request(ppp);
+        ppp->restart_at_ms = 1; // first tick schedules the retransmission
+    }
+    pthread_mutex_unlock(&ppp->lock);
+}
+
+void ppp_lite_close(ppp_lite_t *ppp)
+{
+    pending_t pending = {0};
+    pthread_mutex_lock(&ppp->lock);
+    if (!ppp->open) {
+        pthread_mutex_unlock(&ppp->lock);
+        return;
+    }
+    ppp->terminating = true;
+    ppp->up = false;
+    ppp->retries = 0;
+    ppp->term_id = ppp->next_id++;
+    ppp->restart_at_ms = 1;
+    send_packet(ppp, PROTO_LCP, TERM_REQ, ppp->term_id, NULL, 0);
+    pthread_mutex_unlock(&ppp->lock);
+    run_pending(ppp, &pending);
+}
+
+void ppp_lite_reset(ppp_lite_t *ppp)
+{
+    pthread_mutex_lock(&ppp->lock);
+    clear_state(ppp);
+    pthread_mutex_unlock(&ppp->lock);
+}
+
+void ppp_lite_input(ppp_lite_t *ppp, const uint8_t *data, size_t len)
+{
+    pending_t pending = {0};
+    pthread_mutex_lock(&ppp->lock);
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = data[i];
+        if (c == PPP_FLAG) {
+            if (ppp->rx_len >= 4 && !ppp->rx_overflow) {
+                if (fcs16(PPP_FCS_INIT, ppp->rx, ppp->rx_len) == PPP_FCS_GOOD) {
+                    handle_frame(ppp, ppp->rx, ppp->rx_len - 2, &pending);
+                } else {
+                    ppp->bad_fcs++;
+                }
+            }
+            ppp->rx_len = 0;
+            ppp->rx_escape = false;
+            ppp->rx_overflow = false;
+            continue;
+        }
+        if (c == PPP_ESCAPE) {
+            ppp->rx_escape = true;
+            continue;
+        }
+        if (ppp->rx_escape) {
+            c ^= PPP_TRANS;
+            ppp->rx_escape = false;
+        }
+        if (ppp->rx_len < sizeof(ppp->rx)) {
+            ppp->rx[ppp->rx_len++] = c;
+        } else {
+            ppp->rx_overflow = true;
+        }
+    }
+    pthread_mutex_unlock(&ppp->lock);
+    run_pending(ppp, &pending);
+}
+
+void ppp_lite_tick(ppp_lite_t *ppp, int64_t now_ms)
+{
+    pending_t pending = {0};
+    pthread_mutex_lock(&ppp->lock);
+
+    if (!ppp->open || ppp->up || ppp->restart_at_ms == 0) {
+        pthread_mutex_unlock(&ppp->lock);
+        return;
+    }
+    if (ppp->restart_at_ms == 1) {
+        ppp->restart_at_ms = now_ms + PPP_LITE_RESTART_MS;
+    } else if (now_ms >= ppp->restart_at_ms) {
+        ppp->restart_at_ms = now_ms + PPP_LITE_RESTART_MS;
+        if (ppp->terminating) {
+            if (++ppp->retries >= PPP_LITE_MAX_TERMINATE) {
+                go_down(ppp, false, &pending);
+            } else {
+                send_packet(ppp, PROTO_LCP, TERM_REQ, ppp->term_id, NULL, 0);
+            }
+        } else if (++ppp->retries >= PPP_LITE_MAX_CONFIGURE) {
+            go_down(ppp, false, &pending);
+        } else if (!ppp->lcp_ours_acked) {
+            send_lcp_request(ppp);
+        } else if (lcp_opened(ppp) && !ppp->ipcp_ours_acked) {
+            send_ipcp_request(ppp);
+        }
+    }
+
+    pthread_mutex_unlock(&ppp->lock);
+    run_pending(ppp, &pending);
+}
+
+void ppp_lite_send_ip(ppp_lite_t *ppp, const uint8_t *datagram, size_t len)
+{
+    pthread_mutex_lock(&ppp->lock);
+    if (ppp->up) {
+        send_frame(ppp, PROTO_IP, datagram, len);
+    }
+    pthread_mutex_unlock(&ppp->lock);
+}
@@ -0,0 +1,125 @@
+/* Host shim: UART driver over a socket
+ *
+ * A watcher thread posts UART_DATA to the event queue when the socket becomes readable, and waits for the
+ * reader to drain it before posting again, like the driver's one-event-per-burst behaviour.
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "driver/uart.h"
+#include "freertos/task.h"
+
+typedef struct {
+    int fd;
+    QueueHandle_t events;
+    volatile bool event_pending;
+    pthread_mutex_t write_lock;
+} shim_uart_t;
+
+static shim_uart_t s_uarts[UART_NUM_MAX] = {
+    {.fd = -1, .write_lock = PTHREAD_MUTEX_INITIALIZER},
+    {.fd = -1, .write_lock = PTHREAD_MUTEX_INITIALIZER},
+    {.fd = -1, .write_lock = PTHREAD_MUTEX_INITIALIZER},
+};
+
+void shim_uart_attach(uart_port_t port, int fd)
+{
+    s_uarts[port].fd = fd;
+}
+
+static void uart_watch_task(void *arg)
+{
+    shim_uart_t *uart = arg;
+    struct pollfd pfd = {.fd = uart->fd, .events = POLLIN};
+
+    while (1) {
+        if (uart->event_pending) {
+            vTaskDelay(1);
+            continue;
+        }
+        if (poll(&pfd, 1, 100) > 0) {
+            if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+                return;
+            }
+            uart_event_t event = {.type = UART_DATA};
+            uart->event_pending = true;
+            xQueueSend(uart->events, &event, portMAX_DELAY);
+        }
+    }
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *queue, int intr_flags)
+{
+    shim_uart_t *uart = &s_uarts[port];
+    if (uart->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uart->events = xQueueCreate(queue_size, sizeof(uart_event_t));
+    if (queue) {
+        *queue = uart->events;
+    }
+    xTaskCreate(uart_watch_task, "uart_watch", 2048, uart, 10, NULL);
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_flush(uart_port_t port)
+{
+    uint8_t discard[256];
+    while (recv(s_uarts[port].fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+    }
+    s_uarts[port].event_pending = false;
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks)
+{
+    shim_uart_t *uart = &s_uarts[port];
+    struct pollfd pfd = {.fd = uart->fd, .events = POLLIN};
+
+    if (poll(&pfd, 1, ticks == portMAX_DELAY ? -1 : (int)ticks) <= 0) {
+        uart->event_pending = false;
+        return 0;
+    }
+    ssize_t n = recv(uart->fd, buf, length, MSG_DONTWAIT);
+    if (n <= 0) {
+        uart->event_pending = false;
+        return n < 0 && errno != EAGAIN ? -1 : 0;
+    }
+    return (int)n;
+}
+
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    shim_uart_t *uart = &s_uarts[port];
+    size_t done = 0;
+
+    pthread_mutex_lock(&uart->write_lock);
+    while (done < size) {
+        ssize_t n = send(uart->fd, (const uint8_t *)src + done, size - done, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += n;
+    }
+    pthread_mutex_unlock(&uart->write_lock);
+    return (int)done;
+}
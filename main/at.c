@@ -0,0 +1,407 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "at.h"
+
+static const char* TAG = "MaxBox-AT";
+
+typedef struct {
+    char cmd[AT_MAX_COMMAND];
+    char prefix[16];                /*<! information response prefix, e.g. "+CSQ" for "AT+CSQ\r" */
+    uint32_t timeout_ms;
+    at_response_cb_t callback;
+    void *ctx;
+    SemaphoreHandle_t done;         /*<! set for blocking callers, given once result/response are filled */
+    esp_err_t *result;
+    char *response;
+    size_t response_len;
+    at_data_sink_t data_sink;       /*<! switch to data mode on CONNECT */
+    void *data_ctx;
+} at_request_t;
+
+typedef struct {
+    const char *prefix;
+    at_urc_handler_t handler;
+    void *ctx;
+} at_urc_t;
+
+static uart_port_t s_port;
+static at_data_sink_t s_sink;
+static void *s_sink_ctx;
+
+static QueueHandle_t s_cmd_queue;
+static SemaphoreHandle_t s_lock;            /*<! guards the active command between engine and reader tasks */
+static SemaphoreHandle_t s_done;
+static at_request_t *s_active;
+static esp_err_t s_result;
+static char s_response[AT_MAX_RESPONSE];
+static size_t s_response_len;
+
+static at_urc_t s_urcs[AT_MAX_URC_HANDLERS];
+static uint8_t s_num_urcs;
+
+// Reader task state
+static char s_line[AT_MAX_LINE];
+static size_t s_line_len;
+static bool s_in_data;
+static volatile at_data_sink_t s_data_mode_sink;    /*<! set while the modem is in data mode (PPP) */
+static void *s_data_mode_ctx;
+static size_t s_hangup_matched;                     /*<! bytes of AT_HANGUP_TEXT seen so far in data mode */
+
+// lwIP negotiates an ACCM of 0, so PPP doesn't escape CR or LF and payload bytes could in principle spell this out;
+// matching it relies on 14 exact bytes being vanishingly unlikely in the mostly TLS-encrypted traffic
+#define AT_HANGUP_TEXT "\r\nNO CARRIER\r\n"
+
+static bool starts_with(const char *s, const char *prefix)
+{
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+static bool is_final_result(const char *line, esp_err_t *result)
+{
+    if (!strcmp(line, "OK") || starts_with(line, "CONNECT")) {
+        *result = ESP_OK;
+        return true;
+    }
+    if (!strcmp(line, "ERROR") || starts_with(line, "+CME ERROR:") || starts_with(line, "+CMS ERROR:") ||
+        !strcmp(line, "NO CARRIER") || !strcmp(line, "NO DIALTONE") || !strcmp(line, "BUSY") || !strcmp(line, "NO ANSWER")) {
+        *result = ESP_FAIL;
+        return true;
+    }
+    return false;
+}
+
+static void append_response(const char *line)
+{
+    size_t len = strlen(line);
+    if (s_response_len + len + 2 > sizeof(s_response)) {
+        return; // keep the first lines, they're the ones callers parse
+    }
+    if (s_response_len) {
+        s_response[s_response_len++] = '\n';
+    }
+    memcpy(s_response + s_response_len, line, len + 1);
+    s_response_len += len;
+}
+
+// Returns the number of bytes up to and including the modem's NO CARRIER, or 0 if it isn't in this chunk
+static size_t find_hangup(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == AT_HANGUP_TEXT[s_hangup_matched]) {
+            s_hangup_matched++;
+        } else {
+            s_hangup_matched = (data[i] == '\r') ? 1 : 0;
+        }
+        if (s_hangup_matched == sizeof(AT_HANGUP_TEXT) - 1) {
+            s_hangup_matched = 0;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static bool dispatch_urc(const char *line)
+{
+    for (int i = 0; i < s_num_urcs; i++) {
+        if (starts_with(line, s_urcs[i].prefix)) {
+            s_urcs[i].handler(line, s_urcs[i].ctx);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void handle_line(const char *line)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    at_request_t *req = s_active;
+
+    if (req) {
+        esp_err_t result;
+        if (starts_with(line, "AT")) {
+            xSemaphoreGive(s_lock); // command echo
+            return;
+        }
+        if (is_final_result(line, &result)) {
+            if (result != ESP_OK) {
+                append_response(line); // keep the CME/CMS error code for the caller
+            }
+            if (result == ESP_OK && req->data_sink && starts_with(line, "CONNECT")) {
+                s_data_mode_ctx = req->data_ctx;
+                s_data_mode_sink = req->data_sink;
+                s_hangup_matched = 0;
+            }
+            s_result = result;
+            s_active = NULL;
+            xSemaphoreGive(s_lock);
+            xSemaphoreGive(s_done);
+            return;
+        }
+        // Information responses for the active command win over URC handlers with the same prefix
+        if (req->prefix[0] && starts_with(line, req->prefix) && line[strlen(req->prefix)] == ':') {
+            append_response(line);
+            xSemaphoreGive(s_lock);
+            return;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (dispatch_urc(line)) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_active) {
+        append_response(line);
+    } else {
+        ESP_LOGD(TAG, "Unhandled URC: %s", line);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void at_feed(const uint8_t *data, size_t len)
+{
+    size_t data_start = 0;
+    at_data_sink_t data_mode_sink = s_data_mode_sink; // at_exit_data_mode() may clear it from another task
+
+    if (data_mode_sink) {
+        size_t hangup = find_hangup(data, len);
+        data_mode_sink(data, hangup ? hangup : len, s_data_mode_ctx);
+        if (!hangup) {
+            return;
+        }
+        // The modem dropped back to command mode by itself: stop routing to the sink, tell the URC handlers
+        ESP_LOGI(TAG, "NO CARRIER, leaving data mode");
+        at_exit_data_mode();
+        dispatch_urc("NO CARRIER");
+        data += hangup;
+        len -= hangup;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = data[i];
+
+        if (s_in_data) {
+            if (c == '\n') {
+                if (s_sink) {
+                    s_sink(data + data_start, i + 1 - data_start, s_sink_ctx);
+                }
+                s_in_data = false;
+            }
+            continue;
+        }
+
+        if (s_line_len == 0 && c == '$') {
+            s_in_data = true;
+            data_start = i;
+            continue;
+        }
+
+        if (c == '\r' || c == '\n') {
+            if (s_line_len) {
+                s_line[s_line_len] = '\0';
+                handle_line(s_line);
+                s_line_len = 0;
+            }
+            if (s_data_mode_sink) {
+                // CONNECT: the rest of this chunk is already data
+                if (i + 1 < len) {
+                    at_feed(data + i + 1, len - i - 1);
+                }
+                return;
+            }
+            continue;
+        }
+
+        if (s_line_len < sizeof(s_line) - 1) {
+            s_line[s_line_len++] = c;
+        }
+    }
+
+    // NMEA sentence continues in the next chunk
+    if (s_in_data && s_sink && data_start < len) {
+        s_sink(data + data_start, len - data_start, s_sink_ctx);
+    }
+}
+
+static void at_task(void *arg)
+{
+    at_request_t req;
+
+    while (1) {
+        xQueueReceive(s_cmd_queue, &req, portMAX_DELAY);
+
+        esp_err_t result;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_data_mode_sink) {
+            // The UART carries PPP now: the command would corrupt a frame and its reply would never be parsed
+            xSemaphoreGive(s_lock);
+            req.cmd[strcspn(req.cmd, "\r")] = '\0';
+            ESP_LOGW(TAG, "%s rejected, modem is in data mode", req.cmd);
+            s_response[0] = '\0';
+            result = ESP_ERR_INVALID_STATE;
+        } else {
+            s_response_len = 0;
+            s_response[0] = '\0';
+            s_active = &req;
+            xSemaphoreGive(s_lock);
+            xSemaphoreTake(s_done, 0); // drop a completion that raced a previous timeout
+
+            int64_t start = esp_timer_get_time();
+            uart_write_bytes(s_port, req.cmd, strlen(req.cmd));
+            xSemaphoreTake(s_done, pdMS_TO_TICKS(req.timeout_ms));
+
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            if (s_active) {
+                s_active = NULL;
+                result = ESP_ERR_TIMEOUT;
+            } else {
+                result = s_result;
+            }
+            xSemaphoreGive(s_lock);
+
+            req.cmd[strcspn(req.cmd, "\r")] = '\0';
+            if (result == ESP_ERR_TIMEOUT) {
+                ESP_LOGW(TAG, "%s timed out after %lums", req.cmd, req.timeout_ms);
+            } else {
+                ESP_LOGD(TAG, "%s -> %s in %lldms", req.cmd, result == ESP_OK ? "OK" : "ERROR", (esp_timer_get_time() - start) / 1000);
+            }
+        }
+
+        if (req.callback) {
+            req.callback(result, s_response, req.ctx);
+        }
+        if (req.done) {
+            if (req.response && req.response_len) {
+                strncpy(req.response, s_response, req.response_len - 1);
+                req.response[req.response_len - 1] = '\0';
+            }
+            *req.result = result;
+            xSemaphoreGive(req.done);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+static esp_err_t enqueue(at_request_t *req, const char *cmd, uint32_t timeout_ms)
+{
+    if (!s_cmd_queue || s_data_mode_sink) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (strlen(cmd) >= sizeof(req->cmd)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    strcpy(req->cmd, cmd);
+    req->timeout_ms = timeout_ms;
+
+    // "AT+CSQ\r" / "AT+CGPS=1,1\r" / "AT+CPIN?\r" -> "+CSQ" / "+CGPS" / "+CPIN"
+    req->prefix[0] = '\0';
+    if (cmd[0] == 'A' && cmd[1] == 'T' && (cmd[2] == '+' || cmd[2] == '$')) {
+        size_t n = strcspn(cmd + 2, "=?\r");
+        if (n < sizeof(req->prefix)) {
+            memcpy(req->prefix, cmd + 2, n);
+            req->prefix[n] = '\0';
+        }
+    }
+
+    if (xQueueSend(s_cmd_queue, req, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        ESP_LOGW(TAG, "Command queue full, dropping %s", cmd);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t at_command(const char *cmd, uint32_t timeout_ms, char *response, size_t response_len)
+{
+    StaticSemaphore_t done_buf;
+    esp_err_t result = ESP_FAIL;
+    at_request_t req = {
+        .done = xSemaphoreCreateBinaryStatic(&done_buf),
+        .result = &result,
+        .response = response,
+        .response_len = response_len,
+    };
+
+    esp_err_t err = enqueue(&req, cmd, timeout_ms);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // The engine always completes a request within its timeout
+    xSemaphoreTake(req.done, portMAX_DELAY);
+    return result;
+}
+
+esp_err_t at_dial(const char *cmd, uint32_t timeout_ms, at_data_sink_t sink, void *ctx)
+{
+    StaticSemaphore_t done_buf;
+    esp_err_t result = ESP_FAIL;
+    at_request_t req = {
+        .done = xSemaphoreCreateBinaryStatic(&done_buf),
+        .result = &result,
+        .data_sink = sink,
+        .data_ctx = ctx,
+    };
+
+    esp_err_t err = enqueue(&req, cmd, timeout_ms);
+    if (err != ESP_OK) {
+        return err;
+    }
+    xSemaphoreTake(req.done, portMAX_DELAY);
+    return result;
+}
+
+void at_exit_data_mode(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_data_mode_sink = NULL;
+    s_hangup_matched = 0;
+    s_in_data = false;
+    s_line_len = 0;
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t at_command_async(const char *cmd, uint32_t timeout_ms, at_response_cb_t callback, void *ctx)
+{
+    at_request_t req = {
+        .callback = callback,
+        .ctx = ctx,
+    };
+    return enqueue(&req, cmd, timeout_ms);
+}
+
+esp_err_t at_register_urc(const char *prefix, at_urc_handler_t handler, void *ctx)
+{
+    if (s_num_urcs >= AT_MAX_URC_HANDLERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_urcs[s_num_urcs].prefix = prefix;
+    s_urcs[s_num_urcs].handler = handler;
+    s_urcs[s_num_urcs].ctx = ctx;
+    s_num_urcs++;
+    return ESP_OK;
+}
+
+esp_err_t at_init(uart_port_t port, at_data_sink_t sink, void *sink_ctx)
+{
+    s_port = port;
+    s_sink = sink;
+    s_sink_ctx = sink_ctx;
+
+    s_lock = xSemaphoreCreateMutex();
+    s_done = xSemaphoreCreateBinary();
+    s_cmd_queue = xQueueCreate(AT_COMMAND_QUEUE_LEN, sizeof(at_request_t));
+    if (!s_lock || !s_done || !s_cmd_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    xTaskCreate(at_task, "at_engine", 3072, NULL, 5, NULL);
+    return ESP_OK;
+}
@@ -0,0 +1,88 @@
+/* AT class: response-driven AT command engine with URC dispatch
+ *
+ * Commands are queued and executed one at a time by the engine task; each completes as soon as the modem
+ * sends a final result code (OK, ERROR, +CME ERROR...) or its timeout expires, so any task can issue queries
+ * without coordinating with the others. Lines that are not part of a command response are routed to
+ * registered unsolicited result code handlers. Lines starting with '$' are NMEA and are streamed to the data sink.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "driver/uart.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AT_MAX_COMMAND          96      // including the trailing '\r'
+#define AT_MAX_LINE             128
+#define AT_MAX_RESPONSE         256     // intermediate response lines kept per command, '\n' separated
+#define AT_MAX_URC_HANDLERS     8
+#define AT_COMMAND_QUEUE_LEN    8
+#define AT_DEFAULT_TIMEOUT_MS   1000
+
+/**
+ * @brief Called with each unsolicited line matching the registered prefix, from the UART reader task.
+ *        Must not block on at_command(); use at_command_async() to follow up.
+ */
+typedef void (*at_urc_handler_t)(const char *line, void *ctx);
+
+/**
+ * @brief Called on completion of an asynchronous command, from the engine task
+ * @param result ESP_OK on OK/CONNECT, ESP_FAIL on an error result code, ESP_ERR_TIMEOUT if none arrived
+ * @param response intermediate response lines, '\n' separated, without echo or final result code
+ */
+typedef void (*at_response_cb_t)(esp_err_t result, const char *response, void *ctx);
+
+/**
+ * @brief Raw byte sink for lines the engine doesn't consume (NMEA sentences), or for data mode
+ */
+typedef void (*at_data_sink_t)(const uint8_t *data, size_t len, void *ctx);
+
+/**
+ * @brief Start the engine task. The UART driver must already be installed.
+ */
+esp_err_t at_init(uart_port_t port, at_data_sink_t sink, void *sink_ctx);
+
+/**
+ * @brief Feed bytes read from the UART. Call from the single task that owns UART reads.
+ */
+void at_feed(const uint8_t *data, size_t len);
+
+/**
+ * @brief Run a command and block until its final result code or timeout
+ * @param cmd command including the trailing '\r'
+ * @param response buffer for intermediate response lines, may be NULL
+ * @return ESP_OK on OK/CONNECT, ESP_FAIL on ERROR, ESP_ERR_TIMEOUT, ESP_ERR_NO_MEM if the queue is full,
+ *         or ESP_ERR_INVALID_STATE while the modem is in data mode
+ */
+esp_err_t at_command(const char *cmd, uint32_t timeout_ms, char *response, size_t response_len);
+
+/**
+ * @brief Queue a command without waiting; callback may be NULL for fire-and-forget.
+ *        Commands still queued when the modem enters data mode complete with ESP_ERR_INVALID_STATE.
+ */
+esp_err_t at_command_async(const char *cmd, uint32_t timeout_ms, at_response_cb_t callback, void *ctx);
+
+/**
+ * @brief Run a dial command (e.g. "ATD*99#\r") and block until CONNECT. From then on every byte read from
+ *        the UART is passed to sink instead of being parsed, until at_exit_data_mode() or until the modem
+ *        reports NO CARRIER, which is then dispatched to a "NO CARRIER" URC handler if one is registered.
+ */
+esp_err_t at_dial(const char *cmd, uint32_t timeout_ms, at_data_sink_t sink, void *ctx);
+
+/**
+ * @brief Return UART input to line parsing. Call once the modem is back in command mode (or hung up).
+ */
+void at_exit_data_mode(void);
+
+/**
+ * @brief Route unsolicited lines starting with prefix (e.g. "+CPIN:", "RDY") to handler
+ */
+esp_err_t at_register_urc(const char *prefix, at_urc_handler_t handler, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
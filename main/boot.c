@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "maxbox_defines.h"
+#include "boot.h"
+
+static const char* TAG = "MaxBox-BOOT";
+
+static const boot_stage_t *s_stages;
+static EventGroupHandle_t s_done;
+
+#define ms_since_start(us) ((uint32_t)((us) / 1000))
+
+static void stage_task(void *arg)
+{
+    int i = (int)arg;
+    const boot_stage_t *stage = &s_stages[i];
+    boot_stage_timing_t *timing = &mb->tel->boot.stages[i];
+
+    if (stage->deps) {
+        xEventGroupWaitBits(s_done, stage->deps, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    int64_t start = esp_timer_get_time();
+    stage->init();
+    int64_t end = esp_timer_get_time();
+
+    timing->core = xPortGetCoreID();
+    timing->start_ms = ms_since_start(start);
+    timing->duration_ms = ms_since_start(end - start);
+    xEventGroupSetBits(s_done, BIT(i));
+    vTaskDelete(NULL);
+}
+
+static bool acyclic(const boot_stage_t *stages, size_t num_stages)
+{
+    // Peel off stages whose dependencies are all resolved; anything left over is in a cycle
+    uint32_t resolved = 0;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (int i = 0; i < num_stages; i++) {
+            if (!(resolved & BIT(i)) && (stages[i].deps & ~resolved) == 0) {
+                resolved |= BIT(i);
+                progress = true;
+            }
+        }
+    }
+    return resolved == BIT(num_stages) - 1;
+}
+
+void boot_run(const boot_stage_t *stages, size_t num_stages, uint32_t ready_stages, void (*on_ready)(void))
+{
+    boot_status_t *status = &mb->tel->boot;
+
+    // A dependency that can never finish would hang the boot with no clue why
+    if (num_stages > BOOT_MAX_STAGES || !acyclic(stages, num_stages)) {
+        ESP_LOGE(TAG, "Invalid boot stage table");
+        abort();
+    }
+
+    s_stages = stages;
+    s_done = xEventGroupCreate();
+    status->num_stages = num_stages;
+
+    for (int i = 0; i < num_stages; i++) {
+        status->stages[i].name = stages[i].name;
+        xTaskCreatePinnedToCore(stage_task, stages[i].name, BOOT_STAGE_STACK_SIZE, (void*)i, 3, NULL, stages[i].core);
+    }
+
+    xEventGroupWaitBits(s_done, ready_stages, pdFALSE, pdTRUE, portMAX_DELAY);
+    status->ready_ms = ms_since_start(esp_timer_get_time());
+    on_ready();
+
+    xEventGroupWaitBits(s_done, BIT(num_stages) - 1, pdFALSE, pdTRUE, portMAX_DELAY);
+    status->complete_ms = ms_since_start(esp_timer_get_time());
+
+    for (int i = 0; i < num_stages; i++) {
+        ESP_LOGI(TAG, "%-12s core %d, started %5lums, took %5lums", status->stages[i].name,
+                 status->stages[i].core, status->stages[i].start_ms, status->stages[i].duration_ms);
+    }
+    ESP_LOGI(TAG, "Ready for card taps after %lums, boot complete after %lums", status->ready_ms, status->complete_ms);
+}
@@ -0,0 +1,35 @@
+/* Boot class: dependency-ordered, parallel start of the box's subsystems
+ *
+ * Each stage runs in its own task pinned to the stage's core, so the interrupts it allocates land there, and
+ * starts as soon as the stages it depends on have finished. Stage start times and durations are logged and kept
+ * in telemetry boot.
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_STAGE_STACK_SIZE   4096
+
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    BaseType_t core;                /*<! core to run on, or tskNO_AFFINITY */
+    uint32_t deps;                  /*<! bit per index into the stage table of stages that must finish first */
+} boot_stage_t;
+
+/**
+ * @brief Start every stage and wait until they have all finished
+ * @param ready_stages bit per stage that must finish before the box can take a card tap
+ * @param on_ready called once those have finished, while the others may still be starting
+ */
+void boot_run(const boot_stage_t *stages, size_t num_stages, uint32_t ready_stages, void (*on_ready)(void));
+
+#ifdef __cplusplus
+}
+#endif
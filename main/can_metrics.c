@@ -0,0 +1,204 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/twai.h"
+#include "esp_log.h"
+
+#include "maxbox_defines.h"
+#include "can_metrics.h"
+
+static const char* TAG = "MaxBox-CAN-metrics";
+
+typedef struct {
+    uint32_t identifier;
+    uint32_t count;             /*<! frames this interval, swapped out atomically by the metrics task */
+    uint16_t rate_x10;          /*<! frames per second x10 over the previous interval */
+    bool used;
+} can_id_slot_t;
+
+static can_id_slot_t s_ids[CAN_METRICS_MAX_IDS];
+static uint32_t s_tx_errors;
+static uint32_t s_tx_failed_alerts;
+static uint32_t s_bus_off_events;
+static uint32_t s_rx_queue_full_events;
+static uint32_t s_rxq_hwm;
+static uint32_t s_tec_max;
+static uint32_t s_rec_max;
+
+static can_id_slot_t* find_slot(uint32_t identifier, bool create)
+{
+    // Open addressing on the low bits: standard IDs spread well over 64 slots
+    uint32_t start = identifier % CAN_METRICS_MAX_IDS;
+    for (int i = 0; i < CAN_METRICS_MAX_IDS; i++) {
+        can_id_slot_t *slot = &s_ids[(start + i) % CAN_METRICS_MAX_IDS];
+        if (slot->used && slot->identifier == identifier) {
+            return slot;
+        }
+        if (!slot->used) {
+            if (!create) {
+                return NULL;
+            }
+            slot->identifier = identifier;
+            slot->used = true;
+            return slot;
+        }
+    }
+    return NULL; // table full, ID not tracked
+}
+
+static void sample_status(void)
+{
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) != ESP_OK) {
+        return;
+    }
+    if (status.msgs_to_rx > s_rxq_hwm) {
+        s_rxq_hwm = status.msgs_to_rx;
+    }
+    if (status.tx_error_counter > s_tec_max) {
+        s_tec_max = status.tx_error_counter;
+    }
+    if (status.rx_error_counter > s_rec_max) {
+        s_rec_max = status.rx_error_counter;
+    }
+}
+
+void can_metrics_record_rx(uint32_t identifier)
+{
+    can_id_slot_t *slot = find_slot(identifier, true);
+    if (slot) {
+        __atomic_fetch_add(&slot->count, 1, __ATOMIC_RELAXED);
+    }
+
+    // The queue can fill and drain between sparse samples, so look at every frame
+    sample_status();
+}
+
+void can_metrics_record_tx(esp_err_t err)
+{
+    if (err != ESP_OK) {
+        s_tx_errors++;
+        ESP_LOGW(TAG, "CAN transmit failed: %s", esp_err_to_name(err));
+    }
+}
+
+uint16_t can_metrics_id_rate(uint32_t identifier)
+{
+    can_id_slot_t *slot = find_slot(identifier, false);
+    return slot ? slot->rate_x10 : 0;
+}
+
+static void can_alert_task(void *arg)
+{
+    while (1) {
+        uint32_t alerts;
+        if (twai_read_alerts(&alerts, portMAX_DELAY) != ESP_OK) {
+            vTaskDelay(CAN_BUS_OFF_RECOVERY_DELAY_MS / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        if (alerts & TWAI_ALERT_TX_FAILED) {
+            s_tx_failed_alerts++;
+        }
+        if (alerts & (TWAI_ALERT_RX_QUEUE_FULL | TWAI_ALERT_RX_FIFO_OVERRUN)) {
+            s_rx_queue_full_events++;
+            ESP_LOGW(TAG, "CAN RX queue overrun");
+        }
+        if (alerts & TWAI_ALERT_ABOVE_ERR_WARN) {
+            ESP_LOGW(TAG, "CAN error counters above warning limit");
+        }
+        if (alerts & TWAI_ALERT_ERR_PASS) {
+            ESP_LOGW(TAG, "CAN controller error passive");
+        }
+        if (alerts & (TWAI_ALERT_ABOVE_ERR_WARN | TWAI_ALERT_ERR_PASS | TWAI_ALERT_BUS_ERROR)) {
+            sample_status();
+        }
+        if (alerts & TWAI_ALERT_BUS_OFF) {
+            s_bus_off_events++;
+            ESP_LOGE(TAG, "CAN bus off (event %lu), recovering", s_bus_off_events);
+            vTaskDelay(CAN_BUS_OFF_RECOVERY_DELAY_MS / portTICK_PERIOD_MS);
+            twai_initiate_recovery();
+        }
+        if (alerts & TWAI_ALERT_BUS_RECOVERED) {
+            ESP_LOGI(TAG, "CAN bus recovered, restarting controller");
+            twai_start();
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+static void update_top_ids(void)
+{
+    // Insertion into a short sorted list; the table is only CAN_METRICS_MAX_IDS long
+    can_id_rate_t *top = mb->tel->can.top_ids;
+    uint8_t n = 0;
+
+    for (int i = 0; i < CAN_METRICS_MAX_IDS; i++) {
+        if (!s_ids[i].used || !s_ids[i].rate_x10) {
+            continue;
+        }
+        int pos = n;
+        while (pos > 0 && top[pos - 1].rate_x10 < s_ids[i].rate_x10) {
+            if (pos < CAN_METRICS_TOP_IDS) {
+                top[pos] = top[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < CAN_METRICS_TOP_IDS) {
+            top[pos].identifier = s_ids[i].identifier;
+            top[pos].rate_x10 = s_ids[i].rate_x10;
+            if (n < CAN_METRICS_TOP_IDS) {
+                n++;
+            }
+        }
+    }
+    mb->tel->can.num_top_ids = n;
+}
+
+static void can_metrics_task(void *arg)
+{
+    while (1) {
+        vTaskDelay(CAN_METRICS_INTERVAL_MS / portTICK_PERIOD_MS);
+
+        uint32_t total = 0;
+        uint16_t ids_seen = 0;
+        for (int i = 0; i < CAN_METRICS_MAX_IDS; i++) {
+            if (!s_ids[i].used) {
+                continue;
+            }
+            uint32_t count = __atomic_exchange_n(&s_ids[i].count, 0, __ATOMIC_RELAXED);
+            s_ids[i].rate_x10 = (count * 10000) / CAN_METRICS_INTERVAL_MS;
+            total += count;
+            if (count) {
+                ids_seen++;
+            }
+        }
+
+        twai_status_info_t status;
+        if (twai_get_status_info(&status) == ESP_OK) {
+            mb->tel->can.bus_errors = status.bus_error_count;
+            mb->tel->can.arb_lost = status.arb_lost_count;
+            mb->tel->can.rx_missed = status.rx_missed_count + status.rx_overrun_count;
+            mb->tel->can.bus_off = (status.state == TWAI_STATE_BUS_OFF || status.state == TWAI_STATE_RECOVERING);
+        }
+        sample_status();
+
+        mb->tel->can.rx_fps = (total * 1000) / CAN_METRICS_INTERVAL_MS;
+        mb->tel->can.ids_seen = ids_seen;
+        update_top_ids();
+        mb->tel->can.rxq_hwm = s_rxq_hwm;
+        mb->tel->can.tec_max = s_tec_max;
+        mb->tel->can.rec_max = s_rec_max;
+        mb->tel->can.rxq_full_events = s_rx_queue_full_events;
+        mb->tel->can.bus_off_events = s_bus_off_events;
+        mb->tel->can.tx_failed = s_tx_errors + s_tx_failed_alerts;
+        mb->tel->can.updated_ts = box_timestamp();
+    }
+    vTaskDelete(NULL);
+}
+
+void can_metrics_init(void)
+{
+    xTaskCreatePinnedToCore(can_alert_task, "can_alert_task", 3072, NULL, 4, NULL, 1);
+    xTaskCreatePinnedToCore(can_metrics_task, "can_metrics_task", 3072, NULL, 2, NULL, 1);
+}
@@ -0,0 +1,44 @@
+/* CAN metrics class: bus health, error counters and throughput for the TWAI controller
+*/
+#pragma once
+
+#include <stdint.h>
+#include "driver/twai.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAN_METRICS_ALERTS  (TWAI_ALERT_TX_FAILED | TWAI_ALERT_BUS_OFF | TWAI_ALERT_BUS_RECOVERED | \
+                             TWAI_ALERT_RX_QUEUE_FULL | TWAI_ALERT_RX_FIFO_OVERRUN | TWAI_ALERT_ARB_LOST | \
+                             TWAI_ALERT_BUS_ERROR | TWAI_ALERT_ERR_PASS | TWAI_ALERT_ABOVE_ERR_WARN)
+
+#define CAN_METRICS_MAX_IDS             64      // distinct IDs tracked for per-ID rates
+#define CAN_BUS_OFF_RECOVERY_DELAY_MS   1000    // back off before re-entering the bus
+
+/**
+ * @brief Start the alert and metrics tasks. Call after twai_start(), with CAN_METRICS_ALERTS
+ *        set in twai_general_config_t.alerts_enabled.
+ */
+void can_metrics_init(void);
+
+/**
+ * @brief Count a received frame and sample the RX queue depth. Call for every frame from the receive task.
+ */
+void can_metrics_record_rx(uint32_t identifier);
+
+/**
+ * @brief Count the result of a twai_transmit() call
+ */
+void can_metrics_record_tx(esp_err_t err);
+
+/**
+ * @brief Frame rate of one CAN ID over the last metrics interval
+ * @return frames per second x10, or 0 if the ID has not been seen
+ */
+uint16_t can_metrics_id_rate(uint32_t identifier);
+
+#ifdef __cplusplus
+}
+#endif
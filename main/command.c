@@ -0,0 +1,60 @@
+#include <string.h>
+#include "esp_log.h"
+
+#include "maxbox_defines.h"
+#include "command.h"
+#include "vehicle.h"
+#include "flash.h"
+
+static const char* TAG = "MaxBox-CMD";
+
+event_return_t command_action(const char *action)
+{
+    if (strcmp(action, "lock") == 0) {
+        mb->lock_desired = 1;
+        return vehicle_un_lock();
+    } else if (strcmp(action, "unlock") == 0) {
+        mb->lock_desired = 0;
+        return vehicle_un_lock();
+    } else if (strcmp(action, "reject") == 0) {
+        return BOX_DENY;
+    }
+    ESP_LOGW(TAG, "Unknown action %s", action);
+    return BOX_ERROR;
+}
+
+bool command_card_add(const char *card_id, int32_t etag)
+{
+    int free_slot = -1;
+    for (int i = 0; i < MAX_OPERATOR_CARDS; i++) {
+        if (strcmp(mb->operator_card_list[i], card_id) == 0) {
+            free_slot = i;
+            break;
+        }
+        if (free_slot < 0 && (strcmp(mb->operator_card_list[i], "voidvoid") == 0 || !mb->operator_card_list[i][0])) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        ESP_LOGE(TAG, "Operator card list full, not adding %s", card_id);
+        return false;
+    }
+
+    strncpy(mb->operator_card_list[free_slot], card_id, 9);
+    mb->etag = etag;
+    flash_write_all();
+    ESP_LOGI(TAG, "Added card to operator list with id: %s, etag %ld", card_id, etag);
+    return true;
+}
+
+void command_card_remove(const char *card_id, int32_t etag)
+{
+    for (int i = 0; i < MAX_OPERATOR_CARDS; i++) {
+        if (strcmp(mb->operator_card_list[i], card_id) == 0) {
+            strcpy(mb->operator_card_list[i], "voidvoid");
+        }
+    }
+    mb->etag = etag;
+    flash_write_all();
+    ESP_LOGI(TAG, "Removed card from operator list with id: %s, etag %ld", card_id, etag);
+}
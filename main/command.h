@@ -0,0 +1,31 @@
+/* Command class: remote actions shared by the HTTP response handler and LoRaWAN downlinks
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "maxbox_defines.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Execute a lock/unlock/reject action. Unknown actions return BOX_ERROR.
+ */
+event_return_t command_action(const char *action);
+
+/**
+ * @brief Add an operator card and adopt the server's new etag for the list
+ * @return false if the list is full
+ */
+bool command_card_add(const char *card_id, int32_t etag);
+
+/**
+ * @brief Remove an operator card and adopt the server's new etag for the list
+ */
+void command_card_remove(const char *card_id, int32_t etag);
+
+#ifdef __cplusplus
+}
+#endif
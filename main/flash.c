@@ -70,4 +70,37 @@ void flash_write_all(void)
         size_t required_size = sizeof(mb->operator_card_list);
         nvs_set_blob(my_handle, "op_card_list", mb->operator_card_list, required_size);
     }
-}
\ No newline at end of file
+}
+
+esp_err_t flash_read_blob(const char *key, void *data, size_t *len)
+{
+    nvs_handle_t my_handle;
+
+    esp_err_t err = nvs_open("storage", NVS_READONLY, &my_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_get_blob(my_handle, key, data, len);
+    nvs_close(my_handle);
+    return err;
+}
+
+esp_err_t flash_write_blob(const char *key, const void *data, size_t len)
+{
+    nvs_handle_t my_handle;
+
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &my_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+        return err;
+    }
+    err = nvs_set_blob(my_handle, key, data, len);
+    if (err == ESP_OK) {
+        err = nvs_commit(my_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) writing %s", esp_err_to_name(err), key);
+    }
+    nvs_close(my_handle);
+    return err;
+}
@@ -2,6 +2,9 @@
 */
 #pragma once
 
+#include <stddef.h>
+#include "esp_err.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -16,6 +19,17 @@ void flash_init();
  */
 void flash_write_all();
 
+/**
+ * @brief Read a blob from the "storage" namespace
+ * @param len in: buffer size, out: blob size
+ */
+esp_err_t flash_read_blob(const char *key, void *data, size_t *len);
+
+/**
+ * @brief Write and commit a blob to the "storage" namespace
+ */
+esp_err_t flash_write_blob(const char *key, const void *data, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
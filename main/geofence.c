@@ -0,0 +1,303 @@
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "maxbox_defines.h"
+#include "geofence.h"
+#include "flash.h"
+#include "telemetry.h"
+
+static const char* TAG = "MaxBox-GEOFENCE";
+
+typedef struct {
+    int32_t etag;
+    uint8_t num_fences;
+    geofence_t fences[GEOFENCE_MAX_FENCES];
+} geofence_set_t;  // stored as a single NVS blob
+
+typedef struct {
+    int32_t min_lat, max_lat, min_lon, max_lon;
+} bbox_t;
+
+static SemaphoreHandle_t s_lock;
+static geofence_set_t s_set;
+static bbox_t s_bbox[GEOFENCE_MAX_FENCES];
+static bbox_t s_grid_bbox;
+static int64_t s_cell_lat;
+static int64_t s_cell_lon;
+static uint8_t s_grid[GEOFENCE_GRID_DIM][GEOFENCE_GRID_DIM];   // bitmask of fences overlapping each cell
+
+static uint8_t s_inside;                        // confirmed membership, bit per fence index
+static uint8_t s_confirm[GEOFENCE_MAX_FENCES];  // fixes seen on the other side of the boundary
+static bool s_state_known;
+static uint32_t s_last_fix_time_ms;             // fix that last counted towards s_confirm
+
+static int grid_index(int32_t v, int32_t min, int64_t cell)
+{
+    int64_t i = ((int64_t)v - min) / cell;
+    if (i < 0) {
+        return 0;
+    }
+    return (i >= GEOFENCE_GRID_DIM) ? GEOFENCE_GRID_DIM - 1 : i;
+}
+
+static void build_index(void)
+{
+    memset(s_grid, 0, sizeof(s_grid));
+    s_grid_bbox = (bbox_t) {INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN};
+
+    for (int f = 0; f < s_set.num_fences; f++) {
+        const geofence_t *fence = &s_set.fences[f];
+        bbox_t *b = &s_bbox[f];
+        *b = (bbox_t) {INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN};
+        for (int i = 0; i < fence->num_points; i++) {
+            b->min_lat = MIN(b->min_lat, fence->lat_e7[i]);
+            b->max_lat = MAX(b->max_lat, fence->lat_e7[i]);
+            b->min_lon = MIN(b->min_lon, fence->lon_e7[i]);
+            b->max_lon = MAX(b->max_lon, fence->lon_e7[i]);
+        }
+        s_grid_bbox.min_lat = MIN(s_grid_bbox.min_lat, b->min_lat);
+        s_grid_bbox.max_lat = MAX(s_grid_bbox.max_lat, b->max_lat);
+        s_grid_bbox.min_lon = MIN(s_grid_bbox.min_lon, b->min_lon);
+        s_grid_bbox.max_lon = MAX(s_grid_bbox.max_lon, b->max_lon);
+    }
+
+    if (!s_set.num_fences) {
+        return;
+    }
+
+    s_cell_lat = ((int64_t)s_grid_bbox.max_lat - s_grid_bbox.min_lat) / GEOFENCE_GRID_DIM + 1;
+    s_cell_lon = ((int64_t)s_grid_bbox.max_lon - s_grid_bbox.min_lon) / GEOFENCE_GRID_DIM + 1;
+
+    for (int f = 0; f < s_set.num_fences; f++) {
+        int r0 = grid_index(s_bbox[f].min_lat, s_grid_bbox.min_lat, s_cell_lat);
+        int r1 = grid_index(s_bbox[f].max_lat, s_grid_bbox.min_lat, s_cell_lat);
+        int c0 = grid_index(s_bbox[f].min_lon, s_grid_bbox.min_lon, s_cell_lon);
+        int c1 = grid_index(s_bbox[f].max_lon, s_grid_bbox.min_lon, s_cell_lon);
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                s_grid[r][c] |= 1 << f;
+            }
+        }
+    }
+}
+
+static bool point_in_polygon(const geofence_t *fence, int32_t lat, int32_t lon)
+{
+    // Crossing number; 64-bit products so longitude spans near +-180 can't overflow
+    bool inside = false;
+    for (int i = 0, j = fence->num_points - 1; i < fence->num_points; j = i++) {
+        int64_t yi = fence->lat_e7[i], yj = fence->lat_e7[j];
+        int64_t xi = fence->lon_e7[i], xj = fence->lon_e7[j];
+        if ((yi > lat) != (yj > lat)) {
+            int64_t lhs = (lon - xi) * (yj - yi);
+            int64_t rhs = (xj - xi) * (lat - yi);
+            if ((yj > yi) ? (lhs < rhs) : (lhs > rhs)) {
+                inside = !inside;
+            }
+        }
+    }
+    return inside;
+}
+
+static void publish_membership(void)
+{
+    geofence_status_t *status = &mb->tel->geofence;
+    status->etag = s_set.etag;
+    status->num_inside = 0;
+    for (int f = 0; f < s_set.num_fences; f++) {
+        if (s_inside & (1 << f)) {
+            status->inside[status->num_inside++] = s_set.fences[f].id;
+        }
+    }
+}
+
+static void record_event(uint16_t id, bool entered)
+{
+    geofence_status_t *status = &mb->tel->geofence;
+    status->events[status->next_event] = (geofence_event_t) {
+        .id = id,
+        .entered = entered,
+        .ts = box_timestamp(),
+    };
+    status->next_event = (status->next_event + 1) % GEOFENCE_MAX_EVENTS;
+    status->event_seq++;
+    if (status->num_events < GEOFENCE_MAX_EVENTS) {
+        status->num_events++;
+    }
+    ESP_LOGI(TAG, "%s geofence %u", entered ? "Entered" : "Exited", id);
+}
+
+static void reset_state(void)
+{
+    s_inside = 0;
+    s_state_known = false;
+    memset(s_confirm, 0, sizeof(s_confirm));
+    build_index();
+    publish_membership();
+}
+
+void geofence_check(int32_t lat_e7, int32_t lon_e7, uint32_t fix_time_ms)
+{
+    uint8_t inside = 0;
+    bool changed = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    if (!s_set.num_fences || (s_state_known && fix_time_ms == s_last_fix_time_ms)) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    s_last_fix_time_ms = fix_time_ms;
+
+    if (lat_e7 >= s_grid_bbox.min_lat && lat_e7 <= s_grid_bbox.max_lat &&
+        lon_e7 >= s_grid_bbox.min_lon && lon_e7 <= s_grid_bbox.max_lon) {
+        uint8_t candidates = s_grid[grid_index(lat_e7, s_grid_bbox.min_lat, s_cell_lat)]
+                                   [grid_index(lon_e7, s_grid_bbox.min_lon, s_cell_lon)];
+        for (int f = 0; candidates; f++, candidates >>= 1) {
+            const bbox_t *b = &s_bbox[f];
+            if ((candidates & 1) && lat_e7 >= b->min_lat && lat_e7 <= b->max_lat &&
+                lon_e7 >= b->min_lon && lon_e7 <= b->max_lon &&
+                point_in_polygon(&s_set.fences[f], lat_e7, lon_e7)) {
+                inside |= 1 << f;
+            }
+        }
+    }
+
+    if (!s_state_known) {
+        // First fix after boot or a new fence set establishes membership without events
+        s_inside = inside;
+        s_state_known = true;
+        publish_membership();
+        xSemaphoreGive(s_lock);
+        return;
+    }
+
+    for (int f = 0; f < s_set.num_fences; f++) {
+        uint8_t bit = 1 << f;
+        if ((inside & bit) == (s_inside & bit)) {
+            s_confirm[f] = 0;
+            continue;
+        }
+        if (++s_confirm[f] >= GEOFENCE_CONFIRM_FIXES) {
+            s_confirm[f] = 0;
+            s_inside ^= bit;
+            record_event(s_set.fences[f].id, s_inside & bit);
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        publish_membership();
+    }
+    xSemaphoreGive(s_lock);
+
+    if (changed) {
+        telemetry_request_upload();
+    }
+}
+
+int32_t geofence_etag()
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int32_t etag = s_set.etag;
+    xSemaphoreGive(s_lock);
+    return etag;
+}
+
+uint32_t geofence_event_seq()
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t seq = mb->tel->geofence.event_seq;
+    xSemaphoreGive(s_lock);
+    return seq;
+}
+
+void geofence_discard_events(uint32_t seq)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    geofence_status_t *status = &mb->tel->geofence;
+    // Events recorded after seq stay in the ring for the next upload
+    uint32_t newer = status->event_seq - seq;
+    if (newer < status->num_events) {
+        status->num_events = newer;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void geofence_update_from_json(cJSON *geofences)
+{
+    cJSON *recv_etag = cJSON_GetObjectItem(geofences, "etag");
+    if (!cJSON_IsNumber(recv_etag) || recv_etag->valueint == s_set.etag) {
+        return;
+    }
+
+    geofence_set_t *set = calloc(1, sizeof(geofence_set_t));
+    if (!set) {
+        return;
+    }
+    set->etag = recv_etag->valueint;
+
+    cJSON *fence_json;
+    cJSON_ArrayForEach(fence_json, cJSON_GetObjectItem(geofences, "fences")) {
+        cJSON *id = cJSON_GetObjectItem(fence_json, "id");
+        cJSON *points = cJSON_GetObjectItem(fence_json, "points");
+        int num_points = cJSON_GetArraySize(points);
+
+        if (set->num_fences >= GEOFENCE_MAX_FENCES) {
+            ESP_LOGW(TAG, "Too many geofences, ignoring the rest");
+            break;
+        }
+        if (!cJSON_IsNumber(id) || num_points < 3 || num_points > GEOFENCE_MAX_POINTS) {
+            ESP_LOGW(TAG, "Ignoring malformed geofence");
+            continue;
+        }
+
+        geofence_t *fence = &set->fences[set->num_fences];
+        fence->id = id->valueint;
+        cJSON *point;
+        cJSON_ArrayForEach(point, points) {
+            cJSON *lat = cJSON_GetArrayItem(point, 0);
+            cJSON *lng = cJSON_GetArrayItem(point, 1);
+            if (!cJSON_IsNumber(lat) || !cJSON_IsNumber(lng)) {
+                break;
+            }
+            fence->lat_e7[fence->num_points] = lround(lat->valuedouble * 1e7);
+            fence->lon_e7[fence->num_points] = lround(lng->valuedouble * 1e7);
+            fence->num_points++;
+        }
+        if (fence->num_points == num_points) {
+            set->num_fences++;
+        } else {
+            ESP_LOGW(TAG, "Ignoring geofence %u with malformed points", fence->id);
+            memset(fence, 0, sizeof(geofence_t));
+        }
+    }
+
+    ESP_LOGI(TAG, "New geofence etag is %ld, %u fences", set->etag, set->num_fences);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_set = *set;
+    reset_state();
+    xSemaphoreGive(s_lock);
+
+    flash_write_blob("geofences", set, sizeof(geofence_set_t));
+    free(set);
+}
+
+void geofence_init()
+{
+    s_lock = xSemaphoreCreateMutex();
+
+    size_t len = sizeof(s_set);
+    if (flash_read_blob("geofences", &s_set, &len) != ESP_OK || len != sizeof(s_set) ||
+        s_set.num_fences > GEOFENCE_MAX_FENCES) {
+        memset(&s_set, 0, sizeof(s_set));
+    }
+    reset_state();
+    ESP_LOGI(TAG, "Loaded %u geofences, etag %ld", s_set.num_fences, s_set.etag);
+}
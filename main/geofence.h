@@ -0,0 +1,62 @@
+/* Geofence class: server-pushed polygon geofences, evaluated on-device against filtered fixes
+ *
+ * Fences arrive in the HTTP response as
+ *   "geofences": {"etag": 4, "fences": [{"id": 12, "points": [[51.5, -0.1], ...]}, ...]}
+ * and are kept in NVS. A coarse grid over the fences' combined bounding box lists which fences can
+ * contain a point in each cell, so a fix only runs point-in-polygon tests against nearby fences.
+*/
+#pragma once
+
+#include <stdint.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GEOFENCE_MAX_POINTS     24
+#define GEOFENCE_GRID_DIM       16      // grid cells per side
+#define GEOFENCE_CONFIRM_FIXES  2       // consecutive fixes on the other side before a transition counts
+
+typedef struct {
+    uint16_t id;
+    uint8_t num_points;
+    int32_t lat_e7[GEOFENCE_MAX_POINTS];
+    int32_t lon_e7[GEOFENCE_MAX_POINTS];
+} geofence_t;
+
+/**
+ * @brief Load fences from NVS and build the index. Call after flash_init().
+ */
+void geofence_init();
+
+/**
+ * @brief Replace the fence set from a server "geofences" object, if its etag differs from ours
+ */
+void geofence_update_from_json(cJSON *geofences);
+
+/**
+ * @brief Evaluate a filtered position; records enter/exit transitions in telemetry
+ * @param fix_time_ms UTC time of the fix; a transition needs GEOFENCE_CONFIRM_FIXES distinct fixes, so repeated
+ *        calls for the same fix don't count again
+ */
+void geofence_check(int32_t lat_e7, int32_t lon_e7, uint32_t fix_time_ms);
+
+/**
+ * @brief etag of the fence set in use, for the request headers
+ */
+int32_t geofence_etag();
+
+/**
+ * @brief Number of the newest enter/exit event in telemetry, taken before formatting an upload
+ */
+uint32_t geofence_event_seq();
+
+/**
+ * @brief Drop the events up to and including seq from telemetry once an upload holding them has been accepted
+ */
+void geofence_discard_events(uint32_t seq);
+
+#ifdef __cplusplus
+}
+#endif
@@ -24,10 +24,13 @@
 #include "vehicle.h"
 #include "flash.h"
 #include "state.h"
+#include "geofence.h"
+#include "command.h"
 
 static const char* TAG = "MaxBox-HTTP";
 
 char firmware_update_url[255];
+static bool s_trace_uploading;
 
 esp_err_t _http_event_handler(esp_http_client_event_t *evt)
 {
@@ -55,6 +58,10 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
         if (!esp_http_client_is_chunked_response(evt->client)) {
             // If user_data buffer is configured, copy the response into the buffer
             if (evt->user_data) {
+                if (output_len + evt->data_len > MAX_HTTP_OUTPUT_BUFFER) {
+                    ESP_LOGE(TAG, "Response larger than %d bytes, truncating", MAX_HTTP_OUTPUT_BUFFER);
+                    break;
+                }
                 memcpy(evt->user_data + output_len, evt->data, evt->data_len);
             } else {
                 if (output_buffer == NULL) {
@@ -108,7 +115,8 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
 static esp_err_t _http_set_headers(esp_http_client_handle_t http_client)
 {
     char mac_addr_string[13];
-    char rendered_etag[10];
+    char rendered_etag[12];
+    char rendered_geofence_etag[12];
 
     sprintf(mac_addr_string, "%02x%02x%02x%02x%02x%02x",    mb->base_mac[0],
             mb->base_mac[1],
@@ -117,12 +125,14 @@ static esp_err_t _http_set_headers(esp_http_client_handle_t http_client)
             mb->base_mac[4],
             mb->base_mac[5]);
     sprintf(rendered_etag, "%d", mb->etag);
+    sprintf(rendered_geofence_etag, "%ld", geofence_etag());
 
     esp_http_client_set_header(http_client, "Accept", "application/json");
     esp_http_client_set_header(http_client, "Content-Type", "application/json");
     esp_http_client_set_header(http_client, "X-Carshare-Box-ID", mac_addr_string);
     esp_http_client_set_header(http_client, "X-Carshare-Box-Secret", API_SECRET);
     esp_http_client_set_header(http_client, "X-Carshare-Operator-Card-List-ETag", rendered_etag);
+    esp_http_client_set_header(http_client, "X-Carshare-Geofence-ETag", rendered_geofence_etag);
     esp_http_client_set_header(http_client, "X-Carshare-Firmware-Version", FW_VERSION);
 
     return ESP_OK;
@@ -196,6 +206,51 @@ ota_end:
     vTaskDelete(NULL);
 }
 
+// Binary LMIC event trace, format documented at ttn_trace_export()
+static void lora_trace_upload(void* pxParameters)
+{
+    event_return_t status = BOX_ERROR;
+
+    mb_begin_event(EVT_LORA_TRACE);
+
+    size_t len = ttn_trace_size();
+    uint8_t *trace = len ? malloc(len) : NULL;
+
+    if (!trace) {
+        ESP_LOGW(TAG, "No LoRa trace to upload");
+        goto trace_end;
+    }
+    len = ttn_trace_export(trace, len);
+
+    esp_http_client_config_t config = {
+        .url = API_ENDPOINT_LORA_TRACE,
+        .user_agent = "Carshare Box v2",
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    esp_http_client_set_method(client, HTTP_METHOD_POST);
+    _http_set_headers(client);
+    esp_http_client_set_header(client, "Content-Type", "application/octet-stream");
+    esp_http_client_set_post_field(client, (const char *)trace, len);
+
+    esp_err_t err = esp_http_client_perform(client);
+    if (err == ESP_OK && esp_http_client_get_status_code(client) / 100 == 2) {
+        ESP_LOGI(TAG, "Uploaded %zu bytes of LoRa trace", len);
+        // Only what was sent: events recorded during the upload go with the next one
+        ttn_trace_discard(trace);
+        status = BOX_OK;
+    } else {
+        ESP_LOGE(TAG, "LoRa trace upload failed: %s", esp_err_to_name(err));
+    }
+
+    esp_http_client_cleanup(client);
+    free(trace);
+
+trace_end:
+    mb_complete_event(EVT_LORA_TRACE, status);
+    s_trace_uploading = false;
+    vTaskDelete(NULL);
+}
 
 event_return_t json_return_handler(char* result)
 {
@@ -233,18 +288,13 @@ event_return_t json_return_handler(char* result)
         }
     }
 
+    if (cJSON_GetObjectItem(result_json, "geofences")) {
+        geofence_update_from_json(cJSON_GetObjectItem(result_json, "geofences"));
+    }
+
     // Optionally, there may be an action to manually lock or unlock the car remotely
     if (cJSON_GetObjectItem(result_json, "action")) {
-        char *action = cJSON_GetObjectItem(result_json, "action")->valuestring;
-        if (strcmp(action, "lock") == 0) {
-            mb->lock_desired = 1;
-            status = vehicle_un_lock();
-        } else if (strcmp(action, "unlock") == 0) {
-            mb->lock_desired = 0;
-            status = vehicle_un_lock();
-        } else if (strcmp(action, "reject") == 0) {
-            status = BOX_DENY;
-        }
+        status = command_action(cJSON_GetObjectItem(result_json, "action")->valuestring);
     }
 
     if (cJSON_GetObjectItem(result_json, "firmware_update_url")) {
@@ -255,6 +305,11 @@ event_return_t json_return_handler(char* result)
         xTaskCreate(firmware_update, "firmware_update", 8192, NULL, 5, NULL);
     }
 
+    if (cJSON_IsTrue(cJSON_GetObjectItem(result_json, "upload_lora_trace")) && !s_trace_uploading) {
+        s_trace_uploading = true;
+        xTaskCreate(lora_trace_upload, "lora_trace", 4096, NULL, 4, NULL);
+    }
+
     cJSON_Delete(result_json);
 
     return status;
@@ -265,7 +320,15 @@ static void http_auth_rfid(void *rest_request)
     event_return_t status = BOX_ERROR;
 
     const rest_request_t request = rest_request;
-    char local_response_buffer[MAX_HTTP_OUTPUT_BUFFER + 1] = {0};
+    // Too big for this task's stack once a geofence set comes back
+    char *local_response_buffer = calloc(1, MAX_HTTP_OUTPUT_BUFFER + 1);
+    if (!local_response_buffer) {
+        ESP_LOGE(TAG, "No memory for the HTTP response");
+        mb_complete_event(request->box_event, BOX_ERROR);
+        free(request);
+        vTaskDelete(NULL);
+        return;
+    }
 
     esp_http_client_config_t config = {
         .user_agent = "Carshare Box v2",
@@ -298,6 +361,10 @@ static void http_auth_rfid(void *rest_request)
 
         ESP_LOGI(TAG, "Got data: %s", local_response_buffer);
 
+        if (esp_http_client_get_status_code(client) / 100 == 2) {
+            geofence_discard_events(request->geofence_event_seq);
+        }
+
         status = json_return_handler(local_response_buffer);
 
     } else {
@@ -306,6 +373,7 @@ static void http_auth_rfid(void *rest_request)
     }
 
     esp_http_client_cleanup(client);
+    free(local_response_buffer);
     mb_complete_event(request->box_event, status);
     free(request);
     vTaskDelete(NULL);
@@ -316,13 +384,19 @@ void http_send(char* card_id)
     rest_request_t req = NULL;
     req = calloc(1, sizeof(struct rest_request));
 
-    json_format_telemetry(req->data, card_id);
-
     if (card_id) {
         req->box_event = EVT_TOUCHED;
     } else {
         req->box_event = EVT_TELEMETRY;
     }
 
+    // Taken first: an event recorded while formatting is sent again rather than lost
+    req->geofence_event_seq = geofence_event_seq();
+    if (json_format_telemetry(req->data, sizeof(req->data), card_id) != ESP_OK) {
+        mb_complete_event(req->box_event, BOX_ERROR);
+        free(req);
+        return;
+    }
+
     xTaskCreate(&http_auth_rfid, "http_auth_rfid", 8192, req, 6, NULL);
 }
\ No newline at end of file
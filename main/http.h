@@ -11,10 +11,11 @@ extern "C" {
 typedef void(*rest_callback_t)(char*);
 
 struct rest_request {
-    char *url;                   /*<! URL to POST to */
-    char data[1023];             /*<! JSON data to send */
-    rest_callback_t callback;    /*<! callback function */
-    box_event_t box_event;       /*<! EVT_TOUCHED or EVT_TELEMETRY */
+    char *url;                          /*<! URL to POST to */
+    char data[MAX_HTTP_POST_BUFFER];    /*<! JSON data to send */
+    rest_callback_t callback;           /*<! callback function */
+    box_event_t box_event;              /*<! EVT_TOUCHED or EVT_TELEMETRY */
+    uint32_t geofence_event_seq;        /*<! newest geofence event in data */
 };
 
 typedef struct rest_request* rest_request_t;
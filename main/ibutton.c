@@ -0,0 +1,67 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "maxbox_defines.h"
+#include "ibutton.h"
+#include "onewire.h"
+#include "telemetry.h"
+
+static const char* TAG = "MaxBox-IBUTTON";
+
+static bool poll(const OneWireBus_ROMCode *attached, OneWireBus_ROMCode *rom_code)
+{
+    OneWireBus *bus = onewire_take();
+    if (!bus) {
+        return false;
+    }
+
+    // Cheapest first: the attached iButton is verified by its full ROM code, which the search sends in a few
+    // batches; otherwise the family check rules out a bus with only probes on it before searching for a new one
+    bool present = false;
+    bool found = false;
+    if (attached->fields.family[0] && owb_verify_rom(bus, *attached, &present) == OWB_STATUS_OK && present) {
+        *rom_code = *attached;
+        found = true;
+    } else if (owb_family_present(bus, ONEWIRE_FAMILY_DS1990A, &present) == OWB_STATUS_OK && present) {
+        found = onewire_find_family(bus, ONEWIRE_FAMILY_DS1990A, rom_code);
+    }
+
+    onewire_give();
+    return found;
+}
+
+static void ibutton_task(void *arg)
+{
+    OneWireBus_ROMCode attached = {0};
+    int misses = 0;
+
+    while (1) {
+        OneWireBus_ROMCode rom_code;
+
+        if (poll(&attached, &rom_code)) {
+            misses = 0;
+            if (memcmp(&rom_code, &attached, sizeof(attached))) {
+                attached = rom_code;
+                owb_string_from_rom_code(attached, mb->tel->ibutton_id, sizeof(mb->tel->ibutton_id));
+                ESP_LOGI(TAG, "iButton %s attached", mb->tel->ibutton_id);
+                telemetry_request_upload();
+            }
+        } else if (attached.fields.family[0] && ++misses >= IBUTTON_DETACH_POLLS) {
+            // Contact through a reader is intermittent; don't report every bounce
+            ESP_LOGI(TAG, "iButton %s removed", mb->tel->ibutton_id);
+            memset(&attached, 0, sizeof(attached));
+            mb->tel->ibutton_id[0] = '\0';
+            telemetry_request_upload();
+        }
+
+        vTaskDelay(IBUTTON_POLL_INTERVAL_MS / portTICK_PERIOD_MS);
+    }
+    vTaskDelete(NULL);
+}
+
+void ibutton_init()
+{
+    xTaskCreate(ibutton_task, "ibutton", 3072, NULL, 2, NULL);
+}
@@ -0,0 +1,21 @@
+/* iButton class: presence and ID of a DS1990A iButton on the 1-Wire bus
+ *
+ * The bus is polled every IBUTTON_POLL_INTERVAL_MS in a low priority task. An attach or detach updates
+ * telemetry ibutton_id and requests an upload straight away.
+*/
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IBUTTON_DETACH_POLLS    3       // consecutive polls without the iButton before it counts as removed
+
+/**
+ * @brief Start polling for iButtons. Call after onewire_init().
+ */
+void ibutton_init();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,239 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/twai.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "isotp.h"
+#include "can_metrics.h"
+
+static const char* TAG = "MaxBox-ISOTP";
+
+#define PCI_SINGLE_FRAME        0x00
+#define PCI_FIRST_FRAME         0x10
+#define PCI_CONSECUTIVE_FRAME   0x20
+#define PCI_FLOW_CONTROL        0x30
+
+#define FC_CONTINUE             0x00
+#define FC_WAIT                 0x01
+#define FC_OVERFLOW             0x02
+
+#define now_ms() (esp_timer_get_time() / 1000)
+
+static esp_err_t isotp_transmit(uint32_t id, const uint8_t *data, uint8_t len)
+{
+    twai_message_t frame = {0};
+    frame.identifier = id;
+    frame.data_length_code = 8;
+
+    memset(frame.data, ISOTP_PADDING_BYTE, 8);
+    memcpy(frame.data, data, len);
+
+    esp_err_t err = twai_transmit(&frame, pdMS_TO_TICKS(100));
+    can_metrics_record_tx(err);
+    return err;
+}
+
+static void send_flow_control(isotp_link_t *link, uint8_t flag)
+{
+    // Block size 0 (send everything) and STmin 0: our RX queue absorbs back-to-back frames
+    uint8_t fc[3] = {PCI_FLOW_CONTROL | flag, 0x00, 0x00};
+    isotp_transmit(link->tx_id, fc, sizeof(fc));
+}
+
+static esp_err_t send_consecutive_frame(isotp_link_t *link)
+{
+    uint8_t cf[8];
+    uint8_t chunk = link->tx_len - link->tx_pos;
+    if (chunk > 7) {
+        chunk = 7;
+    }
+
+    cf[0] = PCI_CONSECUTIVE_FRAME | link->tx_sn;
+    memcpy(cf + 1, link->tx_buf + link->tx_pos, chunk);
+
+    esp_err_t err = isotp_transmit(link->tx_id, cf, chunk + 1);
+    if (err == ESP_OK) {
+        link->tx_pos += chunk;
+        link->tx_sn = (link->tx_sn + 1) & 0x0f;
+    }
+    return err;
+}
+
+void isotp_link_init(isotp_link_t *link, uint32_t tx_id, uint32_t rx_id, uint8_t *rx_buf, uint16_t rx_buf_size)
+{
+    memset(link, 0, sizeof(isotp_link_t));
+    link->tx_id = tx_id;
+    link->rx_id = rx_id;
+    link->rx_buf = rx_buf;
+    link->rx_buf_size = rx_buf_size;
+    link->state = ISOTP_IDLE;
+}
+
+esp_err_t isotp_send(isotp_link_t *link, const uint8_t *payload, uint16_t len)
+{
+    if (len == 0 || len > ISOTP_MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    link->tx_buf = payload;
+    link->tx_len = len;
+
+    if (len <= 7) {
+        uint8_t sf[8];
+        sf[0] = PCI_SINGLE_FRAME | len;
+        memcpy(sf + 1, payload, len);
+
+        esp_err_t err = isotp_transmit(link->tx_id, sf, len + 1);
+        link->state = (err == ESP_OK) ? ISOTP_TX_DONE : ISOTP_ERROR;
+        return err;
+    }
+
+    uint8_t ff[8];
+    ff[0] = PCI_FIRST_FRAME | (len >> 8);
+    ff[1] = len & 0xff;
+    memcpy(ff + 2, payload, 6);
+
+    esp_err_t err = isotp_transmit(link->tx_id, ff, 8);
+    if (err != ESP_OK) {
+        link->state = ISOTP_ERROR;
+        return err;
+    }
+
+    link->tx_pos = 6;
+    link->tx_sn = 1;
+    link->state = ISOTP_TX_WAIT_FC;
+    link->deadline_ms = now_ms() + ISOTP_N_BS_TIMEOUT_MS;
+    return ESP_OK;
+}
+
+static void handle_flow_control(isotp_link_t *link, const uint8_t *data)
+{
+    if (link->state != ISOTP_TX_WAIT_FC) {
+        return;
+    }
+
+    switch (data[0] & 0x0f) {
+    case FC_CONTINUE:
+        link->tx_bs_remaining = data[1];
+        // STmin 0x00-0x7f is milliseconds; 0xf1-0xf9 (100-900us) rounds up to one millisecond
+        link->tx_stmin_ms = (data[2] <= 0x7f) ? data[2] : 1;
+        link->state = ISOTP_TX_CF;
+        link->deadline_ms = now_ms();
+        break;
+    case FC_WAIT:
+        link->deadline_ms = now_ms() + ISOTP_N_BS_TIMEOUT_MS;
+        break;
+    case FC_OVERFLOW:
+    default:
+        ESP_LOGW(TAG, "0x%03lx rejected %d byte request", link->rx_id, link->tx_len);
+        link->state = ISOTP_ERROR;
+        break;
+    }
+}
+
+void isotp_on_frame(isotp_link_t *link, const twai_message_t *msg)
+{
+    const uint8_t *data = msg->data;
+
+    if (msg->data_length_code < 1) {
+        return;
+    }
+
+    switch (data[0] & 0xf0) {
+    case PCI_SINGLE_FRAME: {
+        uint8_t len = data[0] & 0x0f;
+        if (len == 0 || len > 7 || len > msg->data_length_code - 1 || len > link->rx_buf_size) {
+            return;
+        }
+        memcpy(link->rx_buf, data + 1, len);
+        link->rx_len = len;
+        link->rx_pos = len;
+        link->state = ISOTP_RX_DONE;
+        break;
+    }
+    case PCI_FIRST_FRAME: {
+        uint16_t len = ((data[0] & 0x0f) << 8) | data[1];
+        if (len < 8 || msg->data_length_code < 8) {
+            return;
+        }
+        if (len > link->rx_buf_size) {
+            send_flow_control(link, FC_OVERFLOW);
+            link->state = ISOTP_ERROR;
+            return;
+        }
+        memcpy(link->rx_buf, data + 2, 6);
+        link->rx_len = len;
+        link->rx_pos = 6;
+        link->rx_sn = 1;
+        link->state = ISOTP_RX_CF;
+        link->deadline_ms = now_ms() + ISOTP_N_CR_TIMEOUT_MS;
+        send_flow_control(link, FC_CONTINUE);
+        break;
+    }
+    case PCI_CONSECUTIVE_FRAME: {
+        if (link->state != ISOTP_RX_CF) {
+            return;
+        }
+        if ((data[0] & 0x0f) != link->rx_sn) {
+            ESP_LOGW(TAG, "0x%03lx sequence error: expected %d, got %d", link->rx_id, link->rx_sn, data[0] & 0x0f);
+            link->state = ISOTP_ERROR;
+            return;
+        }
+        uint16_t chunk = link->rx_len - link->rx_pos;
+        if (chunk > 7) {
+            chunk = 7;
+        }
+        memcpy(link->rx_buf + link->rx_pos, data + 1, chunk);
+        link->rx_pos += chunk;
+        link->rx_sn = (link->rx_sn + 1) & 0x0f;
+        link->deadline_ms = now_ms() + ISOTP_N_CR_TIMEOUT_MS;
+
+        if (link->rx_pos >= link->rx_len) {
+            link->state = ISOTP_RX_DONE;
+        }
+        break;
+    }
+    case PCI_FLOW_CONTROL:
+        handle_flow_control(link, data);
+        break;
+    default:
+        break;
+    }
+}
+
+int32_t isotp_poll(isotp_link_t *link)
+{
+    int64_t now = now_ms();
+
+    switch (link->state) {
+    case ISOTP_TX_CF:
+        while (now >= link->deadline_ms) {
+            if (send_consecutive_frame(link) != ESP_OK) {
+                link->state = ISOTP_ERROR;
+                return -1;
+            }
+            if (link->tx_pos >= link->tx_len) {
+                link->state = ISOTP_TX_DONE;
+                return -1;
+            }
+            if (link->tx_bs_remaining && --link->tx_bs_remaining == 0) {
+                link->state = ISOTP_TX_WAIT_FC;
+                link->deadline_ms = now + ISOTP_N_BS_TIMEOUT_MS;
+                break;
+            }
+            link->deadline_ms = now + link->tx_stmin_ms;
+        }
+        return link->deadline_ms - now;
+    case ISOTP_TX_WAIT_FC:
+    case ISOTP_RX_CF:
+        if (now >= link->deadline_ms) {
+            ESP_LOGW(TAG, "0x%03lx timed out in state %d", link->rx_id, link->state);
+            link->state = ISOTP_ERROR;
+            return -1;
+        }
+        return link->deadline_ms - now;
+    default:
+        return -1;
+    }
+}
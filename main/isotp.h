@@ -0,0 +1,77 @@
+/* ISO-TP class: ISO 15765-2 transport (segmentation and flow control) over TWAI
+*/
+#pragma once
+
+#include <stdint.h>
+#include "driver/twai.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ISOTP_MAX_PAYLOAD       4095    // 12-bit first frame length
+#define ISOTP_PADDING_BYTE      0xff
+
+#define ISOTP_N_BS_TIMEOUT_MS   1000    // sender: max wait for flow control
+#define ISOTP_N_CR_TIMEOUT_MS   1000    // receiver: max wait for consecutive frame
+
+typedef enum {
+    ISOTP_IDLE,             /*<! no transfer in progress */
+    ISOTP_TX_WAIT_FC,       /*<! first frame sent, waiting for flow control */
+    ISOTP_TX_CF,            /*<! sending consecutive frames */
+    ISOTP_TX_DONE,          /*<! request fully sent */
+    ISOTP_RX_CF,            /*<! first frame received, collecting consecutive frames */
+    ISOTP_RX_DONE,          /*<! complete message in rx_buf */
+    ISOTP_ERROR,            /*<! timeout, overflow or sequence error */
+} isotp_state_t;
+
+typedef struct {
+    uint32_t tx_id;                 /*<! CAN ID we transmit on (tester -> ECU) */
+    uint32_t rx_id;                 /*<! CAN ID we receive on (ECU -> tester) */
+    isotp_state_t state;
+
+    const uint8_t *tx_buf;          /*<! payload being sent, owned by caller until TX_DONE */
+    uint16_t tx_len;
+    uint16_t tx_pos;
+    uint8_t tx_sn;                  /*<! next consecutive frame sequence number */
+    uint8_t tx_bs_remaining;        /*<! frames left in current block, 0 = unlimited */
+    uint8_t tx_stmin_ms;            /*<! separation time requested by receiver */
+
+    uint8_t *rx_buf;                /*<! reassembly buffer, owned by caller */
+    uint16_t rx_buf_size;
+    uint16_t rx_len;                /*<! total length announced by first/single frame */
+    uint16_t rx_pos;
+    uint8_t rx_sn;                  /*<! next expected sequence number */
+
+    int64_t deadline_ms;            /*<! timeout or next CF send time, box ms */
+} isotp_link_t;
+
+/**
+ * @brief Initialise a link between a tester/ECU CAN ID pair
+ * @param rx_buf Buffer that received messages are reassembled into
+ */
+void isotp_link_init(isotp_link_t *link, uint32_t tx_id, uint32_t rx_id, uint8_t *rx_buf, uint16_t rx_buf_size);
+
+/**
+ * @brief Start sending a payload. Single frames go out immediately; longer payloads send a first frame
+ *        and continue from isotp_poll() once flow control arrives. The payload must stay valid until the
+ *        link leaves the TX states.
+ * @return ESP_OK if the first frame was transmitted
+ */
+esp_err_t isotp_send(isotp_link_t *link, const uint8_t *payload, uint16_t len);
+
+/**
+ * @brief Feed a received frame addressed to link->rx_id into the link state machine
+ */
+void isotp_on_frame(isotp_link_t *link, const twai_message_t *msg);
+
+/**
+ * @brief Advance timers: sends paced consecutive frames and expires stalled transfers
+ * @return milliseconds until the link next needs polling, or -1 if it is not waiting on a timer
+ */
+int32_t isotp_poll(isotp_link_t *link);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,7 @@
+#include <string.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_event.h"
 #include "driver/gpio.h"
 #include "nvs_flash.h"
@@ -9,14 +12,137 @@
 #include "maxbox_defines.h"
 #include "telemetry.h"
 #include "lorawan.h"
+#include "lorawan_adr.h"
+#include "command.h"
+#include "state.h"
+#include "flash.h"
+#include "temperature.h"
 
 #include "esp_intr_types.h"
 
 static const char* TAG = "MaxBox-LoRaWAN";
 
-void lorawan_rx_callback(const uint8_t* message, size_t length, ttn_port_t port)
+// Session task notification bits
+#define SESSION_REJOIN_BIT  BIT0
+#define SESSION_SAVE_BIT    BIT1
+
+static QueueHandle_t s_command_queue;       // retained ttn_downlink_t buffers, released once executed
+static TaskHandle_t s_session_task;         // joins, rejoins and saves the session; owns NVS writes for it
+static int64_t s_last_command_fcnt = -1;    // FCntDown of the last accepted command this session, -1 if none
+
+static uint32_t be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void reset_command_fcnt(void)
+{
+    // A new session starts its downlink counter from zero again
+    s_last_command_fcnt = -1;
+    flash_write_blob("lora_cmd_fcnt", &s_last_command_fcnt, sizeof(s_last_command_fcnt));
+}
+
+static void save_session(void)
+{
+    // The next queued uplink may already be on air; the session is saved once it's done
+    while (!ttn_save_session() && ttn_busy_duration()) {
+        ttn_wait_for_idle();
+    }
+
+    ttn_session_stats_t session = ttn_session_stats();
+    mb->tel->lora.session_saves = session.rtc_saves;
+    mb->tel->lora.session_nvs_writes = session.nvs_writes;
+    mb->tel->lora.session_nvs_max_us = session.max_nvs_save_us;
+}
+
+static void execute_command(const ttn_downlink_t *cmd)
 {
-    ESP_LOGI(TAG, "Message of %d bytes received", length, port);
+    static const char *actions[] = {NULL, "lock", "unlock", "reject"};
+    char card_id[9];
+
+    switch (cmd->port) {
+    case LORA_PORT_ACTION:
+        if (cmd->length != 1 || cmd->payload[0] == 0 || cmd->payload[0] >= sizeof(actions) / sizeof(actions[0])) {
+            break;
+        }
+        ESP_LOGI(TAG, "Remote action: %s", actions[cmd->payload[0]]);
+        mb_begin_event(EVT_REMOTE);
+        event_return_t status = command_action(actions[cmd->payload[0]]);
+        mb_complete_event(EVT_REMOTE, status);
+        telemetry_request_upload();
+        return;
+
+    case LORA_PORT_CARDS:
+        if (cmd->length != 9) {
+            break;
+        }
+        sprintf(card_id, "%02x%02x%02x%02x", cmd->payload[5], cmd->payload[6], cmd->payload[7], cmd->payload[8]);
+        if (cmd->payload[0] == LORA_CARD_ADD) {
+            command_card_add(card_id, be32(cmd->payload + 1));
+            return;
+        } else if (cmd->payload[0] == LORA_CARD_REMOVE) {
+            command_card_remove(card_id, be32(cmd->payload + 1));
+            return;
+        }
+        break;
+
+    case LORA_PORT_TELEMETRY_RATE:
+        if (cmd->length != 4 && cmd->length != 6) {
+            break;
+        }
+        telemetry_set_intervals(((cmd->payload[0] << 8) | cmd->payload[1]) * 1000, ((cmd->payload[2] << 8) | cmd->payload[3]) * 1000);
+        if (cmd->length == 6) {
+            temperature_set_interval(((cmd->payload[4] << 8) | cmd->payload[5]) * 1000);
+        }
+        return;
+
+    default:
+        break;
+    }
+    ESP_LOGW(TAG, "Malformed command of %d bytes on port %d", cmd->length, cmd->port);
+}
+
+static void lorawan_command_task(void* arg)
+{
+    ttn_downlink_t *cmd;
+
+    while (1) {
+        xQueueReceive(s_command_queue, &cmd, portMAX_DELAY);
+
+        // Persist before acting, so a command is never run twice even if it reboots the box
+        int64_t fcnt = cmd->frame_counter;
+        flash_write_blob("lora_cmd_fcnt", &fcnt, sizeof(fcnt));
+        execute_command(cmd);
+        ttn_downlink_release(cmd);
+    }
+    vTaskDelete(NULL);
+}
+
+void lorawan_rx_callback(ttn_downlink_t *downlink)
+{
+    ESP_LOGI(TAG, "Message of %d bytes received on port %d", downlink->length, downlink->port);
+
+    if (downlink->port < LORA_PORT_ACTION || downlink->port > LORA_PORT_TELEMETRY_RATE) {
+        return;
+    }
+
+    // LMIC rejects replays within a session, but a session restored from flash
+    // can be older than the commands already executed
+    uint32_t fcnt = downlink->frame_counter;
+    if ((int64_t)fcnt <= s_last_command_fcnt) {
+        ESP_LOGW(TAG, "Dropping replayed command, FCntDown %lu <= %lld", fcnt, s_last_command_fcnt);
+        return;
+    }
+
+    // Called from the TTN receive task; the command runs (and may block on CAN) in our own,
+    // straight from the TTN buffer. Only a queued command advances the counter
+    ttn_downlink_retain(downlink);
+    if (xQueueSend(s_command_queue, &downlink, 0) != pdTRUE) {
+        ESP_LOGE(TAG, "Command queue full");
+        ttn_downlink_release(downlink);
+        return;
+    }
+    s_last_command_fcnt = fcnt;
 }
 
 void lorawan_init_task(void* arg)
@@ -29,6 +155,8 @@ void lorawan_init_task(void* arg)
 
     ESP_LOGI(TAG, "DevEUI (generated): %s", deveui_string);
 
+    s_session_task = xTaskGetCurrentTaskHandle();
+
     // Initialize the GPIO ISR handler service
     gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
 
@@ -50,25 +178,70 @@ void lorawan_init_task(void* arg)
     ttn_configure_pins(LORA_SPI_HOST_ID, LORA_NSS_PIN, LORA_RXTX_PIN, LORA_RST_PIN, LORA_DIO0_PIN, LORA_DIO1_PIN);
 
     // Register callback for received messages
-    ttn_on_message(lorawan_rx_callback);
-
-    ttn_set_adr_enabled(false);
-    ttn_set_data_rate(CONFIG_LORAWAN_DATARATE);
-    ttn_set_max_tx_pow(14);
-
-    ESP_LOGI(TAG, "Joining");
-    while (!mb->lorawan_joined) {
-        if (ttn_join_with_keys(deveui_string, "0000000000000000", CONFIG_LORAWAN_APPKEY)) {
-            ESP_LOGI(TAG, "Joined");
-
-            ttn_set_adr_enabled(false);
-            ttn_set_data_rate(CONFIG_LORAWAN_DATARATE);
-            ttn_set_max_tx_pow(14);
-            mb->lorawan_joined = true;
-        } else {
-            ESP_LOGE(TAG, "Join failed. Waiting to retry");
+    s_command_queue = xQueueCreate(LORA_COMMAND_QUEUE_LEN, sizeof(ttn_downlink_t *));
+    xTaskCreate(lorawan_command_task, "lorawan_cmd", 4096, NULL, 5, NULL);
+    ttn_on_downlink(lorawan_rx_callback);
+
+    lorawan_adr_init();
+
+    // Resume the session from the last uplink if there is one; a join costs airtime and
+    // leaves the box without LoRa until it succeeds
+    if (ttn_provision_transiently(deveui_string, "0000000000000000", CONFIG_LORAWAN_APPKEY) &&
+        ttn_resume_after_power_off(LORA_RESUME_OFF_DURATION_MIN)) {
+        ESP_LOGI(TAG, "Resumed session from flash");
+        size_t len = sizeof(s_last_command_fcnt);
+        if (flash_read_blob("lora_cmd_fcnt", &s_last_command_fcnt, &len) != ESP_OK || len != sizeof(s_last_command_fcnt)) {
+            s_last_command_fcnt = -1;
+        }
+        mb->tel->lora.resumed = true;
+        lorawan_adr_init();
+        mb->lorawan_joined = true;
+    }
+
+    // Once LMIC holds a session, or has tried to join, only ttn_rejoin() starts a new one
+    bool started = mb->lorawan_joined;
+    if (!mb->lorawan_joined) {
+        ESP_LOGI(TAG, "No stored session, joining");
+    }
+    while (1) {
+        while (!mb->lorawan_joined) {
+            mb->tel->lora.join_attempts++;
+            bool joined = started ? ttn_rejoin() : ttn_join_with_keys(deveui_string, "0000000000000000", CONFIG_LORAWAN_APPKEY);
+            started = true;
+            if (joined) {
+                ESP_LOGI(TAG, "Joined");
+                reset_command_fcnt();
+
+                lorawan_adr_init();
+                mb->lorawan_joined = true;
+                ttn_save_session();
+            } else {
+                ESP_LOGE(TAG, "Join failed. Waiting to retry");
+                vTaskDelay(LORA_JOIN_RETRY_INTERVAL_MS / portTICK_PERIOD_MS);
+            }
+        }
+
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, SESSION_REJOIN_BIT | SESSION_SAVE_BIT, &bits, portMAX_DELAY);
+        if ((bits & SESSION_SAVE_BIT) && mb->lorawan_joined) {
+            save_session();
         }
-        vTaskDelay(LORA_JOIN_RETRY_INTERVAL_MS / portTICK_PERIOD_MS);
     }
     vTaskDelete(NULL);
 }
+
+void lorawan_rejoin()
+{
+    if (!mb->lorawan_joined) {
+        return;
+    }
+    ESP_LOGW(TAG, "Session has gone silent, rejoining");
+    mb->tel->lora.rejoins++;
+    mb->lorawan_joined = false;
+    xTaskNotify(s_session_task, SESSION_REJOIN_BIT, eSetBits);
+}
+
+void lorawan_save_session()
+{
+    xTaskNotify(s_session_task, SESSION_SAVE_BIT, eSetBits);
+}
\ No newline at end of file
@@ -1,4 +1,8 @@
 /* LoRaWAN telemetry class
+ *
+ * Downlink commands arrive on their own FPorts (LORA_PORT_ACTION, LORA_PORT_CARDS, LORA_PORT_TELEMETRY_RATE,
+ * formats in maxbox_defines.h) and run through the same handlers as the HTTP response. A command is only
+ * executed if its FCntDown is above the last one executed in this session, persisted across reboots.
 */
 #pragma once
 
@@ -7,10 +11,21 @@ extern "C" {
 #endif
 
 /**
- * @brief Initialize LoRaWAN
+ * @brief Initialize LoRaWAN, resume or join, then stay to rejoin on lorawan_rejoin()
  */
 void lorawan_init_task(void* arg);
 
+/**
+ * @brief Drop the session and join again, e.g. once the network has stopped answering. Doesn't block.
+ */
+void lorawan_rejoin();
+
+/**
+ * @brief Save the session (frame counters to RTC memory, every few frames to NVS) from the LoRaWAN task.
+ *        Doesn't block, so it can be called from TTN callbacks.
+ */
+void lorawan_save_session();
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
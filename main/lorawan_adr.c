@@ -0,0 +1,168 @@
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "ttn.h"
+
+#include "maxbox_defines.h"
+#include "lorawan_adr.h"
+#include "lorawan.h"
+
+static const char* TAG = "MaxBox-ADR";
+
+static int s_data_rate;
+static int s_tx_power;
+static uint8_t s_good_measurements;
+static uint8_t s_missed_checks;
+static uint8_t s_silent_uplinks;            // since the last downlink or link check answer
+static bool s_link_check_pending;
+static int64_t s_margin_ts = -1;            // box timestamp of the last margin measurement, -1 = none for these settings
+
+static int required_snr_x10(int data_rate)
+{
+    // EU868 DR0-5 = SF12-SF7; demodulation floor is -7.5dB at SF7, 2.5dB lower per SF step
+    int sf = 12 - data_rate;
+    return -75 - 25 * (sf - 7);
+}
+
+static void apply(void)
+{
+    ttn_set_data_rate(s_data_rate);
+    ttn_set_max_tx_pow(s_tx_power);
+    mb->tel->lora.data_rate = s_data_rate;
+    mb->tel->lora.tx_power = s_tx_power;
+    s_margin_ts = -1; // measured with the old settings; confirm the new ones on the next uplink
+    ESP_LOGI(TAG, "Data rate %d, TX power %ddBm", s_data_rate, s_tx_power);
+}
+
+static void step_down(void)
+{
+    // Power first: it costs energy, a slower data rate costs airtime and duty cycle
+    if (s_tx_power < LORA_ADR_MAX_TX_POW_DBM) {
+        s_tx_power = LORA_ADR_MAX_TX_POW_DBM;
+    } else if (s_data_rate > LORA_ADR_MIN_DR) {
+        s_data_rate--;
+    } else {
+        return;
+    }
+    apply();
+}
+
+static void step_up(void)
+{
+    if (s_data_rate < LORA_ADR_MAX_DR) {
+        s_data_rate++;
+    } else if (s_tx_power - LORA_ADR_TX_POW_STEP_DB >= LORA_ADR_MIN_TX_POW_DBM) {
+        s_tx_power -= LORA_ADR_TX_POW_STEP_DB;
+    } else {
+        return;
+    }
+    apply();
+}
+
+static void control(int margin_db)
+{
+    if (margin_db < LORA_ADR_TARGET_MARGIN_DB - LORA_ADR_HYSTERESIS_DB) {
+        s_good_measurements = 0;
+        step_down();
+    } else if (margin_db >= LORA_ADR_TARGET_MARGIN_DB + LORA_ADR_HYSTERESIS_DB) {
+        if (++s_good_measurements >= LORA_ADR_STABLE_MEASUREMENTS) {
+            s_good_measurements = 0;
+            step_up();
+        }
+    } else {
+        s_good_measurements = 0;
+    }
+}
+
+void lorawan_adr_before_uplink()
+{
+    if (s_link_check_pending) {
+        return; // still riding on the next uplink
+    }
+    // A session resumed from flash may no longer exist on the network; ask before giving up on it
+    bool rejoin_near = s_silent_uplinks + LORA_ADR_MAX_MISSED_CHECKS >= LORA_REJOIN_SILENT_UPLINKS;
+    // Until an answer comes back every uplink asks again; the request is one byte, only answers cost a downlink
+    if (rejoin_near || s_margin_ts < 0 || box_timestamp() - s_margin_ts >= LORA_MARGIN_STALE_MS / 1000) {
+        ttn_request_link_check();
+        s_link_check_pending = true;
+    }
+}
+
+void lorawan_adr_uplink_done(bool sent)
+{
+    if (!sent) {
+        return;
+    }
+
+    ttn_uplink_stats_t stats = ttn_last_uplink_stats();
+    lorawan_status_t *lora = &mb->tel->lora;
+    lora->uplinks++;
+    lora->last_airtime_ms = stats.airtime_ms;
+    lora->airtime_total_ms += stats.airtime_ms;
+
+    bool have_margin = false;
+    int margin_db = 0;
+
+    if (s_link_check_pending) {
+        s_link_check_pending = false;
+        lora->link_checks++;
+        if (stats.link_check_gateways > 0) {
+            lora->link_check_answers++;
+            s_missed_checks = 0;
+            margin_db = stats.link_check_margin;
+            have_margin = true;
+            ESP_LOGI(TAG, "Link check: %d gateways, margin %ddB", stats.link_check_gateways, margin_db);
+        } else {
+            s_missed_checks++;
+            ESP_LOGW(TAG, "Link check unanswered (%u in a row)", s_missed_checks);
+        }
+    }
+    if (!have_margin && stats.downlink) {
+        // Downlink SNR stands in for the uplink's; the path is close enough to symmetric
+        margin_db = (stats.snr * 10 - required_snr_x10(stats.data_rate)) / 10;
+        have_margin = true;
+    }
+    if (have_margin) {
+        lora->margin_db = margin_db;
+        s_margin_ts = box_timestamp();
+    }
+
+    if (stats.downlink || stats.link_check_gateways > 0) {
+        s_silent_uplinks = 0;
+    } else if (++s_silent_uplinks >= LORA_REJOIN_SILENT_UPLINKS) {
+        s_silent_uplinks = 0;
+        lorawan_rejoin();
+        return;
+    }
+
+#ifdef CONFIG_MAXBOX_LORAWAN_NETWORK_ADR
+    lora->data_rate = stats.data_rate;
+    lora->tx_power = stats.tx_power;
+#else
+    if (s_missed_checks >= LORA_ADR_MAX_MISSED_CHECKS) {
+        s_missed_checks = 0;
+        s_good_measurements = 0;
+        step_down();
+    } else if (have_margin) {
+        control(margin_db);
+    }
+#endif
+}
+
+void lorawan_adr_init()
+{
+    s_data_rate = CONFIG_LORAWAN_DATARATE;
+    s_tx_power = LORA_ADR_MAX_TX_POW_DBM;
+    s_good_measurements = 0;
+    s_missed_checks = 0;
+    s_silent_uplinks = 0;
+    s_link_check_pending = false;
+
+    // With network ADR this is only the starting point; the network's LinkADRReq takes over
+#ifdef CONFIG_MAXBOX_LORAWAN_NETWORK_ADR
+    ttn_set_adr_enabled(true);
+#else
+    ttn_set_adr_enabled(false);
+#endif
+    apply();
+}
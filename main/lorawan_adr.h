@@ -0,0 +1,44 @@
+/* LoRaWAN ADR class: device-side data rate and transmit power control from measured link margin
+ *
+ * The margin comes from LinkCheckAns (the gateway's demodulation margin for our uplink) or, failing that,
+ * from the SNR of any downlink. The controller picks the fastest data rate, then the lowest power, that
+ * keeps LORA_ADR_TARGET_MARGIN_DB in hand. With CONFIG_MAXBOX_LORAWAN_NETWORK_ADR the network's ADR is
+ * used instead and this only reports.
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LORA_ADR_TARGET_MARGIN_DB   10
+#define LORA_ADR_HYSTERESIS_DB      3       // margin must exceed target + this to speed up, fall below target - this to slow down
+#define LORA_ADR_STABLE_MEASUREMENTS 2      // consecutive good measurements before stepping up
+#define LORA_ADR_MAX_MISSED_CHECKS  2       // unanswered link checks in a row before stepping down
+#define LORA_ADR_TX_POW_STEP_DB     2
+#define LORA_ADR_MIN_TX_POW_DBM     2
+#define LORA_ADR_MAX_TX_POW_DBM     14
+#define LORA_REJOIN_SILENT_UPLINKS  24      // uplinks in a row with no downlink or link check answer before rejoining;
+                                            // the last LORA_ADR_MAX_MISSED_CHECKS of them carry link checks
+
+/**
+ * @brief Apply the starting data rate and power (or enable network ADR). Call once joined or resumed.
+ */
+void lorawan_adr_init();
+
+/**
+ * @brief Call before queueing an uplink; adds a link check when one is due
+ */
+void lorawan_adr_before_uplink();
+
+/**
+ * @brief Call when an uplink has completed. Updates airtime/delivery telemetry and adjusts the link;
+ *        rejoins once the network has been silent for LORA_REJOIN_SILENT_UPLINKS uplinks.
+ */
+void lorawan_adr_uplink_done(bool sent);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "ttn.h"
+
+#include "maxbox_defines.h"
+#include "lorawan_planner.h"
+
+static const char* TAG = "MaxBox-PLANNER";
+
+#define DAY_US  (86400LL * 1000000)
+
+static SemaphoreHandle_t s_lock;
+static int32_t s_budget_ms;
+static int64_t s_refilled_us;     // time up to which refill has been credited
+
+static void refill(void)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t gained = (now - s_refilled_us) * LORA_AIRTIME_BUDGET_MS_PER_DAY / DAY_US;
+
+    // Only advance by what was credited, so slow polling doesn't lose fractions of a millisecond
+    s_refilled_us += gained * DAY_US / LORA_AIRTIME_BUDGET_MS_PER_DAY;
+    if (s_budget_ms + gained >= LORA_AIRTIME_BURST_MS) {
+        s_budget_ms = LORA_AIRTIME_BURST_MS;
+        s_refilled_us = now;
+    } else {
+        s_budget_ms += gained;
+    }
+    mb->tel->lora.airtime_budget_ms = s_budget_ms;
+}
+
+uint32_t lorawan_planner_tx_delay_ms()
+{
+    return ttn_next_tx_delay_ms();
+}
+
+int32_t lorawan_airtime_available_ms()
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    refill();
+    int32_t budget = s_budget_ms;
+    xSemaphoreGive(s_lock);
+    return budget;
+}
+
+int lorawan_plan_uplink(const size_t *lengths, int num_lengths)
+{
+    int32_t budget = lorawan_airtime_available_ms();
+
+    // Overdrawn is normal: the actual airtime is charged after the uplink. Compare signed, or it fits anything
+    for (int i = 0; i < num_lengths && budget > 0; i++) {
+        uint32_t airtime = ttn_uplink_airtime_ms(lengths[i]);
+        if ((int32_t)airtime <= budget) {
+            ESP_LOGD(TAG, "%u bytes: %lums airtime, %ldms budget", lengths[i], airtime, budget);
+            return i;
+        }
+    }
+    ESP_LOGW(TAG, "Airtime budget exhausted (%ldms left)", budget);
+    return -1;
+}
+
+void lorawan_airtime_used(uint32_t airtime_ms)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    refill();
+    s_budget_ms -= airtime_ms;
+    mb->tel->lora.airtime_budget_ms = s_budget_ms;
+    xSemaphoreGive(s_lock);
+}
+
+void lorawan_planner_init()
+{
+    s_lock = xSemaphoreCreateMutex();
+    s_budget_ms = LORA_AIRTIME_BURST_MS;
+    s_refilled_us = esp_timer_get_time();
+}
@@ -0,0 +1,47 @@
+/* LoRaWAN planner class: duty cycle and airtime budget for uplinks
+ *
+ * The regional duty cycle limits when the radio may transmit next; TTN's fair use policy limits how much
+ * airtime we use per day. The budget is a token bucket that refills at LORA_AIRTIME_BUDGET_MS_PER_DAY and
+ * holds at most LORA_AIRTIME_BURST_MS, so a burst of event uplinks is allowed but the daily average holds.
+ * Senders ask the planner which of their payload variants fits before building one, and report the airtime
+ * actually used once the uplink completes.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the airtime budget. Call before any uplink is planned.
+ */
+void lorawan_planner_init();
+
+/**
+ * @brief Time until the duty cycle allows the next uplink, in ms (0 = now)
+ */
+uint32_t lorawan_planner_tx_delay_ms();
+
+/**
+ * @brief Airtime currently left in the budget, in ms (negative if overdrawn)
+ */
+int32_t lorawan_airtime_available_ms();
+
+/**
+ * @brief Pick the first payload length, in order of preference, whose airtime fits the budget
+ *
+ * @return index into lengths, or -1 if none fits
+ */
+int lorawan_plan_uplink(const size_t *lengths, int num_lengths);
+
+/**
+ * @brief Charge a completed uplink's airtime to the budget
+ */
+void lorawan_airtime_used(uint32_t airtime_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -20,8 +20,14 @@
 #include "lorawan.h"
 #include "telemetry.h"
 #include "wifi.h"
+#include "netlink.h"
 #include "flash.h"
 #include "state.h"
+#include "geofence.h"
+#include "onewire.h"
+#include "ibutton.h"
+#include "temperature.h"
+#include "boot.h"
 
 #include <time.h>
 #include <sys/time.h>
@@ -40,21 +46,40 @@ static const char* TAG = "MaxBox";
 
 maxbox_t mb = NULL;
 
-static void core1init(void* pvParameter)
+static void telemetry_stage(void)
 {
-    // HACK: we have to initialise some tasks pinned to the second core. Interrupts are generally assigned to
-    // the core on which the task runs and we run out of them on core 0, hence manually initialising application task
-    // interrupts on core 1. We choose the routines that are fast to initialise so the LED feedback is still vaguely
-    // correct
-
-    vehicle_init();
     telemetry_init();
-    touch_init();
+}
 
+enum {
+    STAGE_FLASH, STAGE_GEOFENCE, STAGE_SIM7600, STAGE_WIFI, STAGE_NETLINK,
+    STAGE_VEHICLE, STAGE_TOUCH, STAGE_TELEMETRY, STAGE_ONEWIRE, STAGE_IBUTTON, STAGE_TEMPERATURE,
+};
+
+// Interrupts are allocated on the core the allocating task runs on, and core 0 runs out of them, so the
+// peripherals with application-level interrupts (CAN, RFID SPI, LoRa, RMT) initialise on core 1
+static const boot_stage_t s_boot_stages[] = {
+    [STAGE_FLASH]       = {"flash",       flash_init,       0, 0},
+    [STAGE_GEOFENCE]    = {"geofence",    geofence_init,    0, BIT(STAGE_FLASH)},
+    [STAGE_SIM7600]     = {"sim7600",     sim7600_init,     0, BIT(STAGE_GEOFENCE)},   // fixes feed the geofences
+    [STAGE_WIFI]        = {"wifi",        wifi_init,        0, BIT(STAGE_FLASH)},      // esp_wifi_init needs NVS
+    [STAGE_NETLINK]     = {"netlink",     netlink_init,     0, BIT(STAGE_WIFI) | BIT(STAGE_SIM7600)},
+    [STAGE_VEHICLE]     = {"vehicle",     vehicle_init,     1, 0},
+    [STAGE_TOUCH]       = {"touch",       touch_init,       1, 0},  // taps wait for the boot event to complete
+    [STAGE_TELEMETRY]   = {"telemetry",   telemetry_stage,  1, BIT(STAGE_FLASH) | BIT(STAGE_NETLINK)},
+    [STAGE_ONEWIRE]     = {"onewire",     onewire_init,     1, 0},
+    [STAGE_IBUTTON]     = {"ibutton",     ibutton_init,     1, BIT(STAGE_ONEWIRE) | BIT(STAGE_TELEMETRY)},
+    [STAGE_TEMPERATURE] = {"temperature", temperature_init, 1, BIT(STAGE_ONEWIRE)},
+};
+
+// A tap reads the card list, may unlock over CAN and otherwise asks the server over either link
+#define BOOT_READY_STAGES   (BIT(STAGE_FLASH) | BIT(STAGE_GEOFENCE) | BIT(STAGE_SIM7600) | BIT(STAGE_WIFI) | \
+                             BIT(STAGE_NETLINK) | BIT(STAGE_VEHICLE) | BIT(STAGE_TOUCH))
+
+static void boot_ready(void)
+{
     mb_complete_event(EVT_BOOT, BOX_OK); // boot complete
     ESP_LOGI(TAG, "Boot complete");
-
-    vTaskDelete(NULL);
 }
 
 void app_main(void)
@@ -69,8 +94,5 @@ void app_main(void)
     led_init();
     mb_begin_event(EVT_BOOT); // boot begin
 
-    flash_init();
-    sim7600_init();
-    wifi_init();
-    xTaskCreatePinnedToCore(core1init, "core1init", 1024 * 4, (void*)0, 3, NULL, 1);
+    boot_run(s_boot_stages, sizeof(s_boot_stages) / sizeof(s_boot_stages[0]), BOOT_READY_STAGES, boot_ready);
 }
@@ -6,6 +6,7 @@ extern "C" {
 
 #include "driver/spi_master.h"
 #include "esp_timer.h"
+#include "ttn.h"
 
 // User config
 
@@ -13,13 +14,34 @@ extern "C" {
 #define LORA_TELEMETRY_INTERVAL_MS          48000
 #define WIFI_TELEMETRY_INTERVAL_MS          100000
 #define GNSS_POWERSAVE_INTERVAL_MS          120000
+#define GNSS_MOVING_INTERVAL_MS             30000
+#define GNSS_PARKED_INTERVAL_MS             900000
+#define VEHICLE_DIAG_INTERVAL_MS            300000
+#define CAN_METRICS_INTERVAL_MS             10000
+#define IBUTTON_POLL_INTERVAL_MS            250
+#define TEMPERATURE_INTERVAL_MS             60000
+#define TEMPERATURE_MIN_INTERVAL_MS         5000 // floor for the remotely set temperature interval
+#define TELEMETRY_MIN_INTERVAL_MS           30000 // floor for remotely set telemetry intervals
+#define TELEMETRY_PARKED_HEARTBEAT_MS       900000 // parked with an unchanged position, LoRaWAN telemetry goes out this often
 
 #define CONFIG_LORAWAN_DATARATE             TTN_DR_EU868_SF8
+#define LORA_ADR_MIN_DR                     TTN_DR_EU868_SF12
+#define LORA_ADR_MAX_DR                     TTN_DR_EU868_SF7_BW125
+#define LORA_MARGIN_STALE_MS                3600000 // uplinks carry link checks once the margin is this old; any downlink refreshes it
+#define LORA_AIRTIME_BUDGET_MS_PER_DAY      30000 // TTN fair use policy: 30s of uplink airtime per device per day
+#define LORA_AIRTIME_BURST_MS               6000 // most of the daily budget that can be spent at once
 
 #define CONFIG_NIGHT_MODE_THRESHOLD_LUX     1000
 #define CONFIG_BATTERY_VOLTAGE_THRESHOLD    12.4 // voltage threshold to turn on power saving features (not on charger)
+#define GNSS_GOOD_HDOP_X100                 150 // end a fix session once HDOP is at or below this
+#define GNSS_MIN_SATS                       5
 
 #define MAX_OPERATOR_CARDS                  32
+#define GEOFENCE_MAX_FENCES                 8
+#define GEOFENCE_MAX_EVENTS                 8
+#define TEMPERATURE_MAX_SENSORS             4
+#define BOOT_MAX_STAGES                     16
+#define CAN_METRICS_TOP_IDS                 5 // busiest CAN IDs reported in telemetry
 
 // GPIO
 
@@ -56,6 +78,8 @@ extern "C" {
 #define SCL_PIN         12
 
 #define ONEWIRE_PIN     9
+#define ONEWIRE_RMT_TX_CHANNEL  RMT_CHANNEL_0
+#define ONEWIRE_RMT_RX_CHANNEL  RMT_CHANNEL_4   // ESP32-S3: channels 4-7 receive only
 
 #define LED_STATUS_PIN  46
 
@@ -70,30 +94,146 @@ extern "C" {
 #define ESP_WIFI_SSID      CONFIG_ESP_WIFI_SSID
 #define ESP_WIFI_PASS      CONFIG_ESP_WIFI_PASSWORD
 #define API_SECRET         CONFIG_MAXBOX_API_SECRET
+#define SIM_APN            CONFIG_MAXBOX_CELLULAR_APN
 #define FW_VERSION         CONFIG_MAXBOX_FW_VERSION
 
 #define API_ENDPOINT_TOUCH          CONFIG_MAXBOX_API_ROOT "touch"
 #define API_ENDPOINT_TELEMETRY      CONFIG_MAXBOX_API_ROOT "telemetry"
+#define API_ENDPOINT_LORA_TRACE     CONFIG_MAXBOX_API_ROOT "lora_trace"
 
 #define MAX_WIFI_RETRY              4
 #define MAX_HTTP_RECV_BUFFER        512
-#define MAX_HTTP_OUTPUT_BUFFER      2048
+#define MAX_HTTP_OUTPUT_BUFFER      8192 // a full geofence set (8 fences x 24 points, ~5 KB) plus the card list
+#define MAX_HTTP_POST_BUFFER        3072
 
 // Timeouts
 #define MAX_WIFI_WAIT_MS            6000 // maximum time to wait for wifi connection
+#define MAX_PPP_WAIT_MS             20000 // maximum time to dial and negotiate a cellular PPP session
+#define NETLINK_WIFI_RETRY_MS       600000 // after a WiFi failure, touches go straight to cellular for this long
 #define MAX_EVENT_TIMEOUT_MS        180000 // emergency timeout for concurrent events
+#define CAN_BUS_IDLE_TIMEOUT_MS     2000 // no frames for this long means the car is asleep
+#define GNSS_FIX_TIMEOUT_MS         90000 // give up on a fix session after this long
 
 // Misc/enums
 #define POWER_WATCHDOG_INTERVAL_MS      30000
 #define LORA_JOIN_RETRY_INTERVAL_MS     60000
+#define LORA_RESUME_OFF_DURATION_MIN    1 // shortest plausible reboot, advances LMIC's duty cycle clock on resume
+#define LORA_PORT_TELEMETRY             1
+#define LORA_PORT_TELEMETRY_COMPACT     2 // first LORA_TELEMETRY_COMPACT_LEN bytes of the port 1 format
+#define LORA_TELEMETRY_LEN              18
+#define LORA_TELEMETRY_COMPACT_LEN      9 // flags and position only
+#define LORA_PORT_ACTION                10 // downlink: 1 byte, 1 = lock, 2 = unlock, 3 = reject
+#define LORA_PORT_CARDS                 11 // downlink: op (1 = add, 2 = remove), new etag (int32 BE), card ID (4 bytes)
+#define LORA_PORT_TELEMETRY_RATE        12 // downlink: LoRa interval s (uint16 BE), WiFi interval s (uint16 BE),
+                                           // optionally temperature interval s (uint16 BE); 0 = unchanged
+#define LORA_CARD_ADD                   1
+#define LORA_CARD_REMOVE                2
+#define LORA_COMMAND_QUEUE_LEN          4
+#define LORA_PRIORITY_TELEMETRY         1 // ttn_queue_message() priorities, higher goes first
+#define GNSS_MOVING_WINDOW_S            300 // odometer changed within this window means the car is moving
+#define GNSS_HOT_START_MAX_AGE_S        7200 // ephemeris validity for hot starts
 
-typedef enum {EVT_BOOT, EVT_TOUCHED, EVT_TELEMETRY, EVT_FIRMWARE} box_event_t;
+typedef enum {EVT_BOOT, EVT_TOUCHED, EVT_TELEMETRY, EVT_FIRMWARE, EVT_REMOTE, EVT_LORA_TRACE} box_event_t;
 typedef enum {BOX_OK, BOX_LOCKED, BOX_UNLOCKED, BOX_DENY, BOX_ERROR} event_return_t;
 
 #define box_timestamp() esp_timer_get_time()/1000000
 
 // Shared data structs
 
+typedef struct {
+    uint32_t identifier;                   /*<! CAN ID */
+    uint16_t rate_x10;                     /*<! Frames per second x10, last metrics interval */
+} can_id_rate_t;
+
+typedef struct {
+    uint16_t rx_fps;                       /*<! Received frames per second, last metrics interval */
+    uint16_t ids_seen;                     /*<! Distinct CAN IDs seen, last metrics interval */
+    uint16_t rxq_hwm;                      /*<! Driver RX queue high-water mark since boot */
+    uint16_t tec_max;                      /*<! Highest transmit error counter since boot */
+    uint16_t rec_max;                      /*<! Highest receive error counter since boot */
+    uint32_t bus_errors;                   /*<! Bus errors reported by the controller */
+    uint32_t arb_lost;                     /*<! Arbitration losses */
+    uint32_t rx_missed;                    /*<! Frames lost to RX queue or FIFO overrun */
+    uint32_t rxq_full_events;              /*<! RX queue full / FIFO overrun alerts */
+    uint32_t bus_off_events;               /*<! Bus-off events (each followed by recovery) */
+    uint32_t tx_failed;                    /*<! Failed or refused transmissions */
+    int8_t bus_off;                        /*<! 1 = controller currently bus-off or recovering */
+    uint8_t num_top_ids;
+    can_id_rate_t top_ids[CAN_METRICS_TOP_IDS];     /*<! Busiest IDs last metrics interval, highest rate first */
+    int32_t updated_ts;                    /*<! Box timestamp CAN metrics last updated, in seconds */
+} can_health_t;
+
+typedef struct {
+    uint16_t id;                           /*<! Server-assigned geofence ID */
+    int8_t entered;                        /*<! 1 = entered, 0 = exited */
+    int32_t ts;                            /*<! Box timestamp of the transition, in seconds */
+} geofence_event_t;
+
+typedef struct {
+    int32_t etag;                          /*<! etag of the geofence set in use */
+    uint8_t num_inside;
+    uint16_t inside[GEOFENCE_MAX_FENCES];  /*<! IDs of geofences the vehicle is currently inside */
+    uint8_t num_events;                    /*<! Events held in the ring, up to GEOFENCE_MAX_EVENTS */
+    uint8_t next_event;                    /*<! Ring index the next event is written to */
+    uint32_t event_seq;                    /*<! Events recorded since boot; the newest in the ring is number event_seq */
+    geofence_event_t events[GEOFENCE_MAX_EVENTS];   /*<! Most recent enter/exit transitions */
+} geofence_status_t;
+
+typedef struct {
+    const char *name;                      /*<! Boot stage name */
+    int8_t core;                           /*<! Core the stage ran on */
+    uint32_t start_ms;                     /*<! Stage start, in ms since the application started */
+    uint32_t duration_ms;                  /*<! Stage run time, in ms */
+} boot_stage_timing_t;
+
+typedef struct {
+    uint32_t ready_ms;                     /*<! Application start to accepting card taps, in ms */
+    uint32_t complete_ms;                  /*<! Application start to every boot stage finished, in ms */
+    uint8_t num_stages;
+    boot_stage_timing_t stages[BOOT_MAX_STAGES];
+} boot_status_t;
+
+typedef struct {
+    char id[17];                           /*<! ROM code of the sensor */
+    float celsius;                         /*<! Last good reading, in C */
+    int32_t updated_ts;                    /*<! Box timestamp of the last good reading, in seconds */
+} temperature_sensor_t;
+
+typedef struct {
+    uint8_t num_sensors;                   /*<! Sensors found on the 1-Wire bus */
+    temperature_sensor_t sensors[TEMPERATURE_MAX_SENSORS];
+    uint16_t read_errors;                  /*<! Probe reads with no presence pulse, a bad CRC or no conversion */
+} temperature_status_t;
+
+typedef struct {
+    int8_t resumed;                        /*<! 1 = session restored from flash at boot, 0 = joined over the air */
+    uint16_t join_attempts;                /*<! Join attempts since boot */
+    uint16_t rejoins;                      /*<! Sessions dropped for a silent network and joined again since boot */
+    uint32_t first_uplink_ms;              /*<! Boot to first completed uplink, in ms (0 = none yet) */
+    int8_t data_rate;                      /*<! Current uplink data rate (EU868 DR0-5 = SF12-SF7) */
+    int8_t tx_power;                       /*<! Current transmit power, in dBm */
+    int8_t margin_db;                      /*<! Last measured link margin, in dB */
+    uint16_t last_airtime_ms;              /*<! Airtime of the last uplink, in ms */
+    uint32_t airtime_total_ms;             /*<! Uplink airtime since boot, in ms */
+    uint32_t uplinks;                      /*<! Completed uplinks since boot */
+    uint16_t link_checks;                  /*<! Link checks requested since boot */
+    uint16_t link_check_answers;           /*<! Link checks answered; answers/checks is the delivery ratio */
+    int32_t airtime_budget_ms;             /*<! Airtime left in the fair use budget, in ms */
+    uint16_t uplinks_compact;              /*<! Telemetry uplinks cut to the compact format to save airtime */
+    uint16_t uplinks_skipped;              /*<! Telemetry uplinks skipped, airtime budget exhausted */
+    uint16_t uplinks_unchanged;            /*<! Telemetry uplinks skipped, parked and position unchanged */
+    uint32_t spi_transactions;             /*<! Radio SPI transactions since boot */
+    uint32_t spi_skipped;                  /*<! Radio register accesses answered by the HAL's register shadow */
+    uint16_t tx_setup_us;                  /*<! Time to set up the radio for the last uplink, in us */
+    uint8_t tx_setup_spi;                  /*<! SPI transactions to set up the radio for the last uplink */
+    ttn_histogram_t rx_open_error;         /*<! Receiver switch-on relative to the scheduled RX window, in us */
+    ttn_histogram_t dio_latency;           /*<! Radio interrupt to handler, in us */
+    ttn_histogram_t job_latency;           /*<! Scheduled to actual LMIC job start, in us */
+    uint32_t session_saves;                /*<! Frame counter saves to RTC memory since boot */
+    uint16_t session_nvs_writes;           /*<! Full session checkpoints written to NVS since boot */
+    uint32_t session_nvs_max_us;           /*<! Slowest NVS checkpoint, in us */
+} lorawan_status_t;
+
 typedef struct {
     int8_t doors_locked;                   /*<! 1 = doors locked, 0 = doors unlocked */
     int32_t doors_updated_ts;              /*<! Box timestamp doors last updated, in seconds */
@@ -107,6 +247,12 @@ typedef struct {
     float gnss_hdop;                       /*<! GNSS horizontal position uncertainty */
     int8_t gnss_nosats;                    /*<! GNSS number of satellites in use */
     int32_t gnss_updated_ts;               /*<! Box timestamp GNSS position last updated, in seconds */
+    uint16_t gnss_rejected;                /*<! GNSS fixes rejected as outliers since boot */
+    int8_t moving;                         /*<! 1 = vehicle moving, 0 = parked */
+    int32_t moving_updated_ts;             /*<! Box timestamp of the last parked/moving transition, in seconds */
+    uint32_t gnss_ttff_ms;                 /*<! Time to good fix of the last GNSS session, in ms */
+    uint32_t gnss_on_time_s;               /*<! GNSS receiver on-time since boot, in seconds */
+    uint32_t modem_on_time_s;              /*<! SIM7600 powered time since boot, in seconds */
     int8_t tyre_pressure_fl;               /*<! Front left tyre pressure */
     int8_t tyre_pressure_fr;               /*<! Front right tyre pressure */
     int8_t tyre_pressure_rl;               /*<! Rear left tyre pressure */
@@ -114,7 +260,20 @@ typedef struct {
     int32_t tp_updated_ts;                 /*<! Tyre pressure last updated, in seconds */
     uint8_t soh_percent;                   /*<! HV battery SoH, percent */
     int32_t soh_updated_ts;                /*<! SoH last updated, in seconds */
+    uint16_t hv_cell_mv_min;               /*<! Lowest HV cell voltage, in mV */
+    uint16_t hv_cell_mv_max;               /*<! Highest HV cell voltage, in mV */
+    int8_t hv_temp_min_c;                  /*<! Lowest HV battery module temperature, in C */
+    int8_t hv_temp_max_c;                  /*<! Highest HV battery module temperature, in C */
+    int32_t hv_cells_updated_ts;           /*<! HV cell data last updated, in seconds */
+    float vehicle_12v_voltage;             /*<! 12V battery voltage as measured by the VCM */
+    int32_t vehicle_12v_updated_ts;        /*<! VCM 12V voltage last updated, in seconds */
     char ibutton_id[17];                   /*<! ID of iButton currently attached */
+    uint8_t net_link;                      /*<! Link used for the last upload: 0 = none, 1 = WiFi, 2 = cellular */
+    can_health_t can;                      /*<! CAN bus health summary */
+    geofence_status_t geofence;            /*<! Geofence membership and recent transitions */
+    temperature_status_t temperature;      /*<! 1-Wire temperature probes */
+    lorawan_status_t lora;                 /*<! LoRaWAN session and link statistics */
+    boot_status_t boot;                    /*<! Boot stage timings */
 } telemetry_t;
 
 struct maxbox {
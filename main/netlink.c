@@ -0,0 +1,143 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_netif_ppp.h"
+
+#include "maxbox_defines.h"
+#include "netlink.h"
+#include "wifi.h"
+#include "sim7600.h"
+
+static const char* TAG = "MaxBox-NET";
+
+#define LINK_SETTLED_BIT    BIT0    // no connect or disconnect in progress
+
+// s_link_lock only guards the state below; it is never held across wifi_connect()/sim7600_ppp_connect(),
+// so the PPP event handler and netlink_disconnect() can't get stuck behind a 20s dial
+static SemaphoreHandle_t s_link_lock;
+static EventGroupHandle_t s_link_event_group;
+static net_link_t s_link = NET_LINK_NONE;
+static int64_t s_wifi_failed_ts = -1;   // box timestamp of the last failed WiFi attempt, -1 if none
+
+static bool wifi_recently_failed(void)
+{
+    return s_wifi_failed_ts >= 0 && (box_timestamp() - s_wifi_failed_ts) < NETLINK_WIFI_RETRY_MS / 1000;
+}
+
+// Takes the lock once no other task is connecting or disconnecting, and marks a transition in progress
+static void begin_transition(void)
+{
+    while (1) {
+        xSemaphoreTake(s_link_lock, portMAX_DELAY);
+        if (xEventGroupGetBits(s_link_event_group) & LINK_SETTLED_BIT) {
+            xEventGroupClearBits(s_link_event_group, LINK_SETTLED_BIT);
+            return;
+        }
+        xSemaphoreGive(s_link_lock);
+        xEventGroupWaitBits(s_link_event_group, LINK_SETTLED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    }
+}
+
+static void end_transition(void)
+{
+    xEventGroupSetBits(s_link_event_group, LINK_SETTLED_BIT);
+}
+
+net_link_t netlink_connect(bool urgent)
+{
+    begin_transition();
+
+    if (s_link != NET_LINK_NONE) {
+        net_link_t link = s_link;
+        xSemaphoreGive(s_link_lock);
+        end_transition();
+        return link;
+    }
+    bool try_wifi = !urgent || !wifi_recently_failed();
+    xSemaphoreGive(s_link_lock);
+
+    int64_t start = esp_timer_get_time();
+    net_link_t link = NET_LINK_NONE;
+
+    if (try_wifi) {
+        if (wifi_connect() == ESP_OK) {
+            s_wifi_failed_ts = -1;
+            link = NET_LINK_WIFI;
+        } else {
+            s_wifi_failed_ts = box_timestamp();
+            wifi_disconnect();
+        }
+    } else {
+        ESP_LOGI(TAG, "WiFi failed recently, going straight to cellular");
+    }
+
+    if (link == NET_LINK_NONE && sim7600_ppp_connect(MAX_PPP_WAIT_MS) == ESP_OK) {
+        link = NET_LINK_CELLULAR;
+    }
+
+    if (link == NET_LINK_NONE) {
+        ESP_LOGE(TAG, "No data link available");
+    } else {
+        ESP_LOGI(TAG, "%s link up in %lldms", link == NET_LINK_WIFI ? "WiFi" : "Cellular",
+                 (esp_timer_get_time() - start) / 1000);
+        mb->tel->net_link = link;
+    }
+
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    s_link = link;
+    xSemaphoreGive(s_link_lock);
+    end_transition();
+    return link;
+}
+
+void netlink_disconnect()
+{
+    begin_transition();
+    net_link_t link = s_link;
+    s_link = NET_LINK_NONE;
+    xSemaphoreGive(s_link_lock);
+
+    switch (link) {
+    case NET_LINK_WIFI:
+        wifi_disconnect();
+        break;
+    case NET_LINK_CELLULAR:
+        sim7600_ppp_disconnect();
+        break;
+    default:
+        break;
+    }
+
+    end_transition();
+}
+
+static void ppp_lost_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    // The network or modem dropped the session. Forget the link so the next netlink_connect() redials;
+    // sim7600_ppp_connect() hangs up the dead session first. Our own disconnects hold the transition,
+    // so only losses nobody asked for get here with s_link still set.
+    if (event_base == NETIF_PPP_STATUS && (event_id <= NETIF_PPP_ERRORNONE || event_id >= NETIF_PP_PHASE_OFFSET)) {
+        return;
+    }
+
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    if (s_link == NET_LINK_CELLULAR && (xEventGroupGetBits(s_link_event_group) & LINK_SETTLED_BIT)) {
+        ESP_LOGW(TAG, "Cellular link lost");
+        s_link = NET_LINK_NONE;
+    }
+    xSemaphoreGive(s_link_lock);
+}
+
+void netlink_init()
+{
+    s_link_lock = xSemaphoreCreateMutex();
+    s_link_event_group = xEventGroupCreate();
+    xEventGroupSetBits(s_link_event_group, LINK_SETTLED_BIT);
+
+    esp_event_handler_register(IP_EVENT, IP_EVENT_PPP_LOST_IP, &ppp_lost_handler, NULL);
+    esp_event_handler_register(NETIF_PPP_STATUS, ESP_EVENT_ANY_ID, &ppp_lost_handler, NULL);
+}
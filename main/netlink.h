@@ -0,0 +1,33 @@
+/* Network link class: picks WiFi when the depot network is reachable, otherwise cellular PPP
+*/
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {NET_LINK_NONE, NET_LINK_WIFI, NET_LINK_CELLULAR} net_link_t;
+
+/**
+ * @brief Initialize link manager. Call after wifi_init() and sim7600_init().
+ */
+void netlink_init();
+
+/**
+ * @brief Bring up a data link, trying WiFi first and failing over to cellular.
+ * @param urgent skip WiFi if it failed within NETLINK_WIFI_RETRY_MS, so an interactive request
+ *        waits for at most one link attempt
+ * @return link that is up, or NET_LINK_NONE
+ */
+net_link_t netlink_connect(bool urgent);
+
+/**
+ * @brief Take down whichever link is up
+ */
+void netlink_disconnect();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,367 @@
+#include <string.h>
+
+#include "nmea.h"
+
+enum {
+    STATE_IDLE,             // hunting for '$'
+    STATE_BODY,             // between '$' and '*', fields accumulate
+    STATE_CHECKSUM_HI,
+    STATE_CHECKSUM_LO,
+};
+
+static int hex_value(uint8_t c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Parses a decimal field into an integer scaled by 10^decimals, truncating extra fraction digits
+static bool parse_fixed(const char *s, uint8_t len, uint8_t decimals, int32_t *out)
+{
+    int64_t value = 0;
+    bool negative = false;
+    bool digits = false;
+    int8_t frac = -1;       // fraction digits consumed, -1 before the decimal point
+    uint8_t i = 0;
+
+    if (len && s[0] == '-') {
+        negative = true;
+        i++;
+    }
+
+    for (; i < len; i++) {
+        char c = s[i];
+        if (c == '.') {
+            if (frac >= 0) {
+                return false;
+            }
+            frac = 0;
+        } else if (c >= '0' && c <= '9') {
+            digits = true;
+            if (frac < 0) {
+                value = value * 10 + (c - '0');
+                if (value > INT32_MAX) {
+                    return false;
+                }
+            } else if (frac < decimals) {
+                value = value * 10 + (c - '0');
+                frac++;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    if (!digits) {
+        return false;
+    }
+
+    for (int8_t f = (frac < 0) ? 0 : frac; f < decimals; f++) {
+        value *= 10;
+    }
+    if (value > INT32_MAX) {
+        return false;
+    }
+
+    *out = negative ? -(int32_t)value : (int32_t)value;
+    return true;
+}
+
+// NMEA (d)ddmm.mmmm to degrees x 1e7
+static bool parse_coordinate(const char *s, uint8_t len, int32_t *out)
+{
+    // Degrees and minutes are parsed separately: ddmm x 1e7 would overflow 32 bits
+    int32_t minutes_e7;
+    const char *dot = memchr(s, '.', len);
+    uint8_t int_len = dot ? (uint8_t)(dot - s) : len;
+
+    if (int_len < 3 || int_len > 5) {
+        return false;
+    }
+
+    int32_t degrees;
+    if (!parse_fixed(s, int_len - 2, 0, &degrees)) {
+        return false;
+    }
+    if (!parse_fixed(s + int_len - 2, len - int_len + 2, 7, &minutes_e7)) {
+        return false;
+    }
+    if (degrees > 180 || minutes_e7 < 0 || minutes_e7 >= 600000000) {
+        return false;
+    }
+
+    *out = degrees * 10000000 + (minutes_e7 + 30) / 60;
+    return true;
+}
+
+static bool parse_time(const char *s, uint8_t len, uint32_t *out)
+{
+    int32_t hhmmss_ms;
+    if (len < 6 || !parse_fixed(s, len, 3, &hhmmss_ms)) {
+        return false;
+    }
+
+    uint32_t whole = hhmmss_ms / 1000;
+    uint32_t hh = whole / 10000;
+    uint32_t mm = (whole / 100) % 100;
+    uint32_t ss = whole % 100;
+    if (hh > 23 || mm > 59 || ss > 60) {
+        return false;
+    }
+
+    *out = ((hh * 60 + mm) * 60 + ss) * 1000 + hhmmss_ms % 1000;
+    return true;
+}
+
+static bool parse_u16_x100(const char *s, uint8_t len, uint16_t *out)
+{
+    int32_t v;
+    if (!parse_fixed(s, len, 2, &v) || v < 0 || v > UINT16_MAX) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static nmea_sentence_t sentence_type(const char *s, uint8_t len)
+{
+    // Talker ID (GP, GN, GL, GA, BD...) is ignored; all constellations feed the same fix
+    if (len != 5) {
+        return NMEA_SENTENCE_UNKNOWN;
+    }
+    if (!memcmp(s + 2, "GNS", 3)) {
+        return NMEA_SENTENCE_GNS;
+    }
+    if (!memcmp(s + 2, "RMC", 3)) {
+        return NMEA_SENTENCE_RMC;
+    }
+    if (!memcmp(s + 2, "GGA", 3)) {
+        return NMEA_SENTENCE_GGA;
+    }
+    if (!memcmp(s + 2, "GSA", 3)) {
+        return NMEA_SENTENCE_GSA;
+    }
+    return NMEA_SENTENCE_UNKNOWN;
+}
+
+static void apply_hemisphere(nmea_parser_t *p, char h)
+{
+    if (h == 'S') {
+        p->pending_lat_e7 = -p->pending_lat_e7;
+    } else if (h == 'W') {
+        p->pending_lon_e7 = -p->pending_lon_e7;
+    }
+}
+
+static void apply_field(nmea_parser_t *p)
+{
+    const char *f = p->field;
+    uint8_t len = p->field_len;
+    uint8_t idx = p->field_index;
+    nmea_fix_t *fix = &p->scratch;
+    int32_t v;
+
+    if (idx == 0) {
+        p->type = sentence_type(f, len);
+        return;
+    }
+    if (p->type == NMEA_SENTENCE_UNKNOWN || len == 0) {
+        return;
+    }
+
+    switch (p->type) {
+    case NMEA_SENTENCE_GNS:
+        // time, lat, N/S, lon, E/W, mode, sats, HDOP, altitude, ...
+        switch (idx) {
+        case 1: parse_time(f, len, &fix->time_ms); break;
+        case 2: p->have_lat = parse_coordinate(f, len, &p->pending_lat_e7); break;
+        case 3: apply_hemisphere(p, f[0]); break;
+        case 4: p->have_lon = parse_coordinate(f, len, &p->pending_lon_e7); break;
+        case 5: apply_hemisphere(p, f[0]); break;
+        case 6: fix->position_valid = (f[0] != 'N'); break;  // first char is GPS mode, N = no fix
+        case 7: if (parse_fixed(f, len, 0, &v)) fix->sats_used = v; break;
+        case 8: parse_u16_x100(f, len, &fix->hdop_x100); break;
+        case 9: parse_fixed(f, len, 1, &fix->alt_dm); break;
+        }
+        break;
+    case NMEA_SENTENCE_RMC:
+        // time, status, lat, N/S, lon, E/W, speed, course, date, ...
+        switch (idx) {
+        case 1: parse_time(f, len, &fix->time_ms); break;
+        case 2: fix->position_valid = (f[0] == 'A'); break;
+        case 3: p->have_lat = parse_coordinate(f, len, &p->pending_lat_e7); break;
+        case 4: apply_hemisphere(p, f[0]); break;
+        case 5: p->have_lon = parse_coordinate(f, len, &p->pending_lon_e7); break;
+        case 6: apply_hemisphere(p, f[0]); break;
+        case 7: parse_u16_x100(f, len, &fix->speed_knots_x100); break;
+        case 8: parse_u16_x100(f, len, &fix->course_x100); break;
+        case 9: if (parse_fixed(f, len, 0, &v)) fix->date = v; break;
+        }
+        break;
+    case NMEA_SENTENCE_GGA:
+        // time, lat, N/S, lon, E/W, quality, sats, HDOP, altitude, ...
+        switch (idx) {
+        case 1: parse_time(f, len, &fix->time_ms); break;
+        case 2: p->have_lat = parse_coordinate(f, len, &p->pending_lat_e7); break;
+        case 3: apply_hemisphere(p, f[0]); break;
+        case 4: p->have_lon = parse_coordinate(f, len, &p->pending_lon_e7); break;
+        case 5: apply_hemisphere(p, f[0]); break;
+        case 6:
+            if (parse_fixed(f, len, 0, &v)) {
+                fix->fix_quality = v;
+                fix->position_valid = (v != 0);
+            }
+            break;
+        case 7: if (parse_fixed(f, len, 0, &v)) fix->sats_used = v; break;
+        case 8: parse_u16_x100(f, len, &fix->hdop_x100); break;
+        case 9: parse_fixed(f, len, 1, &fix->alt_dm); break;
+        }
+        break;
+    case NMEA_SENTENCE_GSA:
+        // mode, fix type, 12 satellite PRNs, PDOP, HDOP, VDOP
+        switch (idx) {
+        case 2: if (parse_fixed(f, len, 0, &v)) fix->fix_type = v; break;
+        case 15: parse_u16_x100(f, len, &fix->pdop_x100); break;
+        case 16: parse_u16_x100(f, len, &fix->hdop_x100); break;
+        case 17: parse_u16_x100(f, len, &fix->vdop_x100); break;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void end_field(nmea_parser_t *p)
+{
+    if (!p->field_overflow) {
+        apply_field(p);
+    }
+    p->field_index++;
+    p->field_len = 0;
+}
+
+static void start_sentence(nmea_parser_t *p)
+{
+    p->state = STATE_BODY;
+    p->checksum = 0;
+    p->length = 1;
+    p->field_index = 0;
+    p->field_len = 0;
+    p->field_overflow = false;
+    p->type = NMEA_SENTENCE_UNKNOWN;
+    p->have_lat = false;
+    p->have_lon = false;
+    p->scratch = p->fix;
+}
+
+static void commit_sentence(nmea_parser_t *p)
+{
+    p->stats.sentences++;
+
+    if (p->field_overflow) {
+        p->stats.framing_errors++;
+        return;
+    }
+    if (p->type == NMEA_SENTENCE_UNKNOWN) {
+        p->stats.unknown++;
+        return;
+    }
+
+    if (p->have_lat && p->have_lon) {
+        p->scratch.lat_e7 = p->pending_lat_e7;
+        p->scratch.lon_e7 = p->pending_lon_e7;
+    } else if (p->type != NMEA_SENTENCE_GSA) {
+        p->scratch.position_valid = false; // empty position fields: receiver has no fix
+    }
+
+    p->fix = p->scratch;
+    if (p->callback) {
+        p->callback(p->type, &p->fix, p->ctx);
+    }
+}
+
+void nmea_parser_init(nmea_parser_t *p, nmea_callback_t callback, void *ctx)
+{
+    memset(p, 0, sizeof(nmea_parser_t));
+    p->state = STATE_IDLE;
+    p->callback = callback;
+    p->ctx = ctx;
+}
+
+void nmea_parse_byte(nmea_parser_t *p, uint8_t c)
+{
+    if (c == '$') {
+        if (p->state != STATE_IDLE) {
+            p->stats.framing_errors++; // previous sentence never terminated
+        }
+        start_sentence(p);
+        return;
+    }
+
+    switch (p->state) {
+    case STATE_BODY:
+        if (c == '\r' || c == '\n') {
+            p->stats.framing_errors++; // checksum is mandatory
+            p->state = STATE_IDLE;
+            return;
+        }
+        if (++p->length > NMEA_MAX_SENTENCE) {
+            p->stats.framing_errors++;
+            p->state = STATE_IDLE;
+            return;
+        }
+        if (c == '*') {
+            end_field(p);
+            p->state = STATE_CHECKSUM_HI;
+            return;
+        }
+        p->checksum ^= c;
+        if (c == ',') {
+            end_field(p);
+        } else if (p->field_len < NMEA_MAX_FIELD) {
+            p->field[p->field_len++] = c;
+        } else {
+            p->field_overflow = true;
+        }
+        break;
+    case STATE_CHECKSUM_HI:
+    case STATE_CHECKSUM_LO: {
+        int h = hex_value(c);
+        if (h < 0) {
+            p->stats.framing_errors++;
+            p->state = STATE_IDLE;
+            return;
+        }
+        if (p->state == STATE_CHECKSUM_HI) {
+            p->received_checksum = h << 4;
+            p->state = STATE_CHECKSUM_LO;
+            return;
+        }
+        p->received_checksum |= h;
+        p->state = STATE_IDLE;
+        if (p->received_checksum != p->checksum) {
+            p->stats.checksum_errors++;
+            return;
+        }
+        commit_sentence(p);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void nmea_parse(nmea_parser_t *p, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        nmea_parse_byte(p, data[i]);
+    }
+}
@@ -0,0 +1,98 @@
+/* NMEA class: streaming, checksum-validating NMEA 0183 parser
+ *
+ * Bytes are fed one at a time straight from the UART ring buffer; no line buffering and no floating point.
+ * Coordinates are kept as degrees x 1e7, the same fixed-point scale u-blox and LoRaWAN payload codecs use.
+ * Only depends on the C library so it can be built and exercised on a host.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NMEA_MAX_SENTENCE   82      // including '$' and checksum, per NMEA 0183
+#define NMEA_MAX_FIELD      16
+
+typedef enum {
+    NMEA_SENTENCE_UNKNOWN,
+    NMEA_SENTENCE_GNS,
+    NMEA_SENTENCE_RMC,
+    NMEA_SENTENCE_GGA,
+    NMEA_SENTENCE_GSA,
+} nmea_sentence_t;
+
+typedef struct {
+    int32_t lat_e7;                 /*<! latitude, degrees x 1e7, south negative */
+    int32_t lon_e7;                 /*<! longitude, degrees x 1e7, west negative */
+    int32_t alt_dm;                 /*<! altitude above mean sea level, decimetres */
+    uint32_t time_ms;               /*<! UTC time of day, milliseconds */
+    uint32_t date;                  /*<! UTC date as ddmmyy (RMC only) */
+    uint16_t hdop_x100;             /*<! horizontal dilution of precision x 100 */
+    uint16_t pdop_x100;             /*<! position dilution of precision x 100 (GSA) */
+    uint16_t vdop_x100;             /*<! vertical dilution of precision x 100 (GSA) */
+    uint16_t speed_knots_x100;      /*<! speed over ground (RMC) */
+    uint16_t course_x100;           /*<! course over ground, degrees x 100 (RMC) */
+    uint8_t sats_used;              /*<! satellites used in solution */
+    uint8_t fix_quality;            /*<! GGA quality indicator, 0 = no fix */
+    uint8_t fix_type;               /*<! GSA: 1 = none, 2 = 2D, 3 = 3D */
+    bool position_valid;            /*<! last position-bearing sentence reported a fix */
+} nmea_fix_t;
+
+typedef struct {
+    uint32_t sentences;             /*<! sentences with a valid checksum */
+    uint32_t checksum_errors;
+    uint32_t framing_errors;        /*<! overlong sentences/fields, missing checksum */
+    uint32_t unknown;               /*<! valid sentences of a type we don't decode */
+} nmea_stats_t;
+
+/**
+ * @brief Called after every checksum-valid sentence of a supported type, with the merged fix
+ */
+typedef void (*nmea_callback_t)(nmea_sentence_t type, const nmea_fix_t *fix, void *ctx);
+
+typedef struct {
+    uint8_t state;
+    uint8_t checksum;               /*<! running XOR between '$' and '*' */
+    uint8_t received_checksum;
+    uint8_t length;                 /*<! sentence bytes so far */
+    uint8_t field_index;
+    uint8_t field_len;
+    bool field_overflow;
+    char field[NMEA_MAX_FIELD];
+    nmea_sentence_t type;
+
+    int32_t pending_lat_e7;         /*<! position fields are only applied together */
+    int32_t pending_lon_e7;
+    bool have_lat;
+    bool have_lon;
+
+    nmea_fix_t scratch;             /*<! fix being updated by the current sentence */
+    nmea_fix_t fix;                 /*<! last committed fix */
+    nmea_stats_t stats;
+
+    nmea_callback_t callback;
+    void *ctx;
+} nmea_parser_t;
+
+/**
+ * @brief Reset the parser and register the sentence callback
+ */
+void nmea_parser_init(nmea_parser_t *p, nmea_callback_t callback, void *ctx);
+
+/**
+ * @brief Feed one byte
+ */
+void nmea_parse_byte(nmea_parser_t *p, uint8_t c);
+
+/**
+ * @brief Feed a buffer of bytes
+ */
+void nmea_parse(nmea_parser_t *p, const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,59 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "maxbox_defines.h"
+#include "onewire.h"
+
+static const char* TAG = "MaxBox-1WIRE";
+
+static owb_rmt_driver_info s_rmt_info;
+static OneWireBus *s_bus;
+static SemaphoreHandle_t s_lock;
+
+OneWireBus *onewire_take()
+{
+    if (!s_bus) {
+        return NULL;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    return s_bus;
+}
+
+void onewire_give()
+{
+    xSemaphoreGive(s_lock);
+}
+
+bool onewire_find_family(OneWireBus *bus, uint8_t family, OneWireBus_ROMCode *rom_code)
+{
+    // Maxim AN187 "target setup": the search takes the branch towards the family code at every discrepancy,
+    // so it ends on a device of that family if there is one
+    OneWireBus_SearchState search = {
+        .rom_code.fields.family = {family},
+        .last_discrepancy = 64,
+    };
+    bool found = false;
+
+    if (owb_search_next(bus, &search, &found) != OWB_STATUS_OK || !found ||
+        search.rom_code.fields.family[0] != family) {
+        return false;
+    }
+    *rom_code = search.rom_code;
+    return true;
+}
+
+void onewire_init()
+{
+    s_lock = xSemaphoreCreateMutex();
+
+    OneWireBus *bus = owb_rmt_initialize(&s_rmt_info, ONEWIRE_PIN, ONEWIRE_RMT_TX_CHANNEL, ONEWIRE_RMT_RX_CHANNEL);
+    if (!s_rmt_info.rb) {   // only set once both RMT channels are installed
+        ESP_LOGE(TAG, "Failed to initialise 1-Wire bus");
+        return;
+    }
+    owb_use_crc(bus, true);
+    s_bus = bus;
+    ESP_LOGI(TAG, "1-Wire bus on GPIO %d", ONEWIRE_PIN);
+}
@@ -0,0 +1,43 @@
+/* OneWire class: owner of the 1-Wire bus on ONEWIRE_PIN
+ *
+ * The bus is driven by the RMT peripheral, so a task using it sleeps while the slots are clocked out. The iButton
+ * reader and the temperature probes share the bus; each transaction runs between onewire_take() and onewire_give().
+*/
+#pragma once
+
+#include "owb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ONEWIRE_FAMILY_DS1990A  0x01    // iButton serial number
+#define ONEWIRE_FAMILY_DS18S20  0x10    // 9-bit thermometer, extended with COUNT_REMAIN
+#define ONEWIRE_FAMILY_DS1822   0x22
+#define ONEWIRE_FAMILY_DS18B20  0x28
+
+/**
+ * @brief Set up the RMT channels for the bus
+ */
+void onewire_init();
+
+/**
+ * @brief Wait for exclusive use of the bus
+ * @return the bus, or NULL if it couldn't be initialised (the caller must not call onewire_give())
+ */
+OneWireBus *onewire_take();
+
+/**
+ * @brief Release the bus after onewire_take()
+ */
+void onewire_give();
+
+/**
+ * @brief Find the first device of a family, without enumerating the other devices on the bus
+ * @return true if a device was found, its ROM code in rom_code
+ */
+bool onewire_find_family(OneWireBus *bus, uint8_t family, OneWireBus_ROMCode *rom_code);
+
+#ifdef __cplusplus
+}
+#endif
@@ -92,13 +92,87 @@ static uint8_t _calc_crc(uint8_t crc, uint8_t data)
 
 static uint8_t _calc_crc_block(uint8_t crc, const uint8_t * buffer, size_t len)
 {
-    do {
+    while (len--) {
         crc = _calc_crc(crc, *buffer++);
-        ESP_LOGD(TAG, "buffer 0x%02x, crc 0x%02x, len %d", (uint8_t) * (buffer - 1), (int)crc, (int)len);
-    } while (--len > 0);
+    }
     return crc;
 }
 
+/**
+ * @brief Send a batch of time slots, using the driver's single-transaction touch_bits if it has one.
+ *        A write-1 slot doubles as a read slot, so each slot's sampled level is returned in *in.
+ */
+static owb_status _touch_bits(const OneWireBus * bus, uint32_t out, uint32_t * in, int number_of_bits)
+{
+    if (bus->driver->touch_bits) {
+        return bus->driver->touch_bits(bus, out, in, number_of_bits);
+    }
+
+    *in = 0;
+    for (int i = 0; i < number_of_bits; i++) {
+        uint8_t bit = 0;
+        owb_status status = ((out >> i) & 1) ? bus->driver->read_bits(bus, &bit, 1)
+                                             : bus->driver->write_bits(bus, 0, 1);
+        if (status != OWB_STATUS_OK) {
+            return status;
+        }
+        *in |= (uint32_t)(bit & 1) << i;
+    }
+    return OWB_STATUS_OK;
+}
+
+static bool _rom_bit(const OneWireBus_ROMCode * rom_code, int id_bit_number)
+{
+    return rom_code->bytes[(id_bit_number - 1) / 8] & (1 << ((id_bit_number - 1) % 8));
+}
+
+/**
+ * @brief Choose the search direction for one bit position and record it in the state's ROM code
+ * @return search direction, or -1 if no device responded
+ */
+static int _search_direction(OneWireBus_SearchState * state, int id_bit_number, bool id_bit, bool cmp_id_bit, int * last_zero)
+{
+    int search_direction;
+    uint8_t * rom_byte = &state->rom_code.bytes[(id_bit_number - 1) / 8];
+    uint8_t rom_byte_mask = 1 << ((id_bit_number - 1) % 8);
+
+    // check for no devices on 1-wire (signal level is high in both bit reads)
+    if (id_bit && cmp_id_bit) {
+        return -1;
+    }
+
+    if (id_bit != cmp_id_bit) {
+        // all devices coupled have 0 or 1
+        search_direction = id_bit;
+    } else {
+        // if this discrepancy if before the Last Discrepancy
+        // on a previous next then pick the same as last time
+        if (id_bit_number < state->last_discrepancy) {
+            search_direction = (*rom_byte & rom_byte_mask) > 0;
+        } else {
+            // if equal to last pick 1, if not then pick 0
+            search_direction = (id_bit_number == state->last_discrepancy);
+        }
+
+        // if 0 was picked then record its position in LastZero
+        if (search_direction == 0) {
+            *last_zero = id_bit_number;
+
+            // check for Last discrepancy in family
+            if (*last_zero < 9) {
+                state->last_family_discrepancy = *last_zero;
+            }
+        }
+    }
+
+    if (search_direction) {
+        *rom_byte |= rom_byte_mask;
+    } else {
+        *rom_byte &= ~rom_byte_mask;
+    }
+    return search_direction;
+}
+
 /**
  * @param[out] is_found true if a device was found, false if not
  * @return status
@@ -106,21 +180,25 @@ static uint8_t _calc_crc_block(uint8_t crc, const uint8_t * buffer, size_t len)
 static owb_status _search(const OneWireBus * bus, OneWireBus_SearchState * state, bool * is_found)
 {
     // Based on https://www.maximintegrated.com/en/app-notes/index.mvp/id/187
-
-    // initialize for search
-    int id_bit_number = 1;
+    //
+    // Each bit position is a triplet of slots: read bit, read complement, write direction. Up to the last
+    // discrepancy the direction is the one the previous search took, so those triplets are sent in batches
+    // with the direction guessed up front. Past it the direction depends on the bits just read, so it goes
+    // out with the next position's reads, one transaction per bit instead of three. If a guess turns out
+    // wrong (the bus changed since the previous search) the search restarts once, replaying the verified
+    // prefix. A hand-made ROM code that fails its CRC, as in AN187's target setup, only guesses the family.
+    int guess_until = state->last_discrepancy < 64 ? state->last_discrepancy : 64;
+    if (guess_until > 8 && owb_crc8_bytes(0, state->rom_code.bytes, 8) != 0) {
+        guess_until = 8;
+    }
+    bool replay = false;
     int last_zero = 0;
-    int rom_byte_number = 0;
-    uint8_t id_bit = 0;
-    uint8_t cmp_id_bit = 0;
-    uint8_t rom_byte_mask = 1;
-    uint8_t search_direction = 0;
+    int id_bit_number = 1;
     bool search_result = false;
-    uint8_t crc8 = 0;
-    owb_status status = OWB_STATUS_NOT_SET;
+    owb_status status = OWB_STATUS_OK;
 
     // if the last call was not the last one
-    if (!state->last_device_flag) {
+    while (!state->last_device_flag) {
         // 1-Wire reset
         bool is_present;
         bus->driver->reset(bus, &is_present);
@@ -133,82 +211,80 @@ static owb_status _search(const OneWireBus * bus, OneWireBus_SearchState * state
             return OWB_STATUS_OK;
         }
 
-        // issue the search command
-        bus->driver->write_bits(bus, OWB_ROM_SEARCH, 8);
-
-        // loop to do the search
-        do {
-            id_bit = cmp_id_bit = 0;
-
-            // read a bit and its complement
-            bus->driver->read_bits(bus, &id_bit, 1);
-            bus->driver->read_bits(bus, &cmp_id_bit, 1);
-
-            // check for no devices on 1-wire (signal level is high in both bit reads)
-            if (id_bit && cmp_id_bit) {
-                break;
-            } else {
-                // all devices coupled have 0 or 1
-                if (id_bit != cmp_id_bit) {
-                    search_direction = (id_bit) ? 1 : 0;  // bit write value for search
-                } else {
-                    // if this discrepancy if before the Last Discrepancy
-                    // on a previous next then pick the same as last time
-                    if (id_bit_number < state->last_discrepancy) {
-                        search_direction = ((state->rom_code.bytes[rom_byte_number] & rom_byte_mask) > 0);
-                    } else {
-                        // if equal to last pick 1, if not then pick 0
-                        search_direction = (id_bit_number == state->last_discrepancy);
-                    }
-
-                    // if 0 was picked then record its position in LastZero
-                    if (search_direction == 0) {
-                        last_zero = id_bit_number;
-
-                        // check for Last discrepancy in family
-                        if (last_zero < 9) {
-                            state->last_family_discrepancy = last_zero;
-                        }
-                    }
-                }
-
-                // set or clear the bit in the ROM byte rom_byte_number
-                // with mask rom_byte_mask
-                if (search_direction == 1) {
-                    state->rom_code.bytes[rom_byte_number] |= rom_byte_mask;
-                } else {
-                    state->rom_code.bytes[rom_byte_number] &= ~rom_byte_mask;
-                }
-
-                // serial number search direction write bit
-                bus->driver->write_bits(bus, search_direction, 1);
+        // the search command goes out with the first batch of slots
+        uint32_t out = OWB_ROM_SEARCH;
+        int slots = 8;
+        int pending_direction = -1;
+        bool mispredicted = false;
+        last_zero = 0;
+        id_bit_number = 1;
+
+        while (status == OWB_STATUS_OK && !mispredicted) {
+            int first = id_bit_number;
+            if (pending_direction >= 0) {
+                out |= (uint32_t)pending_direction << slots++;
+                pending_direction = -1;
+            }
+            int base = slots;
 
-                // increment the byte counter id_bit_number
-                // and shift the mask rom_byte_mask
+            // triplets with known direction, leaving room for the next position's reads
+            while (id_bit_number <= guess_until && slots + 5 <= OWB_TOUCH_MAX_BITS) {
+                bool guess = (!replay && id_bit_number == state->last_discrepancy) || _rom_bit(&state->rom_code, id_bit_number);
+                out |= (uint32_t)(0x3 | guess << 2) << slots;
+                slots += 3;
                 id_bit_number++;
-                rom_byte_mask <<= 1;
+            }
+            int guessed = id_bit_number;
+            if (id_bit_number <= 64 && id_bit_number > guess_until) {
+                out |= (uint32_t)0x3 << slots;
+                slots += 2;
+                id_bit_number++;
+            }
+            if (!slots) {
+                break;
+            }
 
-                // if the mask is 0 then go to new SerialNum byte rom_byte_number and reset mask
-                if (rom_byte_mask == 0) {
-                    crc8 = owb_crc8_byte(crc8, state->rom_code.bytes[rom_byte_number]);  // accumulate the CRC
-                    rom_byte_number++;
-                    rom_byte_mask = 1;
+            uint32_t in = 0;
+            status = _touch_bits(bus, out, &in, slots);
+            for (int n = first; n < id_bit_number && status == OWB_STATUS_OK; n++) {
+                int slot = base + (n - first) * 3;
+                int search_direction = _search_direction(state, n, (in >> slot) & 1, (in >> (slot + 1)) & 1, &last_zero);
+                if (search_direction < 0) {
+                    status = OWB_STATUS_DEVICE_NOT_RESPONDING;
+                } else if (n >= guessed) {
+                    pending_direction = search_direction;
+                } else if (search_direction != ((out >> (slot + 2)) & 1)) {
+                    // the ROM code now holds the verified directions up to and including n
+                    mispredicted = true;
+                    guess_until = n;
+                    break;
                 }
             }
-        } while (rom_byte_number < 8); // loop until through all ROM bytes 0-7
+            out = 0;
+            slots = 0;
+        }
 
-        // if the search was successful then
-        if (!((id_bit_number < 65) || (crc8 != 0))) {
-            // search successful so set LastDiscrepancy,LastDeviceFlag,search_result
-            state->last_discrepancy = last_zero;
+        if (!mispredicted) {
+            break;
+        }
+        if (replay) {
+            status = OWB_STATUS_DEVICE_NOT_RESPONDING;
+            break;
+        }
+        replay = true;
+    }
 
-            // check for last device
-            if (state->last_discrepancy == 0) {
-                state->last_device_flag = true;
-            }
+    // if the search was successful then
+    if (status == OWB_STATUS_OK && id_bit_number > 64 && owb_crc8_bytes(0, state->rom_code.bytes, 8) == 0) {
+        // search successful so set LastDiscrepancy,LastDeviceFlag,search_result
+        state->last_discrepancy = last_zero;
 
-            search_result = true;
+        // check for last device
+        if (state->last_discrepancy == 0) {
+            state->last_device_flag = true;
         }
+
+        search_result = true;
     }
 
     // if no device found then reset counters so next 'search' will be like a first
@@ -219,11 +295,9 @@ static owb_status _search(const OneWireBus * bus, OneWireBus_SearchState * state
         search_result = false;
     }
 
-    status = OWB_STATUS_OK;
-
     *is_found = search_result;
 
-    return status;
+    return OWB_STATUS_OK;
 }
 
 // Public API
@@ -355,9 +429,11 @@ owb_status owb_verify_rom(const OneWireBus * bus, OneWireBus_ROMCode rom_code, b
     } else if (!_is_init(bus)) {
         status = OWB_STATUS_NOT_INITIALIZED;
     } else {
+        // Past the last bit, so every direction follows rom_code; at 64 the search would guess a 1 there and
+        // start again whenever the CRC's top bit is 0
         OneWireBus_SearchState state = {
             .rom_code = rom_code,
-            .last_discrepancy = 64,
+            .last_discrepancy = 65,
             .last_device_flag = false,
         };
 
@@ -382,6 +458,42 @@ owb_status owb_verify_rom(const OneWireBus * bus, OneWireBus_ROMCode rom_code, b
     return status;
 }
 
+owb_status owb_family_present(const OneWireBus * bus, uint8_t family, bool * is_present)
+{
+    owb_status status = OWB_STATUS_NOT_SET;
+
+    if (!bus || !is_present) {
+        status = OWB_STATUS_PARAMETER_NULL;
+    } else if (!_is_init(bus)) {
+        status = OWB_STATUS_NOT_INITIALIZED;
+    } else {
+        *is_present = false;
+        bus->driver->reset(bus, is_present);
+        if (!*is_present) {
+            return OWB_STATUS_OK;
+        }
+
+        // Search ROM with the direction of the first eight triplets fixed to the family code. A device drops
+        // out at its first bit that differs, so the family is there if every position had a device with its bit
+        uint32_t out = OWB_ROM_SEARCH;
+        int slots = 8;
+        for (int i = 0; i < 8; i++) {
+            out |= (uint32_t)(0x3 | ((family >> i) & 1) << 2) << slots;
+            slots += 3;
+        }
+
+        uint32_t in = 0;
+        status = _touch_bits(bus, out, &in, slots);
+        for (int i = 0; i < 8 && status == OWB_STATUS_OK && *is_present; i++) {
+            // id bit reads 0 if a device has a 0 here, the complement reads 0 if one has a 1
+            int slot = 8 + i * 3;
+            *is_present = !((in >> (slot + ((family >> i) & 1))) & 1);
+        }
+    }
+
+    return status;
+}
+
 owb_status owb_reset(const OneWireBus * bus, bool * a_device_present)
 {
     owb_status status = OWB_STATUS_NOT_SET;
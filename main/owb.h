@@ -54,6 +54,7 @@ extern "C" {
 #define OWB_ROM_SEARCH_ALARM  0xEC  ///< Address all devices on the bus with a set alarm flag
 
 #define OWB_ROM_CODE_STRING_LENGTH (17)  ///< Typical length of OneWire bus ROM ID as ASCII hex string, including null terminator
+#define OWB_TOUCH_MAX_BITS (32)          ///< Maximum number of time slots in one touch_bits transaction
 
 #ifndef GPIO_NUM_NC
 #  define GPIO_NUM_NC (-1)  ///< ESP-IDF prior to v4.x does not define GPIO_NUM_NC
@@ -132,6 +133,11 @@ struct owb_driver {
 
     /** NOTE: Data is read into the high bits, eg. each bit read is shifted down before the next bit is read */
     owb_status(*read_bits)(const OneWireBus *bus, uint8_t *in, int number_of_bits_to_read);
+
+    /** Optional. Sends up to OWB_TOUCH_MAX_BITS time slots, lsb first, as one bus transaction: a 1 bit is a
+        write-1 (= read) slot, a 0 bit a write-0 slot. The level sampled in each slot is returned in the same
+        bit of *in. If NULL, owb falls back to one read_bits/write_bits call per slot. **/
+    owb_status(*touch_bits)(const OneWireBus *bus, uint32_t out, uint32_t *in, int number_of_bits);
 };
 
 /// @cond ignore
@@ -192,6 +198,17 @@ owb_status owb_read_rom(const OneWireBus * bus, OneWireBus_ROMCode * rom_code);
  */
 owb_status owb_verify_rom(const OneWireBus * bus, OneWireBus_ROMCode rom_code, bool * is_present);
 
+/**
+ * @brief Check whether any device of a family is present, without searching for its ROM code.
+ *        A reset and one transaction with a touch_bits driver: the Search ROM command and the family code's
+ *        eight bit positions.
+ * @param[in] bus Pointer to initialised bus instance.
+ * @param[in] family Family code (first byte of the ROM code).
+ * @param[out] is_present Set to true if a device of the family is present, false if not
+ * @return status
+ */
+owb_status owb_family_present(const OneWireBus * bus, uint8_t family, bool * is_present);
+
 /**
  * @brief Reset the 1-Wire bus.
  * @param[in] bus Pointer to initialised bus instance.
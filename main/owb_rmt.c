@@ -301,6 +301,67 @@ static owb_status _read_bits(const OneWireBus * bus, uint8_t *in, int number_of_
     return res;
 }
 
+/** NOTE: A 1 bit sends a write-1 slot, which is also a read slot; the level sampled in every slot is returned */
+static owb_status _touch_bits(const OneWireBus * bus, uint32_t out, uint32_t *in, int number_of_bits)
+{
+    rmt_item32_t tx_items[OWB_TOUCH_MAX_BITS + 1] = {0};
+    uint32_t read_data = 0;
+    int res = OWB_STATUS_OK;
+
+    owb_rmt_driver_info *info = info_of_driver(bus);
+
+    if (number_of_bits > OWB_TOUCH_MAX_BITS) {
+        ESP_LOGE(TAG, "_touch_bits() OWB_STATUS_TOO_MANY_BITS");
+        return OWB_STATUS_TOO_MANY_BITS;
+    }
+
+    for (int i = 0; i < number_of_bits; i++) {
+        tx_items[i] = _encode_write_slot((out >> i) & 0x01);
+    }
+
+    // end marker
+    tx_items[number_of_bits].level0 = 1;
+    tx_items[number_of_bits].duration0 = 0;
+
+    // Up to 32 slots and the end marker fit one RMT memory block (48 items on the S3). Every slot starts with
+    // a falling edge and no high phase reaches the idle threshold, so the RX frame has one item per slot.
+    onewire_flush_rmt_rx_buf(bus);
+    rmt_rx_start(info->rx_channel, true);
+    if (rmt_write_items(info->tx_channel, tx_items, number_of_bits + 1, true) == ESP_OK) {
+        size_t rx_size = 0;
+        rmt_item32_t* rx_items = (rmt_item32_t *)xRingbufferReceive(info->rb, &rx_size, portMAX_DELAY);
+
+        if (rx_items) {
+            if (rx_size >= number_of_bits * sizeof(rmt_item32_t)) {
+                for (int i = 0; i < number_of_bits; i++) {
+                    // rising edge before the sample point -> bit 1
+                    if (rx_items[i].level1 == 1 && rx_items[i].level0 == 0 && rx_items[i].duration0 < OW_DURATION_SAMPLE) {
+                        read_data |= (uint32_t)1 << i;
+                    }
+                }
+            } else {
+                ESP_LOGE(TAG, "short rx frame: %d items", (int)(rx_size / sizeof(rmt_item32_t)));
+                res = OWB_STATUS_HW_ERROR;
+            }
+
+            vRingbufferReturnItem(info->rb, (void *)rx_items);
+        } else {
+            // time out occurred, this indicates an unconnected / misconfigured bus
+            ESP_LOGE(TAG, "rx_items == 0");
+            res = OWB_STATUS_HW_ERROR;
+        }
+    } else {
+        // error in tx channel
+        ESP_LOGE(TAG, "Error tx");
+        res = OWB_STATUS_HW_ERROR;
+    }
+
+    rmt_rx_stop(info->rx_channel);
+
+    *in = read_data;
+    return res;
+}
+
 static owb_status _uninitialize(const OneWireBus *bus)
 {
     owb_rmt_driver_info * info = info_of_driver(bus);
@@ -316,7 +377,8 @@ static struct owb_driver rmt_function_table = {
     .uninitialize = _uninitialize,
     .reset = _reset,
     .write_bits = _write_bits,
-    .read_bits = _read_bits
+    .read_bits = _read_bits,
+    .touch_bits = _touch_bits
 };
 
 static owb_status _init(owb_rmt_driver_info *info, gpio_num_t gpio_num,
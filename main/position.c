@@ -0,0 +1,265 @@
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "maxbox_defines.h"
+#include "position.h"
+#include "vehicle.h"
+#include "telemetry.h"
+#include "geofence.h"
+
+static const char* TAG = "MaxBox-POS";
+
+#define METRES_PER_E7_LAT   0.011131949f    // 111319.49m per degree
+#define POSITION_Q_PARKED   0.01f           // acceleration noise density, m^2/s^3
+#define POSITION_Q_MOVING   2.0f
+#define POSITION_REORIGIN_M 10000.0f        // keep the flat-earth approximation local
+
+typedef struct {
+    float x;                /*<! position along the axis, metres from origin */
+    float v;                /*<! velocity, m/s */
+    float p00, p01, p11;    /*<! covariance */
+} kf_axis_t;
+
+static SemaphoreHandle_t s_lock;
+static kf_axis_t s_kf[2];                   // east, north
+static bool s_initialised;
+static int32_t s_origin_lat_e7;
+static int32_t s_origin_lon_e7;
+static float s_lon_scale;                   // metres per 1e-7 degree of longitude at the origin
+static int64_t s_last_fix_ms;
+static uint8_t s_rejects_in_row;
+
+static bool s_moving;
+static int64_t s_still_since_ms;
+static float s_anchor[2];                   // filtered position when the car parked
+static float s_reported[2];
+static volatile uint32_t s_report_seq;
+
+#define now_ms() (esp_timer_get_time() / 1000)
+
+static void kf_reset(kf_axis_t *kf, float z, float r)
+{
+    kf->x = z;
+    kf->v = 0;
+    kf->p00 = r;
+    kf->p01 = 0;
+    kf->p11 = 25.0f; // unknown velocity, ~5 m/s 1-sigma
+}
+
+static void kf_predict(kf_axis_t *kf, float dt, float q)
+{
+    kf->x += kf->v * dt;
+
+    // P = F P F' + Q, white-noise acceleration model
+    float p00 = kf->p00 + dt * (2 * kf->p01 + dt * kf->p11);
+    float p01 = kf->p01 + dt * kf->p11;
+    kf->p00 = p00 + q * dt * dt * dt / 3;
+    kf->p01 = p01 + q * dt * dt / 2;
+    kf->p11 += q * dt;
+}
+
+static float kf_innovation2(const kf_axis_t *kf, float z, float r)
+{
+    float y = z - kf->x;
+    return y * y / (kf->p00 + r);
+}
+
+static void kf_update(kf_axis_t *kf, float z, float r)
+{
+    float s = kf->p00 + r;
+    float k0 = kf->p00 / s;
+    float k1 = kf->p01 / s;
+    float y = z - kf->x;
+
+    kf->x += k0 * y;
+    kf->v += k1 * y;
+    kf->p11 -= k1 * kf->p01;
+    kf->p01 *= (1 - k0);
+    kf->p00 *= (1 - k0);
+}
+
+static void set_origin(int32_t lat_e7, int32_t lon_e7)
+{
+    s_origin_lat_e7 = lat_e7;
+    s_origin_lon_e7 = lon_e7;
+    s_lon_scale = METRES_PER_E7_LAT * cosf(lat_e7 * (float)M_PI / 1.8e9f);
+}
+
+// Move the origin to the filtered position, keeping the flat-earth approximation local; the filter state,
+// parking anchor and last report carry over in the new frame
+static void reorigin(void)
+{
+    int32_t dlat_e7 = lroundf(s_kf[1].x / METRES_PER_E7_LAT);
+    int32_t dlon_e7 = lroundf(s_kf[0].x / s_lon_scale);
+    float old_lon_scale = s_lon_scale;
+    set_origin(s_origin_lat_e7 + dlat_e7, s_origin_lon_e7 + dlon_e7);
+
+    float *points[][2] = {{&s_kf[0].x, &s_kf[1].x}, {&s_anchor[0], &s_anchor[1]}, {&s_reported[0], &s_reported[1]}};
+    for (int i = 0; i < sizeof(points) / sizeof(points[0]); i++) {
+        *points[i][0] = (*points[i][0] / old_lon_scale - dlon_e7) * s_lon_scale;
+        *points[i][1] -= dlat_e7 * METRES_PER_E7_LAT;
+    }
+    ESP_LOGI(TAG, "Position origin moved to %ld, %ld", s_origin_lat_e7, s_origin_lon_e7);
+}
+
+static void to_local(const nmea_fix_t *fix, float *east, float *north)
+{
+    *east = (fix->lon_e7 - s_origin_lon_e7) * s_lon_scale;
+    *north = (fix->lat_e7 - s_origin_lat_e7) * METRES_PER_E7_LAT;
+}
+
+static void publish(float east, float north)
+{
+    mb->tel->gnss_latitude = (s_origin_lat_e7 + lroundf(north / METRES_PER_E7_LAT)) / 1e7f;
+    mb->tel->gnss_longitude = (s_origin_lon_e7 + lroundf(east / s_lon_scale)) / 1e7f;
+    s_reported[0] = east;
+    s_reported[1] = north;
+    s_report_seq++;
+}
+
+static void set_moving(bool moving)
+{
+    if (moving == s_moving) {
+        return;
+    }
+    s_moving = moving;
+    mb->tel->moving = moving;
+    mb->tel->moving_updated_ts = box_timestamp();
+    s_report_seq++;
+    ESP_LOGI(TAG, "Vehicle %s", moving ? "moving" : "parked");
+
+    if (!moving && s_initialised) {
+        s_anchor[0] = s_kf[0].x;
+        s_anchor[1] = s_kf[1].x;
+        publish(s_anchor[0], s_anchor[1]);
+    }
+    telemetry_request_upload();
+}
+
+static void classify(void)
+{
+    int64_t now = now_ms();
+    int32_t odometer_changed_ts = vehicle_odometer_changed_ts();
+    bool odometer_moving = odometer_changed_ts >= 0 && box_timestamp() - odometer_changed_ts < GNSS_MOVING_WINDOW_S;
+    bool fresh_fix = s_initialised && now - s_last_fix_ms < GNSS_MOVING_INTERVAL_MS;
+    float speed = fresh_fix ? hypotf(s_kf[0].v, s_kf[1].v) : 0;
+
+    if (odometer_moving || speed > POSITION_MOVING_SPEED_MPS) {
+        s_still_since_ms = 0;
+        set_moving(true);
+        return;
+    }
+
+    if (!s_moving) {
+        // Parked: only a sustained displacement away from the anchor counts (e.g. towed, ferry)
+        if (fresh_fix && hypotf(s_kf[0].x - s_anchor[0], s_kf[1].x - s_anchor[1]) > POSITION_PARKED_RADIUS_M) {
+            set_moving(true);
+        }
+        return;
+    }
+
+    if (speed < POSITION_STILL_SPEED_MPS) {
+        if (!s_still_since_ms) {
+            s_still_since_ms = now;
+        } else if (now - s_still_since_ms >= POSITION_PARK_DWELL_S * 1000) {
+            set_moving(false);
+        }
+    } else {
+        s_still_since_ms = 0;
+    }
+}
+
+void position_update(const nmea_fix_t *fix)
+{
+    if (!fix->hdop_x100 || fix->hdop_x100 > POSITION_MAX_HDOP_X100 || fix->sats_used < POSITION_MIN_SATS) {
+        mb->tel->gnss_rejected++;
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    int64_t now = now_ms();
+    float sigma = fix->hdop_x100 / 100.0f * POSITION_UERE_M;
+    float r = sigma * sigma;
+    float z[2];
+
+    if (!s_initialised) {
+        set_origin(fix->lat_e7, fix->lon_e7);
+        kf_reset(&s_kf[0], 0, r);
+        kf_reset(&s_kf[1], 0, r);
+        s_anchor[0] = s_anchor[1] = 0;
+        s_initialised = true;
+        s_rejects_in_row = 0;
+        s_last_fix_ms = now;
+        publish(0, 0);
+        mb->tel->gnss_updated_ts = box_timestamp();
+        xSemaphoreGive(s_lock);
+        return;
+    }
+
+    // A fix far from the origin goes through the gate like any other; only an accepted one moves the origin
+    to_local(fix, &z[0], &z[1]);
+    float dt = (now - s_last_fix_ms) / 1000.0f;
+    float q = s_moving ? POSITION_Q_MOVING : POSITION_Q_PARKED;
+    kf_axis_t predicted[2] = {s_kf[0], s_kf[1]};
+    kf_predict(&predicted[0], dt, q);
+    kf_predict(&predicted[1], dt, q);
+
+    if (kf_innovation2(&predicted[0], z[0], r) + kf_innovation2(&predicted[1], z[1], r) > POSITION_GATE_SIGMA2) {
+        mb->tel->gnss_rejected++;
+        if (++s_rejects_in_row < POSITION_MAX_REJECTS) {
+            xSemaphoreGive(s_lock);
+            return;
+        }
+        // Consistently far from the prediction: the filter is wrong, not the receiver
+        ESP_LOGW(TAG, "%d consecutive outliers, resetting position filter", s_rejects_in_row);
+        kf_reset(&predicted[0], z[0], r);
+        kf_reset(&predicted[1], z[1], r);
+    }
+    s_rejects_in_row = 0;
+
+    kf_update(&predicted[0], z[0], r);
+    kf_update(&predicted[1], z[1], r);
+    s_kf[0] = predicted[0];
+    s_kf[1] = predicted[1];
+    s_last_fix_ms = now;
+    if (hypotf(s_kf[0].x, s_kf[1].x) > POSITION_REORIGIN_M) {
+        reorigin();
+    }
+    mb->tel->gnss_updated_ts = box_timestamp();
+
+    classify();
+
+    geofence_check(s_origin_lat_e7 + lroundf(s_kf[1].x / METRES_PER_E7_LAT),
+                   s_origin_lon_e7 + lroundf(s_kf[0].x / s_lon_scale), fix->time_ms);
+
+    if (s_moving && hypotf(s_kf[0].x - s_reported[0], s_kf[1].x - s_reported[1]) >= POSITION_REPORT_DISTANCE_M) {
+        publish(s_kf[0].x, s_kf[1].x);
+    }
+
+    xSemaphoreGive(s_lock);
+}
+
+void position_tick()
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    classify();
+    xSemaphoreGive(s_lock);
+}
+
+bool position_moving()
+{
+    return s_moving;
+}
+
+uint32_t position_report_seq()
+{
+    return s_report_seq;
+}
+
+void position_init()
+{
+    s_lock = xSemaphoreCreateMutex();
+}
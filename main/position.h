@@ -0,0 +1,54 @@
+/* Position class: GNSS outlier rejection, Kalman smoothing and parked/moving classification
+ *
+ * Fixes are filtered in a local east/north plane with a constant-velocity Kalman filter per axis. Telemetry
+ * position only changes while moving (or on a real displacement), so a parked car no longer reports jitter.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include "nmea.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POSITION_MAX_HDOP_X100          500     // fixes worse than this are rejected outright
+#define POSITION_MIN_SATS               4
+#define POSITION_UERE_M                 4.0f    // user equivalent range error: 1-sigma position error = HDOP x UERE
+#define POSITION_GATE_SIGMA2            16.0f   // reject fixes more than 4 sigma from the prediction
+#define POSITION_MAX_REJECTS            5       // consecutive gated fixes before the filter is reset
+#define POSITION_MOVING_SPEED_MPS       2.0f
+#define POSITION_STILL_SPEED_MPS        0.5f
+#define POSITION_PARKED_RADIUS_M        50.0f   // displacement from the parked anchor that counts as moving
+#define POSITION_PARK_DWELL_S           120     // still for this long before declaring parked
+#define POSITION_REPORT_DISTANCE_M      10.0f   // minimum change before telemetry position is updated
+
+/**
+ * @brief Initialize position filter. Call before the GNSS parser starts.
+ */
+void position_init();
+
+/**
+ * @brief Feed a fix from the NMEA parser. Updates telemetry position, movement state and rejection count.
+ */
+void position_update(const nmea_fix_t *fix);
+
+/**
+ * @brief Re-evaluate movement without a new fix (e.g. odometer changed while the receiver is off)
+ */
+void position_tick();
+
+/**
+ * @brief Current movement classification
+ */
+bool position_moving();
+
+/**
+ * @brief Changes whenever the reported position or the parked/moving state does, so uploaders can skip
+ *        sending a parked car's position again
+ */
+uint32_t position_report_seq();
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,5 +1,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "driver/uart.h"
@@ -15,14 +17,56 @@
 #include "esp_netif_ppp.h"
 
 #include "maxbox_defines.h"
+#include "nmea.h"
+#include "at.h"
+#include "sim7600.h"
+#include "position.h"
 
 #define BUF_SIZE 1024
 
+#define SIM_SYNC_PROBE_TIMEOUT_MS 1000
+#define SIM_DIAL_TIMEOUT_MS       10000
+#define SIM_ESCAPE_GUARD_MS       1100      // "+++" needs a 1s silent guard period on both sides
+#define SIM_HANGUP_TIMEOUT_MS     1000      // LCP terminate to NO CARRIER
+
+#define PPP_CONNECTED_BIT         BIT0
+#define PPP_STOPPED_BIT           BIT1
+#define PPP_HANGUP_BIT            BIT2      // modem reported NO CARRIER and is back in command mode
+
+#define GNSS_FIX_BIT              BIT0      // current session reached GNSS_GOOD_HDOP_X100
+#define GNSS_PARKED_BIT           BIT1      // current session stopped for cellular data
+
+typedef struct {
+    esp_netif_driver_base_t base;
+} ppp_driver_t;
+
+// CGPSINFOCFG NMEA mask: GPGGA (bit 0), GPRMC (bit 1), GNGSA (bit 7), GNGNS (bit 8)
+#define GNSS_NMEA_MASK "387"
+
 ESP_EVENT_DEFINE_BASE(ESP_NMEA_EVENT);
 
-static char *s_buffer;                                  /*!< Runtime buffer */
+static nmea_parser_t s_nmea;                            /*!< Streaming NMEA parser state */
 static QueueHandle_t s_event_queue;                     /*!< UART event queue handle */
 static esp_event_loop_handle_t s_event_loop_hdl;        /*!< Event loop handle */
+static esp_netif_t *s_ppp_netif;                        /*!< PPP interface carried over the modem UART */
+static ppp_driver_t s_ppp_driver;
+static EventGroupHandle_t s_ppp_event_group;
+static volatile bool s_ppp_active;                      /*!< Modem is in data mode */
+
+static EventGroupHandle_t s_gnss_event_group;
+static SemaphoreHandle_t s_gnss_lock;                   /*!< Receiver on/off decisions vs. dialling: held across both */
+static volatile bool s_modem_ready;                     /*!< Modem answered AT and NMEA output is configured */
+static bool s_gnss_on;                                  /*!< GNSS receiver running */
+static bool s_gnss_data_retained;                       /*!< Modem not power cycled since the last fix: ephemeris still in RAM */
+static int64_t s_last_fix_ts;                           /*!< Box timestamp of the last good fix, 0 if none */
+static int64_t s_last_epoch_ms = -1;                    /*!< UTC time of the last fix passed to the position filter */
+static volatile int64_t s_session_start_ms;             /*!< Start of the current fix session, 0 once fixed */
+static int64_t s_gnss_on_since_ms;
+static int64_t s_gnss_on_total_ms;
+static int64_t s_modem_on_since_ms;
+static int64_t s_modem_on_total_ms;
+
+#define now_ms() (esp_timer_get_time() / 1000)
 
 const char *TAG = "MaxBox-SIM7600";
 
@@ -36,67 +80,55 @@ static void config_gpio()
     gpio_set_level(SIM_PWRKEY_PIN, 0);
 }
 
-static void send_sim_raw(char* data)
-{
-    uart_write_bytes(SIM_UART_PORT, data, strlen(data));
-}
-
-static esp_err_t send_sim_at(char* data)
-{
-    uart_disable_pattern_det_intr(SIM_UART_PORT);
-    uart_flush(SIM_UART_PORT);
-
-    char data_recv[128];
-    int length = 0;
-    send_sim_raw(data);
-    vTaskDelay(pdMS_TO_TICKS(500));
-    uart_get_buffered_data_len(SIM_UART_PORT, (size_t*)&length);
-    if (length) {
-        uart_read_bytes(SIM_UART_PORT, data_recv, length, 100);
-        uart_flush(SIM_UART_PORT);
-        uart_enable_pattern_det_baud_intr(SIM_UART_PORT, '\r', 1, 9, 0, 0);
-        return ESP_OK;
-    }
-    uart_flush(SIM_UART_PORT);
-    uart_enable_pattern_det_baud_intr(SIM_UART_PORT, '\r', 1, 9, 0, 0);
-    return ESP_FAIL;
-}
-
-
 static esp_err_t wait_for_sync(uint8_t count)
 {
-    ESP_LOGI(TAG, "Waiting for SIM7600 to boot for up to %is...", count);
-
-    uart_disable_pattern_det_intr(SIM_UART_PORT);
-    uart_flush(SIM_UART_PORT);
+    ESP_LOGI(TAG, "Waiting for SIM7600 to boot for up to %is...", count * SIM_SYNC_PROBE_TIMEOUT_MS / 1000);
 
+    // Each probe returns as soon as the modem answers OK; only a silent modem costs the full timeout
     for (int i = 0; i < count; i++) {
-        if (send_sim_at("AT\r") == ESP_OK) {
+        if (at_command("AT\r", SIM_SYNC_PROBE_TIMEOUT_MS, NULL, 0) == ESP_OK) {
             ESP_LOGI(TAG, "SIM7600 successful boot");
+            at_command("ATE0\r", AT_DEFAULT_TIMEOUT_MS, NULL, 0);
             return ESP_OK;
         }
-        vTaskDelay(pdMS_TO_TICKS(500));
     }
     ESP_LOGW(TAG, "SIM7600 failed to come online in timeout");
     return ESP_FAIL;
 }
 
-static void gnss_start()
+static esp_err_t gnss_configure()
 {
-    ESP_LOGI(TAG, "Turning GPS on");
-    send_sim_at("AT+CGPS=1,1\r");
-    send_sim_at("AT+CGPSINFOCFG=10,256\r");
-    ESP_LOGI(TAG, "GPS enabled");
+    // Receiver stays off until the scheduler starts a session; this only selects the NMEA output
+    if (at_command("AT+CGPSINFOCFG=10," GNSS_NMEA_MASK "\r", AT_DEFAULT_TIMEOUT_MS, NULL, 0) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure NMEA output");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void modem_online()
+{
+    s_modem_ready = (gnss_configure() == ESP_OK);
+    if (s_gnss_on) {
+        s_gnss_on_total_ms += now_ms() - s_gnss_on_since_ms; // reset stopped the receiver
+        s_gnss_on = false;
+    }
+    s_gnss_data_retained = false;
+    if (!s_modem_on_since_ms) {
+        s_modem_on_since_ms = now_ms();
+    }
 }
 
 static void reset_modem()
 {
     ESP_LOGI(TAG, "Sending SIM7600 reset pulse");
+    s_modem_ready = false;
     gpio_set_level(SIM_RESET_PIN, 1);
     vTaskDelay(200 / portTICK_PERIOD_MS);
     gpio_set_level(SIM_RESET_PIN, 0);
-    wait_for_sync(20);
-    gnss_start();
+    if (wait_for_sync(20) == ESP_OK) {
+        modem_online();
+    }
 }
 
 static void power_off_modem()
@@ -109,9 +141,19 @@ static void power_off_modem()
 
     // Power off the modem
     ESP_LOGI(TAG, "Sending SIM7600 power-off pulse");
+    s_modem_ready = false;
+    if (s_gnss_on) {
+        s_gnss_on_total_ms += now_ms() - s_gnss_on_since_ms;
+        s_gnss_on = false;
+    }
     gpio_set_level(SIM_PWRKEY_PIN, 1);
     vTaskDelay(3000 / portTICK_PERIOD_MS);
     gpio_set_level(SIM_PWRKEY_PIN, 0);
+
+    if (s_modem_on_since_ms) {
+        s_modem_on_total_ms += now_ms() - s_modem_on_since_ms;
+        s_modem_on_since_ms = 0;
+    }
 }
 
 static void power_on_modem()
@@ -128,97 +170,107 @@ static void power_on_modem()
     gpio_set_level(SIM_PWRKEY_PIN, 1);
     vTaskDelay(500 / portTICK_PERIOD_MS);
     gpio_set_level(SIM_PWRKEY_PIN, 0);
-    wait_for_sync(16);
-    gnss_start();
+    if (wait_for_sync(16) == ESP_OK) {
+        modem_online();
+    }
 }
 
-static float nmea_to_decimal(const char *lat_long)
+static const char* gnss_start_command()
 {
-    char deg[4] = {0};
-    char *dot, *min;
-    int len;
-    float dec = 0;
-
-    if ((dot = strchr(lat_long, '.'))) {
-        // decimal point was found
-        min = dot - 2;                          // mark the start of minutes 2 chars back
-        len = min - lat_long;                   // find the length of degrees
-        strncpy(deg, lat_long, len);            // copy the degree string to allow conversion to float
-        dec = atof(deg) + atof(min) / 60;       // convert to float
+    // Ephemeris is only held in modem RAM and is good for a few hours; after that or a power cycle,
+    // a warm start (almanac + last position) beats a cold one
+    if (s_last_fix_ts && s_gnss_data_retained) {
+        if (box_timestamp() - s_last_fix_ts < GNSS_HOT_START_MAX_AGE_S) {
+            return "AT+CGPSHOT\r";
+        }
+        return "AT+CGPSWARM\r";
     }
-    return dec;
+    return "AT+CGPS=1,1\r";
 }
 
-static esp_err_t process_gngns_string(char *buf)
+static esp_err_t gnss_receiver_on()
 {
-    // Example string: $GNGNS,223254.00,5156.126739,N,00629.13328,W,AAA,10,1.0,18.9,46.0,,,V*49
-    char *p = buf;
-    if (!(p = strstr(p, "$GNGNS"))) {
-        return ESP_FAIL;
-    }
-    if (!(p = strchr(p, ','))) {
-        return ESP_FAIL;
-    }
-    if (!(p = strchr(++p, ','))) {
-        return ESP_FAIL;    // jump over UTC time
-    }
-    mb->tel->gnss_latitude = nmea_to_decimal(++p);
-    if (!(p = strchr(p, ','))) {
-        return ESP_FAIL;
-    }
-    if (*(++p) == 'S') {
-        mb->tel->gnss_latitude = -mb->tel->gnss_latitude;
-    }
-    if (!(p = strchr(p, ','))) {
-        return ESP_FAIL;
-    }
-    mb->tel->gnss_longitude = nmea_to_decimal(++p);
-    if (!(p = strchr(p, ','))) {
+    const char *cmd = gnss_start_command();
+
+    xEventGroupClearBits(s_gnss_event_group, GNSS_FIX_BIT | GNSS_PARKED_BIT);
+    s_session_start_ms = now_ms();
+    if (at_command(cmd, AT_DEFAULT_TIMEOUT_MS, NULL, 0) != ESP_OK) {
+        s_session_start_ms = 0;
+        ESP_LOGW(TAG, "GNSS start (%.*s) failed", (int)strlen(cmd) - 1, cmd);
         return ESP_FAIL;
     }
-    if (*(++p) == 'W') {
-        mb->tel->gnss_longitude = -mb->tel->gnss_longitude;
-    }
-    if (!(p = strchr(p, ','))) {
-        return ESP_FAIL;    // jump over mode indicator
-    }
-    if (!(p = strchr(++p, ','))) {
-        return ESP_FAIL;
+    ESP_LOGI(TAG, "GNSS session started (%.*s)", (int)strlen(cmd) - 1, cmd);
+    s_gnss_on = true;
+    s_gnss_on_since_ms = s_session_start_ms;
+    return ESP_OK;
+}
+
+static void gnss_receiver_off()
+{
+    if (at_command("AT+CGPS=0\r", AT_DEFAULT_TIMEOUT_MS, NULL, 0) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to stop GNSS");
+        return;
     }
-    mb->tel->gnss_nosats = atoi(++p);
-    if (!(p = strchr(p, ','))) {
-        return ESP_FAIL;
+    s_gnss_on = false;
+    s_session_start_ms = 0;
+    s_gnss_on_total_ms += now_ms() - s_gnss_on_since_ms;
+}
+
+static void gnss_fix_callback(nmea_sentence_t type, const nmea_fix_t *fix, void *ctx)
+{
+    // GSA only refines DOP; the position-bearing sentences (GNS/RMC/GGA) publish the merged fix, once per
+    // epoch: the receiver reports the same fix in each of them and the filter must only see it once
+    if (type == NMEA_SENTENCE_GSA || !fix->position_valid || fix->time_ms == s_last_epoch_ms) {
+        return;
     }
+    s_last_epoch_ms = fix->time_ms;
+
+    mb->tel->gnss_nosats = fix->sats_used;
 
     // HACK: HDoP isn't the same as horizontal precision, but for this
     // application we multiply by 3 to get a rough horizontal range
-    mb->tel->gnss_hdop = atof(++p) * 3.0;
+    mb->tel->gnss_hdop = fix->hdop_x100 * 3 / 100.0f;
+
+    // Filtered position, movement state and timestamp
+    position_update(fix);
+
+    if (fix->hdop_x100 && fix->hdop_x100 <= GNSS_GOOD_HDOP_X100 && fix->sats_used >= GNSS_MIN_SATS) {
+        s_last_fix_ts = box_timestamp();
+        s_gnss_data_retained = true;
+        if (s_session_start_ms) {
+            mb->tel->gnss_ttff_ms = now_ms() - s_session_start_ms;
+            s_session_start_ms = 0;
+            xEventGroupSetBits(s_gnss_event_group, GNSS_FIX_BIT);
+        }
+    }
+}
 
-    mb->tel->gnss_updated_ts = box_timestamp();
+static void nmea_sink(const uint8_t *data, size_t len, void *ctx)
+{
+    nmea_parse(&s_nmea, data, len);
+}
 
-    return ESP_OK;
+static void modem_urc(const char *line, void *ctx)
+{
+    ESP_LOGI(TAG, "SIM7600: %s", line);
 }
 
-static void esp_handle_uart_pattern()
+static void modem_hangup(const char *line, void *ctx)
 {
-    int pos = uart_pattern_pop_pos(SIM_UART_PORT);
-    if (pos != -1) {
-        /* read one line(include '\n') */
-        int read_len = uart_read_bytes(SIM_UART_PORT, s_buffer, pos + 1, 100 / portTICK_PERIOD_MS);
-        /* make sure the line is a standard string */
-        s_buffer[read_len] = '\0';
-        /* Send new line to handle */
-
-        if (process_gngns_string(s_buffer) != ESP_OK) {
-            ESP_LOGW(TAG, "GNSS decode line failed");
-        } else {
-            ESP_LOGI(TAG, "GNSS string successfully processed");
-        }
-    } else {
-        ESP_LOGW(TAG, "Pattern queue size too small");
-        uart_flush_input(SIM_UART_PORT);
+    xEventGroupSetBits(s_ppp_event_group, PPP_HANGUP_BIT);
+}
+
+static void read_uart_data(void)
+{
+    uint8_t chunk[128];
+    int len;
+
+    // Drain everything buffered; AT lines and NMEA sentences are split by the AT engine
+    while ((len = uart_read_bytes(SIM_UART_PORT, chunk, sizeof(chunk), 0)) > 0) {
+        at_feed(chunk, len);
     }
 }
+
 static void nmea_parser_task_entry(void *arg)
 {
     uart_event_t event;
@@ -226,6 +278,7 @@ static void nmea_parser_task_entry(void *arg)
         if (xQueueReceive(s_event_queue, &event, pdMS_TO_TICKS(200))) {
             switch (event.type) {
             case UART_DATA:
+                read_uart_data();
                 break;
             case UART_FIFO_OVF:
                 ESP_LOGW(TAG, "HW FIFO overflow");
@@ -246,9 +299,6 @@ static void nmea_parser_task_entry(void *arg)
             case UART_FRAME_ERR:
                 ESP_LOGE(TAG, "Frame error");
                 break;
-            case UART_PATTERN_DET:
-                esp_handle_uart_pattern();
-                break;
             default:
                 ESP_LOGW(TAG, "Unknown UART event type: %d", event.type);
                 break;
@@ -260,6 +310,189 @@ static void nmea_parser_task_entry(void *arg)
     vTaskDelete(NULL);
 }
 
+static esp_err_t ppp_transmit(void *h, void *buffer, size_t len)
+{
+    uart_write_bytes(SIM_UART_PORT, buffer, len);
+    return ESP_OK;
+}
+
+static esp_err_t ppp_post_attach(esp_netif_t *esp_netif, void *args)
+{
+    ppp_driver_t *driver = args;
+    driver->base.netif = esp_netif;
+
+    esp_netif_driver_ifconfig_t driver_ifconfig = {
+        .handle = driver,
+        .transmit = ppp_transmit,
+    };
+    return esp_netif_set_driver_config(esp_netif, &driver_ifconfig);
+}
+
+static void ppp_sink(const uint8_t *data, size_t len, void *ctx)
+{
+    esp_netif_receive(s_ppp_netif, (void*)data, len, NULL);
+}
+
+static void ppp_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    if (event_base == IP_EVENT && event_id == IP_EVENT_PPP_GOT_IP) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        ESP_LOGI(TAG, "PPP got IP " IPSTR, IP2STR(&event->ip_info.ip));
+        xEventGroupSetBits(s_ppp_event_group, PPP_CONNECTED_BIT);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_PPP_LOST_IP) {
+        ESP_LOGI(TAG, "PPP lost IP");
+        xEventGroupClearBits(s_ppp_event_group, PPP_CONNECTED_BIT);
+    } else if (event_base == NETIF_PPP_STATUS && event_id > NETIF_PPP_ERRORNONE && event_id < NETIF_PP_PHASE_OFFSET) {
+        // Any PPP error, including NETIF_PPP_ERRORUSER after we stop it, means the session is over
+        ESP_LOGI(TAG, "PPP session ended (%ld)", event_id);
+        xEventGroupClearBits(s_ppp_event_group, PPP_CONNECTED_BIT);
+        xEventGroupSetBits(s_ppp_event_group, PPP_STOPPED_BIT);
+    }
+}
+
+// Call with s_gnss_lock held
+static esp_err_t dial()
+{
+    if (s_gnss_on) {
+        // NMEA shares the UART with PPP; the scheduler starts a new session once data mode ends
+        ESP_LOGI(TAG, "Parking GNSS for cellular data");
+        gnss_receiver_off();
+        xEventGroupSetBits(s_gnss_event_group, GNSS_PARKED_BIT);
+    }
+
+    if (at_command("AT+CGDCONT=1,\"IP\",\"" SIM_APN "\"\r", AT_DEFAULT_TIMEOUT_MS, NULL, 0) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set PDP context");
+        return ESP_FAIL;
+    }
+
+    xEventGroupClearBits(s_ppp_event_group, PPP_CONNECTED_BIT | PPP_STOPPED_BIT | PPP_HANGUP_BIT);
+    if (at_dial("ATD*99#\r", SIM_DIAL_TIMEOUT_MS, ppp_sink, NULL) != ESP_OK) {
+        ESP_LOGE(TAG, "Cellular dial failed");
+        return ESP_FAIL;
+    }
+    s_ppp_active = true;
+    return ESP_OK;
+}
+
+esp_err_t sim7600_ppp_connect(uint32_t timeout_ms)
+{
+    if (!gpio_get_level(SIM_STATUS_PIN)) {
+        ESP_LOGW(TAG, "SIM7600 powered off, no cellular data");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_ppp_active) {
+        if (xEventGroupGetBits(s_ppp_event_group) & PPP_CONNECTED_BIT) {
+            return ESP_OK;
+        }
+        // The session dropped since it came up; hang up so the modem takes commands again, then redial
+        ESP_LOGI(TAG, "Stale PPP session, hanging up before redialling");
+        sim7600_ppp_disconnect();
+    }
+
+    int64_t start = esp_timer_get_time();
+
+    // The scheduler decides on/off under the same lock, so it can't slip an AT+CGPS in once we've dialled
+    xSemaphoreTake(s_gnss_lock, portMAX_DELAY);
+    esp_err_t err = dial();
+    xSemaphoreGive(s_gnss_lock);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    esp_netif_action_start(s_ppp_netif, 0, 0, 0);
+    esp_netif_action_connected(s_ppp_netif, 0, 0, 0);
+
+    EventBits_t bits = xEventGroupWaitBits(s_ppp_event_group,
+                                           PPP_CONNECTED_BIT | PPP_STOPPED_BIT,
+                                           pdFALSE,
+                                           pdFALSE,
+                                           timeout_ms / portTICK_PERIOD_MS);
+    if (!(bits & PPP_CONNECTED_BIT)) {
+        ESP_LOGE(TAG, "PPP negotiation failed");
+        sim7600_ppp_disconnect();
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ESP_LOGI(TAG, "Cellular data connected in %lldms", (esp_timer_get_time() - start) / 1000);
+    return ESP_OK;
+}
+
+void sim7600_ppp_disconnect()
+{
+    if (!s_ppp_active) {
+        return;
+    }
+
+    // LCP terminate; the modem normally drops back to command mode with NO CARRIER
+    esp_netif_action_disconnected(s_ppp_netif, 0, 0, 0);
+    esp_netif_action_stop(s_ppp_netif, 0, 0, 0);
+    xEventGroupWaitBits(s_ppp_event_group, PPP_STOPPED_BIT, pdFALSE, pdFALSE, 3000 / portTICK_PERIOD_MS);
+
+    // Probing before the modem has left data mode would send the AT text down the PPP link
+    xEventGroupWaitBits(s_ppp_event_group, PPP_HANGUP_BIT, pdFALSE, pdFALSE, SIM_HANGUP_TIMEOUT_MS / portTICK_PERIOD_MS);
+    at_exit_data_mode();
+    s_ppp_active = false;
+
+    esp_err_t probe = at_command("AT\r", SIM_SYNC_PROBE_TIMEOUT_MS, NULL, 0);
+    if (probe == ESP_FAIL) {
+        // The modem's NO CARRIER arrived after data mode ended and answered the probe
+        probe = at_command("AT\r", SIM_SYNC_PROBE_TIMEOUT_MS, NULL, 0);
+    }
+    if (probe != ESP_OK) {
+        // Still in data mode: escape and hang up
+        vTaskDelay(SIM_ESCAPE_GUARD_MS / portTICK_PERIOD_MS);
+        uart_write_bytes(SIM_UART_PORT, "+++", 3);
+        vTaskDelay(SIM_ESCAPE_GUARD_MS / portTICK_PERIOD_MS);
+        at_command("ATH\r", AT_DEFAULT_TIMEOUT_MS, NULL, 0);
+    }
+    ESP_LOGI(TAG, "Cellular data disconnected");
+}
+
+static void gnss_scheduler_task(void *arg)
+{
+    int64_t next_parked_fix_ms = 0;
+
+    while (1) {
+        // While moving the receiver runs continuously; parked, it takes one good fix per interval and sleeps
+        position_tick();
+        bool moving = position_moving();
+        bool due = moving || s_gnss_on || now_ms() >= next_parked_fix_ms;
+
+        if (due) {
+            // s_ppp_active is only checked with s_gnss_lock held: sim7600_ppp_connect() dials under it
+            xSemaphoreTake(s_gnss_lock, portMAX_DELAY);
+            bool started = s_modem_ready && !s_ppp_active && !s_gnss_on && gnss_receiver_on() == ESP_OK;
+            xSemaphoreGive(s_gnss_lock);
+
+            if (started) {
+                EventBits_t bits = xEventGroupWaitBits(s_gnss_event_group, GNSS_FIX_BIT | GNSS_PARKED_BIT, pdFALSE, pdFALSE,
+                                                       GNSS_FIX_TIMEOUT_MS / portTICK_PERIOD_MS);
+                if (bits & GNSS_FIX_BIT) {
+                    ESP_LOGI(TAG, "GNSS fix in %lums", mb->tel->gnss_ttff_ms);
+                } else if (bits & GNSS_PARKED_BIT) {
+                    ESP_LOGI(TAG, "GNSS session cut short by cellular data");
+                } else {
+                    ESP_LOGW(TAG, "No good GNSS fix within %ims", GNSS_FIX_TIMEOUT_MS);
+                }
+            }
+
+            xSemaphoreTake(s_gnss_lock, portMAX_DELAY);
+            if (s_modem_ready && !s_ppp_active && s_gnss_on && !moving) {
+                gnss_receiver_off();
+                next_parked_fix_ms = now_ms() + GNSS_PARKED_INTERVAL_MS;
+            }
+            xSemaphoreGive(s_gnss_lock);
+        }
+
+        int64_t now = now_ms();
+        mb->tel->gnss_on_time_s = (s_gnss_on_total_ms + (s_gnss_on ? now - s_gnss_on_since_ms : 0)) / 1000;
+        mb->tel->modem_on_time_s = (s_modem_on_total_ms + (s_modem_on_since_ms ? now - s_modem_on_since_ms : 0)) / 1000;
+
+        vTaskDelay(GNSS_MOVING_INTERVAL_MS / portTICK_PERIOD_MS);
+    }
+    vTaskDelete(NULL);
+}
+
 static void sim7600_power_watchdog_task(void *arg)
 {
     power_on_modem(); // initial poweron on first boot to get a fix regardless of battery voltage, and/or reset
@@ -269,7 +502,7 @@ static void sim7600_power_watchdog_task(void *arg)
         if ((mb->tel->aux_battery_voltage > CONFIG_BATTERY_VOLTAGE_THRESHOLD) & !gpio_get_level(SIM_STATUS_PIN)) {
             ESP_LOGI(TAG, "Battery voltage above threshold, powering on SIM7600");
             power_on_modem();
-        } else if ((mb->tel->aux_battery_voltage <= CONFIG_BATTERY_VOLTAGE_THRESHOLD) & gpio_get_level(SIM_STATUS_PIN)) {
+        } else if ((mb->tel->aux_battery_voltage <= CONFIG_BATTERY_VOLTAGE_THRESHOLD) & gpio_get_level(SIM_STATUS_PIN) & !s_ppp_active) {
             ESP_LOGI(TAG, "Battery voltage below threshold, powering off SIM7600");
             power_off_modem();
         }
@@ -281,7 +514,10 @@ void sim7600_init()
 {
     config_gpio();
 
-    s_buffer = calloc(1, 4096);
+    position_init();
+    nmea_parser_init(&s_nmea, gnss_fix_callback, NULL);
+    s_gnss_event_group = xEventGroupCreate();
+    s_gnss_lock = xSemaphoreCreateMutex();
 
     /* Install UART driver */
     uart_config_t uart_config = {
@@ -296,14 +532,24 @@ void sim7600_init()
     uart_driver_install(SIM_UART_PORT, 2048, 2048, 30, &s_event_queue, 0);
     uart_param_config(SIM_UART_PORT, &uart_config);
     uart_set_pin(SIM_UART_PORT, SIM_TXD_PIN, SIM_RXD_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-
-    /* Set pattern interrupt, used to detect the end of a line */
-    uart_enable_pattern_det_baud_intr(SIM_UART_PORT, '\r', 1, 9, 0, 0);
-
-    /* Set pattern queue size */
-    uart_pattern_queue_reset(SIM_UART_PORT, 30);
     uart_flush(SIM_UART_PORT);
 
+    at_init(SIM_UART_PORT, nmea_sink, NULL);
+    at_register_urc("RDY", modem_urc, NULL);
+    at_register_urc("+CPIN:", modem_urc, NULL);
+    at_register_urc("SMS DONE", modem_urc, NULL);
+    at_register_urc("PB DONE", modem_urc, NULL);
+
+    /* PPP interface, driven by the AT engine's data mode */
+    s_ppp_event_group = xEventGroupCreate();
+    at_register_urc("NO CARRIER", modem_hangup, NULL);
+    esp_netif_config_t netif_ppp_config = ESP_NETIF_DEFAULT_PPP();
+    s_ppp_netif = esp_netif_new(&netif_ppp_config);
+    s_ppp_driver.base.post_attach = ppp_post_attach;
+    esp_netif_attach(s_ppp_netif, &s_ppp_driver);
+    esp_event_handler_register(IP_EVENT, ESP_EVENT_ANY_ID, &ppp_event_handler, NULL);
+    esp_event_handler_register(NETIF_PPP_STATUS, ESP_EVENT_ANY_ID, &ppp_event_handler, NULL);
+
     /* Create Event loop */
     esp_event_loop_args_t loop_args = {
         .queue_size = 30,
@@ -314,4 +560,5 @@ void sim7600_init()
 
     xTaskCreate(nmea_parser_task_entry, "nmea_parser", 4096, NULL, 5, NULL);
     xTaskCreate(sim7600_power_watchdog_task, "sim7600_power_watchdog", 4096, NULL, 2, NULL);
+    xTaskCreate(gnss_scheduler_task, "gnss_scheduler", 3072, NULL, 2, NULL);
 }
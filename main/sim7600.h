@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdint.h>
+#include "esp_err.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -10,6 +13,17 @@ extern "C" {
  */
 void sim7600_init();
 
+/**
+ * @brief Dial a cellular data session and bring up the PPP interface. GNSS output pauses while connected.
+ * @return ESP_OK once PPP has an IP address, within timeout_ms plus the dial time
+ */
+esp_err_t sim7600_ppp_connect(uint32_t timeout_ms);
+
+/**
+ * @brief Tear down the PPP session and return the modem to command mode
+ */
+void sim7600_ppp_disconnect();
+
 /**
  * @brief Destroy SIM7600 instance and free all resources
  */
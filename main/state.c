@@ -9,7 +9,7 @@
 
 #include "maxbox_defines.h"
 #include "led.h"
-#include "wifi.h"
+#include "netlink.h"
 #include "telemetry.h"
 
 static const char* TAG = "MaxBox-STATE";
@@ -24,6 +24,10 @@ static EventGroupHandle_t s_box_event_group;
 #define TELEMETRY_DONE_BIT       BIT5
 #define FW_UPDATING_BIT          BIT6
 #define FW_UPDATING_DONE_BIT     BIT7
+#define REMOTE_BIT               BIT8
+#define REMOTE_DONE_BIT          BIT9
+#define LORA_TRACE_BIT           BIT10
+#define LORA_TRACE_DONE_BIT      BIT11
 
 void mb_begin_event(box_event_t box_event)
 {
@@ -33,19 +37,27 @@ void mb_begin_event(box_event_t box_event)
     switch (box_event) {
     case EVT_TOUCHED:
         ESP_LOGI(TAG, "State change requested: TOUCH");
-        bits = (BOOTING_BIT | TOUCHED_BIT | FW_UPDATING_BIT);
+        bits = (BOOTING_BIT | TOUCHED_BIT | FW_UPDATING_BIT | REMOTE_BIT);
         break;
     case EVT_TELEMETRY:
         ESP_LOGI(TAG, "State change requested: TELEMETRY");
-        bits = (BOOTING_BIT | TOUCHED_BIT | TELEMETRY_BIT | FW_UPDATING_BIT);
+        bits = (BOOTING_BIT | TOUCHED_BIT | TELEMETRY_BIT | FW_UPDATING_BIT | REMOTE_BIT | LORA_TRACE_BIT);
         break;
     case EVT_FIRMWARE:
         ESP_LOGI(TAG, "State change requested: FIRMWARE");
-        bits = (BOOTING_BIT | TOUCHED_BIT | FW_UPDATING_BIT);
+        bits = (BOOTING_BIT | TOUCHED_BIT | FW_UPDATING_BIT | REMOTE_BIT);
         break;
     case EVT_BOOT:
         ESP_LOGI(TAG, "State change requested: BOOT");
         break;
+    case EVT_REMOTE:
+        ESP_LOGI(TAG, "State change requested: REMOTE");
+        bits = (BOOTING_BIT | TOUCHED_BIT | FW_UPDATING_BIT | REMOTE_BIT);
+        break;
+    case EVT_LORA_TRACE:
+        ESP_LOGI(TAG, "State change requested: LORA_TRACE");
+        bits = (BOOTING_BIT | TOUCHED_BIT | TELEMETRY_BIT | FW_UPDATING_BIT | REMOTE_BIT | LORA_TRACE_BIT);
+        break;
     default:
         break;
     }
@@ -66,7 +78,7 @@ void mb_begin_event(box_event_t box_event)
     case EVT_TELEMETRY:
         xEventGroupClearBits(s_box_event_group, TELEMETRY_DONE_BIT);
         xEventGroupSetBits(s_box_event_group, TELEMETRY_BIT);
-        wifi_connect();
+        netlink_connect(false);
         break;
     case EVT_FIRMWARE:
         xEventGroupClearBits(s_box_event_group, FW_UPDATING_DONE_BIT);
@@ -78,6 +90,15 @@ void mb_begin_event(box_event_t box_event)
         xEventGroupSetBits(s_box_event_group, BOOTING_BIT);
         led_update(LED_BOOT);
         break;
+    case EVT_REMOTE:
+        xEventGroupClearBits(s_box_event_group, REMOTE_DONE_BIT);
+        xEventGroupSetBits(s_box_event_group, REMOTE_BIT);
+        break;
+    case EVT_LORA_TRACE:
+        xEventGroupClearBits(s_box_event_group, LORA_TRACE_DONE_BIT);
+        xEventGroupSetBits(s_box_event_group, LORA_TRACE_BIT);
+        netlink_connect(false);
+        break;
     default:
         break;
     }
@@ -87,7 +108,9 @@ void mb_complete_event(box_event_t box_event, event_return_t return_status)
 {
     switch (box_event) {
     case EVT_TOUCHED:
-        wifi_disconnect();
+        if (!(xEventGroupGetBits(s_box_event_group) & LORA_TRACE_BIT)) {
+            netlink_disconnect();
+        }
         switch (return_status) {
         case BOX_LOCKED:
             led_update(LED_LOCKED);
@@ -116,8 +139,8 @@ void mb_complete_event(box_event_t box_event, event_return_t return_status)
         xEventGroupSetBits(s_box_event_group, TOUCHED_DONE_BIT);
         break;
     case EVT_TELEMETRY:
-        if (!(xEventGroupGetBits(s_box_event_group) & (TOUCHED_BIT | FW_UPDATING_BIT))) {
-            wifi_disconnect();
+        if (!(xEventGroupGetBits(s_box_event_group) & (TOUCHED_BIT | FW_UPDATING_BIT | LORA_TRACE_BIT))) {
+            netlink_disconnect();
         }
         switch (return_status) {
         case BOX_LOCKED:
@@ -136,13 +159,43 @@ void mb_complete_event(box_event_t box_event, event_return_t return_status)
         xEventGroupClearBits(s_box_event_group, TELEMETRY_BIT);
         xEventGroupSetBits(s_box_event_group, TELEMETRY_DONE_BIT);
         break;
+    case EVT_REMOTE:
+        switch (return_status) {
+        case BOX_LOCKED:
+            led_update(LED_LOCKED);
+            vTaskDelay(1500 / portTICK_PERIOD_MS);
+            led_update(LED_IDLE);
+            break;
+        case BOX_UNLOCKED:
+            led_update(LED_UNLOCKED);
+            vTaskDelay(1500 / portTICK_PERIOD_MS);
+            led_update(LED_IDLE);
+            break;
+        case BOX_DENY:
+            led_update(LED_DENY);
+            vTaskDelay(1500 / portTICK_PERIOD_MS);
+            led_update(LED_IDLE);
+            break;
+        default:
+            break;
+        }
+        xEventGroupClearBits(s_box_event_group, REMOTE_BIT);
+        xEventGroupSetBits(s_box_event_group, REMOTE_DONE_BIT);
+        break;
+    case EVT_LORA_TRACE:
+        if (!(xEventGroupGetBits(s_box_event_group) & (TOUCHED_BIT | TELEMETRY_BIT | FW_UPDATING_BIT))) {
+            netlink_disconnect();
+        }
+        xEventGroupClearBits(s_box_event_group, LORA_TRACE_BIT);
+        xEventGroupSetBits(s_box_event_group, LORA_TRACE_DONE_BIT);
+        break;
     case EVT_BOOT:
         led_update(LED_IDLE);
         xEventGroupClearBits(s_box_event_group, BOOTING_BIT);
         xEventGroupSetBits(s_box_event_group, BOOTING_DONE_BIT);
         break;
     case EVT_FIRMWARE: // note: this will only happen if the firmware update is unsuccessful, otherwise the box will reboot
-        wifi_disconnect();
+        netlink_disconnect();
         led_update(LED_ERROR);
         vTaskDelay(4000 / portTICK_PERIOD_MS);
         led_update(LED_IDLE);
@@ -15,18 +15,39 @@
 
 #include "maxbox_defines.h"
 #include "lorawan.h"
+#include "lorawan_adr.h"
+#include "lorawan_planner.h"
 #include "state.h"
+#include "position.h"
 #include "telemetry.h"
 #include "http.h"
 
 
 static const char* TAG = "MaxBox-telemetry";
 
-#define ts_stale(ts) ((box_timestamp() - ts) > (LORA_TELEMETRY_INTERVAL_MS/1000))
+#define ts_stale(ts) ((box_timestamp() - ts) > (s_lora_interval_ms/1000))
 
 adc_oneshot_unit_handle_t adc1_handle;
 adc_cali_handle_t adc1_cali_handle = NULL;
 
+static TaskHandle_t s_wifi_telemetry_task;
+static TaskHandle_t s_lorawan_telemetry_task;
+static uint32_t s_lora_interval_ms = LORA_TELEMETRY_INTERVAL_MS;
+static uint32_t s_wifi_interval_ms = WIFI_TELEMETRY_INTERVAL_MS;
+static volatile bool s_lora_telemetry_queued;   // previous packet still waiting; don't stack stale copies
+static uint32_t s_lora_sent_position_seq;       // position_report_seq() of the last queued packet
+static int64_t s_lora_sent_ms = -1;             // when it was queued, -1 if never
+
+static void add_histogram(cJSON *parent, const char *name, const ttn_histogram_t *histogram)
+{
+    cJSON *hist;
+    cJSON_AddItemToObject(parent, name, hist = cJSON_CreateObject());
+    cJSON_AddNumberToObject(hist, "n", histogram->count);
+    cJSON_AddNumberToObject(hist, "min", histogram->min_us);
+    cJSON_AddNumberToObject(hist, "max", histogram->max_us);
+    cJSON_AddItemToObject(hist, "buckets", cJSON_CreateIntArray((const int *)histogram->counts, TTN_HISTOGRAM_BUCKETS));
+}
+
 static void update_battery_voltage(void)
 {
     int voltage_raw, voltage_cal;
@@ -72,22 +93,60 @@ void print_all_telemetry()
     ESP_LOGI(TAG, "SoH: %i%", mb->tel->soh_percent);
     ESP_LOGI(TAG, "SoH last updated: %ld", mb->tel->soh_updated_ts);
     ESP_LOGI(TAG, "Odometer last updated: %ld", mb->tel->odometer_updated_ts);
+    ESP_LOGI(TAG, "HV cell voltage range: %u-%umV", mb->tel->hv_cell_mv_min, mb->tel->hv_cell_mv_max);
+    ESP_LOGI(TAG, "HV battery temperature range: %i-%iC", mb->tel->hv_temp_min_c, mb->tel->hv_temp_max_c);
+    ESP_LOGI(TAG, "HV cell data last updated: %ld", mb->tel->hv_cells_updated_ts);
+    ESP_LOGI(TAG, "Vehicle 12V voltage: %fV", mb->tel->vehicle_12v_voltage);
+    ESP_LOGI(TAG, "Vehicle 12V voltage last updated: %ld", mb->tel->vehicle_12v_updated_ts);
     ESP_LOGI(TAG, "GNSS position: %f, %f", mb->tel->gnss_latitude, mb->tel->gnss_longitude);
     ESP_LOGI(TAG, "GNSS HDoP: %f", mb->tel->gnss_hdop);
     ESP_LOGI(TAG, "GNSS number of satellites: %i", mb->tel->gnss_nosats);
     ESP_LOGI(TAG, "GNSS last updated: %ld", mb->tel->gnss_updated_ts);
+    ESP_LOGI(TAG, "Vehicle moving: %i, since %ld", mb->tel->moving, mb->tel->moving_updated_ts);
+    ESP_LOGI(TAG, "GNSS last time to fix: %lums, receiver on %lus, modem on %lus",
+             mb->tel->gnss_ttff_ms, mb->tel->gnss_on_time_s, mb->tel->modem_on_time_s);
     ESP_LOGI(TAG, "Tyre pressure front left: %i", mb->tel->tyre_pressure_fl);
     ESP_LOGI(TAG, "Tyre pressure front right: %i", mb->tel->tyre_pressure_fr);
     ESP_LOGI(TAG, "Tyre pressure rear left: %i", mb->tel->tyre_pressure_rl);
     ESP_LOGI(TAG, "Tyre pressure rear right: %i",   mb->tel->tyre_pressure_rr);
     ESP_LOGI(TAG, "Tyre pressure last updated: %ld", mb->tel->tp_updated_ts);
     ESP_LOGI(TAG, "iButton ID: %s", mb->tel->ibutton_id);
+    for (int i = 0; i < mb->tel->temperature.num_sensors; i++) {
+        ESP_LOGI(TAG, "Temperature probe %s: %.2fC at %ld", mb->tel->temperature.sensors[i].id,
+                 mb->tel->temperature.sensors[i].celsius, mb->tel->temperature.sensors[i].updated_ts);
+    }
+    ESP_LOGI(TAG, "CAN frames/s: %u across %u IDs", mb->tel->can.rx_fps, mb->tel->can.ids_seen);
+    ESP_LOGI(TAG, "CAN RX queue high-water mark: %u", mb->tel->can.rxq_hwm);
+    for (int i = 0; i < mb->tel->can.num_top_ids; i++) {
+        ESP_LOGI(TAG, "CAN ID 0x%03lx: %u.%u frames/s", mb->tel->can.top_ids[i].identifier,
+                 mb->tel->can.top_ids[i].rate_x10 / 10, mb->tel->can.top_ids[i].rate_x10 % 10);
+    }
+    ESP_LOGI(TAG, "CAN error counters max: TEC %u, REC %u", mb->tel->can.tec_max, mb->tel->can.rec_max);
+    ESP_LOGI(TAG, "CAN bus errors: %lu, arbitration lost: %lu, RX missed: %lu",
+             mb->tel->can.bus_errors, mb->tel->can.arb_lost, mb->tel->can.rx_missed);
+    ESP_LOGI(TAG, "CAN bus-off events: %lu, TX failures: %lu", mb->tel->can.bus_off_events, mb->tel->can.tx_failed);
+    ESP_LOGI(TAG, "LoRaWAN session resumed: %i, join attempts: %u, rejoins: %u, first uplink after %lums",
+             mb->tel->lora.resumed, mb->tel->lora.join_attempts, mb->tel->lora.rejoins, mb->tel->lora.first_uplink_ms);
+    ESP_LOGI(TAG, "LoRaWAN DR %i at %idBm, margin %idB, last airtime %ums, %lu uplinks using %lums",
+             mb->tel->lora.data_rate, mb->tel->lora.tx_power, mb->tel->lora.margin_db,
+             mb->tel->lora.last_airtime_ms, mb->tel->lora.uplinks, mb->tel->lora.airtime_total_ms);
+    ESP_LOGI(TAG, "LoRaWAN link checks answered: %u/%u", mb->tel->lora.link_check_answers, mb->tel->lora.link_checks);
+    ESP_LOGI(TAG, "LoRaWAN radio SPI: %lu transactions, %lu skipped, TX setup %uus in %u transactions",
+             mb->tel->lora.spi_transactions, mb->tel->lora.spi_skipped, mb->tel->lora.tx_setup_us, mb->tel->lora.tx_setup_spi);
+    ESP_LOGI(TAG, "LoRaWAN RX window opened %ld..%ldus from schedule over %lu windows, DIO latency max %ldus, job latency max %ldus",
+             mb->tel->lora.rx_open_error.min_us, mb->tel->lora.rx_open_error.max_us, mb->tel->lora.rx_open_error.count,
+             mb->tel->lora.dio_latency.max_us, mb->tel->lora.job_latency.max_us);
+    ESP_LOGI(TAG, "LoRaWAN session saves: %lu, NVS checkpoints: %u, slowest %luus",
+             mb->tel->lora.session_saves, mb->tel->lora.session_nvs_writes, mb->tel->lora.session_nvs_max_us);
+    ESP_LOGI(TAG, "LoRaWAN airtime budget %ldms, %u compact, %u skipped and %u unchanged uplinks", mb->tel->lora.airtime_budget_ms,
+             mb->tel->lora.uplinks_compact, mb->tel->lora.uplinks_skipped, mb->tel->lora.uplinks_unchanged);
+    ESP_LOGI(TAG, "Boot: ready for card taps after %lums, complete after %lums", mb->tel->boot.ready_ms, mb->tel->boot.complete_ms);
     ESP_LOGI(TAG, "Box uptime: %ld", box_ts);
 }
 
-void json_format_telemetry(char *json_string, char *card_id)
+esp_err_t json_format_telemetry(char *json_string, size_t len, char *card_id)
 {
-    cJSON *root, *tel, *tp, *gnss, *soc, *soh, *odo, *doors, *ab, *maxbox;
+    cJSON *root, *tel, *tp, *gnss, *soc, *soh, *hv, *odo, *doors, *ab, *can, *top_ids, *geofence, *inside, *events, *temperature, *probes, *lora, *boot, *stages, *maxbox;
     root = cJSON_CreateObject();
     cJSON_AddItemToObject(root, "telemetry", tel = cJSON_CreateObject());
 
@@ -101,6 +160,12 @@ void json_format_telemetry(char *json_string, char *card_id)
     cJSON_AddNumberToObject(gnss, "hdop",  mb->tel->gnss_hdop);
     cJSON_AddNumberToObject(gnss, "nosats",  mb->tel->gnss_nosats);
     cJSON_AddNumberToObject(gnss, "ts",  mb->tel->gnss_updated_ts);
+    cJSON_AddNumberToObject(gnss, "rejected",  mb->tel->gnss_rejected);
+    cJSON_AddNumberToObject(gnss, "moving",  mb->tel->moving);
+    cJSON_AddNumberToObject(gnss, "moving_ts",  mb->tel->moving_updated_ts);
+    cJSON_AddNumberToObject(gnss, "ttff_ms",  mb->tel->gnss_ttff_ms);
+    cJSON_AddNumberToObject(gnss, "on_s",  mb->tel->gnss_on_time_s);
+    cJSON_AddNumberToObject(gnss, "modem_on_s",  mb->tel->modem_on_time_s);
 
     cJSON_AddItemToObject(tel, "soc", soc = cJSON_CreateObject());
     cJSON_AddNumberToObject(soc, "percent", mb->tel->soc_percent);
@@ -110,6 +175,13 @@ void json_format_telemetry(char *json_string, char *card_id)
     cJSON_AddNumberToObject(soh, "percent", mb->tel->soh_percent);
     cJSON_AddNumberToObject(soh, "ts", mb->tel->soh_updated_ts);
 
+    cJSON_AddItemToObject(tel, "hv_battery", hv = cJSON_CreateObject());
+    cJSON_AddNumberToObject(hv, "cell_mv_min", mb->tel->hv_cell_mv_min);
+    cJSON_AddNumberToObject(hv, "cell_mv_max", mb->tel->hv_cell_mv_max);
+    cJSON_AddNumberToObject(hv, "temp_min_c", mb->tel->hv_temp_min_c);
+    cJSON_AddNumberToObject(hv, "temp_max_c", mb->tel->hv_temp_max_c);
+    cJSON_AddNumberToObject(hv, "ts", mb->tel->hv_cells_updated_ts);
+
     cJSON_AddItemToObject(tel, "odometer", odo = cJSON_CreateObject());
     cJSON_AddNumberToObject(odo, "miles", mb->tel->odometer_miles);
     cJSON_AddNumberToObject(odo, "ts", mb->tel->odometer_updated_ts);
@@ -127,18 +199,131 @@ void json_format_telemetry(char *json_string, char *card_id)
 
     cJSON_AddItemToObject(tel, "aux_battery", ab = cJSON_CreateObject());
     cJSON_AddNumberToObject(ab, "voltage",  mb->tel->aux_battery_voltage);
+    cJSON_AddNumberToObject(ab, "vehicle_voltage",  mb->tel->vehicle_12v_voltage);
+    cJSON_AddNumberToObject(ab, "vehicle_ts",  mb->tel->vehicle_12v_updated_ts);
+
+    cJSON_AddItemToObject(tel, "can", can = cJSON_CreateObject());
+    cJSON_AddNumberToObject(can, "rx_fps", mb->tel->can.rx_fps);
+    cJSON_AddNumberToObject(can, "ids", mb->tel->can.ids_seen);
+    cJSON_AddNumberToObject(can, "rxq_hwm", mb->tel->can.rxq_hwm);
+    cJSON_AddNumberToObject(can, "tec_max", mb->tel->can.tec_max);
+    cJSON_AddNumberToObject(can, "rec_max", mb->tel->can.rec_max);
+    cJSON_AddNumberToObject(can, "bus_err", mb->tel->can.bus_errors);
+    cJSON_AddNumberToObject(can, "arb_lost", mb->tel->can.arb_lost);
+    cJSON_AddNumberToObject(can, "rx_missed", mb->tel->can.rx_missed);
+    cJSON_AddNumberToObject(can, "rxq_full", mb->tel->can.rxq_full_events);
+    cJSON_AddNumberToObject(can, "bus_off", mb->tel->can.bus_off_events);
+    cJSON_AddNumberToObject(can, "tx_fail", mb->tel->can.tx_failed);
+    cJSON_AddItemToObject(can, "top_ids", top_ids = cJSON_CreateArray());
+    for (int i = 0; i < mb->tel->can.num_top_ids; i++) {
+        // [identifier, frames/s x10]
+        const int rate[] = {mb->tel->can.top_ids[i].identifier, mb->tel->can.top_ids[i].rate_x10};
+        cJSON_AddItemToArray(top_ids, cJSON_CreateIntArray(rate, 2));
+    }
+    cJSON_AddNumberToObject(can, "ts", mb->tel->can.updated_ts);
+
+    cJSON_AddItemToObject(tel, "geofence", geofence = cJSON_CreateObject());
+    cJSON_AddNumberToObject(geofence, "etag", mb->tel->geofence.etag);
+    cJSON_AddItemToObject(geofence, "inside", inside = cJSON_CreateArray());
+    for (int i = 0; i < mb->tel->geofence.num_inside; i++) {
+        cJSON_AddItemToArray(inside, cJSON_CreateNumber(mb->tel->geofence.inside[i]));
+    }
+    cJSON_AddItemToObject(geofence, "events", events = cJSON_CreateArray());
+    for (int i = 0; i < mb->tel->geofence.num_events; i++) {
+        // Oldest first
+        int idx = (mb->tel->geofence.next_event + GEOFENCE_MAX_EVENTS - mb->tel->geofence.num_events + i) % GEOFENCE_MAX_EVENTS;
+        geofence_event_t *e = &mb->tel->geofence.events[idx];
+        cJSON *event = cJSON_CreateObject();
+        cJSON_AddNumberToObject(event, "id", e->id);
+        cJSON_AddStringToObject(event, "type", e->entered ? "enter" : "exit");
+        cJSON_AddNumberToObject(event, "ts", e->ts);
+        cJSON_AddItemToArray(events, event);
+    }
+
+    cJSON_AddItemToObject(tel, "temperature", temperature = cJSON_CreateObject());
+    cJSON_AddNumberToObject(temperature, "read_errors", mb->tel->temperature.read_errors);
+    cJSON_AddItemToObject(temperature, "probes", probes = cJSON_CreateArray());
+    for (int i = 0; i < mb->tel->temperature.num_sensors; i++) {
+        temperature_sensor_t *t = &mb->tel->temperature.sensors[i];
+        cJSON *probe = cJSON_CreateObject();
+        cJSON_AddStringToObject(probe, "id", t->id);
+        cJSON_AddNumberToObject(probe, "c", t->celsius);
+        cJSON_AddNumberToObject(probe, "ts", t->updated_ts);
+        cJSON_AddItemToArray(probes, probe);
+    }
+
+    cJSON_AddItemToObject(tel, "lorawan", lora = cJSON_CreateObject());
+    cJSON_AddNumberToObject(lora, "resumed", mb->tel->lora.resumed);
+    cJSON_AddNumberToObject(lora, "joins", mb->tel->lora.join_attempts);
+    cJSON_AddNumberToObject(lora, "rejoins", mb->tel->lora.rejoins);
+    cJSON_AddNumberToObject(lora, "first_uplink_ms", mb->tel->lora.first_uplink_ms);
+    cJSON_AddNumberToObject(lora, "dr", mb->tel->lora.data_rate);
+    cJSON_AddNumberToObject(lora, "tx_pow", mb->tel->lora.tx_power);
+    cJSON_AddNumberToObject(lora, "margin_db", mb->tel->lora.margin_db);
+    cJSON_AddNumberToObject(lora, "airtime_ms", mb->tel->lora.last_airtime_ms);
+    cJSON_AddNumberToObject(lora, "airtime_total_ms", mb->tel->lora.airtime_total_ms);
+    cJSON_AddNumberToObject(lora, "uplinks", mb->tel->lora.uplinks);
+    cJSON_AddNumberToObject(lora, "link_checks", mb->tel->lora.link_checks);
+    cJSON_AddNumberToObject(lora, "link_answers", mb->tel->lora.link_check_answers);
+    cJSON_AddNumberToObject(lora, "airtime_budget_ms", mb->tel->lora.airtime_budget_ms);
+    cJSON_AddNumberToObject(lora, "compact", mb->tel->lora.uplinks_compact);
+    cJSON_AddNumberToObject(lora, "skipped", mb->tel->lora.uplinks_skipped);
+    cJSON_AddNumberToObject(lora, "unchanged", mb->tel->lora.uplinks_unchanged);
+    cJSON_AddNumberToObject(lora, "spi_transactions", mb->tel->lora.spi_transactions);
+    cJSON_AddNumberToObject(lora, "spi_skipped", mb->tel->lora.spi_skipped);
+    cJSON_AddNumberToObject(lora, "tx_setup_us", mb->tel->lora.tx_setup_us);
+    cJSON_AddNumberToObject(lora, "tx_setup_spi", mb->tel->lora.tx_setup_spi);
+    add_histogram(lora, "rx_open_us", &mb->tel->lora.rx_open_error);
+    add_histogram(lora, "dio_us", &mb->tel->lora.dio_latency);
+    add_histogram(lora, "job_us", &mb->tel->lora.job_latency);
+    cJSON_AddNumberToObject(lora, "session_saves", mb->tel->lora.session_saves);
+    cJSON_AddNumberToObject(lora, "nvs_writes", mb->tel->lora.session_nvs_writes);
+    cJSON_AddNumberToObject(lora, "nvs_save_max_us", mb->tel->lora.session_nvs_max_us);
+
+    cJSON_AddItemToObject(tel, "boot", boot = cJSON_CreateObject());
+    cJSON_AddNumberToObject(boot, "ready_ms", mb->tel->boot.ready_ms);
+    cJSON_AddNumberToObject(boot, "complete_ms", mb->tel->boot.complete_ms);
+    cJSON_AddItemToObject(boot, "stages", stages = cJSON_CreateObject());
+    for (int i = 0; i < mb->tel->boot.num_stages; i++) {
+        // "name": [start_ms, duration_ms]
+        const int timing[] = {mb->tel->boot.stages[i].start_ms, mb->tel->boot.stages[i].duration_ms};
+        cJSON_AddItemToObject(stages, mb->tel->boot.stages[i].name, cJSON_CreateIntArray(timing, 2));
+    }
 
     cJSON_AddItemToObject(tel, "maxbox", maxbox = cJSON_CreateObject());
     cJSON_AddStringToObject(maxbox, "ibutton_id",  mb->tel->ibutton_id);
     cJSON_AddNumberToObject(maxbox, "uptime_s", box_timestamp());
+    cJSON_AddNumberToObject(maxbox, "net_link", mb->tel->net_link);
     cJSON_AddNumberToObject(maxbox, "free_heap_bytes", esp_get_free_heap_size());
 
-    char *rendered = cJSON_Print(root);
+    // Diagnostic sections, dropped in this order if the document doesn't fit
+    static const char *optional_sections[] = {"boot", "lorawan", "can"};
+    esp_err_t err = ESP_OK;
+    char *rendered = cJSON_PrintUnformatted(root);
 
-    strcpy(json_string, rendered);
+    for (int i = 0; rendered && strlen(rendered) >= len; i++) {
+        free(rendered);
+        rendered = NULL;
+        if (i == sizeof(optional_sections) / sizeof(optional_sections[0])) {
+            break;
+        }
+        ESP_LOGW(TAG, "Telemetry JSON over %d bytes, dropping \"%s\"", len - 1, optional_sections[i]);
+        cJSON_DeleteItemFromObject(tel, optional_sections[i]);
+        rendered = cJSON_PrintUnformatted(root);
+    }
+
+    if (rendered) {
+        strcpy(json_string, rendered);
+    } else {
+        // Never upload a cut-off document; the server would reject it anyway
+        ESP_LOGE(TAG, "Telemetry JSON doesn't fit in %d bytes", len - 1);
+        json_string[0] = '\0';
+        err = ESP_ERR_INVALID_SIZE;
+    }
 
     cJSON_Delete(root);
     free(rendered);
+    return err;
 }
 
 void lora_format_telemetry(uint8_t *lm)
@@ -161,6 +346,8 @@ void lora_format_telemetry(uint8_t *lm)
     lm[14-16]: TYRE_PRESSURE_PSI (uint6 * 4, packed into 3 bytes)
     lm[17]: TYRE_PRESSURE_AGE (age_t, see below)
 
+    When the airtime budget is short only lm[0-8] are sent, on LORA_PORT_TELEMETRY_COMPACT.
+
     age_t format (variable precision time in one byte)
     0           less than 1 minute
     1 to 60     minutes
@@ -248,35 +435,126 @@ void lora_format_telemetry(uint8_t *lm)
     memcpy(lm + 17, &tp_age_byte, 1);
 }
 
+void telemetry_request_upload()
+{
+    // Wake both uploaders early; each falls back to its normal interval afterwards
+    if (s_wifi_telemetry_task) {
+        xTaskNotifyGive(s_wifi_telemetry_task);
+    }
+    if (s_lorawan_telemetry_task) {
+        xTaskNotifyGive(s_lorawan_telemetry_task);
+    }
+}
+
+void telemetry_set_intervals(uint32_t lora_ms, uint32_t wifi_ms)
+{
+    if (lora_ms) {
+        s_lora_interval_ms = lora_ms < TELEMETRY_MIN_INTERVAL_MS ? TELEMETRY_MIN_INTERVAL_MS : lora_ms;
+    }
+    if (wifi_ms) {
+        s_wifi_interval_ms = wifi_ms < TELEMETRY_MIN_INTERVAL_MS ? TELEMETRY_MIN_INTERVAL_MS : wifi_ms;
+    }
+    ESP_LOGI(TAG, "Telemetry intervals: LoRaWAN %lums, WiFi %lums", s_lora_interval_ms, s_wifi_interval_ms);
+}
+
 void wifi_telemetry_task(void* pvParameter)
 {
     while (1) {
         mb_begin_event(EVT_TELEMETRY);
         http_send(NULL);
 
-        vTaskDelay(WIFI_TELEMETRY_INTERVAL_MS / portTICK_PERIOD_MS);
+        ulTaskNotifyTake(pdTRUE, s_wifi_interval_ms / portTICK_PERIOD_MS);
     }
 }
 
+static void lorawan_telemetry_sent(ttn_response_code_t res, void *arg)
+{
+    // Runs in the TTN background task once the uplink and its receive windows are done
+    s_lora_telemetry_queued = false;
+    lorawan_adr_uplink_done(res == TTN_SUCCESSFUL_TRANSMISSION);
+
+    if (res == TTN_SUCCESSFUL_TRANSMISSION) {
+        lorawan_airtime_used(ttn_last_uplink_stats().airtime_ms);
+        ESP_LOGI(TAG, "Message sent");
+        if (!mb->tel->lora.first_uplink_ms) {
+            mb->tel->lora.first_uplink_ms = esp_timer_get_time() / 1000;
+            ESP_LOGI(TAG, "First uplink %lums after boot", mb->tel->lora.first_uplink_ms);
+        }
+    } else {
+        ESP_LOGE(TAG, "Message sending failed");
+    }
+
+    ttn_spi_stats_t spi = ttn_spi_stats();
+    mb->tel->lora.spi_transactions = spi.transactions;
+    mb->tel->lora.spi_skipped = spi.writes_skipped + spi.reads_skipped;
+    mb->tel->lora.tx_setup_us = spi.tx_setup_us;
+    mb->tel->lora.tx_setup_spi = spi.tx_setup_transactions;
+
+    ttn_timing_stats_t timing = ttn_timing_stats();
+    mb->tel->lora.rx_open_error = timing.rx_open_error;
+    mb->tel->lora.dio_latency = timing.dio_latency;
+    mb->tel->lora.job_latency = timing.job_latency;
+
+    // The uplink advanced the frame counter either way; keep the stored session current. Not from here:
+    // this is the TTN task, and an NVS checkpoint would hold up LMIC's jobs and receive windows
+    lorawan_save_session();
+}
+
 void lorawan_telemetry_task(void* pvParameter)
 {
     vTaskDelay(16000 / portTICK_PERIOD_MS); // initial delay to reduce risk of syncing up LoRaWAN and WiFi telemetry
 
+    bool requested = true; // by telemetry_request_upload(), rather than the interval running out
     while (1) {
-        if (mb->lorawan_joined) {
-            ESP_LOGI(TAG, "Sending LoRaWAN telemetry packet");
-
-            uint8_t lora_telemetry_message[19] = {0};
-            lora_format_telemetry(lora_telemetry_message);
-            ttn_response_code_t res = ttn_transmit_message(lora_telemetry_message, sizeof(lora_telemetry_message) - 1, 1, false);
+        if (mb->lorawan_joined && !s_lora_telemetry_queued) {
+            // Build the packet when the duty cycle lets it go out, not minutes before
+            uint32_t tx_delay_ms = lorawan_planner_tx_delay_ms();
+            if (tx_delay_ms > 0) {
+                ESP_LOGI(TAG, "Duty cycle: LoRaWAN uplink possible in %lums", tx_delay_ms);
+                requested |= ulTaskNotifyTake(pdTRUE, tx_delay_ms / portTICK_PERIOD_MS + 1) > 0;
+                continue;
+            }
 
-            if (res == TTN_SUCCESSFUL_TRANSMISSION) {
-                ESP_LOGI(TAG, "Message sent");
+            // A parked car's position doesn't need resending every interval; a heartbeat still carries the rest
+            int64_t now = esp_timer_get_time() / 1000;
+            bool unchanged = !requested && !position_moving() && s_lora_sent_ms >= 0 &&
+                             position_report_seq() == s_lora_sent_position_seq &&
+                             now - s_lora_sent_ms < TELEMETRY_PARKED_HEARTBEAT_MS;
+
+            const size_t lengths[] = {LORA_TELEMETRY_LEN, LORA_TELEMETRY_COMPACT_LEN};
+            int plan = -1;
+            if (!unchanged) {
+                // A link check adds a byte to the frame; ask for it first so the plan counts it
+                lorawan_adr_before_uplink();
+                plan = lorawan_plan_uplink(lengths, 2);
+            }
+            if (unchanged) {
+                mb->tel->lora.uplinks_unchanged++;
+                ESP_LOGI(TAG, "Parked, position unchanged: skipping LoRaWAN telemetry packet");
+            } else if (plan < 0) {
+                mb->tel->lora.uplinks_skipped++;
+                ESP_LOGW(TAG, "Skipping LoRaWAN telemetry packet, airtime budget exhausted");
             } else {
-                ESP_LOGE(TAG, "Message sending failed");
+                ESP_LOGI(TAG, "Queueing %s LoRaWAN telemetry packet", plan ? "compact" : "full");
+                if (plan) {
+                    mb->tel->lora.uplinks_compact++;
+                }
+
+                uint8_t lora_telemetry_message[LORA_TELEMETRY_LEN + 1] = {0};
+                lora_format_telemetry(lora_telemetry_message);
+                s_lora_telemetry_queued = true;
+                uint32_t position_seq = position_report_seq();
+                if (!ttn_queue_message(lora_telemetry_message, lengths[plan], plan ? LORA_PORT_TELEMETRY_COMPACT : LORA_PORT_TELEMETRY,
+                                       false, LORA_PRIORITY_TELEMETRY, lorawan_telemetry_sent, NULL)) {
+                    s_lora_telemetry_queued = false;
+                    ESP_LOGE(TAG, "LoRaWAN transmit queue full");
+                } else {
+                    s_lora_sent_position_seq = position_seq;
+                    s_lora_sent_ms = now;
+                }
             }
         }
-        vTaskDelay(LORA_TELEMETRY_INTERVAL_MS / portTICK_PERIOD_MS);
+        requested = ulTaskNotifyTake(pdTRUE, s_lora_interval_ms / portTICK_PERIOD_MS) > 0;
     }
 }
 
@@ -312,11 +590,12 @@ esp_err_t telemetry_init(void)
     };
     adc_cali_create_scheme_curve_fitting(&cali_config, &adc1_cali_handle);
 
+    lorawan_planner_init();
     xTaskCreatePinnedToCore(lorawan_init_task, "lorawan_init", 4096, NULL, 3, NULL, 1);
 
     xTaskCreate(power_watchdog_task, "power_watchdog", 4096, NULL, 3, NULL);
-    xTaskCreate(wifi_telemetry_task, "wifi_telemetry", 4096, NULL, 3, NULL);
-    xTaskCreate(lorawan_telemetry_task, "lorawan_telemetry", 4096, NULL, 3, NULL);
+    xTaskCreate(wifi_telemetry_task, "wifi_telemetry", 4096, NULL, 3, &s_wifi_telemetry_task);
+    xTaskCreate(lorawan_telemetry_task, "lorawan_telemetry", 4096, NULL, 3, &s_lorawan_telemetry_task);
 
     return ESP_OK;
 }
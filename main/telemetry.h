@@ -19,9 +19,20 @@ void print_all_telemetry();
 void lora_format_telemetry(uint8_t *lm);
 
 /**
- * @brief Format LoRaWAN telemetry packet contents
+ * @brief Format JSON telemetry for HTTP upload into len bytes including terminator.
+ * Diagnostic sections are dropped if needed to fit; returns ESP_ERR_INVALID_SIZE if it still doesn't.
+ */
+esp_err_t json_format_telemetry(char *json_string, size_t len, char* card_id);
+
+/**
+ * @brief Upload telemetry now rather than at the next interval, e.g. on a movement event
+ */
+void telemetry_request_upload();
+
+/**
+ * @brief Change upload intervals until reboot; 0 leaves an interval unchanged. Takes effect after the current wait.
  */
-void json_format_telemetry(char *json_string, char* card_id);
+void telemetry_set_intervals(uint32_t lora_ms, uint32_t wifi_ms);
 
 /**
  * @brief Initialize telemetry and box monitoring
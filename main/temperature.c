@@ -0,0 +1,149 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "maxbox_defines.h"
+#include "temperature.h"
+#include "onewire.h"
+
+static const char* TAG = "MaxBox-TEMP";
+
+#define DS18X20_CONVERT_T           0x44
+#define DS18X20_READ_SCRATCHPAD     0xBE
+#define DS18X20_SCRATCHPAD_LEN      9
+#define DS18X20_POWER_ON_RAW        0x0550  // 85C in 1/16C: the register's reset value, no conversion ran
+
+static uint32_t s_interval_ms = TEMPERATURE_INTERVAL_MS;
+static OneWireBus_ROMCode s_roms[TEMPERATURE_MAX_SENSORS];
+static uint8_t s_num_sensors;
+
+static bool is_thermometer(uint8_t family)
+{
+    return family == ONEWIRE_FAMILY_DS18B20 || family == ONEWIRE_FAMILY_DS18S20 || family == ONEWIRE_FAMILY_DS1822;
+}
+
+static void scan(OneWireBus *bus)
+{
+    OneWireBus_ROMCode roms[TEMPERATURE_MAX_SENSORS];
+    OneWireBus_SearchState search;
+    bool found = false;
+    uint8_t n = 0;
+
+    owb_search_first(bus, &search, &found);
+    while (found) {
+        if (is_thermometer(search.rom_code.fields.family[0])) {
+            if (n == TEMPERATURE_MAX_SENSORS) {
+                ESP_LOGW(TAG, "More than %d probes, ignoring the rest", TEMPERATURE_MAX_SENSORS);
+                break;
+            }
+            roms[n++] = search.rom_code;
+        }
+        owb_search_next(bus, &search, &found);
+    }
+
+    // The search always runs in ROM code order, so an unchanged bus compares equal
+    if (n == s_num_sensors && !memcmp(roms, s_roms, n * sizeof(roms[0]))) {
+        return;
+    }
+
+    memcpy(s_roms, roms, n * sizeof(roms[0]));
+    s_num_sensors = n;
+
+    temperature_status_t *status = &mb->tel->temperature;
+    memset(status->sensors, 0, sizeof(status->sensors));
+    for (int i = 0; i < n; i++) {
+        owb_string_from_rom_code(s_roms[i], status->sensors[i].id, sizeof(status->sensors[i].id));
+        ESP_LOGI(TAG, "Probe %s", status->sensors[i].id);
+    }
+    status->num_sensors = n;
+    ESP_LOGI(TAG, "%u temperature probes on the bus", n);
+}
+
+static bool convert_all(OneWireBus *bus)
+{
+    bool present = false;
+    if (owb_reset(bus, &present) != OWB_STATUS_OK || !present) {
+        return false;
+    }
+    owb_write_byte(bus, OWB_ROM_SKIP);
+    owb_write_byte(bus, DS18X20_CONVERT_T);
+
+    // The bus stays ours until the probes are read; the iButton poll waits out one conversion
+    vTaskDelay(pdMS_TO_TICKS(TEMPERATURE_CONVERSION_MS));
+    return true;
+}
+
+static bool read_sixteenths(OneWireBus *bus, OneWireBus_ROMCode rom_code, int16_t *raw)
+{
+    static const uint8_t zeros[DS18X20_SCRATCHPAD_LEN];
+    uint8_t sp[DS18X20_SCRATCHPAD_LEN];
+    bool present = false;
+
+    if (owb_reset(bus, &present) != OWB_STATUS_OK || !present) {
+        return false;
+    }
+    owb_write_byte(bus, OWB_ROM_MATCH);
+    owb_write_rom_code(bus, rom_code);
+    owb_write_byte(bus, DS18X20_READ_SCRATCHPAD);
+    owb_read_bytes(bus, sp, sizeof(sp));
+
+    // A shorted bus reads all zeros, which passes the CRC
+    if (owb_crc8_bytes(0, sp, sizeof(sp)) != 0 || !memcmp(sp, zeros, sizeof(sp))) {
+        return false;
+    }
+
+    *raw = (sp[1] << 8) | sp[0];
+    if (rom_code.fields.family[0] == ONEWIRE_FAMILY_DS18S20) {
+        // 0.5C steps; COUNT_REMAIN (byte 6) refines them, with a fixed 16 counts per degree
+        *raw = ((*raw << 3) & 0xFFF0) + 12 - sp[6];
+    }
+    return *raw != DS18X20_POWER_ON_RAW;
+}
+
+static void temperature_task(void *arg)
+{
+    int rounds = 0;
+
+    while (1) {
+        OneWireBus *bus = onewire_take();
+        if (bus) {
+            if (rounds++ % TEMPERATURE_RESCAN_ROUNDS == 0) {
+                scan(bus);
+            }
+
+            if (s_num_sensors && convert_all(bus)) {
+                temperature_status_t *status = &mb->tel->temperature;
+                for (int i = 0; i < s_num_sensors; i++) {
+                    int16_t raw;
+                    if (read_sixteenths(bus, s_roms[i], &raw)) {
+                        status->sensors[i].celsius = raw / 16.0f;
+                        status->sensors[i].updated_ts = box_timestamp();
+                        ESP_LOGD(TAG, "%s: %.2fC", status->sensors[i].id, status->sensors[i].celsius);
+                    } else {
+                        // Probe unplugged or a bad contact; look at the bus again next round
+                        status->read_errors++;
+                        rounds = 0;
+                    }
+                }
+            }
+            onewire_give();
+        }
+
+        vTaskDelay(s_interval_ms / portTICK_PERIOD_MS);
+    }
+    vTaskDelete(NULL);
+}
+
+void temperature_set_interval(uint32_t interval_ms)
+{
+    if (interval_ms) {
+        s_interval_ms = interval_ms < TEMPERATURE_MIN_INTERVAL_MS ? TEMPERATURE_MIN_INTERVAL_MS : interval_ms;
+    }
+    ESP_LOGI(TAG, "Temperature interval: %lums", s_interval_ms);
+}
+
+void temperature_init()
+{
+    xTaskCreate(temperature_task, "temperature", 3072, NULL, 2, NULL);
+}
@@ -0,0 +1,30 @@
+/* Temperature class: DS18B20-family probes on the 1-Wire bus (cabin, box internal)
+ *
+ * All probes convert at once on a Skip ROM broadcast, so a round costs one conversion time however many there
+ * are; each scratchpad is then read by Match ROM and CRC-checked. Readings go to telemetry every
+ * TEMPERATURE_INTERVAL_MS, or the interval set by the LORA_PORT_TELEMETRY_RATE downlink.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEMPERATURE_CONVERSION_MS   750     // 12-bit conversion, the power-on resolution
+#define TEMPERATURE_RESCAN_ROUNDS   60      // re-enumerate the bus this often even without read failures
+
+/**
+ * @brief Start the sampling task. Call after onewire_init().
+ */
+void temperature_init();
+
+/**
+ * @brief Change the sampling interval until reboot; 0 leaves it unchanged. Takes effect after the current wait.
+ */
+void temperature_set_interval(uint32_t interval_ms);
+
+#ifdef __cplusplus
+}
+#endif
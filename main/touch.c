@@ -13,7 +13,7 @@
 #include "telemetry.h"
 #include "http.h"
 #include "state.h"
-#include "wifi.h"
+#include "netlink.h"
 
 #include "maxbox_defines.h"
 
@@ -44,7 +44,7 @@ void touch_handler(void *serial_no) // serial number is always 4 bytes long
         }
     }
 
-    wifi_connect();
+    netlink_connect(true);
     http_send(card_id);
 }
 
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "isotp.h"
+#include "uds.h"
+
+static const char* TAG = "MaxBox-UDS";
+
+#define UDS_NEGATIVE_RESPONSE       0x7f
+#define UDS_NRC_RESPONSE_PENDING    0x78
+#define UDS_POSITIVE_OFFSET         0x40
+
+#define now_ms() (esp_timer_get_time() / 1000)
+
+typedef struct {
+    const uds_ecu_t *ecu;
+    isotp_link_t link;
+    uint8_t rx_buf[UDS_MAX_RESPONSE];
+    uint8_t tx_buf[3];
+    uint8_t query;                  /*<! index of the query in flight */
+    bool finished;
+    int64_t p2_deadline_ms;
+} uds_session_t;
+
+static QueueHandle_t s_rx_queue;
+static volatile bool s_active;
+static uint32_t s_active_rx_ids[UDS_MAX_ECUS];
+static uint8_t s_num_active;
+
+void uds_init(void)
+{
+    s_rx_queue = xQueueCreate(UDS_RX_QUEUE_LEN, sizeof(twai_message_t));
+}
+
+bool uds_push_frame(const twai_message_t *msg)
+{
+    if (!s_active) {
+        return false;
+    }
+    for (int i = 0; i < s_num_active; i++) {
+        if (msg->identifier == s_active_rx_ids[i]) {
+            if (xQueueSend(s_rx_queue, msg, 0) != pdTRUE) {
+                ESP_LOGW(TAG, "RX queue full, dropped frame from 0x%03lx", msg->identifier);
+                return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static void next_query(uds_session_t *s);
+
+static void start_query(uds_session_t *s)
+{
+    const uds_query_t *q = &s->ecu->queries[s->query];
+    uint16_t len;
+
+    s->tx_buf[0] = q->service;
+    if (q->service == UDS_SID_READ_DATA_BY_ID) {
+        s->tx_buf[1] = q->identifier >> 8;
+        s->tx_buf[2] = q->identifier & 0xff;
+        len = 3;
+    } else {
+        s->tx_buf[1] = q->identifier & 0xff;
+        len = 2;
+    }
+
+    s->p2_deadline_ms = now_ms() + UDS_P2_TIMEOUT_MS;
+    if (isotp_send(&s->link, s->tx_buf, len) != ESP_OK) {
+        ESP_LOGW(TAG, "%s: failed to send request %02x %04x", s->ecu->name, q->service, q->identifier);
+        next_query(s);
+    }
+}
+
+static void next_query(uds_session_t *s)
+{
+    if (++s->query >= s->ecu->num_queries) {
+        s->finished = true;
+        return;
+    }
+    start_query(s);
+}
+
+// Returns true if the response was a positive answer to the query in flight
+static bool handle_response(uds_session_t *s)
+{
+    const uds_query_t *q = &s->ecu->queries[s->query];
+    const uint8_t *r = s->rx_buf;
+    uint16_t len = s->link.rx_len;
+    uint8_t id_len = (q->service == UDS_SID_READ_DATA_BY_ID) ? 2 : 1;
+
+    if (len >= 3 && r[0] == UDS_NEGATIVE_RESPONSE && r[1] == q->service) {
+        if (r[2] == UDS_NRC_RESPONSE_PENDING) {
+            s->p2_deadline_ms = now_ms() + UDS_P2_EXT_TIMEOUT_MS;
+            s->link.state = ISOTP_TX_DONE; // keep waiting for the real answer
+            return false;
+        }
+        ESP_LOGW(TAG, "%s: %02x %04x rejected, NRC 0x%02x", s->ecu->name, q->service, q->identifier, r[2]);
+        next_query(s);
+        return false;
+    }
+
+    if (len < 1 + id_len || r[0] != (q->service + UDS_POSITIVE_OFFSET)) {
+        s->link.state = ISOTP_TX_DONE; // not ours, keep waiting
+        return false;
+    }
+
+    uint16_t identifier = (id_len == 2) ? ((r[1] << 8) | r[2]) : r[1];
+    if (identifier != q->identifier) {
+        s->link.state = ISOTP_TX_DONE;
+        return false;
+    }
+
+    if (q->handler) {
+        q->handler(r + 1 + id_len, len - 1 - id_len);
+    }
+    next_query(s);
+    return true;
+}
+
+int uds_read_all(const uds_ecu_t *ecus, uint8_t num_ecus)
+{
+    if (num_ecus > UDS_MAX_ECUS) {
+        num_ecus = UDS_MAX_ECUS;
+    }
+
+    uds_session_t *sessions = calloc(num_ecus, sizeof(uds_session_t));
+    if (!sessions) {
+        ESP_LOGE(TAG, "Failed to allocate diagnostic sessions");
+        return 0;
+    }
+
+    xQueueReset(s_rx_queue);
+    for (int i = 0; i < num_ecus; i++) {
+        s_active_rx_ids[i] = ecus[i].rx_id;
+    }
+    s_num_active = num_ecus;
+    s_active = true;
+
+    int64_t started_ms = now_ms();
+    int responses = 0;
+
+    for (int i = 0; i < num_ecus; i++) {
+        uds_session_t *s = &sessions[i];
+        s->ecu = &ecus[i];
+        isotp_link_init(&s->link, ecus[i].tx_id, ecus[i].rx_id, s->rx_buf, sizeof(s->rx_buf));
+        if (ecus[i].num_queries == 0) {
+            s->finished = true;
+        } else {
+            start_query(s);
+        }
+    }
+
+    while (1) {
+        int32_t wait_ms = 50;
+        bool pending = false;
+
+        for (int i = 0; i < num_ecus; i++) {
+            uds_session_t *s = &sessions[i];
+            if (s->finished) {
+                continue;
+            }
+            pending = true;
+
+            int32_t link_ms = isotp_poll(&s->link);
+
+            switch (s->link.state) {
+            case ISOTP_ERROR:
+                next_query(s);
+                break;
+            case ISOTP_RX_DONE:
+                if (handle_response(s)) {
+                    responses++;
+                }
+                break;
+            case ISOTP_TX_DONE:
+                if (now_ms() >= s->p2_deadline_ms) {
+                    const uds_query_t *q = &s->ecu->queries[s->query];
+                    ESP_LOGW(TAG, "%s: no response to %02x %04x", s->ecu->name, q->service, q->identifier);
+                    next_query(s);
+                }
+                break;
+            default:
+                break;
+            }
+
+            if (link_ms >= 0 && link_ms < wait_ms) {
+                wait_ms = link_ms;
+            }
+        }
+
+        if (!pending) {
+            break;
+        }
+
+        twai_message_t msg;
+        if (xQueueReceive(s_rx_queue, &msg, pdMS_TO_TICKS(wait_ms))) {
+            do {
+                for (int i = 0; i < num_ecus; i++) {
+                    if (!sessions[i].finished && msg.identifier == sessions[i].ecu->rx_id) {
+                        isotp_on_frame(&sessions[i].link, &msg);
+                        break;
+                    }
+                }
+            } while (xQueueReceive(s_rx_queue, &msg, 0));
+        }
+    }
+
+    s_active = false;
+    free(sessions);
+
+    ESP_LOGI(TAG, "Diagnostic poll: %d responses in %lldms", responses, now_ms() - started_ms);
+    return responses;
+}
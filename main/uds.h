@@ -0,0 +1,63 @@
+/* UDS class: diagnostic read client on top of ISO-TP
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/twai.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UDS_SID_READ_DATA_BY_LOCAL_ID   0x21    // KWP2000-style 8-bit identifier, used by Nissan LBC
+#define UDS_SID_READ_DATA_BY_ID         0x22    // ISO 14229 ReadDataByIdentifier, 16-bit DID
+
+#define UDS_MAX_RESPONSE                512
+#define UDS_MAX_ECUS                    4
+#define UDS_RX_QUEUE_LEN                32
+
+#define UDS_P2_TIMEOUT_MS               1000    // first response
+#define UDS_P2_EXT_TIMEOUT_MS           5000    // after NRC 0x78 (response pending)
+
+/**
+ * @brief Called with the response data following the echoed identifier
+ */
+typedef void (*uds_handler_t)(const uint8_t *data, uint16_t len);
+
+typedef struct {
+    uint8_t service;                /*<! UDS_SID_READ_DATA_BY_ID or UDS_SID_READ_DATA_BY_LOCAL_ID */
+    uint16_t identifier;            /*<! DID (or local identifier) to read */
+    uds_handler_t handler;          /*<! decoder for the positive response */
+} uds_query_t;
+
+typedef struct {
+    const char *name;
+    uint32_t tx_id;                 /*<! tester -> ECU request ID */
+    uint32_t rx_id;                 /*<! ECU -> tester response ID */
+    const uds_query_t *queries;
+    uint8_t num_queries;
+} uds_ecu_t;
+
+/**
+ * @brief Create the diagnostic RX queue. Call before the CAN receive task starts.
+ */
+void uds_init(void);
+
+/**
+ * @brief Offer a received frame to the diagnostic client. Never blocks, safe to call from the CAN receive task.
+ * @return true if the frame belongs to an active diagnostic session and was queued
+ */
+bool uds_push_frame(const twai_message_t *msg);
+
+/**
+ * @brief Run every query of every ECU. ECUs are queried concurrently, each ECU's queries back to back.
+ *        Blocks the calling task until all queries have completed or timed out.
+ * @return number of queries that returned a positive response
+ */
+int uds_read_all(const uds_ecu_t *ecus, uint8_t num_ecus);
+
+#ifdef __cplusplus
+}
+#endif
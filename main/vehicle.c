@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include "driver/twai.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -8,6 +9,8 @@
 #include "maxbox_defines.h"
 #include "vehicle.h"
 #include "led.h"
+#include "uds.h"
+#include "can_metrics.h"
 
 static const char* TAG = "MaxBox-vehicle";
 
@@ -16,15 +19,117 @@ static EventGroupHandle_t s_can_event_group;
 #define CAN_SENDING_BIT          BIT0
 #define CAN_SENDING_DONE_BIT     BIT1
 
+#define LEAF_HV_CELL_COUNT       96
+#define LEAF_HV_TEMP_SENSORS     4
+
+static volatile int64_t s_last_rx_ms;
+static volatile int32_t s_odometer_changed_ts = -1;
+
+static void lbc_cell_voltages(const uint8_t *data, uint16_t len)
+{
+    // LBC group 2: big-endian cell voltages in mV, followed by status bytes we don't use
+    uint16_t min = UINT16_MAX;
+    uint16_t max = 0;
+    int cells = len / 2;
+    if (cells > LEAF_HV_CELL_COUNT) {
+        cells = LEAF_HV_CELL_COUNT;
+    }
+
+    for (int i = 0; i < cells; i++) {
+        uint16_t mv = (data[2 * i] << 8) | data[2 * i + 1];
+        if (mv == 0 || mv == 0xffff) {
+            continue;
+        }
+        if (mv < min) {
+            min = mv;
+        }
+        if (mv > max) {
+            max = mv;
+        }
+    }
+
+    if (max) {
+        mb->tel->hv_cell_mv_min = min;
+        mb->tel->hv_cell_mv_max = max;
+        mb->tel->hv_cells_updated_ts = box_timestamp();
+    }
+}
+
+static void lbc_temperatures(const uint8_t *data, uint16_t len)
+{
+    // LBC group 4: per sensor, 2 bytes of thermistor ADC then 1 byte of temperature in C
+    int8_t min = INT8_MAX;
+    int8_t max = INT8_MIN;
+    bool valid = false;
+
+    for (int i = 0; i < LEAF_HV_TEMP_SENSORS && (i * 3 + 2) < len; i++) {
+        if (data[i * 3] == 0xff && data[i * 3 + 1] == 0xff) {
+            continue; // sensor not fitted
+        }
+        int8_t t = (int8_t)data[i * 3 + 2];
+        if (t < min) {
+            min = t;
+        }
+        if (t > max) {
+            max = t;
+        }
+        valid = true;
+    }
+
+    if (valid) {
+        mb->tel->hv_temp_min_c = min;
+        mb->tel->hv_temp_max_c = max;
+        mb->tel->hv_cells_updated_ts = box_timestamp();
+    }
+}
+
+static void vcm_12v_voltage(const uint8_t *data, uint16_t len)
+{
+    if (len < 1) {
+        return;
+    }
+    mb->tel->vehicle_12v_voltage = data[0] * 0.08;
+    mb->tel->vehicle_12v_updated_ts = box_timestamp();
+}
+
+static const uds_query_t s_lbc_queries[] = {
+    {UDS_SID_READ_DATA_BY_LOCAL_ID, 0x02, lbc_cell_voltages},
+    {UDS_SID_READ_DATA_BY_LOCAL_ID, 0x04, lbc_temperatures},
+};
+
+static const uds_query_t s_vcm_queries[] = {
+    {UDS_SID_READ_DATA_BY_ID, 0x1103, vcm_12v_voltage},
+};
+
+static const uds_ecu_t s_diag_ecus[] = {
+    {"LBC", 0x79b, 0x7bb, s_lbc_queries, sizeof(s_lbc_queries) / sizeof(s_lbc_queries[0])},
+    {"VCM", 0x797, 0x79a, s_vcm_queries, sizeof(s_vcm_queries) / sizeof(s_vcm_queries[0])},
+};
+
 void can_receive_task(void *arg)
 {
     // Receives and processes CAN bus data from Nissan E-NV200/Leaf and updates telemetry
 
     while (1) {
         twai_message_t msg;
-        twai_receive(&msg, portMAX_DELAY);
+        if (twai_receive(&msg, portMAX_DELAY) != ESP_OK) {
+            // driver stopped, e.g. bus-off recovery in progress
+            vTaskDelay(100 / portTICK_PERIOD_MS);
+            continue;
+        }
+        s_last_rx_ms = esp_timer_get_time() / 1000;
+        can_metrics_record_rx(msg.identifier);
+
+        if (uds_push_frame(&msg)) {
+            continue;
+        }
+
         if (msg.identifier == 0x5c5) {
-            mb->tel->odometer_miles = (msg.data[1] << 16) | (msg.data[2] << 8) | (msg.data[3]);
+            int32_t odometer_miles = (msg.data[1] << 16) | (msg.data[2] << 8) | (msg.data[3]);
+            if (mb->tel->odometer_updated_ts && odometer_miles != mb->tel->odometer_miles) {
+                s_odometer_changed_ts = box_timestamp();
+            }
+            mb->tel->odometer_miles = odometer_miles;
             mb->tel->odometer_updated_ts = box_timestamp();
         } else if (msg.identifier == 0x55b) {
             mb->tel->soc_percent = ((msg.data[0] << 2) | (msg.data[1] >> 6)) / 10;
@@ -68,7 +173,7 @@ void can_receive_task(void *arg)
 
 static void send_can(twai_message_t message)
 {
-    twai_transmit(&message, pdMS_TO_TICKS(100));
+    can_metrics_record_tx(twai_transmit(&message, pdMS_TO_TICKS(100)));
 }
 
 static void un_lock()
@@ -168,6 +273,36 @@ static void un_lock()
     vTaskDelete(NULL);
 }
 
+static bool bus_active()
+{
+    return (esp_timer_get_time() / 1000 - s_last_rx_ms) < CAN_BUS_IDLE_TIMEOUT_MS;
+}
+
+static void vehicle_diag_task(void *arg)
+{
+    // Polls multi-frame diagnostic data while the car is awake. Runs beside can_receive_task, which
+    // only hands diagnostic responses over through a queue and never waits on this task.
+
+    while (1) {
+        vTaskDelay(VEHICLE_DIAG_INTERVAL_MS / portTICK_PERIOD_MS);
+
+        if (!bus_active()) {
+            continue; // don't wake a sleeping car just for telemetry
+        }
+        if (xEventGroupGetBits(s_can_event_group) & CAN_SENDING_BIT) {
+            continue; // lock script owns the bus, try again next time
+        }
+
+        uds_read_all(s_diag_ecus, sizeof(s_diag_ecus) / sizeof(s_diag_ecus[0]));
+    }
+    vTaskDelete(NULL);
+}
+
+int32_t vehicle_odometer_changed_ts()
+{
+    return s_odometer_changed_ts;
+}
+
 void vehicle_init()
 {
     // TODO: Sleep CAN transmitter until required (to save power)
@@ -181,13 +316,17 @@ void vehicle_init()
     twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
 
     g_config.intr_flags = ESP_INTR_FLAG_LOWMED;
+    g_config.alerts_enabled = CAN_METRICS_ALERTS;
 
     twai_driver_install(&g_config, &t_config, &f_config);
     twai_start();
 
     s_can_event_group = xEventGroupCreate();
+    uds_init();
+    can_metrics_init();
 
     xTaskCreatePinnedToCore(can_receive_task, "can_receive_task", 4096, NULL, 3, NULL, 1);
+    xTaskCreatePinnedToCore(vehicle_diag_task, "vehicle_diag", 4096, NULL, 2, NULL, 1);
 }
 
 event_return_t vehicle_un_lock()
@@ -21,6 +21,11 @@ void can_receive_task(void *arg);
  */
 void vehicle_init();
 
+/**
+ * @brief Box timestamp at which the odometer reading last changed, -1 if it hasn't since boot
+ */
+int32_t vehicle_odometer_changed_ts();
+
 /**
  * @brief Lock / unlock vehicle doors, depending on mb->lock_desired
  */
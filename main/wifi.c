@@ -103,7 +103,7 @@ void wifi_init(void)
     ESP_LOGI(TAG, "WiFi init complete");
 }
 
-void wifi_connect()
+esp_err_t wifi_connect()
 {
     desired_connection_state = 1;
 
@@ -142,6 +142,8 @@ void wifi_connect()
         }
     }
     xEventGroupSetBits(s_wifi_event_group, WIFI_OPERATION_FINISHED_BIT);
+
+    return (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) ? ESP_OK : ESP_FAIL;
 }
 
 void wifi_disconnect()
@@ -2,6 +2,8 @@
 */
 #pragma once
 
+#include "esp_err.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -13,8 +15,9 @@ void wifi_init();
 
 /**
  * @brief Connect to configured WiFi network
+ * @return ESP_OK if connected with an IP address
  */
-void wifi_connect();
+esp_err_t wifi_connect();
 
 /**
  * @brief Disconnect from WiFi